@@ -0,0 +1,360 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ConsoleBatch.h"
+
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "FileNameDisambiguator.h"
+#include "LoadFileTask.h"
+#include "MemoryBudget.h"
+#include "OutOfMemoryHandler.h"
+#include "PageSelectionAccessor.h"
+#include "PageSelectionProvider.h"
+#include "PageSequence.h"
+#include "ProcessingTaskQueue.h"
+#include "ProjectPages.h"
+#include "ProjectReader.h"
+#include "ProjectWriter.h"
+#include "StageSequence.h"
+#include "Utils.h"
+#include "WorkerThreadPool.h"
+#include "filters/deskew/Task.h"
+#include "filters/fix_orientation/Task.h"
+#include "filters/output/Task.h"
+#include "filters/page_layout/Task.h"
+#include "filters/page_split/Task.h"
+#include "filters/select_content/Task.h"
+
+using namespace core;
+
+namespace {
+void printError(const QString& message) {
+  std::cerr << message.toLocal8Bit().constData() << std::endl;
+}
+
+void printMessage(const QString& message) {
+  std::cout << message.toLocal8Bit().constData() << std::endl;
+}
+}  // namespace
+
+/**
+ * Filters only consult the page selection from their option widgets,
+ * which are never shown here.  We provide all the project pages
+ * and an empty selection.
+ */
+class ConsoleBatch::PageSelectionProviderImpl : public PageSelectionProvider {
+ public:
+  explicit PageSelectionProviderImpl(std::shared_ptr<ProjectPages> pages) : m_pages(std::move(pages)) {}
+
+  PageSequence allPages() const override { return m_pages->toPageSequence(PAGE_VIEW); }
+
+  std::set<PageId> selectedPages() const override { return std::set<PageId>(); }
+
+  std::vector<PageRange> selectedRanges() const override { return std::vector<PageRange>(); }
+
+ private:
+  std::shared_ptr<ProjectPages> m_pages;
+};
+
+
+ConsoleBatch::ConsoleBatch()
+    : m_workerThreadPool(std::make_unique<WorkerThreadPool>()),
+      m_memoryBudget(MemoryBudget::forBatchProcessing()),
+      m_lastFilterIdx(-1),
+      m_layoutPass(true),
+      m_numTasks(0),
+      m_numFinished(0),
+      m_numFailed(0),
+      m_aborted(false) {
+  connect(m_workerThreadPool.get(), SIGNAL(taskResult(const BackgroundTaskPtr&, const FilterResultPtr&)), this,
+          SLOT(filterResult(const BackgroundTaskPtr&, const FilterResultPtr&)));
+  connect(m_workerThreadPool.get(), SIGNAL(taskDiscarded(const BackgroundTaskPtr&)), this,
+          SLOT(taskDiscarded(const BackgroundTaskPtr&)));
+  connect(&OutOfMemoryHandler::instance(), SIGNAL(outOfMemory()), this, SLOT(outOfMemory()));
+}
+
+ConsoleBatch::~ConsoleBatch() {
+  if (m_batchQueue) {
+    m_batchQueue->cancelAndClear();
+  }
+  m_workerThreadPool->shutdown();
+}
+
+bool ConsoleBatch::loadProject(const QString& projectFile) {
+  if (!QFile(projectFile).open(QIODevice::ReadOnly)) {
+    printError(tr("Unable to open the project file: %1").arg(QDir::toNativeSeparators(projectFile)));
+    return false;
+  }
+
+  const ProjectReader reader(projectFile);
+  if (reader.isBroken()) {
+    printError(tr("The project file is broken: %1").arg(QDir::toNativeSeparators(projectFile)));
+    return false;
+  }
+  if (!reader.success()) {
+    printError(tr("Unable to interpret the project file: %1").arg(QDir::toNativeSeparators(projectFile)));
+    return false;
+  }
+  if (!reader.pages()->validateDpis()) {
+    printError(tr("The project contains images with missing or invalid DPI. Fix them in the GUI first."));
+    return false;
+  }
+  if (!QDir(reader.outputDirectory()).exists() && !QDir().mkpath(reader.outputDirectory())) {
+    printError(tr("Unable to create the output directory: %1")
+                   .arg(QDir::toNativeSeparators(reader.outputDirectory())));
+    return false;
+  }
+
+  m_projectFile = projectFile;
+  m_pages = reader.pages();
+  m_selectedPage = reader.selectedPage();
+
+  Utils::maybeCreateCacheDir(reader.outputDirectory());
+  m_outFileNameGen = OutputFileNameGenerator(reader.namingDisambiguator(), reader.outputDirectory(),
+                                             m_pages->layoutDirection());
+  for (const PageInfo& page : m_pages->toPageSequence(IMAGE_VIEW)) {
+    m_outFileNameGen.disambiguator()->registerFile(page.imageId().filePath());
+  }
+
+  m_stages = std::make_shared<StageSequence>(
+      m_pages, PageSelectionAccessor(std::make_shared<PageSelectionProviderImpl>(m_pages)));
+  reader.readFilterSettings(m_stages->filters());
+
+  m_thumbnailCache = Utils::createThumbnailCache(m_outFileNameGen.outDir());
+  m_lastFilterIdx = m_stages->count() - 1;
+  return true;
+}  // ConsoleBatch::loadProject
+
+void ConsoleBatch::setNumberOfThreads(const int numThreads) {
+  m_workerThreadPool->setNumberOfThreads(numThreads);
+}
+
+void ConsoleBatch::setMemoryBudget(const int megabytes) {
+  m_memoryBudget = (megabytes > 0) ? qint64(megabytes) * 1024 * 1024 : MemoryBudget::forBatchProcessing();
+}
+
+bool ConsoleBatch::setPageRanges(const QString& ranges) {
+  assert(m_pages);
+
+  const PageSequence images(m_pages->toPageSequence(IMAGE_VIEW));
+  const int numImages = static_cast<int>(images.numPages());
+
+  std::set<ImageId> selected;
+  for (const QString& range : ranges.split(QChar(','), QString::SkipEmptyParts)) {
+    const QStringList bounds(range.trimmed().split(QChar('-')));
+    if (bounds.size() > 2) {
+      return false;
+    }
+
+    bool ok = true;
+    const int from = bounds.front().isEmpty() ? 1 : bounds.front().toInt(&ok);
+    if (!ok) {
+      return false;
+    }
+    int to = from;
+    if (bounds.size() == 2) {
+      to = bounds.back().isEmpty() ? numImages : bounds.back().toInt(&ok);
+      if (!ok) {
+        return false;
+      }
+    }
+    if ((from < 1) || (to < from)) {
+      return false;
+    }
+
+    for (int i = from; i <= std::min(to, numImages); ++i) {
+      selected.insert(images.pageAt(static_cast<size_t>(i - 1)).imageId());
+    }
+  }
+
+  if (selected.empty() && !ranges.trimmed().isEmpty()) {
+    // Don't let a range past the last image silently select everything.
+    return false;
+  }
+
+  m_selectedImages.swap(selected);
+  return true;
+}  // ConsoleBatch::setPageRanges
+
+bool ConsoleBatch::setLastStage(const QString& stage) {
+  assert(m_stages);
+
+  bool ok = false;
+  const int stageNumber = stage.toInt(&ok);
+  if (ok) {
+    if ((stageNumber < 1) || (stageNumber > m_stages->count())) {
+      return false;
+    }
+    m_lastFilterIdx = stageNumber - 1;
+    return true;
+  }
+
+  const QString name(stage.trimmed().toLower());
+  if (name == "fix_orientation") {
+    m_lastFilterIdx = m_stages->fixOrientationFilterIdx();
+  } else if (name == "page_split") {
+    m_lastFilterIdx = m_stages->pageSplitFilterIdx();
+  } else if (name == "deskew") {
+    m_lastFilterIdx = m_stages->deskewFilterIdx();
+  } else if (name == "select_content") {
+    m_lastFilterIdx = m_stages->selectContentFilterIdx();
+  } else if (name == "page_layout") {
+    m_lastFilterIdx = m_stages->pageLayoutFilterIdx();
+  } else if (name == "output") {
+    m_lastFilterIdx = m_stages->outputFilterIdx();
+  } else {
+    return false;
+  }
+  return true;
+}  // ConsoleBatch::setLastStage
+
+void ConsoleBatch::setLayoutPassEnabled(const bool enabled) {
+  m_layoutPass = enabled;
+}
+
+bool ConsoleBatch::process() {
+  assert(m_stages);
+
+  // Stages past page_split work with logical pages, which aren't known
+  // until page_split has seen every image.  The GUI deals with that
+  // by having the user go through the stages one by one.
+  const int pageSplitIdx = m_stages->pageSplitFilterIdx();
+  if (m_layoutPass && (m_lastFilterIdx > pageSplitIdx)) {
+    if (!runPass(pageSplitIdx, IMAGE_VIEW)) {
+      return false;
+    }
+  }
+  if (!runPass(m_lastFilterIdx, m_stages->filterAt(m_lastFilterIdx)->getView())) {
+    return false;
+  }
+  return m_numFailed == 0;
+}
+
+bool ConsoleBatch::runPass(const int lastFilterIdx, const PageView view) {
+  m_batchQueue = std::make_unique<ProcessingTaskQueue>();
+  m_batchQueue->setMemoryBudget(m_memoryBudget);
+  m_numTasks = 0;
+  m_numFinished = 0;
+
+  for (const PageInfo& page : m_pages->toPageSequence(view)) {
+    if (!isSelected(page.imageId())) {
+      continue;
+    }
+    for (int i = 0; i < m_stages->count(); i++) {
+      m_stages->filterAt(i)->loadDefaultSettings(page);
+    }
+    m_batchQueue->addProcessingTask(page, createCompositeTask(page, lastFilterIdx),
+                                    m_stages->estimateMemoryUsage(page, lastFilterIdx));
+    ++m_numTasks;
+  }
+
+  printMessage(tr("Running %1 up to \"%2\" on %3 pages.")
+                   .arg(view == IMAGE_VIEW ? tr("the layout pass") : tr("the processing"))
+                   .arg(m_stages->filterAt(lastFilterIdx)->getName())
+                   .arg(m_numTasks));
+
+  if (!m_batchQueue->allProcessed()) {
+    submitTasks();
+    m_eventLoop.exec();
+  }
+
+  m_batchQueue.reset();
+  return !m_aborted;
+}
+
+void ConsoleBatch::submitTasks() {
+  while (BackgroundTaskPtr task = m_batchQueue->takeForProcessing()) {
+    m_workerThreadPool->submitTask(task);
+    if (!m_workerThreadPool->hasSpareCapacity()) {
+      break;
+    }
+  }
+}
+
+void ConsoleBatch::filterResult(const BackgroundTaskPtr& task, const FilterResultPtr& result) {
+  if (!m_batchQueue) {
+    return;
+  }
+  m_batchQueue->processingFinished(task);
+  ++m_numFinished;
+
+  if (!result->filter()) {
+    // LoadFileTask reports the files it couldn't load this way.
+    ++m_numFailed;
+    printError(tr("[%1/%2] Failed to load an image.").arg(m_numFinished).arg(m_numTasks));
+  } else {
+    printMessage(tr("[%1/%2] Done.").arg(m_numFinished).arg(m_numTasks));
+  }
+
+  if (m_batchQueue->allProcessed()) {
+    m_eventLoop.quit();
+  } else {
+    submitTasks();
+  }
+}
+
+void ConsoleBatch::taskDiscarded(const BackgroundTaskPtr& task) {
+  // Only cancelled tasks end up here, which happens when processing is aborted.
+  if (m_batchQueue) {
+    m_batchQueue->processingFinished(task);
+  }
+}
+
+void ConsoleBatch::outOfMemory() {
+  printError(tr("Out of memory. Try reducing the number of threads."));
+  m_aborted = true;
+  if (m_batchQueue) {
+    m_batchQueue->cancelAndClear();
+  }
+  m_eventLoop.quit();
+}
+
+bool ConsoleBatch::saveProject(const QString& projectFile) {
+  const QString filePath(projectFile.isEmpty() ? m_projectFile : projectFile);
+
+  ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
+  if (!writer.write(filePath, m_stages->filters())) {
+    printError(tr("Error saving the project file: %1").arg(QDir::toNativeSeparators(filePath)));
+    return false;
+  }
+  return true;
+}
+
+BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page, const int lastFilterIdx) {
+  std::shared_ptr<fix_orientation::Task> fixOrientationTask;
+  std::shared_ptr<page_split::Task> pageSplitTask;
+  std::shared_ptr<deskew::Task> deskewTask;
+  std::shared_ptr<select_content::Task> selectContentTask;
+  std::shared_ptr<page_layout::Task> pageLayoutTask;
+  std::shared_ptr<output::Task> outputTask;
+
+  if (lastFilterIdx >= m_stages->outputFilterIdx()) {
+    outputTask = m_stages->outputFilter()->createTask(page.id(), m_thumbnailCache, m_outFileNameGen, true, false);
+  }
+  if (lastFilterIdx >= m_stages->pageLayoutFilterIdx()) {
+    pageLayoutTask = m_stages->pageLayoutFilter()->createTask(page.id(), outputTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->selectContentFilterIdx()) {
+    selectContentTask = m_stages->selectContentFilter()->createTask(page.id(), pageLayoutTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->deskewFilterIdx()) {
+    deskewTask = m_stages->deskewFilter()->createTask(page.id(), selectContentTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->pageSplitFilterIdx()) {
+    pageSplitTask = m_stages->pageSplitFilter()->createTask(page, deskewTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->fixOrientationFilterIdx()) {
+    fixOrientationTask = m_stages->fixOrientationFilter()->createTask(page.id(), pageSplitTask, true);
+  }
+  assert(fixOrientationTask);
+  return std::make_shared<LoadFileTask>(BackgroundTask::BATCH, page, m_thumbnailCache, m_pages, fixOrientationTask);
+}  // ConsoleBatch::createCompositeTask
+
+bool ConsoleBatch::isSelected(const ImageId& imageId) const {
+  return m_selectedImages.empty() || (m_selectedImages.find(imageId) != m_selectedImages.end());
+}
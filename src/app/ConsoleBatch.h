@@ -0,0 +1,152 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_APP_CONSOLEBATCH_H_
+#define SCANTAILOR_APP_CONSOLEBATCH_H_
+
+#include <QEventLoop>
+#include <QObject>
+#include <QString>
+#include <memory>
+#include <set>
+
+#include "BackgroundTask.h"
+#include "FilterResult.h"
+#include "ImageId.h"
+#include "NonCopyable.h"
+#include "OutputFileNameGenerator.h"
+#include "PageView.h"
+#include "SelectedPage.h"
+
+class PageInfo;
+class ProjectPages;
+class StageSequence;
+class ThumbnailPixmapCache;
+class WorkerThreadPool;
+class ProcessingTaskQueue;
+
+/**
+ * \brief Processes a saved project without the GUI.
+ *
+ * Builds the same composite tasks as MainWindow does for batch processing
+ * and runs them on a WorkerThreadPool, driving the queue from a local
+ * event loop.  Progress and errors are reported to the standard streams.
+ */
+class ConsoleBatch : public QObject {
+  Q_OBJECT
+  DECLARE_NON_COPYABLE(ConsoleBatch)
+
+ public:
+  ConsoleBatch();
+
+  ~ConsoleBatch() override;
+
+  /**
+   * \brief Loads the project and instantiates the stages.
+   *
+   * \return true on success.  On failure, an error is printed.
+   */
+  bool loadProject(const QString& projectFile);
+
+  /**
+   * \param numThreads The number of worker threads, or 0 to use the application settings.
+   */
+  void setNumberOfThreads(int numThreads);
+
+  /**
+   * \brief Limits the memory taken by the pages processed at the same time.
+   *
+   * \param megabytes The limit, or 0 to use the application settings
+   *        or derive it from the amount of physical memory.
+   */
+  void setMemoryBudget(int megabytes);
+
+  /**
+   * \brief Restricts processing to a subset of images.
+   *
+   * \param ranges Comma-separated list of 1-based image numbers or ranges,
+   *        like "1-10,15,20-".  An empty string selects all images.
+   * \return false if \p ranges couldn't be parsed.
+   *
+   * To be called after loadProject().
+   */
+  bool setPageRanges(const QString& ranges);
+
+  /**
+   * \brief Sets the last stage to run.
+   *
+   * \param stage Either a 1-based stage number or one of fix_orientation,
+   *        page_split, deskew, select_content, page_layout, output.
+   * \return false if \p stage doesn't name a stage.
+   *
+   * To be called after loadProject().  By default, all stages are run.
+   */
+  bool setLastStage(const QString& stage);
+
+  /**
+   * \brief Whether to establish the page layout of every image before
+   *        running the stages working with split pages.
+   *
+   * Enabled by default.  May be disabled for projects whose page
+   * layouts have already been settled to avoid decoding images twice.
+   */
+  void setLayoutPassEnabled(bool enabled);
+
+  /**
+   * \brief Runs the processing.
+   *
+   * \return true if every page was processed successfully.
+   */
+  bool process();
+
+  /**
+   * \brief Writes the updated project.
+   *
+   * \param projectFile The file to write to.  If empty, the project
+   *        is written back to the file it was loaded from.
+   */
+  bool saveProject(const QString& projectFile = QString());
+
+ private slots:
+
+  void filterResult(const BackgroundTaskPtr& task, const FilterResultPtr& result);
+
+  void taskDiscarded(const BackgroundTaskPtr& task);
+
+  void outOfMemory();
+
+ private:
+  class PageSelectionProviderImpl;
+
+  /**
+   * \return false if processing was aborted.
+   */
+  bool runPass(int lastFilterIdx, PageView view);
+
+  void submitTasks();
+
+  BackgroundTaskPtr createCompositeTask(const PageInfo& page, int lastFilterIdx);
+
+  bool isSelected(const ImageId& imageId) const;
+
+  QString m_projectFile;
+  std::shared_ptr<ProjectPages> m_pages;
+  std::shared_ptr<StageSequence> m_stages;
+  std::shared_ptr<ThumbnailPixmapCache> m_thumbnailCache;
+  std::unique_ptr<WorkerThreadPool> m_workerThreadPool;
+  std::unique_ptr<ProcessingTaskQueue> m_batchQueue;
+  OutputFileNameGenerator m_outFileNameGen;
+  SelectedPage m_selectedPage;
+  std::set<ImageId> m_selectedImages;
+  QEventLoop m_eventLoop;
+  qint64 m_memoryBudget;
+  int m_lastFilterIdx;
+  bool m_layoutPass;
+  int m_numTasks;
+  int m_numFinished;
+  int m_numFailed;
+  bool m_aborted;
+};
+
+
+#endif  // ifndef SCANTAILOR_APP_CONSOLEBATCH_H_
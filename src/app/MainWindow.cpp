@@ -25,6 +25,7 @@
 #include "ContentBoxPropagator.h"
 #include "DebugImageView.h"
 #include "DebugImages.h"
+#include "DecodedImageCache.h"
 #include "DefaultParamsDialog.h"
 #include "ErrorWidget.h"
 #include "FilterOptionsWidget.h"
@@ -33,6 +34,7 @@
 #include "ImageMetadataLoader.h"
 #include "LoadFileTask.h"
 #include "LoadFilesStatusDialog.h"
+#include "MemoryBudget.h"
 #include "NewOpenProjectPanel.h"
 #include "OutOfMemoryDialog.h"
 #include "OutOfMemoryHandler.h"
@@ -41,7 +43,9 @@
 #include "PageSequence.h"
 #include "ProcessingIndicationWidget.h"
 #include "ProcessingTaskQueue.h"
+#include "ProjectAutoSaver.h"
 #include "ProjectCreationContext.h"
+#include "ProjectJournal.h"
 #include "ProjectOpeningContext.h"
 #include "ProjectPages.h"
 #include "ProjectReader.h"
@@ -107,7 +111,8 @@ MainWindow::MainWindow()
       m_ignoreSelectionChanges(0),
       m_ignorePageOrderingChanges(0),
       m_debug(false),
-      m_closing(false) {
+      m_closing(false),
+      m_autoSaver(std::make_unique<ProjectAutoSaver>()) {
   ApplicationSettings& settings = ApplicationSettings::getInstance();
 
   m_maxLogicalThumbSize = settings.getMaxLogicalThumbnailSize();
@@ -271,6 +276,8 @@ MainWindow::MainWindow()
 
   connect(m_workerThreadPool.get(), SIGNAL(taskResult(const BackgroundTaskPtr&, const FilterResultPtr&)), this,
           SLOT(filterResult(const BackgroundTaskPtr&, const FilterResultPtr&)));
+  connect(m_workerThreadPool.get(), SIGNAL(taskDiscarded(const BackgroundTaskPtr&)), this,
+          SLOT(taskDiscarded(const BackgroundTaskPtr&)));
 
   connect(m_thumbSequence.get(),
           SIGNAL(newSelectionLeader(const PageInfo&, const QRectF&, ThumbnailSequence::SelectionFlags)), this,
@@ -364,6 +371,8 @@ void MainWindow::switchToNewProject(const std::shared_ptr<ProjectPages>& pages,
                                     const ProjectReader* projectReader) {
   stopBatchProcessing(CLEAR_MAIN_AREA);
   m_interactiveQueue->cancelAndClear();
+  // Images of the previous project are of no use anymore.
+  DecodedImageCache::instance().clear();
 
   if (!outDir.isEmpty()) {
     Utils::maybeCreateCacheDir(outDir);
@@ -386,6 +395,8 @@ void MainWindow::switchToNewProject(const std::shared_ptr<ProjectPages>& pages,
   // These two need to go in this order.
   updateDisambiguationRecords(pages->toPageSequence(IMAGE_VIEW));
 
+  m_autoSaver->reset(projectFilePath, ProjectWriter(pages, m_selectedPage, m_outFileNameGen));
+
   // Recreate the stages and load their state.
   m_stages = std::make_shared<StageSequence>(pages, newPageSelectionAccessor());
   if (projectReader) {
@@ -750,14 +761,18 @@ void MainWindow::removeImageWidget() {
 }
 
 void MainWindow::invalidateThumbnail(const PageId& pageId) {
+  // Settings of a page change whenever its thumbnail does.
+  m_autoSaver->markPageDirty(pageId);
   m_thumbSequence->invalidateThumbnail(pageId);
 }
 
 void MainWindow::invalidateThumbnail(const PageInfo& pageInfo) {
+  m_autoSaver->markPageDirty(pageInfo.id());
   m_thumbSequence->invalidateThumbnail(pageInfo);
 }
 
 void MainWindow::invalidateAllThumbnails() {
+  m_autoSaver->markAllPagesDirty();
   m_thumbSequence->invalidateAllThumbnails();
 }
 
@@ -926,7 +941,7 @@ void MainWindow::autoSaveProject() {
     return;
   }
 
-  saveProjectWithFeedback(m_projectFile);
+  m_autoSaver->save(m_pages, m_selectedPage, m_outFileNameGen, m_stages->filters());
 }
 
 void MainWindow::pageContextMenuRequested(const PageInfo& pageInfo_, const QPoint& screenPos, bool selected) {
@@ -1116,13 +1131,17 @@ void MainWindow::startBatchProcessing() {
 
   m_interactiveQueue->cancelAndClear();
 
+  // Pick up changes of the settings the budget is derived from.
+  DecodedImageCache::instance().setMaxSize(MemoryBudget::forDecodedImageCache());
   m_batchQueue = std::make_unique<ProcessingTaskQueue>();
+  m_batchQueue->setMemoryBudget(MemoryBudget::forBatchProcessing());
   PageInfo page(m_thumbSequence->selectionLeader());
   for (; !page.isNull(); page = m_thumbSequence->nextPage(page.id())) {
     for (int i = 0; i < m_stages->count(); i++) {
       m_stages->filterAt(i)->loadDefaultSettings(page);
     }
-    m_batchQueue->addProcessingTask(page, createCompositeTask(page, m_curFilter, /*batch=*/true, m_debug));
+    m_batchQueue->addProcessingTask(page, createCompositeTask(page, m_curFilter, /*batch=*/true, m_debug),
+                                    m_stages->estimateMemoryUsage(page, m_curFilter));
   }
 
   focusButton->setChecked(true);
@@ -1250,6 +1269,27 @@ void MainWindow::filterResult(const BackgroundTaskPtr& task, const FilterResultP
   }
 }  // MainWindow::filterResult
 
+void MainWindow::taskDiscarded(const BackgroundTaskPtr& task) {
+  // A cancelled task holds its share of the memory budget until it's done.
+  m_interactiveQueue->processingFinished(task);
+  if (!isBatchProcessingInProgress()) {
+    return;
+  }
+  m_batchQueue->processingFinished(task);
+
+  if (m_batchQueue->allProcessed()) {
+    stopBatchProcessing();
+    return;
+  }
+  do {
+    const BackgroundTaskPtr nextTask(m_batchQueue->takeForProcessing());
+    if (!nextTask) {
+      break;
+    }
+    m_workerThreadPool->submitTask(nextTask);
+  } while (m_workerThreadPool->hasSpareCapacity());
+}
+
 void MainWindow::debugToggled(const bool enabled) {
   m_debug = enabled;
 }
@@ -1370,21 +1410,17 @@ void MainWindow::openProject() {
 }
 
 void MainWindow::openProject(const QString& projectFile) {
-  QFile file(projectFile);
-  if (!file.open(QIODevice::ReadOnly)) {
+  if (!QFile(projectFile).open(QIODevice::ReadOnly)) {
     QMessageBox::warning(this, tr("Error"), tr("Unable to open the project file."));
     return;
   }
 
-  QDomDocument doc;
-  if (!doc.setContent(&file)) {
+  auto* context = new ProjectOpeningContext(this, projectFile);
+  if (context->projectReader()->isBroken()) {
+    delete context;
     QMessageBox::warning(this, tr("Error"), tr("The project file is broken."));
     return;
   }
-
-  file.close();
-
-  auto* context = new ProjectOpeningContext(this, projectFile, doc);
   connect(context, SIGNAL(done(ProjectOpeningContext*)), SLOT(projectOpened(ProjectOpeningContext*)));
   context->proceed();
 }
@@ -1640,6 +1676,9 @@ bool MainWindow::closeProjectInteractive() {
     return true;
   }
 
+  // Get the autosaved changes into the project file, so that it can be compared.
+  m_autoSaver->flush();
+
   const QFileInfo projectFile(m_projectFile);
   const QFileInfo backupFile(projectFile.absoluteDir(), QString::fromLatin1("Backup.") + projectFile.fileName());
   const QString backupFilePath(backupFile.absoluteFilePath());
@@ -1695,10 +1734,13 @@ void MainWindow::closeProjectWithoutSaving() {
 bool MainWindow::saveProjectWithFeedback(const QString& projectFile) {
   ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
 
+  m_autoSaver->waitForDone();
   if (!writer.write(projectFile, m_stages->filters())) {
     QMessageBox::warning(this, tr("Error"), tr("Error saving the project file!"));
     return false;
   }
+  ProjectJournal::remove(projectFile);
+  m_autoSaver->reset(projectFile, writer);
   return true;
 }
 
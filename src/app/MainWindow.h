@@ -46,6 +46,7 @@ class PageInfo;
 class QStackedLayout;
 class WorkerThreadPool;
 class ProjectReader;
+class ProjectAutoSaver;
 class DebugImages;
 class ContentBoxPropagator;
 class PageOrientationPropagator;
@@ -154,6 +155,8 @@ class MainWindow : public QMainWindow, private FilterUiInterface, private Ui::Ma
 
   void filterResult(const BackgroundTaskPtr& task, const FilterResultPtr& result);
 
+  void taskDiscarded(const BackgroundTaskPtr& task);
+
   void debugToggled(bool enabled);
 
   void fixDpiDialogRequested();
@@ -328,6 +331,7 @@ class MainWindow : public QMainWindow, private FilterUiInterface, private Ui::Ma
   bool m_debug;
   bool m_closing;
   QTimer m_autoSaveTimer;
+  std::unique_ptr<ProjectAutoSaver> m_autoSaver;
   StatusBarPanel* m_statusBarPanel;
   QActionGroup* m_unitsMenuActionGroup;
   QTimer m_maxLogicalThumbSizeUpdater;
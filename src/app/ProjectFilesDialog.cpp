@@ -9,9 +9,9 @@
 #include <QMessageBox>
 #include <QSettings>
 #include <QSortFilterProxyModel>
-#include <deque>
 
 #include "ImageMetadataLoader.h"
+#include "ImageMetadataScanner.h"
 #include "NonCopyable.h"
 #include "SmartFilenameOrdering.h"
 
@@ -46,7 +46,7 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   DECLARE_NON_COPYABLE(FileList)
 
  public:
-  enum LoadStatus { LOAD_OK, LOAD_FAILED, NO_MORE_FILES };
+  enum LoadStatus { LOAD_OK, LOAD_FAILED };
 
   FileList();
 
@@ -77,9 +77,15 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
 
   void remove(const QItemSelection& selection);
 
-  void prepareForLoadingFiles();
+  /**
+   * \return The paths of the files to load metadata of, in visual order.
+   *         Results are then reported by their index in this list.
+   */
+  std::vector<QString> prepareForLoadingFiles();
 
-  LoadStatus loadNextFile();
+  LoadStatus fileLoaded(int fileIdx,
+                        ImageMetadataLoader::Status status,
+                        const std::vector<ImageMetadata>& perPageMetadata);
 
  private:
   int rowCount(const QModelIndex& parent) const override;
@@ -89,7 +95,7 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
   std::vector<Item> m_items;
-  std::deque<int> m_itemsToLoad;
+  std::vector<int> m_itemsToLoad;
 };
 
 
@@ -162,7 +168,7 @@ ProjectFilesDialog::ProjectFilesDialog(QWidget* parent)
       m_offProjectFilesSorted(std::make_unique<SortedFileList>(*m_offProjectFiles)),
       m_inProjectFiles(std::make_unique<FileList>()),
       m_inProjectFilesSorted(std::make_unique<SortedFileList>(*m_inProjectFiles)),
-      m_loadTimerId(0),
+      m_metadataScanner(new ImageMetadataScanner(this)),
       m_metadataLoadFailed(false),
       m_autoOutDir(true) {
   m_supportedExtensions.insert("png");
@@ -185,6 +191,11 @@ ProjectFilesDialog::ProjectFilesDialog(QWidget* parent)
   connect(addToProjectBtn, SIGNAL(clicked()), this, SLOT(addToProject()));
   connect(removeFromProjectBtn, SIGNAL(clicked()), this, SLOT(removeFromProject()));
   connect(buttonBox, SIGNAL(accepted()), this, SLOT(onOK()));
+  connect(m_metadataScanner,
+          SIGNAL(fileScanned(int, ImageMetadataLoader::Status, const std::vector<ImageMetadata>&)), this,
+          SLOT(fileMetadataLoaded(int, ImageMetadataLoader::Status, const std::vector<ImageMetadata>&)));
+  connect(m_metadataScanner, SIGNAL(finished()), this, SLOT(finishLoadingMetadata()));
+  connect(this, SIGNAL(rejected()), m_metadataScanner, SLOT(cancel()));
 }
 
 ProjectFilesDialog::~ProjectFilesDialog() = default;
@@ -405,7 +416,7 @@ void ProjectFilesDialog::onOK() {
 }  // ProjectFilesDialog::onOK
 
 void ProjectFilesDialog::startLoadingMetadata() {
-  m_inProjectFiles->prepareForLoadingFiles();
+  const std::vector<QString> filePaths(m_inProjectFiles->prepareForLoadingFiles());
 
   progressBar->setMaximum(static_cast<int>(m_inProjectFiles->count()));
   inpDirLine->setEnabled(false);
@@ -421,32 +432,21 @@ void ProjectFilesDialog::startLoadingMetadata() {
   buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
   offProjectList->clearSelection();
   inProjectList->clearSelection();
-  m_loadTimerId = startTimer(0);
+  progressBar->setValue(0);
   m_metadataLoadFailed = false;
+  m_metadataScanner->start(filePaths);
 }
 
-void ProjectFilesDialog::timerEvent(QTimerEvent* event) {
-  if (event->timerId() != m_loadTimerId) {
-    QWidget::timerEvent(event);
-    return;
-  }
-
-  switch (m_inProjectFiles->loadNextFile()) {
-    case FileList::NO_MORE_FILES:
-      finishLoadingMetadata();
-      break;
-    case FileList::LOAD_FAILED:
-      m_metadataLoadFailed = true;
-      // Fall through.
-    case FileList::LOAD_OK:
-      progressBar->setValue(progressBar->value() + 1);
-      break;
+void ProjectFilesDialog::fileMetadataLoaded(const int fileIdx,
+                                            const ImageMetadataLoader::Status status,
+                                            const std::vector<ImageMetadata>& perPageMetadata) {
+  if (m_inProjectFiles->fileLoaded(fileIdx, status, perPageMetadata) == FileList::LOAD_FAILED) {
+    m_metadataLoadFailed = true;
   }
+  progressBar->setValue(progressBar->value() + 1);
 }
 
 void ProjectFilesDialog::finishLoadingMetadata() {
-  killTimer(m_loadTimerId);
-
   inpDirLine->setEnabled(true);
   inpDirBrowseBtn->setEnabled(true);
   outDirLine->setEnabled(true);
@@ -548,8 +548,8 @@ Qt::ItemFlags ProjectFilesDialog::FileList::flags(const QModelIndex& index) cons
   return m_items[index.row()].flags();
 }
 
-void ProjectFilesDialog::FileList::prepareForLoadingFiles() {
-  std::deque<int> itemIndexes;
+std::vector<QString> ProjectFilesDialog::FileList::prepareForLoadingFiles() {
+  std::vector<int> itemIndexes;
   const auto numItems = static_cast<int>(m_items.size());
   for (int i = 0; i < numItems; ++i) {
     itemIndexes.push_back(i);
@@ -559,36 +559,36 @@ void ProjectFilesDialog::FileList::prepareForLoadingFiles() {
             [&](int lhs, int rhs) { return ItemVisualOrdering()(m_items[lhs], m_items[rhs]); });
 
   m_itemsToLoad.swap(itemIndexes);
-}
 
-ProjectFilesDialog::FileList::LoadStatus ProjectFilesDialog::FileList::loadNextFile() {
-  if (m_itemsToLoad.empty()) {
-    return NO_MORE_FILES;
+  std::vector<QString> filePaths;
+  filePaths.reserve(m_itemsToLoad.size());
+  for (const int itemIdx : m_itemsToLoad) {
+    filePaths.push_back(m_items[itemIdx].fileInfo().absoluteFilePath());
   }
+  return filePaths;
+}
 
-  const int itemIdx = m_itemsToLoad.front();
+ProjectFilesDialog::FileList::LoadStatus ProjectFilesDialog::FileList::fileLoaded(
+    const int fileIdx,
+    const ImageMetadataLoader::Status status,
+    const std::vector<ImageMetadata>& perPageMetadata) {
+  const int itemIdx = m_itemsToLoad[fileIdx];
   Item& item = m_items[itemIdx];
-  std::vector<ImageMetadata> perPageMetadata;
-  const QString filePath(item.fileInfo().absoluteFilePath());
-  const ImageMetadataLoader::Status st = ImageMetadataLoader::load(
-      filePath, [&](const ImageMetadata& metadata) { perPageMetadata.push_back(metadata); });
 
-  LoadStatus status;
+  LoadStatus loadStatus;
 
-  if (st == ImageMetadataLoader::LOADED) {
-    status = LOAD_OK;
-    item.perPageMetadata().swap(perPageMetadata);
+  if (status == ImageMetadataLoader::LOADED) {
+    loadStatus = LOAD_OK;
+    item.perPageMetadata() = perPageMetadata;
     item.setStatus(Item::STATUS_LOAD_OK);
   } else {
-    status = LOAD_FAILED;
+    loadStatus = LOAD_FAILED;
     item.setStatus(Item::STATUS_LOAD_FAILED);
   }
   const QModelIndex idx(index(itemIdx, 0));
   emit dataChanged(idx, idx);
-
-  m_itemsToLoad.pop_front();
-  return status;
-}  // ProjectFilesDialog::FileList::loadNextFile
+  return loadStatus;
+}
 
 /*================= ProjectFilesDialog::SortedFileList ===================*/
 
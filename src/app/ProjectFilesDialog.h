@@ -11,8 +11,11 @@
 #include <vector>
 
 #include "ImageFileInfo.h"
+#include "ImageMetadataLoader.h"
 #include "ui_ProjectFilesDialog.h"
 
+class ImageMetadataScanner;
+
 class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   Q_OBJECT
  public:
@@ -48,6 +51,12 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
 
   void onOK();
 
+  void fileMetadataLoaded(int fileIdx,
+                          ImageMetadataLoader::Status status,
+                          const std::vector<ImageMetadata>& perPageMetadata);
+
+  void finishLoadingMetadata();
+
  private:
   class Item;
   class FileList;
@@ -60,10 +69,6 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
 
   void startLoadingMetadata();
 
-  void timerEvent(QTimerEvent* event) override;
-
-  void finishLoadingMetadata();
-
   void setupIcons();
 
   QSet<QString> m_supportedExtensions;
@@ -71,7 +76,7 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   std::unique_ptr<SortedFileList> m_offProjectFilesSorted;
   std::unique_ptr<FileList> m_inProjectFiles;
   std::unique_ptr<SortedFileList> m_inProjectFilesSorted;
-  int m_loadTimerId;
+  ImageMetadataScanner* m_metadataScanner;
   bool m_metadataLoadFailed;
   bool m_autoOutDir;
 };
@@ -16,14 +16,13 @@
 
 class FixDpiDialog;
 class QWidget;
-class QDomDocument;
 
 class ProjectOpeningContext : public QObject {
   Q_OBJECT
   DECLARE_NON_COPYABLE(ProjectOpeningContext)
 
  public:
-  ProjectOpeningContext(QWidget* parent, const QString& projectFile, const QDomDocument& doc);
+  ProjectOpeningContext(QWidget* parent, const QString& projectFile);
 
   ~ProjectOpeningContext() override;
 
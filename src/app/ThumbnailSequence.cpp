@@ -11,9 +11,12 @@
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsView>
+#include <QScrollBar>
 #include <QStyleOptionGraphicsItem>
+#include <QTimer>
 #include <QtWidgets/QCheckBox>
 #include <QtWidgets/QMessageBox>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/lambda/bind.hpp>
@@ -22,6 +25,7 @@
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
+#include <iterator>
 #include <memory>
 
 #include "ColorSchemeManager.h"
@@ -207,6 +211,14 @@ class ThumbnailSequence::Impl {
 
   void commitSceneRect();
 
+  void scheduleVisibleRangeUpdate();
+
+  /**
+   * Tells the thumbnail cache which thumbnails are on screen and which
+   * come next in the direction of scrolling, so that it loads those first.
+   */
+  void updateVisibleRange();
+
   int getGraphicsViewWidth() const;
 
   void orderItems();
@@ -232,6 +244,8 @@ class ThumbnailSequence::Impl {
   std::shared_ptr<const PageOrderProvider> m_orderProvider;
   GraphicsScene m_graphicsScene;
   QRectF m_sceneRect;
+  QTimer m_visibleRangeTimer;
+  int m_lastScrollPos;
   bool m_selectionMode;
 };
 
@@ -442,19 +456,28 @@ ThumbnailSequence::Impl::Impl(ThumbnailSequence& owner, const QSizeF& maxLogical
       m_itemsInOrder(m_items.get<ItemsInOrderTag>()),
       m_selectedThenUnselected(m_items.get<SelectedThenUnselectedTag>()),
       m_selectionLeader(nullptr),
+      m_lastScrollPos(0),
       m_selectionMode(false) {
   m_graphicsScene.setContextMenuEventCallback(
       [&](QGraphicsSceneContextMenuEvent* evt) { this->sceneContextMenuEvent(evt); });
+
+  // Scrolling produces bursts of changes.  Only the last one matters.
+  m_visibleRangeTimer.setSingleShot(true);
+  m_visibleRangeTimer.setInterval(0);
+  QObject::connect(&m_visibleRangeTimer, &QTimer::timeout, [this]() { updateVisibleRange(); });
 }
 
 ThumbnailSequence::Impl::~Impl() {}
 
 void ThumbnailSequence::Impl::setThumbnailFactory(std::shared_ptr<ThumbnailFactory> factory) {
   m_factory = std::move(factory);
+  scheduleVisibleRangeUpdate();
 }
 
 void ThumbnailSequence::Impl::attachView(QGraphicsView* const view) {
   view->setScene(&m_graphicsScene);
+  QObject::connect(view->verticalScrollBar(), &QScrollBar::valueChanged, &m_owner,
+                   [this]() { scheduleVisibleRangeUpdate(); });
 }
 
 void ThumbnailSequence::Impl::reset(const PageSequence& pages,
@@ -1371,8 +1394,57 @@ void ThumbnailSequence::Impl::commitSceneRect() {
   } else {
     m_graphicsScene.setSceneRect(m_sceneRect);
   }
+  scheduleVisibleRangeUpdate();
+}
+
+void ThumbnailSequence::Impl::scheduleVisibleRangeUpdate() {
+  if (!m_visibleRangeTimer.isActive()) {
+    m_visibleRangeTimer.start();
+  }
 }
 
+void ThumbnailSequence::Impl::updateVisibleRange() {
+  if (!m_factory || m_graphicsScene.views().isEmpty()) {
+    return;
+  }
+
+  QGraphicsView* gv = m_graphicsScene.views().first();
+  const QRectF visibleRect(gv->mapToScene(gv->viewport()->rect()).boundingRect());
+  const int scrollPos = gv->verticalScrollBar()->value();
+  const bool scrollingUp = scrollPos < m_lastScrollPos;
+  m_lastScrollPos = scrollPos;
+
+  std::vector<ImageId> visible;
+  ItemsInOrder::iterator firstVisible(m_itemsInOrder.end());
+  ItemsInOrder::iterator lastVisible(m_itemsInOrder.end());
+  for (auto it = m_itemsInOrder.begin(); it != m_itemsInOrder.end(); ++it) {
+    if (it->composite && it->composite->sceneBoundingRect().intersects(visibleRect)) {
+      if (firstVisible == m_itemsInOrder.end()) {
+        firstVisible = it;
+      }
+      lastVisible = it;
+      visible.push_back(it->pageInfo.id().imageId());
+    }
+  }
+
+  // Prefetch about a screenful of thumbnails.
+  const size_t numUpcoming = std::max<size_t>(visible.size(), 1);
+  std::vector<ImageId> upcoming;
+  if (scrollingUp && (firstVisible != m_itemsInOrder.end())) {
+    for (auto it = firstVisible; (it != m_itemsInOrder.begin()) && (upcoming.size() < numUpcoming);) {
+      --it;
+      upcoming.push_back(it->pageInfo.id().imageId());
+    }
+  } else {
+    auto it = (lastVisible != m_itemsInOrder.end()) ? std::next(lastVisible) : m_itemsInOrder.begin();
+    for (; (it != m_itemsInOrder.end()) && (upcoming.size() < numUpcoming); ++it) {
+      upcoming.push_back(it->pageInfo.id().imageId());
+    }
+  }
+
+  m_factory->pixmapCache()->setVisibleRange(visible, upcoming);
+}  // ThumbnailSequence::Impl::updateVisibleRange
+
 const QSizeF& ThumbnailSequence::Impl::getMaxLogicalThumbSize() const {
   return m_maxLogicalThumbSize;
 }
@@ -9,6 +9,7 @@
 #include <core/FontIconPack.h>
 #include <core/IconProvider.h>
 #include <core/StyledIconPack.h>
+#include <foundation/Tracer.h>
 
 #include <QSettings>
 #include <QStringList>
@@ -38,6 +39,10 @@ int main(int argc, char* argv[]) {
   }
   QSettings settings;
 
+  // Where to record how long the processing stages take, in the Chrome trace format.
+  const QString traceFile(QString::fromLocal8Bit(qgetenv("SCANTAILOR_TRACE")));
+  foundation::Tracer::setEnabled(!traceFile.isEmpty());
+
   app.installLanguage(ApplicationSettings::getInstance().getLanguage());
 
   {
@@ -59,5 +64,10 @@ int main(int argc, char* argv[]) {
   if (args.size() > 1) {
     mainWnd->openProject(args.at(1));
   }
-  return Application::exec();
+
+  const int result = Application::exec();
+  if (!traceFile.isEmpty()) {
+    foundation::Tracer::saveChromeTrace(traceFile);
+  }
+  return result;
 }  // main
@@ -0,0 +1,113 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <config.h>
+#include <core/Application.h>
+#include <foundation/Tracer.h>
+
+#include <QCommandLineParser>
+#include <QSettings>
+#include <iostream>
+
+#include "ConsoleBatch.h"
+
+int main(int argc, char* argv[]) {
+  // The filters instantiate their option widgets, so we do need a QApplication,
+  // but nothing is ever shown, so there is no reason to require a display.
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  Application app(argc, argv);
+
+  // This information is used by QSettings.
+  Application::setApplicationName(APPLICATION_NAME);
+  Application::setOrganizationName(ORGANIZATION_NAME);
+
+  QSettings::setDefaultFormat(QSettings::IniFormat);
+  if (app.isPortableVersion()) {
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, app.getPortableConfigPath());
+  }
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Processes a ScanTailor project without the GUI.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("project", "The project file to process.");
+
+  const QCommandLineOption threadsOption(
+      QStringList{"t", "threads"}, "The number of worker threads. Defaults to the application settings.", "count");
+  const QCommandLineOption memoryOption(
+      QStringList{"m", "memory"},
+      "The memory in megabytes the pages processed at the same time may take. "
+      "Defaults to the application settings or three quarters of the physical memory.",
+      "megabytes");
+  const QCommandLineOption pagesOption(QStringList{"p", "pages"},
+                                       "The images to process, as 1-based numbers or ranges, like 1-10,15,20-.",
+                                       "ranges");
+  const QCommandLineOption endStageOption(
+      QStringList{"e", "end-stage"},
+      "The last stage to run: a 1-based stage number or one of fix_orientation, page_split, deskew, "
+      "select_content, page_layout, output. Defaults to output.",
+      "stage");
+  const QCommandLineOption outputProjectOption(
+      QStringList{"o", "output-project"}, "Where to write the updated project. Defaults to the input project.", "file");
+  const QCommandLineOption noLayoutPassOption(
+      "no-layout-pass", "Don't run page_split over all images first. Use when page layouts are already settled.");
+  const QCommandLineOption noSaveOption("no-save", "Don't write the updated project.");
+  const QCommandLineOption traceOption(
+      "trace", "Record how long the processing stages take into a file in the Chrome trace format.", "file");
+  parser.addOptions({threadsOption, memoryOption, pagesOption, endStageOption, outputProjectOption, noLayoutPassOption,
+                     noSaveOption, traceOption});
+
+  parser.process(app);
+
+  const QStringList positionalArgs(parser.positionalArguments());
+  if (positionalArgs.size() != 1) {
+    parser.showHelp(1);
+  }
+
+  ConsoleBatch batch;
+  if (!batch.loadProject(positionalArgs.front())) {
+    return 1;
+  }
+
+  if (parser.isSet(threadsOption)) {
+    bool ok = false;
+    const int numThreads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || (numThreads < 1)) {
+      std::cerr << "Invalid number of threads." << std::endl;
+      return 1;
+    }
+    batch.setNumberOfThreads(numThreads);
+  }
+  if (parser.isSet(memoryOption)) {
+    bool ok = false;
+    const int megabytes = parser.value(memoryOption).toInt(&ok);
+    if (!ok || (megabytes < 1)) {
+      std::cerr << "Invalid memory limit." << std::endl;
+      return 1;
+    }
+    batch.setMemoryBudget(megabytes);
+  }
+  if (parser.isSet(pagesOption) && !batch.setPageRanges(parser.value(pagesOption))) {
+    std::cerr << "Invalid page ranges." << std::endl;
+    return 1;
+  }
+  if (parser.isSet(endStageOption) && !batch.setLastStage(parser.value(endStageOption))) {
+    std::cerr << "Invalid stage." << std::endl;
+    return 1;
+  }
+  batch.setLayoutPassEnabled(!parser.isSet(noLayoutPassOption));
+
+  foundation::Tracer::setEnabled(parser.isSet(traceOption));
+  const bool success = batch.process();
+  if (parser.isSet(traceOption) && !foundation::Tracer::saveChromeTrace(parser.value(traceOption))) {
+    std::cerr << "Couldn't write the trace." << std::endl;
+  }
+
+  // Even a partially processed project is worth saving.
+  if (!parser.isSet(noSaveOption) && !batch.saveProject(parser.value(outputProjectOption))) {
+    return 1;
+  }
+  return success ? 0 : 2;
+}  // main
@@ -15,8 +15,8 @@ class ProjectReader;
 class ProjectWriter;
 class AbstractRelinker;
 class QString;
-class QDomDocument;
 class QDomElement;
+class QXmlStreamWriter;
 
 /**
  * Filters represent processing stages, like "Deskew", "Margins" and "Output".
@@ -27,6 +27,11 @@ class AbstractFilter : public std::enable_shared_from_this<AbstractFilter> {
 
   virtual QString getName() const = 0;
 
+  /**
+   * \return The name of the element under <filters> holding the settings of this filter.
+   */
+  virtual QString settingsTagName() const = 0;
+
   virtual PageView getView() const = 0;
 
   virtual void selected() {}
@@ -41,7 +46,13 @@ class AbstractFilter : public std::enable_shared_from_this<AbstractFilter> {
 
   virtual void preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) = 0;
 
-  virtual QDomElement saveSettings(const ProjectWriter& writer, QDomDocument& doc) const = 0;
+  /**
+   * \brief Writes the settings of this filter into the project being saved.
+   *
+   * Per-page settings are meant to be written one page at a time, so that
+   * saving a large project doesn't need memory proportional to its size.
+   */
+  virtual void saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const = 0;
 
   virtual void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) = 0;
 
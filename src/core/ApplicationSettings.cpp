@@ -29,6 +29,9 @@ const QString ApplicationSettings::DEFAULT_LANGUAGE = QLocale::system().name();
 const QString ApplicationSettings::DEFAULT_UNITS = "mm";
 const QString ApplicationSettings::DEFAULT_PROFILE = "Default";
 const bool ApplicationSettings::DEFAULT_SHOW_CANCELING_SELECTION_QUESTION = true;
+const int ApplicationSettings::DEFAULT_BATCH_MEMORY_BUDGET = 0;
+const int ApplicationSettings::DEFAULT_DECODED_IMAGE_CACHE_SIZE = 512;
+const int ApplicationSettings::DEFAULT_STAGE_CACHE_SIZE = 1024;
 
 const QString ApplicationSettings::ROOT_KEY = "settings";
 const QString ApplicationSettings::OPENGL_STATE_KEY = "enable_opengl";
@@ -52,6 +55,9 @@ const QString ApplicationSettings::LANGUAGE_KEY = "language";
 const QString ApplicationSettings::UNITS_KEY = "units";
 const QString ApplicationSettings::CURRENT_PROFILE_KEY = "current_profile";
 const QString ApplicationSettings::SHOW_CANCELING_SELECTION_QUESTION_KEY = "selection_canceling_question";
+const QString ApplicationSettings::BATCH_MEMORY_BUDGET_KEY = "batch_memory_budget";
+const QString ApplicationSettings::DECODED_IMAGE_CACHE_SIZE_KEY = "decoded_image_cache_size";
+const QString ApplicationSettings::STAGE_CACHE_SIZE_KEY = "stage_cache_size";
 
 QString ApplicationSettings::getKey(const QString& keyName) {
   return ApplicationSettings::ROOT_KEY + '/' + keyName;
@@ -235,3 +241,27 @@ bool ApplicationSettings::isCancelingSelectionQuestionEnabled() {
 void ApplicationSettings::setCancelingSelectionQuestionEnabled(bool enabled) {
   m_settings.setValue(getKey(SHOW_CANCELING_SELECTION_QUESTION_KEY), enabled);
 }
+
+int ApplicationSettings::getBatchMemoryBudget() const {
+  return m_settings.value(getKey(BATCH_MEMORY_BUDGET_KEY), DEFAULT_BATCH_MEMORY_BUDGET).toInt();
+}
+
+void ApplicationSettings::setBatchMemoryBudget(int megabytes) {
+  m_settings.setValue(getKey(BATCH_MEMORY_BUDGET_KEY), megabytes);
+}
+
+int ApplicationSettings::getDecodedImageCacheSize() const {
+  return m_settings.value(getKey(DECODED_IMAGE_CACHE_SIZE_KEY), DEFAULT_DECODED_IMAGE_CACHE_SIZE).toInt();
+}
+
+void ApplicationSettings::setDecodedImageCacheSize(int megabytes) {
+  m_settings.setValue(getKey(DECODED_IMAGE_CACHE_SIZE_KEY), megabytes);
+}
+
+int ApplicationSettings::getStageCacheSize() const {
+  return m_settings.value(getKey(STAGE_CACHE_SIZE_KEY), DEFAULT_STAGE_CACHE_SIZE).toInt();
+}
+
+void ApplicationSettings::setStageCacheSize(int megabytes) {
+  m_settings.setValue(getKey(STAGE_CACHE_SIZE_KEY), megabytes);
+}
@@ -104,6 +104,29 @@ class ApplicationSettings {
 
   void setCancelingSelectionQuestionEnabled(bool enabled);
 
+  /**
+   * \return The memory batch processing may use, in megabytes,
+   *         or 0 to derive it from the amount of physical memory.
+   */
+  int getBatchMemoryBudget() const;
+
+  void setBatchMemoryBudget(int megabytes);
+
+  /**
+   * \return The memory decoded images may be kept in for reuse, in megabytes.
+   */
+  int getDecodedImageCacheSize() const;
+
+  void setDecodedImageCacheSize(int megabytes);
+
+  /**
+   * \return The disk space intermediate images of processing stages
+   *         may take, in megabytes.
+   */
+  int getStageCacheSize() const;
+
+  void setStageCacheSize(int megabytes);
+
  private:
   static inline QString getKey(const QString& keyName);
 
@@ -128,6 +151,9 @@ class ApplicationSettings {
   static const QString DEFAULT_UNITS;
   static const QString DEFAULT_PROFILE;
   static const bool DEFAULT_SHOW_CANCELING_SELECTION_QUESTION;
+  static const int DEFAULT_BATCH_MEMORY_BUDGET;
+  static const int DEFAULT_DECODED_IMAGE_CACHE_SIZE;
+  static const int DEFAULT_STAGE_CACHE_SIZE;
 
   static const QString ROOT_KEY;
   static const QString OPENGL_STATE_KEY;
@@ -151,6 +177,9 @@ class ApplicationSettings {
   static const QString UNITS_KEY;
   static const QString CURRENT_PROFILE_KEY;
   static const QString SHOW_CANCELING_SELECTION_QUESTION_KEY;
+  static const QString BATCH_MEMORY_BUDGET_KEY;
+  static const QString DECODED_IMAGE_CACHE_SIZE_KEY;
+  static const QString STAGE_CACHE_SIZE_KEY;
 
   QSettings m_settings;
 };
@@ -26,6 +26,15 @@ class BackgroundTask : public AbstractCommand<FilterResultPtr>, public TaskStatu
 
   Type type() const { return m_type; }
 
+  /**
+   * \brief Performs the I/O-bound part of the task, like decoding the input image.
+   *
+   * WorkerThreadPool calls it for batch tasks from a separate input stage,
+   * ahead of operator(), so that reading files overlaps with processing.
+   * The default implementation does nothing.
+   */
+  virtual void prepare() {}
+
   void cancel() override { m_cancelFlag.store(1); }
 
   bool isCancelled() const override { return m_cancelFlag.load() != 0; }
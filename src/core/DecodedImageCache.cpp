@@ -0,0 +1,189 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "DecodedImageCache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <iterator>
+
+#include "ImageLoader.h"
+#include "MemoryBudget.h"
+
+using namespace imageproc;
+
+namespace {
+qint64 imageCost(const QImage& image) {
+  return qint64(image.bytesPerLine()) * image.height();
+}
+}  // namespace
+
+DecodedImageCache& DecodedImageCache::instance() {
+  static DecodedImageCache cache(MemoryBudget::forDecodedImageCache());
+  return cache;
+}
+
+DecodedImageCache::DecodedImageCache(const qint64 maxSize) : m_maxSize(maxSize), m_totalSize(0) {}
+
+void DecodedImageCache::setMaxSize(const qint64 maxSize) {
+  const QMutexLocker locker(&m_mutex);
+  m_maxSize = maxSize;
+  removeExcessLocked();
+}
+
+QImage DecodedImageCache::load(const ImageId& imageId) {
+  const FileStamp stamp(imageId);
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = findLocked(imageId, stamp);
+    if (it != m_entries.end()) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->image;
+    }
+  }
+
+  // Decoding is done without holding the lock.  If another thread
+  // happens to decode the same image, the later result wins.
+  const QImage image(ImageLoader::load(imageId));
+  if (image.isNull()) {
+    return image;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+  const auto it = m_entriesById.find(imageId);
+  if (it != m_entriesById.end()) {
+    removeLocked(it->second);
+  }
+  if (imageCost(image) <= m_maxSize) {
+    m_entries.emplace_front(imageId, stamp, image);
+    m_entriesById[imageId] = m_entries.begin();
+    m_totalSize += m_entries.front().cost;
+    removeExcessLocked();
+  }
+  return image;
+}  // DecodedImageCache::load
+
+QImage DecodedImageCache::find(const ImageId& imageId) {
+  const FileStamp stamp(imageId);
+
+  const QMutexLocker locker(&m_mutex);
+  const auto it = findLocked(imageId, stamp);
+  return (it != m_entries.end()) ? it->image : QImage();
+}
+
+void DecodedImageCache::replace(const ImageId& imageId, const QImage& image) {
+  const FileStamp stamp(imageId);
+
+  const QMutexLocker locker(&m_mutex);
+  const auto it = findLocked(imageId, stamp);
+  if ((it != m_entries.end()) && (it->image.size() == image.size())) {
+    m_totalSize -= it->cost;
+    it->image = image;
+    it->updateCost();
+    m_totalSize += it->cost;
+    removeExcessLocked();
+  }
+}
+
+GrayImage DecodedImageCache::grayscale(const ImageId& imageId, const QImage& image) {
+  const FileStamp stamp(imageId);
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = findLocked(imageId, stamp);
+    if ((it != m_entries.end()) && !it->grayImage.isNull() && (it->grayImage.size() == image.size())) {
+      GrayImage grayImage(it->grayImage);
+      // The DPI of a page may have been changed since.
+      if ((grayImage.dotsPerMeterX() != image.dotsPerMeterX())
+          || (grayImage.dotsPerMeterY() != image.dotsPerMeterY())) {
+        grayImage.setDotsPerMeterX(image.dotsPerMeterX());
+        grayImage.setDotsPerMeterY(image.dotsPerMeterY());
+      }
+      return grayImage;
+    }
+  }
+
+  const GrayImage grayImage(image);
+
+  const QMutexLocker locker(&m_mutex);
+  const auto it = findLocked(imageId, stamp);
+  if ((it != m_entries.end()) && (it->image.size() == image.size())) {
+    m_totalSize -= it->cost;
+    it->grayImage = grayImage;
+    it->updateCost();
+    m_totalSize += it->cost;
+    removeExcessLocked();
+  }
+  return grayImage;
+}  // DecodedImageCache::grayscale
+
+void DecodedImageCache::invalidate(const QString& filePath) {
+  const QMutexLocker locker(&m_mutex);
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    const auto next = std::next(it);
+    if (it->imageId.filePath() == filePath) {
+      removeLocked(it);
+    }
+    it = next;
+  }
+}
+
+void DecodedImageCache::clear() {
+  const QMutexLocker locker(&m_mutex);
+  m_entriesById.clear();
+  m_entries.clear();
+  m_totalSize = 0;
+}
+
+DecodedImageCache::EntryList::iterator DecodedImageCache::findLocked(const ImageId& imageId,
+                                                                     const FileStamp& stamp) {
+  const auto it = m_entriesById.find(imageId);
+  if (it == m_entriesById.end()) {
+    return m_entries.end();
+  }
+  if (!(it->second->stamp == stamp)) {
+    // The file has been replaced.
+    removeLocked(it->second);
+    return m_entries.end();
+  }
+  return it->second;
+}
+
+void DecodedImageCache::removeLocked(const EntryList::iterator it) {
+  m_totalSize -= it->cost;
+  m_entriesById.erase(it->imageId);
+  m_entries.erase(it);
+}
+
+void DecodedImageCache::removeExcessLocked() {
+  while (!m_entries.empty() && (m_totalSize > m_maxSize)) {
+    removeLocked(std::prev(m_entries.end()));
+  }
+}
+
+/*========================= DecodedImageCache::FileStamp =========================*/
+
+DecodedImageCache::FileStamp::FileStamp(const ImageId& imageId) {
+  const QFileInfo fileInfo(imageId.filePath());
+  size = fileInfo.size();
+  modified = fileInfo.lastModified().toMSecsSinceEpoch();
+}
+
+bool DecodedImageCache::FileStamp::operator==(const FileStamp& other) const {
+  return (size == other.size) && (modified == other.modified);
+}
+
+/*=========================== DecodedImageCache::Entry ===========================*/
+
+DecodedImageCache::Entry::Entry(const ImageId& imageId, const FileStamp& stamp, const QImage& image)
+    : imageId(imageId), stamp(stamp), image(image), cost(0) {
+  updateCost();
+}
+
+void DecodedImageCache::Entry::updateCost() {
+  cost = imageCost(image);
+  // A grayscale image and its grayscale version share the data.
+  if (grayImage.toQImage().cacheKey() != image.cacheKey()) {
+    cost += imageCost(grayImage.toQImage());
+  }
+}
@@ -0,0 +1,135 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_DECODEDIMAGECACHE_H_
+#define SCANTAILOR_CORE_DECODEDIMAGECACHE_H_
+
+#include <GrayImage.h>
+
+#include <QImage>
+#include <QMutex>
+#include <list>
+#include <unordered_map>
+
+#include "ImageId.h"
+#include "NonCopyable.h"
+
+/**
+ * \brief Keeps recently decoded images in memory, so that switching
+ *        between stages or reopening a page doesn't decode the file again.
+ *
+ * Entries are identified by ImageId and are only returned while the size
+ * and the modification time of the file stay the same.  As that can miss
+ * a file quickly rewritten with the same size, the code writing images
+ * that may be cached calls invalidate().  The least recently used entries
+ * are dropped once the total size exceeds the limit.
+ * As QImage is implicitly shared, a cached image doesn't take additional
+ * memory while it's also being processed.
+ *
+ * All methods are thread-safe.
+ */
+class DecodedImageCache {
+  DECLARE_NON_COPYABLE(DecodedImageCache)
+
+ public:
+  /**
+   * \brief The cache shared by the whole application.
+   *
+   * Its size is given by MemoryBudget::forDecodedImageCache().
+   */
+  static DecodedImageCache& instance();
+
+  /**
+   * \param maxSize The limit on the total size of cached images, in bytes.
+   */
+  explicit DecodedImageCache(qint64 maxSize);
+
+  void setMaxSize(qint64 maxSize);
+
+  /**
+   * \brief Returns the image either from the cache or from ImageLoader,
+   *        caching it in the latter case.
+   *
+   * A null image is returned if the file couldn't be loaded.
+   */
+  QImage load(const ImageId& imageId);
+
+  /**
+   * \brief Returns the cached image or a null one, never loading it.
+   *
+   * Unlike load(), doesn't make the image more recently used.  Suitable
+   * for things like building thumbnails that touch every image once.
+   */
+  QImage find(const ImageId& imageId);
+
+  /**
+   * \brief Replaces the cached image with a version of it converted
+   *        to a different format, without changing its pixels.
+   *
+   * Makes sure the conversion isn't repeated and that both versions
+   * don't take memory at the same time.  Does nothing if \p imageId
+   * isn't cached.
+   */
+  void replace(const ImageId& imageId, const QImage& image);
+
+  /**
+   * \brief Returns the grayscale version of \p image, reusing the one
+   *        computed for the same file before.
+   *
+   * \p image has to be the result of load() for \p imageId, possibly
+   * converted to a different format without changing its pixels.
+   */
+  imageproc::GrayImage grayscale(const ImageId& imageId, const QImage& image);
+
+  /**
+   * \brief Drops the cached images of all the pages of \p filePath.
+   *
+   * To be called before the file is written.
+   */
+  void invalidate(const QString& filePath);
+
+  void clear();
+
+ private:
+  struct FileStamp {
+    qint64 size;
+    qint64 modified;
+
+    explicit FileStamp(const ImageId& imageId);
+
+    bool operator==(const FileStamp& other) const;
+  };
+
+  struct Entry {
+    ImageId imageId;
+    FileStamp stamp;
+    QImage image;
+    imageproc::GrayImage grayImage;
+    qint64 cost;
+
+    Entry(const ImageId& imageId, const FileStamp& stamp, const QImage& image);
+
+    void updateCost();
+  };
+
+  using EntryList = std::list<Entry>;
+
+  /**
+   * \return The entry matching \p stamp or m_entries.end().
+   *         Outdated entries are removed.
+   */
+  EntryList::iterator findLocked(const ImageId& imageId, const FileStamp& stamp);
+
+  void removeLocked(EntryList::iterator it);
+
+  void removeExcessLocked();
+
+  mutable QMutex m_mutex;
+  EntryList m_entries; /**< The most recently used first. */
+  std::unordered_map<ImageId, EntryList::iterator> m_entriesById;
+  qint64 m_maxSize;
+  qint64 m_totalSize;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_DECODEDIMAGECACHE_H_
@@ -12,6 +12,9 @@ using namespace imageproc;
 FilterData::FilterData(const QImage& image)
     : m_origImage(image), m_grayImage(toGrayscale(m_origImage)), m_xform(image.rect(), Dpm(image)) {}
 
+FilterData::FilterData(const QImage& image, const GrayImage& grayImage)
+    : m_origImage(image), m_grayImage(grayImage), m_xform(image.rect(), Dpm(image)) {}
+
 FilterData::FilterData(const FilterData& other, const ImageTransformation& xform)
     : m_origImage(other.m_origImage),
       m_grayImage(other.m_grayImage),
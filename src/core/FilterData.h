@@ -17,6 +17,11 @@ class FilterData {
  public:
   explicit FilterData(const QImage& image);
 
+  /**
+   * \param grayImage The grayscale version of \p image, if it's already known.
+   */
+  FilterData(const QImage& image, const imageproc::GrayImage& grayImage);
+
   FilterData(const FilterData& other, const ImageTransformation& xform);
 
   FilterData(const FilterData& other);
@@ -4,6 +4,7 @@
 #ifndef SCANTAILOR_CORE_FILTERRESULT_H_
 #define SCANTAILOR_CORE_FILTERRESULT_H_
 
+#include <functional>
 #include <memory>
 
 class AbstractFilter;
@@ -23,6 +24,17 @@ class FilterResult {
    */
 
   virtual std::shared_ptr<AbstractFilter> filter() = 0;
+
+  /**
+   * \brief Returns the work to be done before the result is delivered
+   *        that doesn't need a processing thread, like encoding and
+   *        writing output files.
+   *
+   * WorkerThreadPool runs it from a separate output stage, letting the
+   * processing thread move on to the next page.  The work is handed out
+   * once, subsequent calls return an empty function.
+   */
+  virtual std::function<void()> takeDeferredWork() { return nullptr; }
 };
 
 
@@ -6,8 +6,10 @@
 #include <QFile>
 #include <QImage>
 #include <QtGui/QImageReader>
+#include <Tracer.h>
 
 #include "ImageId.h"
+#include "JpegReader.h"
 #include "TiffReader.h"
 
 QImage ImageLoader::load(const ImageId& imageId) {
@@ -23,6 +25,8 @@ QImage ImageLoader::load(const QString& filePath, const int pageNum) {
 }
 
 QImage ImageLoader::load(QIODevice& ioDev, const int pageNum) {
+  const foundation::Tracer::Span span("ImageLoader::load");
+
   if (TiffReader::canRead(ioDev)) {
     return TiffReader::readImage(ioDev, pageNum);
   }
@@ -36,3 +40,30 @@ QImage ImageLoader::load(QIODevice& ioDev, const int pageNum) {
   QImageReader(&ioDev).read(&image);
   return image;
 }
+
+QImage ImageLoader::loadDownscaled(const ImageId& imageId, const QSize& targetSize) {
+  QFile file(imageId.filePath());
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QImage();
+  }
+  return loadDownscaled(file, imageId.zeroBasedPage(), targetSize);
+}
+
+QImage ImageLoader::loadDownscaled(QIODevice& ioDev, const int pageNum, const QSize& targetSize) {
+  const foundation::Tracer::Span span("ImageLoader::loadDownscaled");
+
+  if (TiffReader::canRead(ioDev)) {
+    return TiffReader::readImage(ioDev, pageNum, targetSize);
+  }
+
+  if ((pageNum == 0) && JpegReader::canRead(ioDev) && !ioDev.isSequential()) {
+    const qint64 startPos = ioDev.pos();
+    const QImage image(JpegReader::readImage(ioDev, targetSize));
+    if (!image.isNull()) {
+      return image;
+    }
+    // Maybe Qt can do better.
+    ioDev.seek(startPos);
+  }
+  return load(ioDev, pageNum);
+}
@@ -8,6 +8,7 @@ class ImageId;
 class QImage;
 class QString;
 class QIODevice;
+class QSize;
 
 class ImageLoader {
  public:
@@ -16,6 +17,19 @@ class ImageLoader {
   static QImage load(const ImageId& imageId);
 
   static QImage load(QIODevice& ioDev, int pageNum);
+
+  /**
+   * \brief Loads an image that is going to be scaled down to fit into \p targetSize.
+   *
+   * Where the format allows it, the image is decoded at a reduced resolution,
+   * which is the smallest one that still doesn't need upscaling to fit into
+   * \p targetSize.  That's the case for JPEG images, which libjpeg decodes
+   * at 1/2, 1/4 or 1/8 scale, and for TIFF pages that come with reduced
+   * resolution subimages.  Other images are loaded at full resolution.
+   */
+  static QImage loadDownscaled(const ImageId& imageId, const QSize& targetSize);
+
+  static QImage loadDownscaled(QIODevice& ioDev, int pageNum, const QSize& targetSize);
 };
 
 
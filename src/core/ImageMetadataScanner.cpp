@@ -0,0 +1,166 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ImageMetadataScanner.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QEvent>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+class ImageMetadataScanner::Scan {
+ public:
+  explicit Scan(std::vector<QString> filePaths) : m_filePaths(std::move(filePaths)) {}
+
+  int numFiles() const { return static_cast<int>(m_filePaths.size()); }
+
+  const QString& filePath(int fileIdx) const { return m_filePaths[fileIdx]; }
+
+  /**
+   * \return The index of the next file to scan, or -1 if there are no more
+   *         files or the scan was cancelled.
+   */
+  int takeNextFile() {
+    if (isCancelled()) {
+      return -1;
+    }
+    const int fileIdx = m_nextFileIdx.fetchAndAddRelaxed(1);
+    return fileIdx < numFiles() ? fileIdx : -1;
+  }
+
+  void cancel() { m_cancelFlag.store(1); }
+
+  bool isCancelled() const { return m_cancelFlag.load() != 0; }
+
+ private:
+  const std::vector<QString> m_filePaths;
+  QAtomicInt m_nextFileIdx;
+  QAtomicInt m_cancelFlag;
+};
+
+
+class ImageMetadataScanner::FileScannedEvent : public QEvent {
+ public:
+  FileScannedEvent(std::shared_ptr<Scan> scan,
+                   int fileIdx,
+                   ImageMetadataLoader::Status status,
+                   std::vector<ImageMetadata> perPageMetadata)
+      : QEvent(User),
+        m_scan(std::move(scan)),
+        m_fileIdx(fileIdx),
+        m_status(status),
+        m_perPageMetadata(std::move(perPageMetadata)) {}
+
+  const std::shared_ptr<Scan>& scan() const { return m_scan; }
+
+  int fileIdx() const { return m_fileIdx; }
+
+  ImageMetadataLoader::Status status() const { return m_status; }
+
+  const std::vector<ImageMetadata>& perPageMetadata() const { return m_perPageMetadata; }
+
+ private:
+  std::shared_ptr<Scan> m_scan;
+  int m_fileIdx;
+  ImageMetadataLoader::Status m_status;
+  std::vector<ImageMetadata> m_perPageMetadata;
+};
+
+
+namespace {
+class FunctionRunnable : public QRunnable {
+ public:
+  explicit FunctionRunnable(std::function<void()> func) : m_func(std::move(func)) { setAutoDelete(true); }
+
+  void run() override { m_func(); }
+
+ private:
+  std::function<void()> m_func;
+};
+
+// Reading headers is bound by the latency of the storage rather than
+// by the processor, which makes it worth having more requests in flight
+// than there are cores, especially with network drives.  Past some point
+// more threads only make the requests compete with each other.
+const int MIN_SCAN_THREADS = 8;
+const int MAX_SCAN_THREADS = 16;
+}  // namespace
+
+ImageMetadataScanner::ImageMetadataScanner(QObject* parent)
+    : QObject(parent), m_pool(new QThreadPool(this)), m_numFilesLeft(0) {
+  m_pool->setMaxThreadCount(qBound(MIN_SCAN_THREADS, QThread::idealThreadCount(), MAX_SCAN_THREADS));
+}
+
+ImageMetadataScanner::~ImageMetadataScanner() {
+  cancel();
+  m_pool->waitForDone();
+}
+
+void ImageMetadataScanner::start(const std::vector<QString>& filePaths) {
+  cancel();
+
+  m_scan = std::make_shared<Scan>(filePaths);
+  m_numFilesLeft = m_scan->numFiles();
+  if (m_numFilesLeft == 0) {
+    m_scan.reset();
+    emit finished();
+    return;
+  }
+
+  // Each thread takes files one by one, so that a slow file doesn't hold up the rest.
+  const int numThreads = std::min(m_pool->maxThreadCount(), m_numFilesLeft);
+  for (int i = 0; i < numThreads; ++i) {
+    const std::shared_ptr<Scan> scan(m_scan);
+    m_pool->start(new FunctionRunnable([scan, this]() { scanFiles(scan, this); }));
+  }
+}
+
+void ImageMetadataScanner::cancel() {
+  if (m_scan) {
+    m_scan->cancel();
+    m_scan.reset();
+  }
+  m_numFilesLeft = 0;
+}
+
+bool ImageMetadataScanner::isRunning() const {
+  return m_scan != nullptr;
+}
+
+void ImageMetadataScanner::scanFiles(const std::shared_ptr<Scan>& scan, QObject* receiver) {
+  for (int fileIdx = scan->takeNextFile(); fileIdx >= 0; fileIdx = scan->takeNextFile()) {
+    std::vector<ImageMetadata> perPageMetadata;
+    const ImageMetadataLoader::Status status = ImageMetadataLoader::load(
+        scan->filePath(fileIdx), [&](const ImageMetadata& metadata) { perPageMetadata.push_back(metadata); });
+    if (status != ImageMetadataLoader::LOADED) {
+      perPageMetadata.clear();
+    }
+
+    // The receiver outlives the threads, as its destructor waits for them.
+    QCoreApplication::postEvent(receiver, new FileScannedEvent(scan, fileIdx, status, std::move(perPageMetadata)));
+  }
+}
+
+void ImageMetadataScanner::customEvent(QEvent* event) {
+  auto* evt = dynamic_cast<FileScannedEvent*>(event);
+  if (!evt || (evt->scan() != m_scan)) {
+    // A result of a cancelled scan.
+    return;
+  }
+
+  --m_numFilesLeft;
+  const bool lastFile = (m_numFilesLeft == 0);
+  if (lastFile) {
+    m_scan.reset();
+  }
+
+  emit fileScanned(evt->fileIdx(), evt->status(), evt->perPageMetadata());
+  if (lastFile) {
+    emit finished();
+  }
+}
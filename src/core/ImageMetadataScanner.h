@@ -0,0 +1,82 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_IMAGEMETADATASCANNER_H_
+#define SCANTAILOR_CORE_IMAGEMETADATASCANNER_H_
+
+#include <QObject>
+#include <QString>
+#include <memory>
+#include <vector>
+
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
+
+class QThreadPool;
+
+/**
+ * \brief Loads metadata of many image files in background threads.
+ *
+ * Only the headers of the files are read, through ImageMetadataLoader.
+ * As that's mostly waiting for the disk or the network, more files are
+ * read in parallel than there are processor cores, but not too many,
+ * so as not to overwhelm the storage.  The results are delivered to the
+ * thread the scanner lives in, in the order the files were scanned,
+ * which is not necessarily the order they were given in.
+ */
+class ImageMetadataScanner : public QObject {
+  Q_OBJECT
+ public:
+  explicit ImageMetadataScanner(QObject* parent = nullptr);
+
+  /**
+   * \brief Cancels the scan in progress and waits for the files being read.
+   */
+  ~ImageMetadataScanner() override;
+
+  /**
+   * \brief Starts scanning the given files, cancelling the previous scan, if any.
+   *
+   * For each of the files, fileScanned() is emitted, followed by finished()
+   * once all of them are done.
+   */
+  void start(const std::vector<QString>& filePaths);
+
+  bool isRunning() const;
+
+ public slots:
+
+  /**
+   * \brief Stops scanning.
+   *
+   * No signals for the current scan are emitted after this call.
+   * The files being read at the moment are left to finish in background.
+   */
+  void cancel();
+
+ signals:
+
+  /**
+   * \param fileIdx The index of the file in the list given to start().
+   * \param status The status returned by ImageMetadataLoader::load().
+   * \param perPageMetadata Metadata of every page of the file, if loaded.
+   */
+  void fileScanned(int fileIdx, ImageMetadataLoader::Status status, const std::vector<ImageMetadata>& perPageMetadata);
+
+  void finished();
+
+ private:
+  class Scan;
+  class FileScannedEvent;
+
+  void customEvent(QEvent* event) override;
+
+  static void scanFiles(const std::shared_ptr<Scan>& scan, QObject* receiver);
+
+  QThreadPool* m_pool;
+  std::shared_ptr<Scan> m_scan;
+  int m_numFilesLeft;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_IMAGEMETADATASCANNER_H_
@@ -0,0 +1,92 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ImagePyramid.h"
+
+#include <Transform.h>
+
+#include <QMutexLocker>
+#include <QRect>
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <utility>
+
+using namespace imageproc;
+
+namespace {
+// Levels are only built while both dimensions stay at least this large.
+const int MIN_LEVEL_SIZE = 256;
+
+// The number of pyramids of recently displayed images to keep.
+const int MAX_CACHED_PYRAMIDS = 4;
+}  // namespace
+
+std::shared_ptr<ImagePyramid> ImagePyramid::forImage(const QImage& image) {
+  static QMutex mutex;
+  // The most recently used first.
+  static std::list<std::pair<qint64, std::shared_ptr<ImagePyramid>>> pyramids;
+
+  const QMutexLocker locker(&mutex);
+  for (auto it = pyramids.begin(); it != pyramids.end(); ++it) {
+    if (it->first == image.cacheKey()) {
+      pyramids.splice(pyramids.begin(), pyramids, it);
+      return it->second;
+    }
+  }
+
+  pyramids.emplace_front(image.cacheKey(), std::make_shared<ImagePyramid>(image.size()));
+  if (pyramids.size() > MAX_CACHED_PYRAMIDS) {
+    pyramids.pop_back();
+  }
+  return pyramids.front().second;
+}
+
+ImagePyramid::ImagePyramid(const QSize& imageSize) {
+  m_levelSizes.push_back(imageSize);
+  while (true) {
+    const QSize& prev = m_levelSizes.back();
+    const QSize next((prev.width() + 1) / 2, (prev.height() + 1) / 2);
+    if ((next.width() < MIN_LEVEL_SIZE) || (next.height() < MIN_LEVEL_SIZE)) {
+      break;
+    }
+    m_levelSizes.push_back(next);
+  }
+  m_levels.resize(m_levelSizes.size());
+}
+
+int ImagePyramid::levelFor(const double scale) const {
+  if (scale >= 1.0) {
+    return 0;
+  }
+  const auto index = static_cast<int>(std::floor(std::log2(1.0 / scale)));
+  return qBound(0, index, numLevels() - 1);
+}
+
+QImage ImagePyramid::level(const int index, const QImage& image) {
+  if (index == 0) {
+    return image;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+
+  int built = index;
+  while ((built > 0) && m_levels[built].isNull()) {
+    --built;
+  }
+  for (int i = built + 1; i <= index; ++i) {
+    const QImage& source = (i == 1) ? image : m_levels[i - 1];
+    const QSize& size = m_levelSizes[i];
+    const QTransform xform(QTransform().scale(double(size.width()) / source.width(),
+                                              double(size.height()) / source.height()));
+    m_levels[i] = transform(source, xform, QRect(QPoint(0, 0), size), OutsidePixels::assumeWeakColor(Qt::white));
+  }
+  return m_levels[index];
+}
+
+QTransform ImagePyramid::levelToImage(const int index) const {
+  const QSize& imageSize = m_levelSizes.front();
+  const QSize& levelSize = m_levelSizes[index];
+  return QTransform().scale(double(imageSize.width()) / levelSize.width(),
+                            double(imageSize.height()) / levelSize.height());
+}
@@ -0,0 +1,74 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_IMAGEPYRAMID_H_
+#define SCANTAILOR_CORE_IMAGEPYRAMID_H_
+
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QTransform>
+#include <memory>
+#include <vector>
+
+#include "NonCopyable.h"
+
+/**
+ * \brief Versions of an image downscaled by powers of two.
+ *
+ * Rendering a zoomed out view from a suitable level touches
+ * far fewer pixels than rendering it from the full image.
+ * Level 0 is the image itself, which the pyramid doesn't keep,
+ * so it has to be passed to level().  The other levels are built
+ * on demand, each from the previous one.
+ *
+ * All methods are thread-safe.
+ */
+class ImagePyramid {
+  DECLARE_NON_COPYABLE(ImagePyramid)
+
+ public:
+  /**
+   * \brief Returns the pyramid for \p image, shared by everything
+   *        displaying the same image data.
+   *
+   * Pyramids of a few recently used images are kept around,
+   * so that switching back to a page doesn't rebuild its levels.
+   */
+  static std::shared_ptr<ImagePyramid> forImage(const QImage& image);
+
+  explicit ImagePyramid(const QSize& imageSize);
+
+  int numLevels() const { return static_cast<int>(m_levelSizes.size()); }
+
+  /**
+   * \brief Picks the smallest level that still has at least as many
+   *        pixels per image pixel as \p scale.
+   *
+   * \param scale The number of target pixels per image pixel.
+   */
+  int levelFor(double scale) const;
+
+  /**
+   * \brief Returns the level, building it and the levels before it
+   *        if necessary.
+   *
+   * \param index The level, in [0, numLevels()).
+   * \param image The image the pyramid was created for.
+   */
+  QImage level(int index, const QImage& image);
+
+  /**
+   * \brief The transformation from the coordinates of a level
+   *        to the coordinates of the original image.
+   */
+  QTransform levelToImage(int index) const;
+
+ private:
+  std::vector<QSize> m_levelSizes;
+  QMutex m_mutex;
+  std::vector<QImage> m_levels;  // Built levels, except level 0, which is left null.
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_IMAGEPYRAMID_H_
@@ -3,6 +3,7 @@
 
 #include "ImageViewBase.h"
 
+#include <ParallelFor.h>
 #include <PolygonUtils.h>
 #include <Transform.h>
 
@@ -14,11 +15,14 @@
 #include <QScrollBar>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QStatusBar>
+#include <algorithm>
+#include <cmath>
 
 #include "ApplicationSettings.h"
 #include "BackgroundExecutor.h"
 #include "ColorSchemeManager.h"
 #include "Dpm.h"
+#include "ImagePyramid.h"
 #include "ImagePresentation.h"
 #include "OpenGLSupport.h"
 #include "PixmapRenderer.h"
@@ -29,11 +33,55 @@
 using namespace core;
 using namespace imageproc;
 
+namespace {
+// The side of a square HQ tile, in widget pixels.
+const int HQ_TILE_SIZE = 256;
+
+// The number of HQ tiles built by a single task.  Tiles are delivered
+// in batches of this size, so that the view is refined progressively.
+const int MAX_HQ_TILES_PER_TASK = 16;
+
+// The minimum capacity of the HQ tile cache, in pixels.
+const int MIN_HQ_TILE_CACHE_COST = 16 * 1024 * 1024;
+
+int floorDiv(const int value, const int divisor) {
+  return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+QRect hqTileRect(const QPoint& tile) {
+  return QRect(tile.x() * HQ_TILE_SIZE, tile.y() * HQ_TILE_SIZE, HQ_TILE_SIZE, HQ_TILE_SIZE);
+}
+
+quint64 hqTileKey(const QPoint& tile) {
+  return (quint64(quint32(tile.y())) << 32) | quint32(tile.x());
+}
+
+/**
+ * Tells whether HQ tiles built for one tile transformation may be shown
+ * with another.  Panning leaves the linear part alone, but recomputes the
+ * fractional translation, which may then differ by rounding errors.
+ */
+bool sameHqTileTransform(const QTransform& xform1, const QTransform& xform2) {
+  // Tiles shifted by less than this many pixels are still considered aligned.
+  const double maxShift = 1.0 / 256;
+
+  const auto same = [](const double value1, const double value2) { return qFuzzyCompare(1.0 + value1, 1.0 + value2); };
+
+  return same(xform1.m11(), xform2.m11()) && same(xform1.m12(), xform2.m12()) && same(xform1.m21(), xform2.m21())
+         && same(xform1.m22(), xform2.m22()) && (std::abs(xform1.dx() - xform2.dx()) < maxShift)
+         && (std::abs(xform1.dy() - xform2.dy()) < maxShift);
+}
+}  // namespace
+
 class ImageViewBase::HqTransformTask : public AbstractCommand<std::shared_ptr<AbstractCommand<void>>>, public QObject {
   DECLARE_NON_COPYABLE(HqTransformTask)
 
  public:
-  HqTransformTask(ImageViewBase* imageView, const QImage& image, const QTransform& xform, const QSize& targetSize);
+  HqTransformTask(ImageViewBase* imageView,
+                  const QImage& image,
+                  const std::shared_ptr<ImagePyramid>& pyramid,
+                  const QTransform& tileXform,
+                  const std::vector<QRect>& tileRects);
 
   void cancel() { m_result->cancel(); }
 
@@ -44,9 +92,9 @@ class ImageViewBase::HqTransformTask : public AbstractCommand<std::shared_ptr<Ab
  private:
   class Result : public AbstractCommand<void> {
    public:
-    explicit Result(ImageViewBase* imageView);
+    Result(ImageViewBase* imageView, const QTransform& tileXform);
 
-    void setData(const QPoint& origin, const QImage& hqImage);
+    void setData(const std::vector<QRect>& tileRects, const std::vector<QImage>& tileImages);
 
     void cancel() { m_cancelFlag.fetchAndStoreRelaxed(1); }
 
@@ -56,16 +104,18 @@ class ImageViewBase::HqTransformTask : public AbstractCommand<std::shared_ptr<Ab
 
    private:
     QPointer<ImageViewBase> m_imageView;
-    QPoint m_origin;
-    QImage m_hqImage;
+    QTransform m_tileXform;
+    std::vector<QRect> m_tileRects;
+    std::vector<QImage> m_tileImages;
     mutable QAtomicInt m_cancelFlag;
   };
 
 
   std::shared_ptr<Result> m_result;
   QImage m_image;
-  QTransform m_xform;
-  QSize m_targetSize;
+  std::shared_ptr<ImagePyramid> m_pyramid;
+  QTransform m_tileXform;
+  std::vector<QRect> m_tileRects;
 };
 
 
@@ -117,6 +167,7 @@ ImageViewBase::ImageViewBase(const QImage& image,
                              const ImagePresentation& presentation,
                              const Margins& margins)
     : m_image(image),
+      m_pyramid(ImagePyramid::forImage(image)),
       m_virtualImageCropArea(presentation.cropArea()),
       m_virtualDisplayArea(presentation.displayArea()),
       m_imageToVirtual(presentation.transform()),
@@ -172,6 +223,8 @@ ImageViewBase::ImageViewBase(const QImage& image,
     m_pixmap = downscaledVersion.pixmap();
   }
 
+  m_hqTiles.setMaxCost(MIN_HQ_TILE_CACHE_COST);
+
   m_pixmapToImage.scale((double) m_image.width() / m_pixmap.width(), (double) m_image.height() / m_pixmap.height());
 
   m_widgetFocalPoint = centeredWidgetFocalPoint();
@@ -215,8 +268,8 @@ void ImageViewBase::hqTransformSetEnabled(const bool enabled) {
       m_hqTransformTask->cancel();
       m_hqTransformTask.reset();
     }
-    if (!m_hqPixmap.isNull()) {
-      m_hqPixmap = QPixmap();
+    if (!m_hqTiles.isEmpty()) {
+      m_hqTiles.clear();
       update();
     }
   } else if (enabled && !m_hqTransformEnabled) {
@@ -409,17 +462,25 @@ void ImageViewBase::paintEvent(QPaintEvent* event) {
   // Disable antialiasing for large zoom levels.
   painter.setRenderHint(QPainter::SmoothPixmapTransform, pixelWidth < 0.5);
 
-  if (validateHqPixmap()) {
-    // HQ pixmap maps one to one to screen pixels, so antialiasing is not necessary.
-    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
-
-    QPainterPath clipPath;
-    clipPath.addPolygon(m_virtualToWidget.map(m_virtualImageCropArea));
-    painter.setClipPath(clipPath);
+  QPoint hqOffset;
+  const QTransform hqTileXform(hqTileTransform(&hqOffset));
+
+  std::vector<const HqTile*> hqTiles;
+  bool hqComplete = false;
+  if (m_hqTransformEnabled && sameHqTileTransform(m_hqTileXform, hqTileXform)) {
+    hqComplete = true;
+    for (const QPoint& tile : visibleHqTiles(hqTileXform, hqOffset)) {
+      if (const HqTile* hqTile = m_hqTiles.object(hqTileKey(tile))) {
+        hqTiles.push_back(hqTile);
+      } else {
+        hqComplete = false;
+      }
+    }
+  }
 
-    painter.drawPixmap(m_hqPixmapPos, m_hqPixmap);
-  } else {
-    scheduleHqVersionRebuild();
+  if (!hqComplete) {
+    // Show the downscaled version where HQ tiles are yet to be built.
+    scheduleHqVersionRebuild(hqTileXform);
 
     const QTransform pixmapToVirtual(m_pixmapToImage * m_imageToVirtual);
     painter.setWorldTransform(pixmapToVirtual * m_virtualToWidget);
@@ -431,6 +492,20 @@ void ImageViewBase::paintEvent(QPaintEvent* event) {
     PixmapRenderer::drawPixmap(painter, m_pixmap);
   }
 
+  if (!hqTiles.empty()) {
+    // HQ tiles map one to one to screen pixels, so antialiasing is not necessary.
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.setWorldTransform(QTransform());
+
+    QPainterPath clipPath;
+    clipPath.addPolygon(m_virtualToWidget.map(m_virtualImageCropArea));
+    painter.setClipPath(clipPath);
+
+    for (const HqTile* hqTile : hqTiles) {
+      painter.drawPixmap(hqOffset + hqTile->pos, hqTile->pixmap);
+    }
+  }
+
   painter.restore();
 
   painter.setWorldTransform(m_virtualToWidget);
@@ -884,73 +959,134 @@ void ImageViewBase::setWidgetFocalPointWithoutMoving(const QPointF newWidgetFp)
 }
 
 /**
- * Returns true if m_hqPixmap is valid and up to date.
+ * Splits the image to widget transformation into a transformation
+ * to HQ tile coordinates and a whole pixel \p offset from those
+ * to widget coordinates.
  */
-bool ImageViewBase::validateHqPixmap() const {
-  if (!m_hqTransformEnabled) {
-    return false;
-  }
+QTransform ImageViewBase::hqTileTransform(QPoint* offset) const {
+  const QTransform xform(m_imageToVirtual * m_virtualToWidget);
+  *offset = QPoint(static_cast<int>(std::floor(xform.dx())), static_cast<int>(std::floor(xform.dy())));
+  return xform * QTransform().translate(-offset->x(), -offset->y());
+}
 
-  if (m_hqPixmap.isNull()) {
-    return false;
+/**
+ * Returns the tiles covering both the image and the viewport.
+ */
+std::vector<QPoint> ImageViewBase::visibleHqTiles(const QTransform& tileXform, const QPoint& offset) const {
+  const QRect imageRect(tileXform.mapRect(QRectF(m_image.rect())).toRect());
+  const QRect area(viewport()->rect().translated(-offset).intersected(imageRect));
+  if (area.isEmpty()) {
+    return {};
   }
 
-  if (m_hqSourceId != m_image.cacheKey()) {
-    return false;
-  }
+  const int left = floorDiv(area.left(), HQ_TILE_SIZE);
+  const int right = floorDiv(area.right(), HQ_TILE_SIZE);
+  const int top = floorDiv(area.top(), HQ_TILE_SIZE);
+  const int bottom = floorDiv(area.bottom(), HQ_TILE_SIZE);
 
-  if (m_hqXform != m_imageToVirtual * m_virtualToWidget) {
-    return false;
+  std::vector<QPoint> tiles;
+  tiles.reserve((right - left + 1) * (bottom - top + 1));
+  for (int y = top; y <= bottom; ++y) {
+    for (int x = left; x <= right; ++x) {
+      tiles.emplace_back(x, y);
+    }
   }
-  return true;
+  return tiles;
 }
 
-void ImageViewBase::scheduleHqVersionRebuild() {
-  const QTransform xform(m_imageToVirtual * m_virtualToWidget);
-
-  if (!m_timer.isActive() || (m_potentialHqXform != xform)) {
+void ImageViewBase::scheduleHqVersionRebuild(const QTransform& tileXform) {
+  if (!sameHqTileTransform(m_potentialHqXform, tileXform)) {
+    // Zooming or rotating invalidates the tiles.  Wait for it to settle.
     if (m_hqTransformTask) {
       m_hqTransformTask->cancel();
       m_hqTransformTask.reset();
     }
-    m_potentialHqXform = xform;
+    m_potentialHqXform = tileXform;
+    m_timer.start();
+  } else if (!m_timer.isActive() && !m_hqTransformTask) {
+    // Panning only needs the tiles that came into view.
+    m_timer.start();
   }
-  m_timer.start();
 }
 
 void ImageViewBase::initiateBuildingHqVersion() {
-  if (validateHqPixmap()) {
+  if (!m_hqTransformEnabled) {
     return;
   }
 
-  m_hqPixmap = QPixmap();
-
+  QPoint offset;
+  const QTransform tileXform(hqTileTransform(&offset));
+  if (!sameHqTileTransform(m_hqTileXform, tileXform)) {
+    m_hqTiles.clear();
+    if (m_hqTransformTask) {
+      m_hqTransformTask->cancel();
+      m_hqTransformTask.reset();
+    }
+    m_hqTileXform = tileXform;
+  }
   if (m_hqTransformTask) {
-    m_hqTransformTask->cancel();
-    m_hqTransformTask.reset();
+    // Once it's done, we'll get called again.
+    return;
   }
 
-  const QTransform xform(m_imageToVirtual * m_virtualToWidget);
-  const auto task = std::make_shared<HqTransformTask>(this, m_image, xform, viewport()->size());
+  const std::vector<QPoint> visibleTiles(visibleHqTiles(tileXform, offset));
+  // Make sure the visible tiles don't push each other out of the cache.
+  m_hqTiles.setMaxCost(
+      std::max(MIN_HQ_TILE_CACHE_COST, 2 * static_cast<int>(visibleTiles.size()) * HQ_TILE_SIZE * HQ_TILE_SIZE));
 
-  backgroundExecutor().enqueueTask(task);
+  std::vector<QPoint> missingTiles;
+  for (const QPoint& tile : visibleTiles) {
+    if (!m_hqTiles.contains(hqTileKey(tile))) {
+      missingTiles.push_back(tile);
+    }
+  }
+  if (missingTiles.empty()) {
+    return;
+  }
 
+  // Build the tiles closest to the center of the viewport first.
+  const QPointF center(QRectF(viewport()->rect()).center() - offset);
+  const auto distance = [&center](const QPoint& tile) {
+    const QPointF delta(QRectF(hqTileRect(tile)).center() - center);
+    return delta.x() * delta.x() + delta.y() * delta.y();
+  };
+  std::sort(missingTiles.begin(), missingTiles.end(),
+            [&distance](const QPoint& lhs, const QPoint& rhs) { return distance(lhs) < distance(rhs); });
+  if (static_cast<int>(missingTiles.size()) > MAX_HQ_TILES_PER_TASK) {
+    missingTiles.resize(MAX_HQ_TILES_PER_TASK);
+  }
+
+  const QRect imageRect(tileXform.mapRect(QRectF(m_image.rect())).toRect());
+  std::vector<QRect> tileRects;
+  tileRects.reserve(missingTiles.size());
+  for (const QPoint& tile : missingTiles) {
+    tileRects.push_back(hqTileRect(tile).intersected(imageRect));
+  }
+
+  const auto task = std::make_shared<HqTransformTask>(this, m_image, m_pyramid, tileXform, tileRects);
+  backgroundExecutor().enqueueTask(task);
   m_hqTransformTask = task;
-  m_hqXform = xform;
-  m_hqSourceId = m_image.cacheKey();
-}
+}  // ImageViewBase::initiateBuildingHqVersion
 
 /**
  * Gets called from HqTransformationTask::Result.
  */
-void ImageViewBase::hqVersionBuilt(const QPoint& origin, const QImage& image) {
-  if (!m_hqTransformEnabled) {
+void ImageViewBase::hqTilesBuilt(const QTransform& tileXform,
+                                 const std::vector<QRect>& rects,
+                                 const std::vector<QImage>& images) {
+  m_hqTransformTask.reset();
+  if (!m_hqTransformEnabled || !sameHqTileTransform(tileXform, m_hqTileXform)) {
     return;
   }
 
-  m_hqPixmap = QPixmap::fromImage(image);
-  m_hqPixmapPos = origin;
-  m_hqTransformTask.reset();
+  for (size_t i = 0; i < rects.size(); ++i) {
+    const QPoint tile(floorDiv(rects[i].x(), HQ_TILE_SIZE), floorDiv(rects[i].y(), HQ_TILE_SIZE));
+    m_hqTiles.insert(hqTileKey(tile), new HqTile{QPixmap::fromImage(images[i]), rects[i].topLeft()},
+                     rects[i].width() * rects[i].height());
+  }
+
+  // Continue with the tiles that are still missing.
+  initiateBuildingHqVersion();
   update();
 }
 
@@ -1001,43 +1137,67 @@ ImageViewInfoProvider& ImageViewBase::infoProvider() {
 
 ImageViewBase::HqTransformTask::HqTransformTask(ImageViewBase* imageView,
                                                 const QImage& image,
-                                                const QTransform& xform,
-                                                const QSize& targetSize)
-    : m_result(std::make_shared<Result>(imageView)), m_image(image), m_xform(xform), m_targetSize(targetSize) {}
+                                                const std::shared_ptr<ImagePyramid>& pyramid,
+                                                const QTransform& tileXform,
+                                                const std::vector<QRect>& tileRects)
+    : m_result(std::make_shared<Result>(imageView, tileXform)),
+      m_image(image),
+      m_pyramid(pyramid),
+      m_tileXform(tileXform),
+      m_tileRects(tileRects) {}
 
 std::shared_ptr<AbstractCommand<void>> ImageViewBase::HqTransformTask::operator()() {
   if (isCancelled()) {
     return nullptr;
   }
 
-  const QRect targetRect(
-      m_xform.map(QRectF(m_image.rect())).boundingRect().toRect().intersected(QRect(QPoint(0, 0), m_targetSize)));
-
-  QImage hqImage(transform(m_image, m_xform, targetRect, OutsidePixels::assumeWeakColor(Qt::white), QSizeF(0.0, 0.0)));
+  // Transform the smallest pyramid level that has enough detail
+  // rather than the full resolution image.
+  const double scale = std::sqrt(std::abs(m_tileXform.determinant()));
+  const int levelIndex = m_pyramid->levelFor(scale);
+  const QImage level(m_pyramid->level(levelIndex, m_image));
+  const QTransform levelXform(m_pyramid->levelToImage(levelIndex) * m_tileXform);
+
+  std::vector<QImage> tileImages(m_tileRects.size());
+  foundation::ParallelFor::run(static_cast<int>(m_tileRects.size()), 1, [&](const int begin, const int end) {
+    for (int i = begin; i < end; ++i) {
+      if (isCancelled()) {
+        return;
+      }
+
+      const QImage tileImage(
+          transform(level, levelXform, m_tileRects[i], OutsidePixels::assumeWeakColor(Qt::white), QSizeF(0.0, 0.0)));
+      // In many cases m_image and therefore tileImage are grayscale with
+      // a palette, but given that tileImage will be converted to a QPixmap
+      // on the GUI thread, it's better to convert it to RGB as a preparation
+      // step while we are still in a background thread.
+      tileImages[i] = tileImage.convertToFormat(tileImage.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                            : QImage::Format_RGB32);
+    }
+  });
 
-  // In many cases m_image and therefore hqImage are grayscale with
-  // a palette, but given that hqImage will be converted to a QPixmap
-  // on the GUI thread, it's better to convert it to RGB as a preparation
-  // step while we are still in a background thread.
-  hqImage
-      = hqImage.convertToFormat(hqImage.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+  if (isCancelled()) {
+    return nullptr;
+  }
 
-  m_result->setData(targetRect.topLeft(), hqImage);
+  m_result->setData(m_tileRects, tileImages);
   return m_result;
 }
 
 /*================ ImageViewBase::HqTransformTask::Result ================*/
 
-ImageViewBase::HqTransformTask::Result::Result(ImageViewBase* imageView) : m_imageView(imageView) {}
+ImageViewBase::HqTransformTask::Result::Result(ImageViewBase* imageView, const QTransform& tileXform)
+    : m_imageView(imageView), m_tileXform(tileXform) {}
 
-void ImageViewBase::HqTransformTask::Result::setData(const QPoint& origin, const QImage& hqImage) {
-  m_hqImage = hqImage;
-  m_origin = origin;
+void ImageViewBase::HqTransformTask::Result::setData(const std::vector<QRect>& tileRects,
+                                                     const std::vector<QImage>& tileImages) {
+  m_tileRects = tileRects;
+  m_tileImages = tileImages;
 }
 
 void ImageViewBase::HqTransformTask::Result::operator()() {
   if (m_imageView && !isCancelled()) {
-    m_imageView->hqVersionBuilt(m_origin, m_hqImage);
+    m_imageView->hqTilesBuilt(m_tileXform, m_tileRects, m_tileImages);
   }
 }
 
@@ -5,6 +5,7 @@
 #define SCANTAILOR_CORE_IMAGEVIEWBASE_H_
 
 #include <QAbstractScrollArea>
+#include <QCache>
 #include <QImage>
 #include <QPixmap>
 #include <QPoint>
@@ -17,6 +18,7 @@
 #include <QWidget>
 #include <Qt>
 #include <memory>
+#include <vector>
 
 #include "ImagePixmapUnion.h"
 #include "ImageViewInfoProvider.h"
@@ -26,6 +28,7 @@
 
 class QPainter;
 class BackgroundExecutor;
+class ImagePyramid;
 class ImagePresentation;
 
 /**
@@ -59,7 +62,8 @@ class ImageViewBase : public QAbstractScrollArea {
    *        The whole idea of having a downscaled version is
    *        to speed up real-time rendering of high-resolution
    *        images.  Note that the delayed high quality transform
-   *        operates on the original image, not the downscaled one.
+   *        operates on the original image or its pyramid levels,
+   *        not on the downscaled version.
    * \param presentation Specifies transformation from image
    *        pixel coordinates to virtual image coordinates, along
    *        with some other properties.
@@ -268,6 +272,11 @@ class ImageViewBase : public QAbstractScrollArea {
 
  private:
   class HqTransformTask;
+
+  struct HqTile {
+    QPixmap pixmap;
+    QPoint pos;  // In HQ tile coordinates, see m_hqTileXform.
+  };
   class TempFocalPointAdjuster;
 
   class TransformChangeWatcher;
@@ -288,11 +297,13 @@ class ImageViewBase : public QAbstractScrollArea {
 
   QPointF centeredWidgetFocalPoint() const;
 
-  bool validateHqPixmap() const;
+  QTransform hqTileTransform(QPoint* offset) const;
+
+  std::vector<QPoint> visibleHqTiles(const QTransform& tileXform, const QPoint& offset) const;
 
-  void scheduleHqVersionRebuild();
+  void scheduleHqVersionRebuild(const QTransform& tileXform);
 
-  void hqVersionBuilt(const QPoint& origin, const QImage& image);
+  void hqTilesBuilt(const QTransform& tileXform, const std::vector<QRect>& rects, const std::vector<QImage>& images);
 
   void updateStatusTipAndCursor();
 
@@ -325,33 +336,29 @@ class ImageViewBase : public QAbstractScrollArea {
   QPixmap m_pixmap;
 
   /**
-   * The high quality, pre-transformed version of m_pixmap.
+   * Downscaled versions of m_image the high quality tiles are built from.
    */
-  QPixmap m_hqPixmap;
+  std::shared_ptr<ImagePyramid> m_pyramid;
 
   /**
-   * The position, in widget coordinates, where m_hqPixmap is to be drawn.
+   * The high quality, pre-transformed pieces of m_image, keyed by their
+   * position on the grid of HQ tile coordinates.  The cost is the number
+   * of pixels.
    */
-  QPoint m_hqPixmapPos;
+  QCache<quint64, HqTile> m_hqTiles;
 
   /**
-   * The transformation used to build m_hqPixmap.
-   * It's used to detect if m_hqPixmap needs to be rebuild.
+   * The transformation from image to HQ tile coordinates m_hqTiles
+   * were built with.  HQ tile coordinates are widget coordinates shifted
+   * by a whole number of pixels, so that the tiles survive panning.
    */
-  QTransform m_hqXform;
+  QTransform m_hqTileXform;
 
   /**
-   * Used to check if we need to extend the delay before building m_hqPixmap.
+   * Used to check if we need to extend the delay before building HQ tiles.
    */
   QTransform m_potentialHqXform;
 
-  /**
-   * The ID (QImage::cacheKey()) of the image that was used
-   * to build m_hqPixmap.  It's used to detect if m_hqPixmap
-   * needs to be rebuilt.
-   */
-  qint64 m_hqSourceId;
-
   /**
    * The pending (if any) high quality transformation task.
    */
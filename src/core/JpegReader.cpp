@@ -0,0 +1,347 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "JpegReader.h"
+
+#include <QIODevice>
+#include <QImage>
+#include <cassert>
+#include <csetjmp>
+#include <cstring>
+#include <vector>
+
+#include "Dpm.h"
+#include "ImageMetadata.h"
+#include "NonCopyable.h"
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace {
+/*======================== JpegDecompressionHandle =======================*/
+
+class JpegDecompressHandle {
+  DECLARE_NON_COPYABLE(JpegDecompressHandle)
+
+ public:
+  JpegDecompressHandle(jpeg_error_mgr* errMgr, jpeg_source_mgr* srcMgr);
+
+  ~JpegDecompressHandle();
+
+  jpeg_decompress_struct* ptr() { return &m_info; }
+
+  jpeg_decompress_struct* operator->() { return &m_info; }
+
+ private:
+  jpeg_decompress_struct m_info{};
+};
+
+
+JpegDecompressHandle::JpegDecompressHandle(jpeg_error_mgr* errMgr, jpeg_source_mgr* srcMgr) {
+  m_info.err = errMgr;
+  jpeg_create_decompress(&m_info);
+  m_info.src = srcMgr;
+}
+
+JpegDecompressHandle::~JpegDecompressHandle() {
+  jpeg_destroy_decompress(&m_info);
+}
+
+/*============================ JpegSourceManager =========================*/
+
+class JpegSourceManager : public jpeg_source_mgr {
+  DECLARE_NON_COPYABLE(JpegSourceManager)
+
+ public:
+  explicit JpegSourceManager(QIODevice& ioDevice);
+
+ private:
+  static void initSource(j_decompress_ptr cinfo);
+
+  static boolean fillInputBuffer(j_decompress_ptr cinfo);
+
+  boolean fillInputBufferImpl();
+
+  static void skipInputData(j_decompress_ptr cinfo, long numBytes);
+
+  void skipInputDataImpl(long numBytes);
+
+  static void termSource(j_decompress_ptr cinfo);
+
+  static JpegSourceManager* object(j_decompress_ptr cinfo);
+
+  QIODevice& m_device;
+  JOCTET m_buf[4096]{};
+};
+
+
+JpegSourceManager::JpegSourceManager(QIODevice& ioDevice) : jpeg_source_mgr(), m_device(ioDevice) {
+  init_source = &JpegSourceManager::initSource;
+  fill_input_buffer = &JpegSourceManager::fillInputBuffer;
+  skip_input_data = &JpegSourceManager::skipInputData;
+  resync_to_restart = &jpeg_resync_to_restart;
+  term_source = &JpegSourceManager::termSource;
+  bytes_in_buffer = 0;
+  next_input_byte = m_buf;
+}
+
+void JpegSourceManager::initSource(j_decompress_ptr cinfo) {
+  // No-op.
+}
+
+boolean JpegSourceManager::fillInputBuffer(j_decompress_ptr cinfo) {
+  return object(cinfo)->fillInputBufferImpl();
+}
+
+boolean JpegSourceManager::fillInputBufferImpl() {
+  const qint64 bytesRead = m_device.read((char*) m_buf, sizeof(m_buf));
+  if (bytesRead > 0) {
+    bytes_in_buffer = bytesRead;
+  } else {
+    // Insert a fake EOI marker.
+    m_buf[0] = 0xFF;
+    m_buf[1] = JPEG_EOI;
+    bytes_in_buffer = 2;
+  }
+  next_input_byte = m_buf;
+  return 1;
+}
+
+void JpegSourceManager::skipInputData(j_decompress_ptr cinfo, long numBytes) {
+  object(cinfo)->skipInputDataImpl(numBytes);
+}
+
+void JpegSourceManager::skipInputDataImpl(long numBytes) {
+  if (numBytes <= 0) {
+    return;
+  }
+
+  while (numBytes > (long) bytes_in_buffer) {
+    numBytes -= (long) bytes_in_buffer;
+    fillInputBufferImpl();
+  }
+  next_input_byte += numBytes;
+  bytes_in_buffer -= numBytes;
+}
+
+void JpegSourceManager::termSource(j_decompress_ptr cinfo) {
+  // No-op.
+}
+
+JpegSourceManager* JpegSourceManager::object(j_decompress_ptr cinfo) {
+  return static_cast<JpegSourceManager*>(cinfo->src);
+}
+
+/*============================= JpegErrorManager ===========================*/
+
+class JpegErrorManager : public jpeg_error_mgr {
+  DECLARE_NON_COPYABLE(JpegErrorManager)
+
+ public:
+  JpegErrorManager();
+
+  jmp_buf& jmpBuf() { return m_jmpBuf; }
+
+ private:
+  static void errorExit(j_common_ptr cinfo);
+
+  static JpegErrorManager* object(j_common_ptr cinfo);
+
+  jmp_buf m_jmpBuf{};
+};
+
+
+JpegErrorManager::JpegErrorManager() : jpeg_error_mgr() {
+  jpeg_std_error(this);
+  error_exit = &JpegErrorManager::errorExit;
+}
+
+void JpegErrorManager::errorExit(j_common_ptr cinfo) {
+  longjmp(object(cinfo)->jmpBuf(), 1);
+}
+
+JpegErrorManager* JpegErrorManager::object(j_common_ptr cinfo) {
+  return static_cast<JpegErrorManager*>(cinfo->err);
+}
+}  // namespace
+
+/*============================= JpegReader ==========================*/
+
+namespace {
+Dpi densityToDpi(const jpeg_decompress_struct& cinfo) {
+  if (cinfo.density_unit == 1) {
+    // Dots per inch.
+    return Dpi(cinfo.X_density, cinfo.Y_density);
+  } else if (cinfo.density_unit == 2) {
+    // Dots per centimeter.
+    return Dpm(cinfo.X_density * 100, cinfo.Y_density * 100);
+  }
+  return Dpi();
+}
+
+/**
+ * Returns the largest of the scale denominators supported by libjpeg,
+ * such that the image decoded with it would still be at least as large
+ * as \p fullSize scaled to fit into \p targetSize.
+ */
+unsigned selectScaleDenom(const QSize& fullSize, const QSize& targetSize) {
+  if (targetSize.isEmpty() || fullSize.isEmpty()) {
+    return 1;
+  }
+
+  const QSize fitSize(fullSize.scaled(targetSize, Qt::KeepAspectRatio));
+  unsigned denom = 8;
+  for (; denom > 1; denom /= 2) {
+    // That's how libjpeg computes the output dimensions.
+    const int width = (fullSize.width() + denom - 1) / denom;
+    const int height = (fullSize.height() + denom - 1) / denom;
+    if ((width >= fitSize.width()) && (height >= fitSize.height())) {
+      break;
+    }
+  }
+  return denom;
+}
+
+/**
+ * Decompresses the image into \p image, which is the only thing that may be
+ * left partially initialized on failure.  All the objects with destructors
+ * are owned by the caller, so that longjmp() doesn't skip over any of them.
+ */
+bool decompressImage(JpegDecompressHandle& cinfo,
+                     JpegErrorManager& errMgr,
+                     const QSize& targetSize,
+                     std::vector<JSAMPLE>& rgbLine,
+                     QImage& image) {
+  if (setjmp(errMgr.jmpBuf())) {
+    // Returning from longjmp().
+    return false;
+  }
+
+  if (jpeg_read_header(cinfo.ptr(), 1) != JPEG_HEADER_OK) {
+    return false;
+  }
+
+  switch (cinfo->jpeg_color_space) {
+    case JCS_GRAYSCALE:
+      cinfo->out_color_space = JCS_GRAYSCALE;
+      break;
+    case JCS_YCbCr:
+    case JCS_RGB:
+      cinfo->out_color_space = JCS_RGB;
+      break;
+    default:
+      // CMYK and the like are left to Qt.
+      return false;
+  }
+
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = selectScaleDenom(QSize(cinfo->image_width, cinfo->image_height), targetSize);
+
+  if (!jpeg_start_decompress(cinfo.ptr())) {
+    return false;
+  }
+
+  const int width = cinfo->output_width;
+  const bool grayscale = (cinfo->out_color_space == JCS_GRAYSCALE);
+  image = QImage(width, cinfo->output_height, grayscale ? QImage::Format_Indexed8 : QImage::Format_RGB32);
+  if (image.isNull()) {
+    throw std::bad_alloc();
+  }
+
+  if (grayscale) {
+    image.setColorCount(256);
+    for (int i = 0; i < 256; ++i) {
+      image.setColor(i, qRgb(i, i, i));
+    }
+    while (cinfo->output_scanline < cinfo->output_height) {
+      JSAMPROW row = image.scanLine(cinfo->output_scanline);
+      jpeg_read_scanlines(cinfo.ptr(), &row, 1);
+    }
+  } else {
+    rgbLine.resize(static_cast<size_t>(width) * 3);
+    while (cinfo->output_scanline < cinfo->output_height) {
+      auto* dstLine = reinterpret_cast<QRgb*>(image.scanLine(cinfo->output_scanline));
+      JSAMPROW row = rgbLine.data();
+      jpeg_read_scanlines(cinfo.ptr(), &row, 1);
+
+      const JSAMPLE* src = rgbLine.data();
+      for (int x = 0; x < width; ++x, src += 3) {
+        dstLine[x] = qRgb(src[0], src[1], src[2]);
+      }
+    }
+  }
+
+  jpeg_finish_decompress(cinfo.ptr());
+  return true;
+}  // decompressImage
+}  // namespace
+
+bool JpegReader::canRead(QIODevice& device) {
+  static const unsigned char jpeg_signature[] = {0xff, 0xd8, 0xff};
+  static const int sigSize = sizeof(jpeg_signature);
+
+  unsigned char signature[sigSize];
+  if (device.peek((char*) signature, sigSize) != sigSize) {
+    return false;
+  }
+  return memcmp(jpeg_signature, signature, sigSize) == 0;
+}
+
+ImageMetadataLoader::Status JpegReader::readMetadata(QIODevice& device,
+                                                     const VirtualFunction<void, const ImageMetadata&>& out) {
+  if (!device.isReadable()) {
+    return ImageMetadataLoader::GENERIC_ERROR;
+  }
+  if (!canRead(device)) {
+    return ImageMetadataLoader::FORMAT_NOT_RECOGNIZED;
+  }
+
+  JpegErrorManager errMgr;
+  if (setjmp(errMgr.jmpBuf())) {
+    // Returning from longjmp().
+    return ImageMetadataLoader::GENERIC_ERROR;
+  }
+
+  JpegSourceManager srcMgr(device);
+  JpegDecompressHandle cinfo(&errMgr, &srcMgr);
+
+  const int headerStatus = jpeg_read_header(cinfo.ptr(), 0);
+  if (headerStatus == JPEG_HEADER_TABLES_ONLY) {
+    return ImageMetadataLoader::NO_IMAGES;
+  }
+
+  // The other possible value is JPEG_SUSPENDED, but we never suspend it.
+  assert(headerStatus == JPEG_HEADER_OK);
+
+  // Everything we need is in the header.  Unlike jpeg_start_decompress(),
+  // which reads the whole file in case of progressive JPEGs, we stop here.
+  const QSize size(cinfo->image_width, cinfo->image_height);
+  out(ImageMetadata(size, densityToDpi(*cinfo.ptr())));
+  return ImageMetadataLoader::LOADED;
+}
+
+QImage JpegReader::readImage(QIODevice& device, const QSize& targetSize) {
+  if (!device.isReadable() || !canRead(device)) {
+    return QImage();
+  }
+
+  JpegErrorManager errMgr;
+  JpegSourceManager srcMgr(device);
+  JpegDecompressHandle cinfo(&errMgr, &srcMgr);
+  std::vector<JSAMPLE> rgbLine;
+  QImage image;
+  if (!decompressImage(cinfo, errMgr, targetSize, rgbLine, image)) {
+    return QImage();
+  }
+
+  const Dpi dpi(densityToDpi(*cinfo.ptr()));
+  if (!dpi.isNull()) {
+    // The density is that of the full resolution image.
+    const Dpm dpm(dpi);
+    const double scale = double(image.width()) / cinfo->image_width;
+    image.setDotsPerMeterX(qRound(dpm.horizontal() * scale));
+    image.setDotsPerMeterY(qRound(dpm.vertical() * scale));
+  }
+  return image;
+}
@@ -0,0 +1,39 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_JPEGREADER_H_
+#define SCANTAILOR_CORE_JPEGREADER_H_
+
+#include <QSize>
+
+#include "ImageMetadataLoader.h"
+#include "VirtualFunction.h"
+
+class QIODevice;
+class QImage;
+class ImageMetadata;
+
+class JpegReader {
+ public:
+  static bool canRead(QIODevice& device);
+
+  static ImageMetadataLoader::Status readMetadata(QIODevice& device,
+                                                  const VirtualFunction<void, const ImageMetadata&>& out);
+
+  /**
+   * \brief Reads the image from io device to QImage.
+   *
+   * \param device The device to read from.  This device must be
+   *        opened for reading.
+   * \param targetSize If not empty, the image is going to be scaled
+   *        down to fit into that size.  libjpeg is then told to decode
+   *        it at 1/2, 1/4 or 1/8 scale, whichever is the smallest one
+   *        that still doesn't need upscaling.
+   * \return The resulting image, or a null image in case of failure,
+   *         including images libjpeg can't convert to RGB, like CMYK ones.
+   */
+  static QImage readImage(QIODevice& device, const QSize& targetSize = QSize());
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_JPEGREADER_H_
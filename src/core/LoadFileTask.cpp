@@ -11,12 +11,12 @@
 #include <QTextDocument>
 
 #include "AbstractFilter.h"
+#include "DecodedImageCache.h"
 #include "Dpm.h"
 #include "ErrorWidget.h"
 #include "FilterData.h"
 #include "FilterOptionsWidget.h"
 #include "FilterUiInterface.h"
-#include "ImageLoader.h"
 #include "ProjectPages.h"
 #include "ThumbnailPixmapCache.h"
 #include "filters/fix_orientation/Task.h"
@@ -46,6 +46,7 @@ LoadFileTask::LoadFileTask(Type type,
     : BackgroundTask(type),
       m_thumbnailCache(std::move(thumbnailCache)),
       m_imageId(page.imageId()),
+      m_prepared(false),
       m_imageMetadata(page.metadata()),
       m_pages(std::move(pages)),
       m_nextTask(std::move(nextTask)) {
@@ -54,8 +55,18 @@ LoadFileTask::LoadFileTask(Type type,
 
 LoadFileTask::~LoadFileTask() = default;
 
+void LoadFileTask::prepare() {
+  m_preparedImage = DecodedImageCache::instance().load(m_imageId);
+  m_prepared = true;
+}
+
 FilterResultPtr LoadFileTask::operator()() {
-  QImage image = ImageLoader::load(m_imageId);
+  QImage image;
+  if (m_prepared) {
+    image.swap(m_preparedImage);
+  } else {
+    image = DecodedImageCache::instance().load(m_imageId);
+  }
 
   try {
     throwIfCancelled();
@@ -66,8 +77,10 @@ FilterResultPtr LoadFileTask::operator()() {
       convertToSupportedFormat(image);
       updateImageSizeIfChanged(image);
       overrideDpi(image);
+      DecodedImageCache::instance().replace(m_imageId, image);
       m_thumbnailCache->ensureThumbnailExists(m_imageId, image);
-      return m_nextTask->process(*this, FilterData(image));
+      const GrayImage grayImage(DecodedImageCache::instance().grayscale(m_imageId, image));
+      return m_nextTask->process(*this, FilterData(image, grayImage));
     }
   } catch (const CancelledException&) {
     return nullptr;
@@ -93,8 +106,12 @@ void LoadFileTask::overrideDpi(QImage& image) const {
   // Beware: QImage will have a default DPI when loading
   // an image that doesn't specify one.
   const Dpm dpm(m_imageMetadata.dpi());
-  image.setDotsPerMeterX(dpm.horizontal());
-  image.setDotsPerMeterY(dpm.vertical());
+  // Setting the DPI detaches the image from the copy kept by
+  // DecodedImageCache, so we only do that when necessary.
+  if ((image.dotsPerMeterX() != dpm.horizontal()) || (image.dotsPerMeterY() != dpm.vertical())) {
+    image.setDotsPerMeterX(dpm.horizontal());
+    image.setDotsPerMeterY(dpm.vertical());
+  }
 }
 
 void LoadFileTask::convertToSupportedFormat(QImage& image) const {
@@ -4,6 +4,7 @@
 #ifndef SCANTAILOR_CORE_LOADFILETASK_H_
 #define SCANTAILOR_CORE_LOADFILETASK_H_
 
+#include <QImage>
 #include <memory>
 
 #include "BackgroundTask.h"
@@ -15,7 +16,6 @@
 class ThumbnailPixmapCache;
 class PageInfo;
 class ProjectPages;
-class QImage;
 
 namespace fix_orientation {
 class Task;
@@ -33,6 +33,8 @@ class LoadFileTask : public BackgroundTask {
 
   ~LoadFileTask() override;
 
+  void prepare() override;
+
   FilterResultPtr operator()() override;
 
  private:
@@ -46,6 +48,8 @@ class LoadFileTask : public BackgroundTask {
 
   std::shared_ptr<ThumbnailPixmapCache> m_thumbnailCache;
   ImageId m_imageId;
+  QImage m_preparedImage;
+  bool m_prepared;
   ImageMetadata m_imageMetadata;
   const std::shared_ptr<ProjectPages> m_pages;
   const std::shared_ptr<fix_orientation::Task> m_nextTask;
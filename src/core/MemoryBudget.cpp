@@ -0,0 +1,85 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "MemoryBudget.h"
+
+#include <algorithm>
+
+#include "ApplicationSettings.h"
+#include "ImageMetadata.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+const qint64 MEGABYTE = 1024 * 1024;
+
+// The address space is the limiting factor on 32-bit systems.
+const qint64 MAX_BUDGET_32BIT = 1536 * MEGABYTE;
+
+// The decoded image, which may be up to 32 bits per pixel,
+// and its grayscale version, which most stages work with.
+const int SOURCE_BYTES_PER_PIXEL = 4 + 1;
+
+/**
+ * \return The amount of physical memory in bytes, or 0 if unknown.
+ */
+qint64 physicalMemory() {
+#ifdef Q_OS_WIN
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status)) {
+    return 0;
+  }
+  return static_cast<qint64>(status.ullTotalPhys);
+#else
+  const long numPages = sysconf(_SC_PHYS_PAGES);
+  const long pageSize = sysconf(_SC_PAGESIZE);
+  if ((numPages <= 0) || (pageSize <= 0)) {
+    return 0;
+  }
+  return static_cast<qint64>(numPages) * pageSize;
+#endif
+}
+
+/**
+ * \return The memory shared by processing tasks and DecodedImageCache
+ *         in bytes, or 0 if unknown.
+ */
+qint64 totalBudget() {
+  qint64 budget = ApplicationSettings::getInstance().getBatchMemoryBudget() * MEGABYTE;
+  if (budget <= 0) {
+    // Leave a quarter to the OS, the GUI and the other caches.
+    budget = physicalMemory() / 4 * 3;
+  }
+  if ((budget > 0) && (sizeof(void*) <= 4)) {
+    budget = std::min(budget, MAX_BUDGET_32BIT);
+  }
+  return budget;
+}
+}  // namespace
+
+qint64 MemoryBudget::forBatchProcessing() {
+  const qint64 budget = totalBudget();
+  if (budget <= 0) {
+    return 0;
+  }
+  return budget - forDecodedImageCache();
+}
+
+qint64 MemoryBudget::forDecodedImageCache() {
+  qint64 size = ApplicationSettings::getInstance().getDecodedImageCacheSize() * MEGABYTE;
+  const qint64 budget = totalBudget();
+  if (budget > 0) {
+    size = std::min(size, budget / 2);
+  }
+  return std::max<qint64>(size, 0);
+}
+
+qint64 MemoryBudget::estimateForImage(const ImageMetadata& metadata) {
+  const QSize& size = metadata.size();
+  return static_cast<qint64>(size.width()) * size.height() * SOURCE_BYTES_PER_PIXEL;
+}
@@ -0,0 +1,48 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_MEMORYBUDGET_H_
+#define SCANTAILOR_CORE_MEMORYBUDGET_H_
+
+#include <QtGlobal>
+
+class ImageMetadata;
+
+/**
+ * \brief Decides how much memory batch processing may take and
+ *        estimates how much of it a page needs.
+ *
+ * The estimates are deliberately pessimistic.  They are used by
+ * ProcessingTaskQueue to avoid starting more pages than fit in memory.
+ */
+class MemoryBudget {
+ public:
+  /**
+   * \brief Returns the number of bytes batch processing may use.
+   *
+   * The total comes from the application settings or, if it's not set there,
+   * is derived from the amount of physical memory.  The memory given to
+   * DecodedImageCache is subtracted from it.  Zero is returned if neither
+   * is known, meaning there is no limit.
+   */
+  static qint64 forBatchProcessing();
+
+  /**
+   * \brief Returns the number of bytes decoded images may be kept in.
+   *
+   * The value comes from the application settings, but doesn't exceed
+   * half of the total memory budget.
+   */
+  static qint64 forDecodedImageCache();
+
+  /**
+   * \brief Estimates the peak memory usage of loading an image and running
+   *        the stages preceding the output one on it.
+   */
+  static qint64 estimateForImage(const ImageMetadata& metadata);
+
+  MemoryBudget() = delete;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_MEMORYBUDGET_H_
@@ -3,20 +3,31 @@
 
 #include "ProcessingTaskQueue.h"
 
-ProcessingTaskQueue::Entry::Entry(const PageInfo& pageInfo, const BackgroundTaskPtr& tsk)
-    : pageInfo(pageInfo), task(tsk), takenForProcessing(false) {}
+ProcessingTaskQueue::Entry::Entry(const PageInfo& pageInfo, const BackgroundTaskPtr& tsk, const qint64 memoryUsage)
+    : pageInfo(pageInfo), task(tsk), memoryUsage(memoryUsage), takenForProcessing(false) {}
 
-ProcessingTaskQueue::ProcessingTaskQueue() = default;
+ProcessingTaskQueue::ProcessingTaskQueue() : m_memoryBudget(0), m_memoryInUse(0) {}
 
-void ProcessingTaskQueue::addProcessingTask(const PageInfo& pageInfo, const BackgroundTaskPtr& task) {
-  m_queue.emplace_back(pageInfo, task);
+void ProcessingTaskQueue::addProcessingTask(const PageInfo& pageInfo,
+                                            const BackgroundTaskPtr& task,
+                                            const qint64 memoryUsage) {
+  m_queue.emplace_back(pageInfo, task, memoryUsage);
   m_pageToSelectWhenDone = PageInfo();
 }
 
+void ProcessingTaskQueue::setMemoryBudget(const qint64 bytes) {
+  m_memoryBudget = bytes;
+}
+
 BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing() {
   for (Entry& ent : m_queue) {
     if (!ent.takenForProcessing) {
+      if ((m_memoryBudget > 0) && (m_memoryInUse > 0) && (m_memoryInUse + ent.memoryUsage > m_memoryBudget)) {
+        // Wait for some of the tasks being processed to finish.
+        return nullptr;
+      }
       ent.takenForProcessing = true;
+      m_memoryInUse += ent.memoryUsage;
 
       if (m_selectedPage.isNull()) {
         // In this mode we select the most recently submitted for processing page.
@@ -31,6 +42,14 @@ BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing() {
 }
 
 void ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
+  for (auto cancelledIt = m_cancelledEntries.begin(); cancelledIt != m_cancelledEntries.end(); ++cancelledIt) {
+    if (cancelledIt->task == task) {
+      releaseMemory(*cancelledIt);
+      m_cancelledEntries.erase(cancelledIt);
+      return;
+    }
+  }
+
   auto it(m_queue.begin());
   const auto end(m_queue.end());
 
@@ -60,6 +79,7 @@ void ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
     m_pageToSelectWhenDone = it->pageInfo;
   }
 
+  releaseMemory(*it);
   m_queue.erase(it);
 
   if (removingSelectedPage) {
@@ -86,16 +106,16 @@ void ProcessingTaskQueue::cancelAndRemove(const std::set<PageId>& pages) {
     if (pages.find(it->pageInfo.id()) == pages.end()) {
       ++it;
     } else {
-      if (it->takenForProcessing) {
-        it->task->cancel();
-      }
-
       if (m_selectedPage.id() == it->pageInfo.id()) {
         m_selectedPage = PageInfo();
       }
 
-
-      m_queue.erase(it++);
+      if (it->takenForProcessing) {
+        it->task->cancel();
+        m_cancelledEntries.splice(m_cancelledEntries.end(), m_queue, it++);
+      } else {
+        m_queue.erase(it++);
+      }
     }
   }
 }
@@ -105,8 +125,16 @@ void ProcessingTaskQueue::cancelAndClear() {
     Entry& ent = m_queue.front();
     if (ent.takenForProcessing) {
       ent.task->cancel();
+      m_cancelledEntries.splice(m_cancelledEntries.end(), m_queue, m_queue.begin());
+    } else {
+      m_queue.pop_front();
     }
-    m_queue.pop_front();
   }
   m_selectedPage = m_pageToSelectWhenDone;
 }
+
+void ProcessingTaskQueue::releaseMemory(const Entry& entry) {
+  if (entry.takenForProcessing) {
+    m_memoryInUse -= entry.memoryUsage;
+  }
+}
@@ -4,6 +4,7 @@
 #ifndef SCANTAILOR_CORE_PROCESSINGTASKQUEUE_H_
 #define SCANTAILOR_CORE_PROCESSINGTASKQUEUE_H_
 
+#include <QtGlobal>
 #include <list>
 #include <set>
 
@@ -18,12 +19,28 @@ class ProcessingTaskQueue {
  public:
   ProcessingTaskQueue();
 
-  void addProcessingTask(const PageInfo& pageInfo, const BackgroundTaskPtr& task);
+  /**
+   * \param memoryUsage The estimated peak memory usage of the task, in bytes.
+   *        See setMemoryBudget().
+   */
+  void addProcessingTask(const PageInfo& pageInfo, const BackgroundTaskPtr& task, qint64 memoryUsage = 0);
+
+  /**
+   * \brief Limits the total memory usage of the tasks being processed.
+   *
+   * \param bytes The limit, or 0 for no limit, which is the default.
+   *
+   * A task won't be taken for processing if the memory usage estimates of
+   * the tasks already taken plus its own exceed the limit.  A task is always
+   * taken if no other tasks are being processed, no matter its estimate.
+   */
+  void setMemoryBudget(qint64 bytes);
 
   /**
    * The first task among those that haven't been already taken for processing
    * is marked as taken and returned.  A null task will be returned if there
-   * are no such tasks.
+   * are no such tasks, or if the memory budget doesn't allow to take it yet,
+   * in which case it should be retried after processingFinished().
    */
   BackgroundTaskPtr takeForProcessing();
 
@@ -40,20 +57,38 @@ class ProcessingTaskQueue {
 
   bool allProcessed() const;
 
+  /**
+   * \brief Cancels and removes the tasks for the given pages.
+   *
+   * The tasks being processed keep their share of the memory budget
+   * until processingFinished() is called for them, as they may still
+   * be holding their images until they notice the cancellation.
+   */
   void cancelAndRemove(const std::set<PageId>& pages);
 
+  /**
+   * \brief Cancels and removes all the tasks.
+   *
+   * \see cancelAndRemove()
+   */
   void cancelAndClear();
 
  private:
   struct Entry {
     PageInfo pageInfo;
     BackgroundTaskPtr task;
+    qint64 memoryUsage;
     bool takenForProcessing;
 
-    Entry(const PageInfo& pageInfo, const BackgroundTaskPtr& task);
+    Entry(const PageInfo& pageInfo, const BackgroundTaskPtr& task, qint64 memoryUsage);
   };
 
+  void releaseMemory(const Entry& entry);
+
   std::list<Entry> m_queue;
+  std::list<Entry> m_cancelledEntries;  // Cancelled while being processed.
+  qint64 m_memoryBudget;
+  qint64 m_memoryInUse;
   PageInfo m_selectedPage;
   PageInfo m_pageToSelectWhenDone;
 };
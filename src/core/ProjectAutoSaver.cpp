@@ -0,0 +1,164 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ProjectAutoSaver.h"
+
+#include <QBuffer>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "AtomicFileOverwriter.h"
+#include "PageId.h"
+#include "ProjectJournal.h"
+
+namespace {
+class FunctionRunnable : public QRunnable {
+ public:
+  explicit FunctionRunnable(std::function<void()> func) : m_func(std::move(func)) { setAutoDelete(true); }
+
+  void run() override { m_func(); }
+
+ private:
+  std::function<void()> m_func;
+};
+
+// The journal is merged into the project file once it gets larger than
+// this or a quarter of the project file, whichever is greater.
+const qint64 MIN_JOURNAL_SIZE_TO_COMPACT = 1024 * 1024;
+}  // namespace
+
+ProjectAutoSaver::ProjectAutoSaver() : m_pool(std::make_unique<QThreadPool>()), m_allPagesDirty(false) {
+  // Writes must not overtake each other.
+  m_pool->setMaxThreadCount(1);
+}
+
+ProjectAutoSaver::~ProjectAutoSaver() {
+  waitForDone();
+}
+
+void ProjectAutoSaver::reset(const QString& projectFile, const ProjectWriter& writer) {
+  waitForDone();
+
+  m_projectFile = projectFile;
+  m_structureDigest = writer.structureDigest();
+  m_dirtyImages.clear();
+  m_allPagesDirty = false;
+  m_writeFailed.store(0);
+}
+
+void ProjectAutoSaver::markPageDirty(const PageId& pageId) {
+  if (!m_allPagesDirty) {
+    m_dirtyImages.insert(pageId.imageId());
+  }
+}
+
+void ProjectAutoSaver::markAllPagesDirty() {
+  m_allPagesDirty = true;
+  m_dirtyImages.clear();
+}
+
+void ProjectAutoSaver::save(const std::shared_ptr<ProjectPages>& pages,
+                            const SelectedPage& selectedPage,
+                            const OutputFileNameGenerator& outFileNameGen,
+                            const std::vector<FilterPtr>& filters) {
+  if (m_projectFile.isEmpty()) {
+    return;
+  }
+
+  ProjectWriter writer(pages, selectedPage, outFileNameGen);
+  if ((writer.structureDigest() != m_structureDigest) || (m_writeFailed.load() != 0)) {
+    saveFull(writer, filters);
+    return;
+  }
+
+  // The page being worked on may have changed without its thumbnail being invalidated yet.
+  const PageId selectedPageId(selectedPage.get(IMAGE_VIEW));
+  if (!selectedPageId.isNull()) {
+    markPageDirty(selectedPageId);
+  }
+  saveIncremental(writer, filters);
+}
+
+bool ProjectAutoSaver::flush() {
+  waitForDone();
+  if (m_projectFile.isEmpty()) {
+    return true;
+  }
+  return ProjectJournal::compact(m_projectFile);
+}
+
+void ProjectAutoSaver::waitForDone() {
+  m_pool->waitForDone();
+}
+
+void ProjectAutoSaver::saveFull(const ProjectWriter& writer, const std::vector<FilterPtr>& filters) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  if (!writer.write(buffer, filters)) {
+    return;
+  }
+
+  m_structureDigest = writer.structureDigest();
+  m_dirtyImages.clear();
+  m_allPagesDirty = false;
+  m_writeFailed.store(0);
+
+  const QString projectFile(m_projectFile);
+  const QByteArray data(buffer.data());
+  QAtomicInt* writeFailed = &m_writeFailed;
+  m_pool->start(new FunctionRunnable(
+      [projectFile, data, writeFailed]() { writeProject(projectFile, data, writeFailed); }));
+}
+
+void ProjectAutoSaver::saveIncremental(ProjectWriter& writer, const std::vector<FilterPtr>& filters) {
+  if (!m_allPagesDirty) {
+    if (m_dirtyImages.empty()) {
+      return;
+    }
+    writer.restrictToImages(m_dirtyImages);
+  }
+
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  if (!writer.writeFilterSettings(buffer, filters)) {
+    return;
+  }
+
+  m_dirtyImages.clear();
+  m_allPagesDirty = false;
+
+  const QString projectFile(m_projectFile);
+  const QByteArray record(buffer.data());
+  QAtomicInt* writeFailed = &m_writeFailed;
+  m_pool->start(new FunctionRunnable(
+      [projectFile, record, writeFailed]() { appendToJournal(projectFile, record, writeFailed); }));
+}
+
+void ProjectAutoSaver::writeProject(const QString& projectFile, const QByteArray& data, QAtomicInt* writeFailed) {
+  AtomicFileOverwriter overwriter;
+  QIODevice* device = overwriter.startWriting(projectFile);
+  if (!device || (device->write(data) != data.size()) || !overwriter.commit()) {
+    writeFailed->store(1);
+    return;
+  }
+  // The journal was made against the previous version of the project file.
+  ProjectJournal::remove(projectFile);
+}
+
+void ProjectAutoSaver::appendToJournal(const QString& projectFile, const QByteArray& record, QAtomicInt* writeFailed) {
+  if (!ProjectJournal::append(projectFile, record)) {
+    // The pages written here are no longer dirty, so only a full save recovers them.
+    writeFailed->store(1);
+    return;
+  }
+
+  const qint64 journalSize = QFileInfo(ProjectJournal::filePath(projectFile)).size();
+  const qint64 projectSize = QFileInfo(projectFile).size();
+  if (journalSize > std::max(MIN_JOURNAL_SIZE_TO_COMPACT, projectSize / 4)) {
+    ProjectJournal::compact(projectFile);
+  }
+}
@@ -0,0 +1,91 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_PROJECTAUTOSAVER_H_
+#define SCANTAILOR_CORE_PROJECTAUTOSAVER_H_
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "ImageId.h"
+#include "NonCopyable.h"
+#include "ProjectWriter.h"
+
+class QThreadPool;
+
+/**
+ * \brief Saves the project periodically without blocking the GUI.
+ *
+ * The settings are serialized in the GUI thread, where they are consistent,
+ * but nothing is written to disk there.  As long as the pages stay the same,
+ * only settings of pages marked dirty are saved, by appending them to the
+ * ProjectJournal, which gets compacted into the project file once it grows
+ * large enough.  Any change to the set of pages, as well as a failure
+ * to write to the journal, makes the next save a full one.
+ */
+class ProjectAutoSaver {
+  DECLARE_NON_COPYABLE(ProjectAutoSaver)
+
+ public:
+  using FilterPtr = ProjectWriter::FilterPtr;
+
+  ProjectAutoSaver();
+
+  /**
+   * \brief Waits for the pending writes to finish.
+   */
+  ~ProjectAutoSaver();
+
+  /**
+   * \brief Starts tracking changes against a project file in the state \p writer describes.
+   *
+   * Called after the project was opened or fully saved.  Pending writes
+   * for the previous project are finished first.
+   */
+  void reset(const QString& projectFile, const ProjectWriter& writer);
+
+  void markPageDirty(const PageId& pageId);
+
+  void markAllPagesDirty();
+
+  /**
+   * \brief Schedules saving the changes made since the previous save.
+   */
+  void save(const std::shared_ptr<ProjectPages>& pages,
+            const SelectedPage& selectedPage,
+            const OutputFileNameGenerator& outFileNameGen,
+            const std::vector<FilterPtr>& filters);
+
+  /**
+   * \brief Waits for the pending writes and merges the journal into the project file.
+   *
+   * The project file then holds the autosaved state, laid out exactly as
+   * ProjectWriter would write it, so it can be compared to a fresh write.
+   */
+  bool flush();
+
+  void waitForDone();
+
+ private:
+  void saveFull(const ProjectWriter& writer, const std::vector<FilterPtr>& filters);
+
+  void saveIncremental(ProjectWriter& writer, const std::vector<FilterPtr>& filters);
+
+  static void writeProject(const QString& projectFile, const QByteArray& data, QAtomicInt* writeFailed);
+
+  static void appendToJournal(const QString& projectFile, const QByteArray& record, QAtomicInt* writeFailed);
+
+  std::unique_ptr<QThreadPool> m_pool;
+  QString m_projectFile;
+  QByteArray m_structureDigest;
+  std::unordered_set<ImageId> m_dirtyImages;
+  bool m_allPagesDirty;
+  QAtomicInt m_writeFailed;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_PROJECTAUTOSAVER_H_
@@ -0,0 +1,331 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ProjectJournal.h"
+
+#include <QDateTime>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <algorithm>
+#include <vector>
+
+#include "AtomicFileOverwriter.h"
+#include "ProjectWriter.h"
+
+namespace {
+QString idKey(const QDomElement& el) {
+  return el.tagName() + QChar('#') + el.attribute("id");
+}
+
+/**
+ * A removed entry is an element with just the id attribute,
+ * as written by ProjectWriter::writeRemovedEntry().
+ */
+bool isRemovedEntry(const QDomElement& el) {
+  return el.hasAttribute("id") && (el.attributes().count() == 1) && !el.hasChildNodes();
+}
+
+/**
+ * A container is an element made of per-page entries and other containers,
+ * so that it may be merged entry by entry rather than replaced as a whole.
+ */
+bool isContainer(const QDomElement& el) {
+  bool hasEntries = false;
+  for (QDomNode node(el.firstChild()); !node.isNull(); node = node.nextSibling()) {
+    if (!node.isElement()) {
+      return false;
+    }
+    const QDomElement child(node.toElement());
+    if (!child.hasAttribute("id") && !isContainer(child)) {
+      return false;
+    }
+    hasEntries = true;
+  }
+  return hasEntries || !el.hasChildNodes();
+}
+}  // namespace
+
+QString ProjectJournal::filePath(const QString& projectFile) {
+  return projectFile + ".journal";
+}
+
+bool ProjectJournal::append(const QString& projectFile, const QByteArray& record) {
+  QFile file(filePath(projectFile));
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    return false;
+  }
+  if (file.size() == 0) {
+    // The root element is never closed, so that records can be just appended.
+    const QByteArray header("<journal base=\"" + baseStamp(projectFile).toUtf8() + "\">\n");
+    if (file.write(header) != header.size()) {
+      return false;
+    }
+  }
+  return (file.write(record) == record.size()) && file.flush();
+}
+
+bool ProjectJournal::compact(const QString& projectFile) {
+  if (!QFile::exists(filePath(projectFile))) {
+    return true;
+  }
+
+  QDomDocument doc;
+  const QDomElement delta(readDelta(projectFile, doc));
+  if (delta.isNull()) {
+    // Either empty or left from a different version of the project file.
+    remove(projectFile);
+    return true;
+  }
+
+  QFile projectIn(projectFile);
+  if (!projectIn.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* device = overwriter.startWriting(projectFile);
+  if (!device) {
+    return false;
+  }
+
+  // The project is copied token by token, except for the <filters> element,
+  // which is the only one that's read into memory to have the delta merged in.
+  QXmlStreamReader reader(&projectIn);
+  QXmlStreamWriter xml(device);
+  xml.setAutoFormatting(true);
+  xml.setAutoFormattingIndent(2);
+
+  int depth = 0;
+  while (!reader.atEnd()) {
+    const QXmlStreamReader::TokenType token = reader.readNext();
+    if ((token == QXmlStreamReader::StartElement) && (depth == 1) && (reader.name() == "filters")) {
+      QDomElement filtersEl(readDomElement(reader, doc));
+      merge(filtersEl, delta);
+      ProjectWriter::writeDomElement(xml, filtersEl);
+      continue;
+    }
+
+    if (token == QXmlStreamReader::StartElement) {
+      ++depth;
+    } else if (token == QXmlStreamReader::EndElement) {
+      --depth;
+    } else if ((token == QXmlStreamReader::StartDocument) || (token == QXmlStreamReader::Invalid)
+               || ((token == QXmlStreamReader::Characters) && reader.isWhitespace())) {
+      continue;
+    }
+    xml.writeCurrentToken(reader);
+  }
+
+  if (reader.hasError() || xml.hasError()) {
+    overwriter.abort();
+    return false;
+  }
+
+  projectIn.close();
+  if (!overwriter.commit()) {
+    return false;
+  }
+  remove(projectFile);
+  return true;
+}  // ProjectJournal::compact
+
+void ProjectJournal::applyTo(QDomDocument& projectDoc, const QString& projectFile) {
+  const QDomElement delta(readDelta(projectFile, projectDoc));
+  if (delta.isNull()) {
+    return;
+  }
+
+  QDomElement filtersEl(projectDoc.documentElement().namedItem("filters").toElement());
+  if (!filtersEl.isNull()) {
+    merge(filtersEl, delta);
+  }
+}
+
+void ProjectJournal::applyTo(QDomElement& filtersEl, const QDomElement& delta, const QString& filterTagName) {
+  if (delta.isNull()) {
+    return;
+  }
+
+  // As every record holds the settings of all the filters, merging just the element
+  // of one filter gives the same result for it as merging the whole delta.
+  QDomDocument doc(filtersEl.ownerDocument());
+  QDomElement filterDelta(doc.createElement(delta.tagName()));
+  const QDomElement filterEl(delta.namedItem(filterTagName).toElement());
+  if (!filterEl.isNull()) {
+    filterDelta.appendChild(doc.importNode(filterEl, true));
+  }
+  merge(filtersEl, filterDelta);
+}
+
+void ProjectJournal::remove(const QString& projectFile) {
+  QFile::remove(filePath(projectFile));
+}
+
+void ProjectJournal::merge(QDomElement& target, const QDomElement& delta, const bool keepRemovedEntries) {
+  QDomDocument doc(target.ownerDocument());
+
+  const QDomNamedNodeMap targetAttributes(target.attributes());
+  for (int i = targetAttributes.count() - 1; i >= 0; --i) {
+    const QString name(targetAttributes.item(i).nodeName());
+    if (!delta.hasAttribute(name)) {
+      target.removeAttribute(name);
+    }
+  }
+  const QDomNamedNodeMap attributes(delta.attributes());
+  for (int i = 0; i < attributes.count(); ++i) {
+    const QDomAttr attr(attributes.item(i).toAttr());
+    target.setAttribute(attr.name(), attr.value());
+  }
+
+  // The children are rearranged the way ProjectWriter would write them: project-wide
+  // settings in the order of the delta, and per-page entries in the order of their
+  // numeric ids, which is the order of pages, as a block in the same place as in
+  // the delta, or, failing that, in the target.
+  QHash<QString, QDomElement> targetEntries;
+  std::vector<QDomElement> targetOthers;
+  QString tagAfterTargetEntries;
+  for (QDomNode node(target.firstChild()); !node.isNull(); node = node.nextSibling()) {
+    if (!node.isElement()) {
+      continue;
+    }
+    const QDomElement child(node.toElement());
+    if (child.hasAttribute("id")) {
+      targetEntries.insert(idKey(child), child);
+    } else {
+      if (!targetEntries.isEmpty() && tagAfterTargetEntries.isNull()) {
+        tagAfterTargetEntries = child.tagName();
+      }
+      targetOthers.push_back(child);
+    }
+  }
+
+  std::vector<QDomElement> entries;
+  std::vector<QDomElement> others;
+  int entriesPos = -1;
+  for (QDomNode node(delta.firstChild()); !node.isNull(); node = node.nextSibling()) {
+    if (!node.isElement()) {
+      continue;
+    }
+    const QDomElement deltaChild(node.toElement());
+
+    if (deltaChild.hasAttribute("id")) {
+      if (entriesPos < 0) {
+        entriesPos = static_cast<int>(others.size());
+      }
+      targetEntries.remove(idKey(deltaChild));
+      if (keepRemovedEntries || !isRemovedEntry(deltaChild)) {
+        entries.push_back(doc.importNode(deltaChild, true).toElement());
+      }
+      continue;
+    }
+
+    const auto it = std::find_if(targetOthers.begin(), targetOthers.end(),
+                                 [&](const QDomElement& el) { return el.tagName() == deltaChild.tagName(); });
+    if ((it != targetOthers.end()) && isContainer(deltaChild) && isContainer(*it)) {
+      QDomElement targetChild(*it);
+      merge(targetChild, deltaChild, keepRemovedEntries);
+      others.push_back(targetChild);
+    } else {
+      others.push_back(doc.importNode(deltaChild, true).toElement());
+    }
+    if (it != targetOthers.end()) {
+      targetOthers.erase(it);
+    }
+  }
+
+  for (const QDomElement& el : targetEntries) {
+    entries.push_back(el);
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](const QDomElement& lhs, const QDomElement& rhs) {
+    return lhs.attribute("id").toInt() < rhs.attribute("id").toInt();
+  });
+
+  if (entriesPos < 0) {
+    const auto it = std::find_if(others.begin(), others.end(),
+                                 [&](const QDomElement& el) { return el.tagName() == tagAfterTargetEntries; });
+    entriesPos = static_cast<int>(it - others.begin());
+  }
+
+  // Project-wide settings are always written in full, so whatever
+  // is missing from the delta no longer exists.
+  while (target.hasChildNodes()) {
+    target.removeChild(target.firstChild());
+  }
+  for (int i = 0; i < entriesPos; ++i) {
+    target.appendChild(others[i]);
+  }
+  for (const QDomElement& el : entries) {
+    target.appendChild(el);
+  }
+  for (int i = entriesPos; i < static_cast<int>(others.size()); ++i) {
+    target.appendChild(others[i]);
+  }
+}  // ProjectJournal::merge
+
+QDomElement ProjectJournal::readDomElement(QXmlStreamReader& reader, QDomDocument& doc) {
+  QDomElement el(doc.createElement(reader.name().toString()));
+  for (const QXmlStreamAttribute& attr : reader.attributes()) {
+    el.setAttribute(attr.name().toString(), attr.value().toString());
+  }
+
+  while (!reader.atEnd()) {
+    switch (reader.readNext()) {
+      case QXmlStreamReader::StartElement:
+        el.appendChild(readDomElement(reader, doc));
+        break;
+      case QXmlStreamReader::Characters:
+        if (reader.isCDATA()) {
+          el.appendChild(doc.createCDATASection(reader.text().toString()));
+        } else if (!reader.isWhitespace()) {
+          el.appendChild(doc.createTextNode(reader.text().toString()));
+        }
+        break;
+      case QXmlStreamReader::EndElement:
+        return el;
+      default:
+        break;
+    }
+  }
+  return el;
+}
+
+QDomElement ProjectJournal::readDelta(const QString& projectFile, QDomDocument& doc) {
+  QFile file(filePath(projectFile));
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QDomElement();
+  }
+
+  QXmlStreamReader reader(&file);
+  if (!reader.readNextStartElement() || (reader.name() != "journal")
+      || (reader.attributes().value("base") != baseStamp(projectFile))) {
+    return QDomElement();
+  }
+
+  QDomElement delta;
+  while (reader.readNextStartElement()) {
+    if (reader.name() != "filters") {
+      reader.skipCurrentElement();
+      continue;
+    }
+    const QDomElement record(readDomElement(reader, doc));
+    if (reader.hasError()) {
+      // The last record may have been cut short.
+      break;
+    }
+    if (delta.isNull()) {
+      delta = record;
+    } else {
+      merge(delta, record, /* keepRemovedEntries= */ true);
+    }
+  }
+  return delta;
+}
+
+QString ProjectJournal::baseStamp(const QString& projectFile) {
+  const QFileInfo fileInfo(projectFile);
+  return QString("%1:%2").arg(fileInfo.size()).arg(fileInfo.lastModified().toMSecsSinceEpoch());
+}
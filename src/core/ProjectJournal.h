@@ -0,0 +1,95 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_PROJECTJOURNAL_H_
+#define SCANTAILOR_CORE_PROJECTJOURNAL_H_
+
+#include <QByteArray>
+#include <QString>
+
+class QDomDocument;
+class QDomElement;
+class QXmlStreamReader;
+
+/**
+ * \brief An append-only log of changes to filter settings, kept next to a project file.
+ *
+ * Each record is a \<filters\> element as written by ProjectWriter::writeFilterSettings()
+ * for just the pages that changed.  Project-wide settings of a filter are always written
+ * in full, so a record replaces those, while per-page settings (elements with an id
+ * attribute) are replaced one by one.  Pages that no longer have settings are written
+ * as entries with nothing but the id, which remove the entries they replace.
+ * The journal remembers the size and the modification time of the project file
+ * it was started against, and is ignored if the project file was changed
+ * by other means since then.
+ *
+ * Appending a record is cheap, and a record cut off by a crash is simply dropped.
+ * Sooner or later the journal is compacted, that is merged into the project file,
+ * which is replaced atomically.
+ */
+class ProjectJournal {
+ public:
+  static QString filePath(const QString& projectFile);
+
+  /**
+   * \brief Appends a record to the journal of the given project, creating it if necessary.
+   */
+  static bool append(const QString& projectFile, const QByteArray& record);
+
+  /**
+   * \brief Merges the journal into the project file and removes the journal.
+   *
+   * Does nothing and returns true if there is no journal.
+   */
+  static bool compact(const QString& projectFile);
+
+  /**
+   * \brief Merges the journal into a project document just read from \p projectFile.
+   *
+   * The journal itself is left in place.
+   */
+  static void applyTo(QDomDocument& projectDoc, const QString& projectFile);
+
+  static void remove(const QString& projectFile);
+
+  /**
+   * \brief Merges a delta element into a target element of the same tag.
+   *
+   * The children end up in the order ProjectWriter would write them in,
+   * so a compacted project file doesn't differ from a freshly written one.
+   *
+   * \param keepRemovedEntries Whether removed entries from the delta are to be kept
+   *        in the target, as needed when the target is itself a delta.
+   */
+  static void merge(QDomElement& target, const QDomElement& delta, bool keepRemovedEntries = false);
+
+  /**
+   * \brief Reads the element the reader is positioned at, including its children.
+   *
+   * Leaves the reader at the corresponding end element.
+   */
+  static QDomElement readDomElement(QXmlStreamReader& reader, QDomDocument& doc);
+
+  /**
+   * \return The delta of all the records in the journal merged together, or a null
+   *         element if there is no journal or it doesn't belong to the project file.
+   */
+  static QDomElement readDelta(const QString& projectFile, QDomDocument& doc);
+
+  /**
+   * \brief Merges the part of \p delta concerning a single filter into \p filtersEl.
+   *
+   * Lets the settings of filters be read from the project file one filter at a time.
+   *
+   * \param filtersEl A <filters> element holding at most the element of that filter.
+   * \param delta The result of readDelta(), which may be null.
+   * \param filterTagName The name of the element of the filter.
+   */
+  static void applyTo(QDomElement& filtersEl, const QDomElement& delta, const QString& filterTagName);
+
+ private:
+  static QString baseStamp(const QString& projectFile);
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_PROJECTJOURNAL_H_
@@ -4,71 +4,147 @@
 #include "ProjectReader.h"
 
 #include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QHash>
+#include <QXmlStreamReader>
 #include <boost/bind.hpp>
 
 #include "AbstractFilter.h"
 #include "FileNameDisambiguator.h"
+#include "ProjectJournal.h"
 #include "ProjectPages.h"
 #include "XmlUnmarshaller.h"
 #include "version.h"
 
-ProjectReader::ProjectReader(const QDomDocument& doc)
-    : m_doc(doc), m_disambiguator(std::make_shared<FileNameDisambiguator>()) {
-  QDomElement projectEl(m_doc.documentElement());
+ProjectReader::ProjectReader(const QString& projectFile)
+    : m_projectFile(projectFile), m_broken(false), m_disambiguator(std::make_shared<FileNameDisambiguator>()) {
+  QFile file(projectFile);
+  if (!file.open(QIODevice::ReadOnly)) {
+    m_broken = true;
+    return;
+  }
+
+  QXmlStreamReader reader(&file);
+  if (!reader.readNextStartElement()) {
+    m_broken = true;
+    return;
+  }
+  const QXmlStreamAttributes projectAttributes(reader.attributes());
+
+  // The settings of filters are skipped here and read by readFilterSettings().
+  QDomDocument doc;
+  QDomElement dirsEl;
+  QDomElement filesEl;
+  QDomElement imagesEl;
+  QDomElement pagesEl;
+  QDomElement disambigEl;
+  while (reader.readNextStartElement()) {
+    if (reader.name() == "directories") {
+      dirsEl = ProjectJournal::readDomElement(reader, doc);
+    } else if (reader.name() == "files") {
+      filesEl = ProjectJournal::readDomElement(reader, doc);
+    } else if (reader.name() == "images") {
+      imagesEl = ProjectJournal::readDomElement(reader, doc);
+    } else if (reader.name() == "pages") {
+      pagesEl = ProjectJournal::readDomElement(reader, doc);
+    } else if (reader.name() == "file-name-disambiguation") {
+      disambigEl = ProjectJournal::readDomElement(reader, doc);
+    } else {
+      reader.skipCurrentElement();
+    }
+  }
+  if (reader.hasError()) {
+    m_broken = true;
+    return;
+  }
 
-  m_version = projectEl.attribute("version");
+  m_version = projectAttributes.value("version").toString();
   if (m_version.isNull() || (m_version.toInt() != PROJECT_VERSION)) {
     return;
   }
 
-  m_outDir = projectEl.attribute("outputDirectory");
+  m_outDir = projectAttributes.value("outputDirectory").toString();
 
   Qt::LayoutDirection layoutDirection = Qt::LeftToRight;
-  if (projectEl.attribute("layoutDirection") == "RTL") {
+  if (projectAttributes.value("layoutDirection") == "RTL") {
     layoutDirection = Qt::RightToLeft;
   }
 
-  const QDomElement dirsEl(projectEl.namedItem("directories").toElement());
   if (dirsEl.isNull()) {
     return;
   }
   processDirectories(dirsEl);
 
-  const QDomElement filesEl(projectEl.namedItem("files").toElement());
   if (filesEl.isNull()) {
     return;
   }
   processFiles(filesEl);
 
-  const QDomElement imagesEl(projectEl.namedItem("images").toElement());
   if (imagesEl.isNull()) {
     return;
   }
   processImages(imagesEl, layoutDirection);
 
-  const QDomElement pagesEl(projectEl.namedItem("pages").toElement());
   if (pagesEl.isNull()) {
     return;
   }
   processPages(pagesEl);
   // Load naming disambiguator.  This needs to be done after processing pages.
-  const QDomElement disambigEl(projectEl.namedItem("file-name-disambiguation").toElement());
   m_disambiguator
       = std::make_shared<FileNameDisambiguator>(disambigEl, boost::bind(&ProjectReader::expandFilePath, this, _1));
-}
+}  // ProjectReader::ProjectReader
 
 ProjectReader::~ProjectReader() = default;
 
 void ProjectReader::readFilterSettings(const std::vector<FilterPtr>& filters) const {
-  QDomElement projectEl(m_doc.documentElement());
-  QDomElement filtersEl(projectEl.namedItem("filters").toElement());
+  // Changes autosaved since the project file was last written in full.
+  QDomDocument deltaDoc;
+  const QDomElement delta(ProjectJournal::readDelta(m_projectFile, deltaDoc));
 
-  auto it(filters.begin());
-  const auto end(filters.end());
-  for (; it != end; ++it) {
-    (*it)->loadSettings(*this, filtersEl);
+  QHash<QString, FilterPtr> pendingFilters;
+  for (const FilterPtr& filter : filters) {
+    pendingFilters.insert(filter->settingsTagName(), filter);
   }
-}
+
+  const auto loadFilterSettings = [&](QDomElement& filtersEl, const QString& tagName) {
+    ProjectJournal::applyTo(filtersEl, delta, tagName);
+    pendingFilters.take(tagName)->loadSettings(*this, filtersEl);
+  };
+
+  QFile file(m_projectFile);
+  if (file.open(QIODevice::ReadOnly)) {
+    QXmlStreamReader reader(&file);
+    if (reader.readNextStartElement()) {
+      while (reader.readNextStartElement()) {
+        if (reader.name() != "filters") {
+          reader.skipCurrentElement();
+          continue;
+        }
+        while (reader.readNextStartElement()) {
+          const QString tagName(reader.name().toString());
+          if (!pendingFilters.contains(tagName)) {
+            reader.skipCurrentElement();
+            continue;
+          }
+          // The DOM of one filter at a time.
+          QDomDocument doc;
+          QDomElement filtersEl(doc.createElement("filters"));
+          filtersEl.appendChild(ProjectJournal::readDomElement(reader, doc));
+          loadFilterSettings(filtersEl, tagName);
+        }
+      }
+    }
+  }
+
+  // Filters missing from the project file still get their settings reset
+  // and possibly taken from the journal.
+  while (!pendingFilters.isEmpty()) {
+    QDomDocument doc;
+    QDomElement filtersEl(doc.createElement("filters"));
+    loadFilterSettings(filtersEl, pendingFilters.begin().key());
+  }
+}  // ProjectReader::readFilterSettings
 
 void ProjectReader::processDirectories(const QDomElement& dirsEl) {
   const QString dirTagName("directory");
@@ -4,7 +4,6 @@
 #ifndef SCANTAILOR_CORE_PROJECTREADER_H_
 #define SCANTAILOR_CORE_PROJECTREADER_H_
 
-#include <QDomDocument>
 #include <QString>
 #include <Qt>
 #include <memory>
@@ -22,18 +21,37 @@ class ProjectPages;
 class FileNameDisambiguator;
 class AbstractFilter;
 
+/**
+ * \brief Reads a project file.
+ *
+ * The file is read with QXmlStreamReader.  Only the parts describing the pages
+ * and only the settings of one filter at a time are kept in memory as DOM,
+ * so that opening a large project doesn't take memory proportional to its size.
+ */
 class ProjectReader {
  public:
   using FilterPtr = std::shared_ptr<AbstractFilter>;
 
-  explicit ProjectReader(const QDomDocument& doc);
+  /**
+   * \brief Reads everything but the settings of filters.
+   */
+  explicit ProjectReader(const QString& projectFile);
 
   ~ProjectReader();
 
+  /**
+   * \brief Reads the settings of filters from the project file,
+   *        along with the changes autosaved in its journal.
+   */
   void readFilterSettings(const std::vector<FilterPtr>& filters) const;
 
   bool success() const { return (m_pages != nullptr); }
 
+  /**
+   * \return true if the project file couldn't be read or isn't well-formed XML.
+   */
+  bool isBroken() const { return m_broken; }
+
   const QString& outputDirectory() const { return m_outDir; }
 
   const QString& getVersion() const { return m_version; }
@@ -81,7 +99,8 @@ class ProjectReader {
 
   ImageInfo getImageInfo(int id) const;
 
-  QDomDocument m_doc;
+  QString m_projectFile;
+  bool m_broken;
   QString m_outDir;
   QString m_version;
   DirMap m_dirMap;
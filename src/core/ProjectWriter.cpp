@@ -3,12 +3,14 @@
 
 #include "ProjectWriter.h"
 
-#include <QFile>
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QFileInfo>
-#include <QTextStream>
+#include <QXmlStreamWriter>
 #include <QtXml>
 
 #include "AbstractFilter.h"
+#include "AtomicFileOverwriter.h"
 #include "FileNameDisambiguator.h"
 #include "ImageId.h"
 #include "ImageMetadata.h"
@@ -24,6 +26,7 @@
 
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 
@@ -33,7 +36,9 @@ ProjectWriter::ProjectWriter(const std::shared_ptr<ProjectPages>& pageSequence,
     : m_pageSequence(pageSequence->toPageSequence(PAGE_VIEW)),
       m_outFileNameGen(outFileNameGen),
       m_selectedPage(selectedPage),
-      m_layoutDirection(pageSequence->layoutDirection()) {
+      m_layoutDirection(pageSequence->layoutDirection()),
+      m_restrictedToImages(false),
+      m_writingRemovedEntries(false) {
   int nextId = 1;
   for (const PageInfo& page : m_pageSequence) {
     const PageId& pageId = page.id();
@@ -65,101 +70,191 @@ ProjectWriter::ProjectWriter(const std::shared_ptr<ProjectPages>& pageSequence,
 ProjectWriter::~ProjectWriter() = default;
 
 bool ProjectWriter::write(const QString& filePath, const std::vector<FilterPtr>& filters) const {
+  AtomicFileOverwriter overwriter;
+  QIODevice* device = overwriter.startWriting(filePath);
+  if (!device) {
+    return false;
+  }
+  if (!write(*device, filters)) {
+    overwriter.abort();
+    return false;
+  }
+  return overwriter.commit();
+}
+
+bool ProjectWriter::write(QIODevice& device, const std::vector<FilterPtr>& filters) const {
+  // Formatted the same way QDomDocument::save() with an indent of 2 used to do it.
+  QXmlStreamWriter xml(&device);
+  xml.setAutoFormatting(true);
+  xml.setAutoFormattingIndent(2);
+
+  writeSkeleton(xml, /* markSelectedPage= */ true);
+  writeFilters(xml, filters);
+
+  xml.writeEndDocument();
+  return !xml.hasError();
+}
+
+bool ProjectWriter::writeFilterSettings(QIODevice& device, const std::vector<FilterPtr>& filters) {
+  QXmlStreamWriter xml(&device);
+  xml.setAutoFormatting(true);
+  xml.setAutoFormattingIndent(2);
+
+  m_writingRemovedEntries = true;
+  writeFilters(xml, filters);
+  m_writingRemovedEntries = false;
+
+  xml.writeEndDocument();
+  return !xml.hasError();
+}
+
+void ProjectWriter::restrictToImages(const std::unordered_set<ImageId>& imageIds) {
+  m_imagesToWrite = imageIds;
+  m_restrictedToImages = true;
+}
+
+void ProjectWriter::writeRemovedEntry(QXmlStreamWriter& xml, const QString& tagName, const int numericId) const {
+  if (!m_writingRemovedEntries) {
+    return;
+  }
+  xml.writeStartElement(tagName);
+  xml.writeAttribute("id", QString::number(numericId));
+  xml.writeEndElement();
+}
+
+QByteArray ProjectWriter::structureDigest() const {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  {
+    QXmlStreamWriter xml(&buffer);
+    writeSkeleton(xml, /* markSelectedPage= */ false);
+    xml.writeEndDocument();
+  }
+  return QCryptographicHash::hash(buffer.data(), QCryptographicHash::Md5);
+}
+
+void ProjectWriter::writeSkeleton(QXmlStreamWriter& xml, const bool markSelectedPage) const {
+  xml.writeStartElement("project");
+  xml.writeAttribute("version", QString::number(PROJECT_VERSION));
+  xml.writeAttribute("outputDirectory", m_outFileNameGen.outDir());
+  xml.writeAttribute("layoutDirection", m_layoutDirection == Qt::LeftToRight ? "LTR" : "RTL");
+
+  writeDirectories(xml);
+  writeFiles(xml);
+  writeImages(xml);
+  writePages(xml, markSelectedPage);
+
   QDomDocument doc;
-  QDomElement rootEl(doc.createElement("project"));
-  doc.appendChild(rootEl);
-  rootEl.setAttribute("version", PROJECT_VERSION);
-  rootEl.setAttribute("outputDirectory", m_outFileNameGen.outDir());
-  rootEl.setAttribute("layoutDirection", m_layoutDirection == Qt::LeftToRight ? "LTR" : "RTL");
-
-  rootEl.appendChild(processDirectories(doc));
-  rootEl.appendChild(processFiles(doc));
-  rootEl.appendChild(processImages(doc));
-  rootEl.appendChild(processPages(doc));
-  rootEl.appendChild(m_outFileNameGen.disambiguator()->toXml(doc, "file-name-disambiguation",
-                                                             boost::bind(&ProjectWriter::packFilePath, this, _1)));
-
-  QDomElement filtersEl(doc.createElement("filters"));
-  rootEl.appendChild(filtersEl);
-  auto it(filters.begin());
-  const auto end(filters.end());
-  for (; it != end; ++it) {
-    filtersEl.appendChild((*it)->saveSettings(*this, doc));
-  }
-
-  QFile file(filePath);
-  if (file.open(QIODevice::WriteOnly)) {
-    QTextStream strm(&file);
-    doc.save(strm, 2);
-    return true;
-  }
-  return false;
-}  // ProjectWriter::write
-
-QDomElement ProjectWriter::processDirectories(QDomDocument& doc) const {
-  QDomElement dirsEl(doc.createElement("directories"));
+  writeDomElement(xml, m_outFileNameGen.disambiguator()->toXml(doc, "file-name-disambiguation",
+                                                               boost::bind(&ProjectWriter::packFilePath, this, _1)));
+}
+
+void ProjectWriter::writeFilters(QXmlStreamWriter& xml, const std::vector<FilterPtr>& filters) const {
+  xml.writeStartElement("filters");
+  for (const FilterPtr& filter : filters) {
+    filter->saveSettings(*this, xml);
+  }
+  xml.writeEndElement();
+}
+
+void ProjectWriter::writeDomElement(QXmlStreamWriter& xml, const QDomElement& el) {
+  xml.writeStartElement(el.tagName());
+
+  // QDom doesn't keep the order of attributes, so the same element may list them
+  // differently depending on how it was built, which is why they are sorted.
+  const QDomNamedNodeMap attributes(el.attributes());
+  const int numAttributes = attributes.count();
+  std::vector<QDomAttr> sortedAttributes;
+  sortedAttributes.reserve(numAttributes);
+  for (int i = 0; i < numAttributes; ++i) {
+    sortedAttributes.push_back(attributes.item(i).toAttr());
+  }
+  std::sort(sortedAttributes.begin(), sortedAttributes.end(),
+            [](const QDomAttr& lhs, const QDomAttr& rhs) { return lhs.name() < rhs.name(); });
+  for (const QDomAttr& attr : sortedAttributes) {
+    xml.writeAttribute(attr.name(), attr.value());
+  }
+
+  for (QDomNode node(el.firstChild()); !node.isNull(); node = node.nextSibling()) {
+    if (node.isElement()) {
+      writeDomElement(xml, node.toElement());
+    } else if (node.isCDATASection()) {
+      xml.writeCDATA(node.toCDATASection().data());
+    } else if (node.isText()) {
+      xml.writeCharacters(node.toText().data());
+    }
+  }
+
+  xml.writeEndElement();
+}
+
+void ProjectWriter::writeDirectories(QXmlStreamWriter& xml) const {
+  xml.writeStartElement("directories");
 
   for (const Directory& dir : m_dirs.get<Sequenced>()) {
-    QDomElement dirEl(doc.createElement("directory"));
-    dirEl.setAttribute("id", dir.numericId);
-    dirEl.setAttribute("path", dir.path);
-    dirsEl.appendChild(dirEl);
+    xml.writeStartElement("directory");
+    xml.writeAttribute("id", QString::number(dir.numericId));
+    xml.writeAttribute("path", dir.path);
+    xml.writeEndElement();
   }
-  return dirsEl;
+
+  xml.writeEndElement();
 }
 
-QDomElement ProjectWriter::processFiles(QDomDocument& doc) const {
-  QDomElement filesEl(doc.createElement("files"));
+void ProjectWriter::writeFiles(QXmlStreamWriter& xml) const {
+  xml.writeStartElement("files");
 
   for (const File& file : m_files.get<Sequenced>()) {
     const QFileInfo fileInfo(file.path);
     const QString& dirPath = fileInfo.absolutePath();
-    QDomElement fileEl(doc.createElement("file"));
-    fileEl.setAttribute("id", file.numericId);
-    fileEl.setAttribute("dirId", dirId(dirPath));
-    fileEl.setAttribute("name", fileInfo.fileName());
-    filesEl.appendChild(fileEl);
+    xml.writeStartElement("file");
+    xml.writeAttribute("id", QString::number(file.numericId));
+    xml.writeAttribute("dirId", QString::number(dirId(dirPath)));
+    xml.writeAttribute("name", fileInfo.fileName());
+    xml.writeEndElement();
   }
-  return filesEl;
+
+  xml.writeEndElement();
 }
 
-QDomElement ProjectWriter::processImages(QDomDocument& doc) const {
-  QDomElement imagesEl(doc.createElement("images"));
+void ProjectWriter::writeImages(QXmlStreamWriter& xml) const {
+  xml.writeStartElement("images");
 
   for (const Image& image : m_images.get<Sequenced>()) {
-    QDomElement imageEl(doc.createElement("image"));
-    imageEl.setAttribute("id", image.numericId);
-    imageEl.setAttribute("subPages", image.numSubPages);
-    imageEl.setAttribute("fileId", fileId(image.id.filePath()));
-    imageEl.setAttribute("fileImage", image.id.page());
+    xml.writeStartElement("image");
+    xml.writeAttribute("id", QString::number(image.numericId));
+    xml.writeAttribute("subPages", QString::number(image.numSubPages));
+    xml.writeAttribute("fileId", QString::number(fileId(image.id.filePath())));
+    xml.writeAttribute("fileImage", QString::number(image.id.page()));
     if (image.leftHalfRemoved != image.rightHalfRemoved) {
       // Both are not supposed to be removed.
-      imageEl.setAttribute("removed", image.leftHalfRemoved ? "L" : "R");
+      xml.writeAttribute("removed", image.leftHalfRemoved ? "L" : "R");
     }
-    writeImageMetadata(doc, imageEl, image.id);
-    imagesEl.appendChild(imageEl);
+    writeImageMetadata(xml, image.id);
+    xml.writeEndElement();
   }
-  return imagesEl;
+
+  xml.writeEndElement();
 }
 
-void ProjectWriter::writeImageMetadata(QDomDocument& doc, QDomElement& imageEl, const ImageId& imageId) const {
+void ProjectWriter::writeImageMetadata(QXmlStreamWriter& xml, const ImageId& imageId) const {
   auto it(m_metadataByImage.find(imageId));
   assert(it != m_metadataByImage.end());
   const ImageMetadata& metadata = it->second;
 
-  QDomElement sizeEl(doc.createElement("size"));
-  sizeEl.setAttribute("width", metadata.size().width());
-  sizeEl.setAttribute("height", metadata.size().height());
-  imageEl.appendChild(sizeEl);
+  xml.writeStartElement("size");
+  xml.writeAttribute("width", QString::number(metadata.size().width()));
+  xml.writeAttribute("height", QString::number(metadata.size().height()));
+  xml.writeEndElement();
 
-  QDomElement dpiEl(doc.createElement("dpi"));
-  dpiEl.setAttribute("horizontal", metadata.dpi().horizontal());
-  dpiEl.setAttribute("vertical", metadata.dpi().vertical());
-  imageEl.appendChild(dpiEl);
+  xml.writeStartElement("dpi");
+  xml.writeAttribute("horizontal", QString::number(metadata.dpi().horizontal()));
+  xml.writeAttribute("vertical", QString::number(metadata.dpi().vertical()));
+  xml.writeEndElement();
 }
 
-QDomElement ProjectWriter::processPages(QDomDocument& doc) const {
-  QDomElement pagesEl(doc.createElement("pages"));
+void ProjectWriter::writePages(QXmlStreamWriter& xml, const bool markSelectedPage) const {
+  xml.writeStartElement("pages");
 
   const PageId selOpt1(m_selectedPage.get(IMAGE_VIEW));
   const PageId selOpt2(m_selectedPage.get(PAGE_VIEW));
@@ -175,18 +270,20 @@ QDomElement ProjectWriter::processPages(QDomDocument& doc) const {
 
   for (const PageInfo& page : m_pageSequence) {
     const PageId& pageId = page.id();
-    QDomElement pageEl(doc.createElement("page"));
-    pageEl.setAttribute("id", this->pageId(pageId));
-    pageEl.setAttribute("imageId", imageId(pageId.imageId()));
-    pageEl.setAttribute("subPage", pageId.subPageAsString());
-    if ((pageId == selOpt1) || (pageId == selOpt2) || (pageId == pageLeft) || (pageId == pageRight)) {
-      pageEl.setAttribute("selected", "selected");
+    xml.writeStartElement("page");
+    xml.writeAttribute("id", QString::number(this->pageId(pageId)));
+    xml.writeAttribute("imageId", QString::number(imageId(pageId.imageId())));
+    xml.writeAttribute("subPage", pageId.subPageAsString());
+    if (markSelectedPage
+        && ((pageId == selOpt1) || (pageId == selOpt2) || (pageId == pageLeft) || (pageId == pageRight))) {
+      xml.writeAttribute("selected", "selected");
       pageLeft = pageRight = PageId();  // if one of these match other shouldn't
     }
-    pagesEl.appendChild(pageEl);
+    xml.writeEndElement();
   }
-  return pagesEl;
-}  // ProjectWriter::processPages
+
+  xml.writeEndElement();
+}  // ProjectWriter::writePages
 
 int ProjectWriter::dirId(const QString& dirPath) const {
   const Directories::const_iterator it(m_dirs.find(dirPath));
@@ -226,12 +323,18 @@ int ProjectWriter::pageId(const PageId& pageId) const {
 
 void ProjectWriter::enumImagesImpl(const VirtualFunction<void, const ImageId&, int>& out) const {
   for (const Image& image : m_images.get<Sequenced>()) {
+    if (m_restrictedToImages && (m_imagesToWrite.count(image.id) == 0)) {
+      continue;
+    }
     out(image.id, image.numericId);
   }
 }
 
 void ProjectWriter::enumPagesImpl(const VirtualFunction<void, const PageId&, int>& out) const {
   for (const Page& page : m_pages.get<Sequenced>()) {
+    if (m_restrictedToImages && (m_imagesToWrite.count(page.id.imageId()) == 0)) {
+      continue;
+    }
     out(page.id, page.numericId);
   }
 }
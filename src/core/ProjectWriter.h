@@ -6,6 +6,7 @@
 
 #include <foundation/Hashes.h>
 
+#include <QByteArray>
 #include <QString>
 #include <Qt>
 #include <boost/multi_index/hashed_index.hpp>
@@ -14,6 +15,7 @@
 #include <boost/multi_index_container.hpp>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "ImageId.h"
@@ -26,8 +28,9 @@
 class AbstractFilter;
 class ProjectPages;
 class PageInfo;
-class QDomDocument;
+class QIODevice;
 class QDomElement;
+class QXmlStreamWriter;
 
 class ProjectWriter {
   DECLARE_NON_COPYABLE(ProjectWriter)
@@ -43,6 +46,55 @@ class ProjectWriter {
 
   bool write(const QString& filePath, const std::vector<FilterPtr>& filters) const;
 
+  /**
+   * \brief Streams the project to \p device.
+   *
+   * Nothing but the bookkeeping of this object is kept in memory,
+   * as filters write their settings page by page.
+   */
+  bool write(QIODevice& device, const std::vector<FilterPtr>& filters) const;
+
+  /**
+   * \brief Writes just the \<filters\> element, as used by ProjectJournal.
+   *
+   * Unlike in a full project, the pages without settings are written
+   * as removed entries, see writeRemovedEntry().
+   */
+  bool writeFilterSettings(QIODevice& device, const std::vector<FilterPtr>& filters);
+
+  /**
+   * \brief Limits enumImages() and enumPages() to the given images and their pages.
+   *
+   * Filters then write per-page settings of those pages only, while
+   * their project-wide settings are still written in full.
+   */
+  void restrictToImages(const std::unordered_set<ImageId>& imageIds);
+
+  /**
+   * \brief To be called by filters for a page or an image they have no settings for.
+   *
+   * In a journal record, writes an element with just the id attribute, which tells
+   * ProjectJournal to drop the entry it may have from before.  Otherwise does nothing.
+   */
+  void writeRemovedEntry(QXmlStreamWriter& xml, const QString& tagName, int numericId) const;
+
+  /**
+   * \brief A hash of everything but the filter settings.
+   *
+   * Numeric ids that filter settings refer to stay the same as long
+   * as this hash does.  The selected page doesn't affect it.
+   */
+  QByteArray structureDigest() const;
+
+  /**
+   * \brief Writes a DOM element with all its descendants, the way QDomDocument::save() would.
+   *
+   * That's how pieces of settings that are built as DOM elements get into the stream.
+   * Unlike QDomDocument::save(), it writes attributes in the order of their names,
+   * so that an element read back from a project file is written the same way.
+   */
+  static void writeDomElement(QXmlStreamWriter& xml, const QDomElement& el);
+
   /**
    * \p out will be called like this: out(ImageId, numeric_image_id)
    */
@@ -117,15 +169,19 @@ class ProjectWriter {
           boost::multi_index::hashed_unique<boost::multi_index::member<Page, PageId, &Page::id>, std::hash<PageId>>,
           boost::multi_index::sequenced<boost::multi_index::tag<Sequenced>>>>;
 
-  QDomElement processDirectories(QDomDocument& doc) const;
+  void writeSkeleton(QXmlStreamWriter& xml, bool markSelectedPage) const;
+
+  void writeFilters(QXmlStreamWriter& xml, const std::vector<FilterPtr>& filters) const;
+
+  void writeDirectories(QXmlStreamWriter& xml) const;
 
-  QDomElement processFiles(QDomDocument& doc) const;
+  void writeFiles(QXmlStreamWriter& xml) const;
 
-  QDomElement processImages(QDomDocument& doc) const;
+  void writeImages(QXmlStreamWriter& xml) const;
 
-  QDomElement processPages(QDomDocument& doc) const;
+  void writePages(QXmlStreamWriter& xml, bool markSelectedPage) const;
 
-  void writeImageMetadata(QDomDocument& doc, QDomElement& imageEl, const ImageId& imageId) const;
+  void writeImageMetadata(QXmlStreamWriter& xml, const ImageId& imageId) const;
 
   int dirId(const QString& dirPath) const;
 
@@ -150,6 +206,9 @@ class ProjectWriter {
   Pages m_pages;
   MetadataByImage m_metadataByImage;
   Qt::LayoutDirection m_layoutDirection;
+  std::unordered_set<ImageId> m_imagesToWrite;
+  bool m_restrictedToImages;
+  bool m_writingRemovedEntries;
 };
 
 
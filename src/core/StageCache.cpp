@@ -0,0 +1,231 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "StageCache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <iterator>
+#include <list>
+
+#include "AtomicFileOverwriter.h"
+#include "ImageId.h"
+
+namespace {
+const quint32 FILE_MAGIC = 0x53544743;  // "STGC"
+const quint32 FILE_VERSION = 1;
+
+int bytesPerUsedLine(const QImage& image) {
+  return (image.width() * image.depth() + 7) / 8;
+}
+}  // namespace
+
+StageCache::Key::Key(const QString& stage) : m_stream(&m_data, QIODevice::WriteOnly) {
+  // Keep the keys the same regardless of the version of Qt.
+  m_stream.setVersion(QDataStream::Qt_5_6);
+  m_stream << stage;
+}
+
+StageCache::Key& StageCache::Key::addSource(const ImageId& imageId) {
+  const QFileInfo fileInfo(imageId.filePath());
+  m_stream << fileInfo.absoluteFilePath() << qint32(imageId.page()) << fileInfo.size()
+           << fileInfo.lastModified().toMSecsSinceEpoch();
+  return *this;
+}
+
+QString StageCache::Key::toFileName() const {
+  return QString::fromLatin1(QCryptographicHash::hash(m_data, QCryptographicHash::Sha1).toHex());
+}
+
+/**
+ * Tracks the entries of a cache directory, most recently used first.
+ */
+class StageCache::Index {
+  DECLARE_NON_COPYABLE(Index)
+
+ public:
+  static std::shared_ptr<Index> forDirectory(const QString& cacheDir);
+
+  explicit Index(const QString& cacheDir);
+
+  void touch(const QString& fileName);
+
+  void remove(const QString& fileName);
+
+  /**
+   * Records a newly stored entry and removes the least recently used
+   * ones until the total size fits \p maxSize.
+   */
+  void add(const QString& fileName, qint64 size, qint64 maxSize);
+
+ private:
+  struct Entry {
+    QString fileName;
+    qint64 size;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  void removeLocked(EntryList::iterator it);
+
+  QMutex m_mutex;
+  QDir m_dir;
+  EntryList m_entries;
+  QHash<QString, EntryList::iterator> m_entriesByName;
+  qint64 m_totalSize;
+};
+
+std::shared_ptr<StageCache::Index> StageCache::Index::forDirectory(const QString& cacheDir) {
+  // Indexes are kept for the lifetime of the process, so that
+  // the directory doesn't have to be scanned again.
+  static QMutex indexesMutex;
+  static QHash<QString, std::shared_ptr<Index>> indexes;
+
+  const QString dirPath(QDir(cacheDir).absolutePath());
+  const QMutexLocker locker(&indexesMutex);
+  std::shared_ptr<Index>& index = indexes[dirPath];
+  if (!index) {
+    index = std::make_shared<Index>(dirPath);
+  }
+  return index;
+}
+
+StageCache::Index::Index(const QString& cacheDir) : m_dir(cacheDir), m_totalSize(0) {
+  // Newest first.
+  const QFileInfoList entries(m_dir.entryInfoList(QDir::Files, QDir::Time));
+  for (const QFileInfo& entry : entries) {
+    m_entries.push_back(Entry{entry.fileName(), entry.size()});
+    m_entriesByName.insert(entry.fileName(), std::prev(m_entries.end()));
+    m_totalSize += entry.size();
+  }
+}
+
+void StageCache::Index::touch(const QString& fileName) {
+  const QMutexLocker locker(&m_mutex);
+  const auto it = m_entriesByName.find(fileName);
+  if (it != m_entriesByName.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, it.value());
+  }
+}
+
+void StageCache::Index::remove(const QString& fileName) {
+  const QMutexLocker locker(&m_mutex);
+  const auto it = m_entriesByName.find(fileName);
+  if (it != m_entriesByName.end()) {
+    removeLocked(it.value());
+  }
+}
+
+void StageCache::Index::add(const QString& fileName, const qint64 size, const qint64 maxSize) {
+  const QMutexLocker locker(&m_mutex);
+  const auto it = m_entriesByName.find(fileName);
+  if (it != m_entriesByName.end()) {
+    removeLocked(it.value());
+  }
+  m_entries.push_front(Entry{fileName, size});
+  m_entriesByName.insert(fileName, m_entries.begin());
+  m_totalSize += size;
+
+  while ((m_totalSize > maxSize) && !m_entries.empty()) {
+    const auto last = std::prev(m_entries.end());
+    QFile::remove(m_dir.absoluteFilePath(last->fileName));
+    removeLocked(last);
+  }
+}
+
+void StageCache::Index::removeLocked(const EntryList::iterator it) {
+  m_totalSize -= it->size;
+  m_entriesByName.remove(it->fileName);
+  m_entries.erase(it);
+}
+
+/*================================== StageCache ==================================*/
+
+StageCache::StageCache(const QString& cacheDir, const qint64 maxSize)
+    : m_cacheDir(cacheDir), m_maxSize(maxSize), m_index(Index::forDirectory(cacheDir)) {}
+
+bool StageCache::load(const Key& key, QImage& image) const {
+  const QString fileName(key.toFileName());
+  QFile file(QDir(m_cacheDir).absoluteFilePath(fileName));
+  if (!file.open(QIODevice::ReadOnly)) {
+    m_index->remove(fileName);
+    return false;
+  }
+
+  QDataStream strm(&file);
+  quint32 magic = 0;
+  quint32 version = 0;
+  qint32 width = 0;
+  qint32 height = 0;
+  qint32 format = 0;
+  qint32 dpmX = 0;
+  qint32 dpmY = 0;
+  QVector<QRgb> colorTable;
+  strm >> magic >> version >> width >> height >> format >> dpmX >> dpmY >> colorTable;
+  if ((strm.status() != QDataStream::Ok) || (magic != FILE_MAGIC) || (version != FILE_VERSION) || (width <= 0)
+      || (height <= 0) || (format <= QImage::Format_Invalid) || (format >= QImage::NImageFormats)) {
+    return false;
+  }
+
+  QImage loaded(width, height, static_cast<QImage::Format>(format));
+  if (loaded.isNull()) {
+    return false;
+  }
+  loaded.setColorTable(colorTable);
+  loaded.setDotsPerMeterX(dpmX);
+  loaded.setDotsPerMeterY(dpmY);
+
+  const int lineBytes = bytesPerUsedLine(loaded);
+  for (int y = 0; y < height; ++y) {
+    if (strm.readRawData(reinterpret_cast<char*>(loaded.scanLine(y)), lineBytes) != lineBytes) {
+      return false;
+    }
+  }
+
+  image = loaded;
+  m_index->touch(fileName);
+  return true;
+}  // StageCache::load
+
+void StageCache::store(const Key& key, const QImage& image) const {
+  if (image.isNull()) {
+    return;
+  }
+  if (!QDir().mkpath(m_cacheDir)) {
+    return;
+  }
+
+  const QString fileName(key.toFileName());
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(QDir(m_cacheDir).absoluteFilePath(fileName));
+  if (!device) {
+    return;
+  }
+
+  QDataStream strm(device);
+  strm << FILE_MAGIC << FILE_VERSION << qint32(image.width()) << qint32(image.height()) << qint32(image.format())
+       << qint32(image.dotsPerMeterX()) << qint32(image.dotsPerMeterY()) << image.colorTable();
+
+  const int lineBytes = bytesPerUsedLine(image);
+  for (int y = 0; y < image.height(); ++y) {
+    if (strm.writeRawData(reinterpret_cast<const char*>(image.scanLine(y)), lineBytes) != lineBytes) {
+      overwriter.abort();
+      return;
+    }
+  }
+
+  const qint64 size = device->size();
+  if ((strm.status() != QDataStream::Ok) || !overwriter.commit()) {
+    return;
+  }
+
+  m_index->add(fileName, size, m_maxSize);
+}  // StageCache::store
@@ -0,0 +1,101 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_STAGECACHE_H_
+#define SCANTAILOR_CORE_STAGECACHE_H_
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QString>
+#include <memory>
+
+#include "NonCopyable.h"
+
+class ImageId;
+class QImage;
+
+/**
+ * \brief An on-disk cache for images produced by processing stages.
+ *
+ * Images are stored uncompressed under names derived from a hash of
+ * everything they depend on, so an entry is never invalidated, it just
+ * stops being looked up.  When the total size of the cache exceeds
+ * the limit, the least recently used entries are removed.
+ *
+ * The directory is scanned only once per process.  After that, the sizes
+ * and the order of use of the entries are tracked in memory, shared by all
+ * the StageCache objects working with the same directory.
+ *
+ * The cache may be used from several threads at once.
+ */
+class StageCache {
+  DECLARE_NON_COPYABLE(StageCache)
+
+ public:
+  /**
+   * \brief Collects everything a cached image depends on.
+   *
+   * Anything QDataStream can serialize may be added to a key.
+   */
+  class Key {
+    DECLARE_NON_COPYABLE(Key)
+
+   public:
+    /**
+     * \param stage Identifies the stage and the kind of image it produces.
+     *        Should be changed whenever the way the image is produced changes.
+     */
+    explicit Key(const QString& stage);
+
+    /**
+     * \brief Adds the identity of a source image.
+     *
+     * Besides the path, the size and modification time of the file are
+     * taken into account, so that replacing the file invalidates the entry.
+     */
+    Key& addSource(const ImageId& imageId);
+
+    template <typename T>
+    Key& operator<<(const T& value) {
+      m_stream << value;
+      return *this;
+    }
+
+    QString toFileName() const;
+
+   private:
+    QByteArray m_data;
+    QDataStream m_stream;
+  };
+
+  /**
+   * \param cacheDir The directory to store images in.  It's created
+   *        once the first image is stored.
+   * \param maxSize The limit on the total size of cached images, in bytes.
+   */
+  StageCache(const QString& cacheDir, qint64 maxSize);
+
+  /**
+   * \brief Loads the image stored for \p key.
+   *
+   * \return true on success.  On failure, \p image is left untouched.
+   */
+  bool load(const Key& key, QImage& image) const;
+
+  /**
+   * \brief Stores \p image for \p key, replacing any existing entry.
+   *
+   * Failures are silently ignored, as the cache is not essential.
+   */
+  void store(const Key& key, const QImage& image) const;
+
+ private:
+  class Index;
+
+  QString m_cacheDir;
+  qint64 m_maxSize;
+  std::shared_ptr<Index> m_index;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_STAGECACHE_H_
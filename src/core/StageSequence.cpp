@@ -3,6 +3,7 @@
 
 #include "StageSequence.h"
 
+#include "MemoryBudget.h"
 #include "ProjectPages.h"
 
 StageSequence::StageSequence(const std::shared_ptr<ProjectPages>& pages,
@@ -48,3 +49,10 @@ int StageSequence::findFilter(const FilterPtr& filter) const {
   }
   return -1;
 }
+
+qint64 StageSequence::estimateMemoryUsage(const PageInfo& pageInfo, const int lastFilterIdx) const {
+  if (lastFilterIdx >= m_outputFilterIdx) {
+    return m_outputFilter->estimateMemoryUsage(pageInfo);
+  }
+  return MemoryBudget::estimateForImage(pageInfo.metadata());
+}
@@ -41,6 +41,12 @@ class StageSequence {
 
   int findFilter(const FilterPtr& filter) const;
 
+  /**
+   * \brief Estimates the peak memory usage of running the stages
+   *        up to and including \p lastFilterIdx on a page, in bytes.
+   */
+  qint64 estimateMemoryUsage(const PageInfo& pageInfo, int lastFilterIdx) const;
+
   const std::shared_ptr<fix_orientation::Filter>& fixOrientationFilter() const { return m_fixOrientationFilter; }
 
   const std::shared_ptr<page_split::Filter>& pageSplitFilter() const { return m_pageSplitFilter; }
@@ -26,6 +26,8 @@ class ThumbnailFactory {
 
   std::unique_ptr<QGraphicsItem> get(const PageInfo& pageInfo);
 
+  const std::shared_ptr<ThumbnailPixmapCache>& pixmapCache() const { return m_pixmapCache; }
+
  private:
   class Collector;
 
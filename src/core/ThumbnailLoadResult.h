@@ -20,19 +20,17 @@ class ThumbnailLoadResult {
     LOAD_FAILED,
 
     /**
-     * \brief Request has expired.  Pixmap is null.
+     * \brief Request has been cancelled.  Pixmap is null.
      *
-     * Consider the following situation: we scroll our thumbnail
-     * list from the beginning all the way to the end.  This will
-     * result in every thumbnail being requested.  If we just
-     * load them in request order, that would be quite slow and
-     * inefficient.  It would be nice if we could cancel the load
-     * requests for items that went out of view.  Unfortunately,
-     * QGraphicsView doesn't provide "went out of view"
-     * notifications.  Instead, we load thumbnails starting from
-     * most recently requested, and expire requests after a certain
-     * number of newer requests are processed.  If the client is
-     * still interested in the thumbnail, it may request it again.
+     * Loading thumbnails in request order would make scrolling through
+     * a long list slow, as thumbnails that went out of view would still
+     * be loaded.  QGraphicsView doesn't notify items going out of view,
+     * so the view reports what's visible to ThumbnailPixmapCache, which
+     * cancels queued requests for everything else.  Changing the thumbnail
+     * directory cancels all the queued requests.  If the client is still
+     * interested in the thumbnail, it may request it again.
+     *
+     * \see ThumbnailPixmapCache::setVisibleRange()
      */
     REQUEST_EXPIRED
   };
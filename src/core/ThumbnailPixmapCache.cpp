@@ -12,22 +12,32 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QThread>
+#include <QWaitCondition>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
+#include <memory>
+#include <unordered_set>
 
-#include "AtomicFileOverwriter.h"
+#include "DecodedImageCache.h"
 #include "ImageId.h"
 #include "ImageLoader.h"
 #include "OutOfMemoryHandler.h"
 #include "RelinkablePath.h"
+#include "ThumbnailStore.h"
 
 using namespace ::boost;
 using namespace ::boost::multi_index;
 using namespace imageproc;
 
+namespace {
+// Thumbnails are loaded by at most this many threads at once.
+const int MAX_LOADER_THREADS = 4;
+}  // namespace
+
 class ThumbnailPixmapCache::Item {
  public:
   enum Status {
@@ -64,17 +74,9 @@ class ThumbnailPixmapCache::Item {
 
   mutable std::vector<std::weak_ptr<CompletionHandler>> completionHandlers;
 
-  /**
-   * The total image loading attempts (of any images) by
-   * ThumbnailPixmapCache at the time of the creation of this item.
-   * This information is used for request expiration.
-   * \see ThumbnailLoadResult::REQUEST_EXPIRED
-   */
-  int precedingLoadAttempts;
-
   mutable Status status;
 
-  Item(const ImageId& imageId, int precedingLoadAttempts, Status st);
+  Item(const ImageId& imageId, Status st);
 
   Item(const Item& other);
 
@@ -83,9 +85,9 @@ class ThumbnailPixmapCache::Item {
 };
 
 
-class ThumbnailPixmapCache::Impl : public QThread {
+class ThumbnailPixmapCache::Impl : public QObject {
  public:
-  Impl(const QString& thumbDir, const QSize& maxThumbSize, int maxCachedPixmaps, int expirationThreshold);
+  Impl(const QString& thumbDir, const QSize& maxThumbSize, int maxCachedPixmaps);
 
   ~Impl() override;
 
@@ -100,13 +102,13 @@ class ThumbnailPixmapCache::Impl : public QThread {
                  bool loadNow = false,
                  const std::weak_ptr<CompletionHandler>* completionHandler = nullptr);
 
+  void setVisibleRange(const std::vector<ImageId>& visible, const std::vector<ImageId>& upcoming);
+
   void ensureThumbnailExists(const ImageId& imageId, const QImage& image);
 
   void recreateThumbnail(const ImageId& imageId, const QImage& image);
 
  protected:
-  void run() override;
-
   void customEvent(QEvent* e) override;
 
  private:
@@ -125,12 +127,12 @@ class ThumbnailPixmapCache::Impl : public QThread {
   using LoadQueue = Container::index<LoadQueueTag>::type;
   using RemoveQueue = Container::index<RemoveQueueTag>::type;
 
-  class BackgroundLoader : public QObject {
+  class LoaderThread : public QThread {
    public:
-    explicit BackgroundLoader(Impl& owner);
+    explicit LoaderThread(Impl& owner);
 
    protected:
-    void customEvent(QEvent* e) override;
+    void run() override;
 
    private:
     Impl& m_owner;
@@ -139,9 +141,20 @@ class ThumbnailPixmapCache::Impl : public QThread {
 
   void backgroundProcessing();
 
-  static QImage loadSaveThumbnail(const ImageId& imageId, const QString& thumbDir, const QSize& maxThumbSize);
+  /**
+   * \brief Creates a QUEUED item at the beginning of the load queue
+   *        and wakes up the loader threads.
+   */
+  LoadQueue::iterator enqueueLocked(const ImageId& imageId);
+
+  /**
+   * \brief Cancels QUEUED items, except for the ones in \p keep.
+   */
+  void expireQueuedItemsLocked(const std::unordered_set<ImageId>& keep);
+
+  static QImage loadSaveThumbnail(const ImageId& imageId, ThumbnailStore& store, const QSize& maxThumbSize);
 
-  static QString getThumbFilePath(const ImageId& imageId, const QString& thumbDir, const QSize& maxThumbSize);
+  static QString getThumbKey(const ImageId& imageId, const QSize& maxThumbSize);
 
   static QImage makeThumbnail(const QImage& image, const QSize& maxThumbSize);
 
@@ -162,7 +175,8 @@ class ThumbnailPixmapCache::Impl : public QThread {
   void cachePixmapLocked(const ImageId& imageId, const QPixmap& pixmap);
 
   mutable QMutex m_mutex;
-  BackgroundLoader m_backgroundLoader;
+  QWaitCondition m_itemsQueued;
+  std::vector<std::unique_ptr<LoaderThread>> m_loaderThreads;
   Container m_items;
   ItemsByKey& m_itemsByKey; /**< ImageId => Item mapping */
 
@@ -170,8 +184,9 @@ class ThumbnailPixmapCache::Impl : public QThread {
    * An "std::list"-like view of QUEUED items in the order they are
    * going to be loaded.  Actually the list contains all kinds of items,
    * but all QUEUED ones precede any others.  New QUEUED items are added
-   * to the front of this list for purposes of request expiration.
-   * \see ThumbnailLoadResult::REQUEST_EXPIRED
+   * to the front of this list, as the most recently requested thumbnails
+   * are the most likely to be on screen.
+   * \see setVisibleRange()
    */
   LoadQueue& m_loadQueue;
 
@@ -191,24 +206,11 @@ class ThumbnailPixmapCache::Impl : public QThread {
   RemoveQueue::iterator m_endOfLoadedItems;
 
   QString m_thumbDir;
+  std::shared_ptr<ThumbnailStore> m_store;
   QSize m_maxThumbSize;
   int m_maxCachedPixmaps;
-
-  /**
-   * \see ThumbnailPixmapCache::ThumbnailPixmapCache()
-   */
-  int m_expirationThreshold;
-
   int m_numQueuedItems;
   int m_numLoadedItems;
-
-  /**
-   * Total image loading attempts so far.  Used for request expiration.
-   * \see ThumbnailLoadResult::REQUEST_EXPIRED
-   */
-  int m_totalLoadAttempts;
-
-  bool m_threadStarted;
   bool m_shuttingDown;
 };
 
@@ -238,12 +240,8 @@ class ThumbnailPixmapCache::Impl::LoadResultEvent : public QEvent {
 
 ThumbnailPixmapCache::ThumbnailPixmapCache(const QString& thumbDir,
                                            const QSize& maxThumbSize,
-                                           const int maxCachedPixmaps,
-                                           const int expirationThreshold)
-    : m_impl(std::make_unique<Impl>(RelinkablePath::normalize(thumbDir),
-                                    maxThumbSize,
-                                    maxCachedPixmaps,
-                                    expirationThreshold)) {}
+                                           const int maxCachedPixmaps)
+    : m_impl(std::make_unique<Impl>(RelinkablePath::normalize(thumbDir), maxThumbSize, maxCachedPixmaps)) {}
 
 ThumbnailPixmapCache::~ThumbnailPixmapCache() = default;
 
@@ -266,6 +264,10 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::loadRequest(
   return m_impl->request(imageId, pixmap, false, &completionHandler);
 }
 
+void ThumbnailPixmapCache::setVisibleRange(const std::vector<ImageId>& visible, const std::vector<ImageId>& upcoming) {
+  m_impl->setVisibleRange(visible, upcoming);
+}
+
 void ThumbnailPixmapCache::ensureThumbnailExists(const ImageId& imageId, const QImage& image) {
   m_impl->ensureThumbnailExists(imageId, image);
 }
@@ -286,10 +288,8 @@ const QSize& ThumbnailPixmapCache::getMaxThumbSize() const {
 
 ThumbnailPixmapCache::Impl::Impl(const QString& thumbDir,
                                  const QSize& maxThumbSize,
-                                 const int maxCachedPixmaps,
-                                 const int expirationThreshold)
-    : m_backgroundLoader(*this),
-      m_items(),
+                                 const int maxCachedPixmaps)
+    : m_items(),
       m_itemsByKey(m_items.get<ItemsByKeyTag>()),
       m_loadQueue(m_items.get<LoadQueueTag>()),
       m_removeQueue(m_items.get<RemoveQueueTag>()),
@@ -297,34 +297,27 @@ ThumbnailPixmapCache::Impl::Impl(const QString& thumbDir,
       m_thumbDir(thumbDir),
       m_maxThumbSize(maxThumbSize),
       m_maxCachedPixmaps(maxCachedPixmaps),
-      m_expirationThreshold(expirationThreshold),
       m_numQueuedItems(0),
       m_numLoadedItems(0),
-      m_totalLoadAttempts(0),
-      m_threadStarted(false),
       m_shuttingDown(false) {
   // Note that QDir::mkdir() will fail if the parent directory,
   // that is $OUT/cache doesn't exist. We want that behaviour,
   // as otherwise when loading a project from a different machine,
   // a whole bunch of bogus directories would be created.
   QDir().mkdir(m_thumbDir);
-
-  m_backgroundLoader.moveToThread(this);
+  m_store = ThumbnailStore::forDirectory(m_thumbDir);
 }
 
 ThumbnailPixmapCache::Impl::~Impl() {
   {
     const QMutexLocker locker(&m_mutex);
-
-    if (!m_threadStarted) {
-      return;
-    }
-
     m_shuttingDown = true;
   }
 
-  quit();
-  wait();
+  m_itemsQueued.wakeAll();
+  for (const std::unique_ptr<LoaderThread>& thread : m_loaderThreads) {
+    thread->wait();
+  }
 }
 
 void ThumbnailPixmapCache::Impl::setThumbDir(const QString& thumbDir) {
@@ -335,11 +328,10 @@ void ThumbnailPixmapCache::Impl::setThumbDir(const QString& thumbDir) {
   }
 
   m_thumbDir = thumbDir;
+  m_store = ThumbnailStore::forDirectory(m_thumbDir);
 
-  for (const Item& item : m_loadQueue) {
-    // This trick will make all queued tasks to expire.
-    m_totalLoadAttempts = std::max(m_totalLoadAttempts, item.precedingLoadAttempts + m_expirationThreshold + 1);
-  }
+  // The queued thumbnails would go to the old directory.
+  expireQueuedItemsLocked({});
 }
 
 ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
@@ -371,12 +363,12 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
   }
 
   if (loadNow) {
-    const QString thumbDir(m_thumbDir);
+    const std::shared_ptr<ThumbnailStore> store(m_store);
     const QSize maxThumbSize(m_maxThumbSize);
 
     locker.unlock();
 
-    pixmap = QPixmap::fromImage(loadSaveThumbnail(imageId, thumbDir, maxThumbSize));
+    pixmap = QPixmap::fromImage(loadSaveThumbnail(imageId, *store, maxThumbSize));
     if (pixmap.isNull()) {
       return LOAD_FAILED;
     }
@@ -405,8 +397,41 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
     return QUEUED;
   }
 
-  // Create a new item.
-  const LoadQueue::iterator lqIt(m_loadQueue.push_front(Item(imageId, m_totalLoadAttempts, Item::QUEUED)).first);
+  const LoadQueue::iterator lqIt(enqueueLocked(imageId));
+  lqIt->completionHandlers.push_back(*completionHandler);
+  return QUEUED;
+}  // ThumbnailPixmapCache::Impl::request
+
+void ThumbnailPixmapCache::Impl::setVisibleRange(const std::vector<ImageId>& visible,
+                                                 const std::vector<ImageId>& upcoming) {
+  assert(QCoreApplication::instance()->thread() == QThread::currentThread());
+
+  const QMutexLocker locker(&m_mutex);
+
+  if (m_shuttingDown) {
+    return;
+  }
+
+  std::unordered_set<ImageId> wanted(visible.begin(), visible.end());
+  wanted.insert(upcoming.begin(), upcoming.end());
+  expireQueuedItemsLocked(wanted);
+
+  // Move the wanted items to the beginning of the load queue,
+  // so that the visible ones come first, in the given order.
+  const auto moveToFront = [this](const ImageId& imageId) {
+    const ItemsByKey::iterator kIt(m_itemsByKey.find(imageId));
+    if (kIt == m_itemsByKey.end()) {
+      enqueueLocked(imageId);
+    } else if (kIt->status == Item::QUEUED) {
+      m_loadQueue.relocate(m_loadQueue.begin(), m_items.project<LoadQueueTag>(kIt));
+    }
+  };
+  std::for_each(upcoming.rbegin(), upcoming.rend(), moveToFront);
+  std::for_each(visible.rbegin(), visible.rend(), moveToFront);
+}
+
+ThumbnailPixmapCache::Impl::LoadQueue::iterator ThumbnailPixmapCache::Impl::enqueueLocked(const ImageId& imageId) {
+  const LoadQueue::iterator lqIt(m_loadQueue.push_front(Item(imageId, Item::QUEUED)).first);
   // Now our new item is at the beginning of the load queue and at the
   // end of the remove queue.
 
@@ -416,20 +441,34 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
   if (m_endOfLoadedItems == m_removeQueue.end()) {
     m_endOfLoadedItems = m_items.project<RemoveQueueTag>(lqIt);
   }
-  lqIt->completionHandlers.push_back(*completionHandler);
+  ++m_numQueuedItems;
 
-  if (m_numQueuedItems++ == 0) {
-    if (m_threadStarted) {
-      // Wake the background thread up.
-      QCoreApplication::postEvent(&m_backgroundLoader, new QEvent(QEvent::User));
-    } else {
-      // Start the background thread.
-      start();
-      m_threadStarted = true;
+  if (m_loaderThreads.empty()) {
+    const int numThreads = qBound(1, QThread::idealThreadCount(), MAX_LOADER_THREADS);
+    for (int i = 0; i < numThreads; ++i) {
+      m_loaderThreads.push_back(std::make_unique<LoaderThread>(*this));
+      m_loaderThreads.back()->start();
     }
   }
-  return QUEUED;
-}  // ThumbnailPixmapCache::Impl::request
+  m_itemsQueued.wakeOne();
+  return lqIt;
+}
+
+void ThumbnailPixmapCache::Impl::expireQueuedItemsLocked(const std::unordered_set<ImageId>& keep) {
+  std::vector<LoadQueue::iterator> expired;
+  for (auto it = m_loadQueue.begin(); (it != m_loadQueue.end()) && (it->status == Item::QUEUED); ++it) {
+    if (keep.find(it->imageId) == keep.end()) {
+      expired.push_back(it);
+    }
+  }
+
+  for (const LoadQueue::iterator& lqIt : expired) {
+    // Marking the item as IN_PROGRESS keeps the loader threads
+    // away from it until the GUI thread removes it.
+    queuedToInProgress(lqIt);
+    postLoadResult(lqIt, QImage(), ThumbnailLoadResult::REQUEST_EXPIRED);
+  }
+}
 
 void ThumbnailPixmapCache::Impl::ensureThumbnailExists(const ImageId& imageId, const QImage& image) {
   if (m_shuttingDown) {
@@ -441,22 +480,16 @@ void ThumbnailPixmapCache::Impl::ensureThumbnailExists(const ImageId& imageId, c
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumbDir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize maxThumbSize(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, m_maxThumbSize));
-  if (QFile::exists(thumbFilePath)) {
+  const QString thumbKey(getThumbKey(imageId, maxThumbSize));
+  if (store->contains(thumbKey)) {
     return;
   }
 
-  const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumbFilePath);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    overwriter.commit();
-  }
+  store->store(thumbKey, makeThumbnail(image, maxThumbSize));
 }
 
 void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& imageId, const QImage& image) {
@@ -469,24 +502,12 @@ void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& imageId, const
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumbDir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize maxThumbSize(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, m_maxThumbSize));
-  const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-  bool thumbWritten = false;
-
   // Note that we may be called from multiple threads at the same time.
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumbFilePath);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    thumbWritten = overwriter.commit();
-  } else {
-    overwriter.abort();
-  }
-
-  if (!thumbWritten) {
+  if (!store->store(getThumbKey(imageId, maxThumbSize), makeThumbnail(image, maxThumbSize))) {
     return;
   }
 
@@ -515,11 +536,6 @@ void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& imageId, const
   }
 }  // ThumbnailPixmapCache::Impl::recreateThumbnail
 
-void ThumbnailPixmapCache::Impl::run() {
-  backgroundProcessing();
-  exec();  // Wait for further processing requests (via custom events).
-}
-
 void ThumbnailPixmapCache::Impl::customEvent(QEvent* e) {
   processLoadResult(dynamic_cast<LoadResultEvent*>(e));
 }
@@ -533,50 +549,34 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
       // We are going to initialize these while holding the mutex.
       LoadQueue::iterator lqIt;
       ImageId imageId;
-      QString thumbDir;
+      std::shared_ptr<ThumbnailStore> store;
       QSize maxThumbSize;
 
       {
         const QMutexLocker locker(&m_mutex);
 
-        if (m_shuttingDown || m_items.empty()) {
+        while (!m_shuttingDown && (m_numQueuedItems == 0)) {
+          m_itemsQueued.wait(&m_mutex);
+        }
+        if (m_shuttingDown) {
           break;
         }
 
+        // All QUEUED items precede any other items in the load queue.
         lqIt = m_loadQueue.begin();
+        assert(lqIt->status == Item::QUEUED);
         imageId = lqIt->imageId;
 
-        if (lqIt->status != Item::QUEUED) {
-          // All QUEUED items precede any other items
-          // in the load queue, so it means there are no
-          // QUEUED items at all.
-          assert(m_numQueuedItems == 0);
-          break;
-        }
-
         // By marking the item as IN_PROGRESS, we prevent it
-        // from being processed again before the GUI thread
-        // receives our LoadResultEvent.
+        // from being processed again, by this or another thread,
+        // before the GUI thread receives our LoadResultEvent.
         queuedToInProgress(lqIt);
 
-        if (m_totalLoadAttempts - lqIt->precedingLoadAttempts > m_expirationThreshold) {
-          // Expire this request.  The reasoning behind
-          // request expiration is described in
-          // ThumbnailLoadResult::REQUEST_EXPIRED
-          // documentation.
-
-          postLoadResult(lqIt, QImage(), ThumbnailLoadResult::REQUEST_EXPIRED);
-          continue;
-        }
-
-        // Expired requests don't count as load attempts.
-        ++m_totalLoadAttempts;
-
         // Copy those while holding the mutex.
-        thumbDir = m_thumbDir;
+        store = m_store;
         maxThumbSize = m_maxThumbSize;
       }  // mutex scope
-      const QImage image(loadSaveThumbnail(imageId, thumbDir, maxThumbSize));
+      const QImage image(loadSaveThumbnail(imageId, *store, maxThumbSize));
 
       const ThumbnailLoadResult::Status status
           = image.isNull() ? ThumbnailLoadResult::LOAD_FAILED : ThumbnailLoadResult::LOADED;
@@ -588,48 +588,49 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
 }  // ThumbnailPixmapCache::Impl::backgroundProcessing
 
 QImage ThumbnailPixmapCache::Impl::loadSaveThumbnail(const ImageId& imageId,
-                                                     const QString& thumbDir,
+                                                     ThumbnailStore& store,
                                                      const QSize& maxThumbSize) {
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, maxThumbSize));
+  const QString thumbKey(getThumbKey(imageId, maxThumbSize));
 
-  QImage image(ImageLoader::load(thumbFilePath, 0));
+  QImage image(store.load(thumbKey));
   if (!image.isNull()) {
     return image;
   }
 
-  image = ImageLoader::load(imageId);
+  // The image may have just been decoded for processing.
+  image = DecodedImageCache::instance().find(imageId);
+  if (image.isNull()) {
+    // There is no point in decoding more pixels than the thumbnail needs.
+    image = ImageLoader::loadDownscaled(imageId, maxThumbSize);
+  }
   if (image.isNull()) {
     return QImage();
   }
 
   const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-  thumbnail.save(thumbFilePath, "PNG");
+  store.store(thumbKey, thumbnail);
   return thumbnail;
 }
 
-QString ThumbnailPixmapCache::Impl::getThumbFilePath(const ImageId& imageId,
-                                                     const QString& thumbDir,
-                                                     const QSize& maxThumbSize) {
+QString ThumbnailPixmapCache::Impl::getThumbKey(const ImageId& imageId, const QSize& maxThumbSize) {
   // Because a project may have several files with the same name (from
   // different directories), we add a hash of the original image path
-  // to the thumbnail file name.
+  // to the key.  The key used to be the name of the thumbnail file,
+  // which ThumbnailStore relies on to pick up thumbnails stored that way.
   const QByteArray origPathHash = QCryptographicHash::hash(imageId.filePath().toUtf8(), QCryptographicHash::Md5)
                                       .toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
   const QString origPathHashStr = QString::fromLatin1(origPathHash.data(), origPathHash.size());
   const QString thumbnailQualityStr = QChar('q') + QString::number(maxThumbSize.width());
 
   const QFileInfo origImgPath(imageId.filePath());
-  QString thumbFilePath(thumbDir);
-  thumbFilePath += QChar('/');
-  thumbFilePath += origImgPath.completeBaseName();
-  thumbFilePath += QChar('_');
-  thumbFilePath += QString::number(imageId.zeroBasedPage());
-  thumbFilePath += QChar('_');
-  thumbFilePath += origPathHashStr;
-  thumbFilePath += QChar('_');
-  thumbFilePath += thumbnailQualityStr;
-  thumbFilePath += QString::fromLatin1(".png");
-  return thumbFilePath;
+  QString thumbKey(origImgPath.completeBaseName());
+  thumbKey += QChar('_');
+  thumbKey += QString::number(imageId.zeroBasedPage());
+  thumbKey += QChar('_');
+  thumbKey += origPathHashStr;
+  thumbKey += QChar('_');
+  thumbKey += thumbnailQualityStr;
+  return thumbKey;
 }
 
 QImage ThumbnailPixmapCache::Impl::makeThumbnail(const QImage& image, const QSize& maxThumbSize) {
@@ -806,7 +807,7 @@ void ThumbnailPixmapCache::Impl::cachePixmapLocked(const ImageId& imageId, const
 
     // Insert our new item.
     const RemoveQueue::iterator rqIt(
-        m_removeQueue.insert(m_endOfLoadedItems, Item(imageId, m_totalLoadAttempts, newStatus)).first);
+        m_removeQueue.insert(m_endOfLoadedItems, Item(imageId, newStatus)).first);
     // Our new item is now after all LOADED items in the
     // remove queue and at the end of the load queue.
     if (newStatus == Item::LOAD_FAILED) {
@@ -836,8 +837,6 @@ void ThumbnailPixmapCache::Impl::cachePixmapLocked(const ImageId& imageId, const
     // so let's transition it to IN_PROGRESS and send
     // a LoadResultEvent asynchronously.
 
-    assert(!kIt->completionHandlers.empty());
-
     const LoadQueue::iterator lqIt(m_items.project<LoadQueueTag>(kIt));
 
     lqIt->pixmap = pixmap;
@@ -871,8 +870,7 @@ void ThumbnailPixmapCache::Impl::setMaxThumbSize(const QSize& maxSize) {
 
 /*====================== ThumbnailPixmapCache::Item =========================*/
 
-ThumbnailPixmapCache::Item::Item(const ImageId& imageId, const int precedingLoadAttempts, const Status st)
-    : imageId(imageId), precedingLoadAttempts(precedingLoadAttempts), status(st) {}
+ThumbnailPixmapCache::Item::Item(const ImageId& imageId, const Status st) : imageId(imageId), status(st) {}
 
 ThumbnailPixmapCache::Item::Item(const Item& other) = default;
 
@@ -885,10 +883,10 @@ ThumbnailPixmapCache::Impl::LoadResultEvent::LoadResultEvent(const Impl::LoadQue
 
 ThumbnailPixmapCache::Impl::LoadResultEvent::~LoadResultEvent() = default;
 
-/*================== ThumbnailPixmapCache::BackgroundLoader =================*/
+/*=================== ThumbnailPixmapCache::LoaderThread ====================*/
 
-ThumbnailPixmapCache::Impl::BackgroundLoader::BackgroundLoader(Impl& owner) : m_owner(owner) {}
+ThumbnailPixmapCache::Impl::LoaderThread::LoaderThread(Impl& owner) : m_owner(owner) {}
 
-void ThumbnailPixmapCache::Impl::BackgroundLoader::customEvent(QEvent*) {
+void ThumbnailPixmapCache::Impl::LoaderThread::run() {
   m_owner.backgroundProcessing();
 }
@@ -6,6 +6,7 @@
 
 #include <boost/weak_ptr.hpp>
 #include <memory>
+#include <vector>
 
 #include "AbstractCommand.h"
 #include "NonCopyable.h"
@@ -35,15 +36,8 @@ class ThumbnailPixmapCache {
    *        ratio, but it won't exceed the provided maximum.
    * \param maxCachedPixmaps The maximum number of pixmaps to store
    *        in memory.
-   * \param expirationThreshold Requests are served from newest to
-   *        oldest ones. If a request is still not served after a certain
-   *        number of newer requests have been served, that request is
-   *        expired.  \p expirationThreshold specifies the exact number
-   *        of requests that cause older requests to expire.
-   *
-   * \see ThumbnailLoadResult::REQUEST_EXPIRED
    */
-  ThumbnailPixmapCache(const QString& thumbDir, const QSize& maxSize, int maxCachedPixmaps, int expirationThreshold);
+  ThumbnailPixmapCache(const QString& thumbDir, const QSize& maxSize, int maxCachedPixmaps);
 
   /**
    * \brief Destructor.  To be called from the GUI thread only.
@@ -106,6 +100,20 @@ class ThumbnailPixmapCache {
                      QPixmap& pixmap,
                      const std::weak_ptr<CompletionHandler>& completionHandler);
 
+  /**
+   * \brief Tells which thumbnails are on screen and which are likely
+   *        to come into view next.
+   *
+   * Queued requests for any other thumbnails are cancelled.  Visible
+   * thumbnails are loaded first, in the given order, followed by
+   * the upcoming ones, which are loaded even if nobody requested them.
+   *
+   * \note This function is to be called from the GUI thread only.
+   *
+   * \see ThumbnailLoadResult::REQUEST_EXPIRED
+   */
+  void setVisibleRange(const std::vector<ImageId>& visible, const std::vector<ImageId>& upcoming);
+
   /**
    * \brief If no thumbnail exists for this image, create it.
    *
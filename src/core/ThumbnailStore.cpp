@@ -0,0 +1,478 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ThumbnailStore.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QImage>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QVector>
+#include <QtEndian>
+#include <cstring>
+
+#include "AtomicFileOverwriter.h"
+
+namespace {
+const quint32 PACK_MAGIC = 0x53545450;  // "STTP"
+const quint32 PACK_VERSION = 1;
+const quint32 INDEX_MAGIC = 0x53545449;  // "STTI"
+const quint32 INDEX_VERSION = 1;
+
+// Magic, version and generation.
+const qint64 PACK_HEADER_SIZE = 16;
+
+// Thumbnails are small, so there is little to gain from harder compression.
+const int COMPRESSION_LEVEL = 1;
+
+// The pack is only compacted if it would shrink by at least this many bytes.
+const qint64 MIN_COMPACTION_GAIN = 16 * 1024 * 1024;
+
+const char PACK_FILE_NAME[] = "thumbnails.pack";
+const char INDEX_FILE_NAME[] = "thumbnails.index";
+const char LOCK_FILE_NAME[] = "thumbnails.lock";
+
+// The stores that are open in this process, by directory.
+QMutex storesMutex;
+QHash<QString, std::weak_ptr<ThumbnailStore>> stores;
+
+quint64 newGeneration() {
+  return static_cast<quint64>(QDateTime::currentMSecsSinceEpoch());
+}
+
+int bytesPerUsedLine(const QImage& image) {
+  return (image.width() * image.depth() + 7) / 8;
+}
+
+QByteArray encodePackHeader(const quint64 generation) {
+  QByteArray header;
+  QDataStream strm(&header, QIODevice::WriteOnly);
+  strm << PACK_MAGIC << PACK_VERSION << generation;
+  return header;
+}
+
+/**
+ * A record is a 32-bit big endian size of the rest of it, followed by
+ * the key, the image dimensions, format and color table, followed by
+ * the compressed pixels.
+ */
+QByteArray encodeRecord(const QString& key, const QImage& image) {
+  QByteArray pixels;
+  const int lineBytes = bytesPerUsedLine(image);
+  pixels.reserve(lineBytes * image.height());
+  for (int y = 0; y < image.height(); ++y) {
+    pixels.append(reinterpret_cast<const char*>(image.scanLine(y)), lineBytes);
+  }
+  const QByteArray compressed(qCompress(pixels, COMPRESSION_LEVEL));
+
+  QByteArray record;
+  {
+    QDataStream strm(&record, QIODevice::WriteOnly);
+    strm.setVersion(QDataStream::Qt_5_6);
+    strm << quint32(0) << key << qint32(image.width()) << qint32(image.height()) << qint32(image.format())
+         << image.colorTable();
+    strm.writeRawData(compressed.constData(), compressed.size());
+  }
+  // Now that the size is known.
+  qToBigEndian<quint32>(static_cast<quint32>(record.size() - 4), reinterpret_cast<uchar*>(record.data()));
+  return record;
+}
+
+QImage decodeRecord(const QByteArray& record) {
+  QDataStream strm(record);
+  strm.setVersion(QDataStream::Qt_5_6);
+  quint32 size = 0;
+  QString key;
+  qint32 width = 0;
+  qint32 height = 0;
+  qint32 format = 0;
+  QVector<QRgb> colorTable;
+  strm >> size >> key >> width >> height >> format >> colorTable;
+  if ((strm.status() != QDataStream::Ok) || (width <= 0) || (height <= 0) || (format <= QImage::Format_Invalid)
+      || (format >= QImage::NImageFormats)) {
+    return QImage();
+  }
+
+  const auto pos = static_cast<int>(strm.device()->pos());
+  const QByteArray pixels(
+      qUncompress(reinterpret_cast<const uchar*>(record.constData()) + pos, record.size() - pos));
+
+  QImage image(width, height, static_cast<QImage::Format>(format));
+  if (image.isNull()) {
+    return QImage();
+  }
+  image.setColorTable(colorTable);
+
+  const int lineBytes = bytesPerUsedLine(image);
+  if (pixels.size() != lineBytes * height) {
+    return QImage();
+  }
+  for (int y = 0; y < height; ++y) {
+    memcpy(image.scanLine(y), pixels.constData() + y * lineBytes, lineBytes);
+  }
+  return image;
+}
+}  // namespace
+
+ThumbnailStore::ThumbnailStore(const QString& thumbDir)
+    : m_thumbDir(thumbDir),
+      m_readOnly(false),
+      m_generation(0),
+      m_packSize(0),
+      m_garbageSize(0),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_indexDirty(false) {
+  const QMutexLocker locker(&m_mutex);
+  openLocked();
+  if ((m_garbageSize >= MIN_COMPACTION_GAIN) && (m_garbageSize * 2 > m_packSize)) {
+    compactLocked();
+  }
+}
+
+ThumbnailStore::~ThumbnailStore() {
+  const QMutexLocker locker(&m_mutex);
+  writeIndexLocked();
+  unmapLocked();
+}
+
+std::shared_ptr<ThumbnailStore> ThumbnailStore::forDirectory(const QString& thumbDir) {
+  const QString key(QDir(thumbDir).absolutePath());
+
+  const QMutexLocker locker(&storesMutex);
+  std::shared_ptr<ThumbnailStore> store(stores.value(key).lock());
+  if (!store) {
+    store = std::make_shared<ThumbnailStore>(thumbDir);
+    stores.insert(key, store);
+  }
+  return store;
+}
+
+bool ThumbnailStore::isReadOnly() const {
+  const QMutexLocker locker(&m_mutex);
+  return m_readOnly;
+}
+
+bool ThumbnailStore::contains(const QString& key) const {
+  {
+    const QMutexLocker locker(&m_mutex);
+    if (m_offsets.contains(key)) {
+      return true;
+    }
+  }
+  return QFile::exists(QDir(m_thumbDir).absoluteFilePath(key + ".png"));
+}
+
+QImage ThumbnailStore::load(const QString& key) {
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_offsets.constFind(key);
+    if (it != m_offsets.constEnd()) {
+      const QImage image(decodeRecord(recordLocked(it->offset)));
+      if (!image.isNull()) {
+        return image;
+      }
+    }
+  }
+
+  // Move the thumbnail from the one-PNG-per-thumbnail layout, if it's there.
+  const QString legacyFilePath(QDir(m_thumbDir).absoluteFilePath(key + ".png"));
+  if (!QFile::exists(legacyFilePath)) {
+    return QImage();
+  }
+  const QImage image(legacyFilePath, "PNG");
+  if (image.isNull()) {
+    return QImage();
+  }
+
+  const QMutexLocker locker(&m_mutex);
+  if (appendLocked(key, image)) {
+    QFile::remove(legacyFilePath);
+  }
+  return image;
+}
+
+bool ThumbnailStore::store(const QString& key, const QImage& image) {
+  if (image.isNull()) {
+    return false;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+  return appendLocked(key, image);
+}
+
+void ThumbnailStore::compact() {
+  const QMutexLocker locker(&m_mutex);
+  compactLocked();
+}
+
+void ThumbnailStore::openLocked() {
+  // Like the thumbnail directory itself, the pack is only created
+  // if the directory exists.
+  const QDir dir(m_thumbDir);
+  if (!dir.exists()) {
+    return;
+  }
+
+  m_pack.setFileName(dir.absoluteFilePath(QString::fromLatin1(PACK_FILE_NAME)));
+
+  // The lock is only considered stale if its owner is gone, however long it's held.
+  m_lock = std::make_unique<QLockFile>(dir.absoluteFilePath(QString::fromLatin1(LOCK_FILE_NAME)));
+  m_lock->setStaleLockTime(0);
+  if (!m_lock->tryLock(0) || !m_pack.open(QIODevice::ReadWrite)) {
+    // Another store is writing to the pack, or the directory is read-only.
+    // The existing thumbnails are still worth reading.
+    if (!m_pack.open(QIODevice::ReadOnly)) {
+      return;
+    }
+    m_readOnly = true;
+  }
+
+  quint32 magic = 0;
+  quint32 version = 0;
+  {
+    QDataStream strm(&m_pack);
+    strm >> magic >> version >> m_generation;
+  }
+  if ((m_pack.size() < PACK_HEADER_SIZE) || (magic != PACK_MAGIC) || (version != PACK_VERSION)) {
+    if (m_readOnly) {
+      m_pack.close();
+      return;
+    }
+    // A new or unusable pack.
+    m_generation = newGeneration();
+    const QByteArray header(encodePackHeader(m_generation));
+    if (!m_pack.resize(0) || (m_pack.write(header) != header.size()) || !m_pack.flush()) {
+      m_pack.close();
+      return;
+    }
+    m_packSize = PACK_HEADER_SIZE;
+    m_indexDirty = true;
+    return;
+  }
+
+  m_packSize = m_pack.size();
+  if (!readIndexLocked()) {
+    m_offsets.clear();
+    m_garbageSize = 0;
+    scanLocked(PACK_HEADER_SIZE);
+  }
+}  // ThumbnailStore::openLocked
+
+bool ThumbnailStore::readIndexLocked() {
+  QFile file(QDir(m_thumbDir).absoluteFilePath(QString::fromLatin1(INDEX_FILE_NAME)));
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  QDataStream strm(&file);
+  strm.setVersion(QDataStream::Qt_5_6);
+  quint32 magic = 0;
+  quint32 version = 0;
+  quint64 generation = 0;
+  qint64 indexedSize = 0;
+  qint64 garbageSize = 0;
+  quint32 count = 0;
+  strm >> magic >> version >> generation >> indexedSize >> garbageSize >> count;
+  if ((strm.status() != QDataStream::Ok) || (magic != INDEX_MAGIC) || (version != INDEX_VERSION)
+      || (generation != m_generation) || (indexedSize > m_packSize)) {
+    return false;
+  }
+
+  QHash<QString, Location> offsets;
+  offsets.reserve(static_cast<int>(count));
+  for (quint32 i = 0; i < count; ++i) {
+    QString key;
+    Location location{};
+    strm >> key >> location.offset >> location.size;
+    if ((strm.status() != QDataStream::Ok) || (location.offset + location.size > indexedSize)) {
+      return false;
+    }
+    offsets.insert(key, location);
+  }
+
+  m_offsets.swap(offsets);
+  m_garbageSize = garbageSize;
+  if (indexedSize < m_packSize) {
+    // Thumbnails added after the index was saved.
+    scanLocked(indexedSize);
+  }
+  return true;
+}  // ThumbnailStore::readIndexLocked
+
+void ThumbnailStore::writeIndexLocked() {
+  if (!m_pack.isOpen() || m_readOnly || !m_indexDirty) {
+    return;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device
+      = overwriter.startWriting(QDir(m_thumbDir).absoluteFilePath(QString::fromLatin1(INDEX_FILE_NAME)));
+  if (!device) {
+    return;
+  }
+
+  QDataStream strm(device);
+  strm.setVersion(QDataStream::Qt_5_6);
+  strm << INDEX_MAGIC << INDEX_VERSION << m_generation << m_packSize << m_garbageSize << quint32(m_offsets.size());
+  for (auto it = m_offsets.constBegin(); it != m_offsets.constEnd(); ++it) {
+    strm << it.key() << it->offset << it->size;
+  }
+
+  if ((strm.status() == QDataStream::Ok) && overwriter.commit()) {
+    m_indexDirty = false;
+  }
+}
+
+void ThumbnailStore::scanLocked(qint64 offset) {
+  const qint64 fileSize = m_pack.size();
+  QDataStream strm(&m_pack);
+  strm.setVersion(QDataStream::Qt_5_6);
+  while (offset + 4 <= fileSize) {
+    if (!m_pack.seek(offset)) {
+      break;
+    }
+    quint32 size = 0;
+    QString key;
+    strm >> size >> key;
+    if ((strm.status() != QDataStream::Ok) || (offset + 4 + size > fileSize)) {
+      break;
+    }
+
+    const Location location{offset, 4 + size};
+    const auto it = m_offsets.find(key);
+    if (it != m_offsets.end()) {
+      m_garbageSize += it->size;
+      *it = location;
+    } else {
+      m_offsets.insert(key, location);
+    }
+    offset += location.size;
+  }
+
+  if ((offset < fileSize) && !m_readOnly) {
+    // The last record was cut short, probably by a crash.
+    m_pack.resize(offset);
+  }
+  m_packSize = offset;
+  m_indexDirty = true;
+}  // ThumbnailStore::scanLocked
+
+QByteArray ThumbnailStore::recordLocked(const qint64 offset) {
+  if (offset + 4 > m_packSize) {
+    return QByteArray();
+  }
+
+  if (m_mapSize < m_packSize) {
+    // The pack has grown since it was mapped.
+    unmapLocked();
+    m_map = m_pack.map(0, m_packSize);
+    if (m_map) {
+      m_mapSize = m_packSize;
+    }
+  }
+
+  if (m_map) {
+    const quint32 size = qFromBigEndian<quint32>(m_map + offset);
+    if (offset + 4 + size > m_mapSize) {
+      return QByteArray();
+    }
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(m_map + offset), static_cast<int>(4 + size));
+  }
+
+  // Mapping is not supported everywhere.
+  if (!m_pack.seek(offset)) {
+    return QByteArray();
+  }
+  QByteArray record(m_pack.read(4));
+  if (record.size() != 4) {
+    return QByteArray();
+  }
+  const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(record.constData()));
+  if (offset + 4 + size > m_packSize) {
+    return QByteArray();
+  }
+  record += m_pack.read(size);
+  return record;
+}  // ThumbnailStore::recordLocked
+
+void ThumbnailStore::unmapLocked() {
+  if (m_map) {
+    m_pack.unmap(m_map);
+    m_map = nullptr;
+    m_mapSize = 0;
+  }
+}
+
+bool ThumbnailStore::appendLocked(const QString& key, const QImage& image) {
+  if (!m_pack.isOpen() || m_readOnly) {
+    return false;
+  }
+
+  const QByteArray record(encodeRecord(key, image));
+  if (!m_pack.seek(m_packSize) || (m_pack.write(record) != record.size()) || !m_pack.flush()) {
+    m_pack.resize(m_packSize);
+    return false;
+  }
+
+  const Location location{m_packSize, static_cast<quint32>(record.size())};
+  const auto it = m_offsets.find(key);
+  if (it != m_offsets.end()) {
+    m_garbageSize += it->size;
+    *it = location;
+  } else {
+    m_offsets.insert(key, location);
+  }
+  m_packSize += record.size();
+  m_indexDirty = true;
+  return true;
+}
+
+void ThumbnailStore::compactLocked() {
+  if (!m_pack.isOpen() || m_readOnly || (m_garbageSize == 0)) {
+    return;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(m_pack.fileName());
+  if (!device) {
+    return;
+  }
+
+  const quint64 generation = newGeneration();
+  const QByteArray header(encodePackHeader(generation));
+  if (device->write(header) != header.size()) {
+    return;
+  }
+
+  QHash<QString, Location> offsets;
+  offsets.reserve(m_offsets.size());
+  qint64 packSize = PACK_HEADER_SIZE;
+  for (auto it = m_offsets.constBegin(); it != m_offsets.constEnd(); ++it) {
+    const QByteArray record(recordLocked(it->offset));
+    if (record.isEmpty()) {
+      continue;
+    }
+    if (device->write(record) != record.size()) {
+      return;
+    }
+    offsets.insert(it.key(), Location{packSize, static_cast<quint32>(record.size())});
+    packSize += record.size();
+  }
+
+  // A file that's open can't be replaced on some platforms.
+  unmapLocked();
+  m_pack.close();
+  if (overwriter.commit()) {
+    m_offsets.swap(offsets);
+    m_generation = generation;
+    m_packSize = packSize;
+    m_garbageSize = 0;
+    m_indexDirty = true;
+  }
+  if (m_pack.open(QIODevice::ReadWrite)) {
+    writeIndexLocked();
+  }
+}  // ThumbnailStore::compactLocked
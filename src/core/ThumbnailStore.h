@@ -0,0 +1,127 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_THUMBNAILSTORE_H_
+#define SCANTAILOR_CORE_THUMBNAILSTORE_H_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <memory>
+
+#include "NonCopyable.h"
+
+class QImage;
+class QLockFile;
+
+/**
+ * \brief Keeps all the thumbnails of a project in a single pack file.
+ *
+ * Thumbnails are appended to the pack, with their pixels compressed
+ * with zlib, and an index maps their keys to the offsets in the pack.
+ * The index is saved to a separate file when the store is destroyed.
+ * If it's missing or outdated, the pack is scanned instead.  Replaced
+ * thumbnails stay in the pack until it's compacted, which happens
+ * when the store is opened and most of the pack is unused.
+ *
+ * Thumbnails left by older versions as one PNG file per thumbnail
+ * are moved into the pack as they are loaded.
+ *
+ * Only one store at a time may write to a pack, which is ensured by a lock
+ * file next to it.  A store that can't take the lock, or can't write to
+ * the directory, opens the pack read-only and doesn't store anything.
+ * Within a process, forDirectory() lets the users of a directory share
+ * a single store.
+ *
+ * All methods are thread-safe.
+ */
+class ThumbnailStore {
+  DECLARE_NON_COPYABLE(ThumbnailStore)
+
+ public:
+  /**
+   * \param thumbDir The directory to keep the pack and the index in.
+   *        It's not created if it doesn't exist, in which case nothing
+   *        gets stored.
+   */
+  explicit ThumbnailStore(const QString& thumbDir);
+
+  /**
+   * \brief Saves the index.
+   */
+  ~ThumbnailStore();
+
+  /**
+   * \brief Returns the store for \p thumbDir, creating one unless it's already open.
+   */
+  static std::shared_ptr<ThumbnailStore> forDirectory(const QString& thumbDir);
+
+  bool isReadOnly() const;
+
+  bool contains(const QString& key) const;
+
+  /**
+   * \brief Returns the thumbnail stored under \p key or a null image.
+   */
+  QImage load(const QString& key);
+
+  /**
+   * \brief Stores \p image under \p key, replacing any existing thumbnail.
+   *
+   * \return true on success.
+   */
+  bool store(const QString& key, const QImage& image);
+
+  /**
+   * \brief Rewrites the pack, leaving out replaced thumbnails.
+   */
+  void compact();
+
+ private:
+  struct Location {
+    qint64 offset;
+    quint32 size;  // Including the size prefix.
+  };
+
+  void openLocked();
+
+  bool readIndexLocked();
+
+  void writeIndexLocked();
+
+  /**
+   * \brief Indexes the records starting at \p offset, truncating the pack
+   *        after the last complete one.
+   */
+  void scanLocked(qint64 offset);
+
+  /**
+   * \brief Returns the record at \p offset, including its size prefix,
+   *        or an empty array.
+   */
+  QByteArray recordLocked(qint64 offset);
+
+  void unmapLocked();
+
+  bool appendLocked(const QString& key, const QImage& image);
+
+  void compactLocked();
+
+  QString m_thumbDir;
+  mutable QMutex m_mutex;
+  std::unique_ptr<QLockFile> m_lock;
+  QFile m_pack;
+  bool m_readOnly;
+  quint64 m_generation;  // Changes whenever the pack is rewritten, to detect stale indexes.
+  qint64 m_packSize;
+  qint64 m_garbageSize;  // The total size of replaced records.
+  uchar* m_map;
+  qint64 m_mapSize;
+  QHash<QString, Location> m_offsets;
+  bool m_indexDirty;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_THUMBNAILSTORE_H_
@@ -7,10 +7,14 @@
 #include <tiffio.h>
 
 #include <QDebug>
+#include <QFileDevice>
 #include <QIODevice>
 #include <QImage>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 #include "Dpm.h"
 #include "ImageMetadata.h"
@@ -182,13 +186,30 @@ static toff_t deviceSize(thandle_t context) {
   return dev->size();
 }
 
-static int deviceMap(thandle_t, tdata_t*, toff_t*) {
-  // Not implemented.
-  return 0;
+static int deviceMap(thandle_t context, tdata_t* base, toff_t* size) {
+  // Mapping lets libtiff use the data of uncompressed strips in place
+  // rather than reading them into a temporary buffer first.
+  auto* file = qobject_cast<QFileDevice*>((QIODevice*) context);
+  if (!file) {
+    return 0;
+  }
+
+  const qint64 fileSize = file->size();
+  uchar* const data = file->map(0, fileSize);
+  if (!data) {
+    // Not enough address space or not a regular file.
+    return 0;
+  }
+  *base = data;
+  *size = (toff_t) fileSize;
+  return 1;
 }
 
-static void deviceUnmap(thandle_t, tdata_t, toff_t) {
-  // Not implemented.
+static void deviceUnmap(thandle_t context, tdata_t base, toff_t) {
+  auto* file = qobject_cast<QFileDevice*>((QIODevice*) context);
+  if (file) {
+    file->unmap(static_cast<uchar*>(base));
+  }
 }
 
 bool TiffReader::canRead(QIODevice& device) {
@@ -241,7 +262,7 @@ static void convertAbgrToArgb(const uint32* src, uint32* dst, int count) {
   }
 }
 
-QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
+QImage TiffReader::readImage(QIODevice& device, const int pageNum, const QSize& targetSize) {
   if (!device.isReadable()) {
     return QImage();
   }
@@ -255,7 +276,8 @@ QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
     return QImage();
   }
 
-  TiffHandle tif(TIFFClientOpen("file", "rBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+  // Unlike when reading metadata, we let libtiff map the file.
+  TiffHandle tif(TIFFClientOpen("file", "rB", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
                                 &deviceSize, &deviceMap, &deviceUnmap));
   if (!tif.handle()) {
     return QImage();
@@ -265,10 +287,14 @@ QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
     return QImage();
   }
 
-  const TiffInfo info(tif, header);
-
   const ImageMetadata metadata(currentPageMetadata(tif));
 
+  if (!targetSize.isEmpty() && !selectReducedImage(tif, metadata.size(), targetSize)) {
+    return QImage();
+  }
+
+  const TiffInfo info(tif, header);
+
   QImage image;
 
   if (info.mapsToBinaryOrIndexed8()) {
@@ -311,13 +337,52 @@ QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
   }
 
   if (!metadata.dpi().isNull()) {
+    // A reduced resolution image may not have its own resolution tags,
+    // so we derive it from the resolution of the page itself.
     const Dpm dpm(metadata.dpi());
-    image.setDotsPerMeterX(dpm.horizontal());
-    image.setDotsPerMeterY(dpm.vertical());
+    const double scale = double(info.width) / metadata.size().width();
+    image.setDotsPerMeterX(qRound(dpm.horizontal() * scale));
+    image.setDotsPerMeterY(qRound(dpm.vertical() * scale));
   }
   return image;
 }  // TiffReader::readImage
 
+bool TiffReader::selectReducedImage(const TiffHandle& tif, const QSize& fullSize, const QSize& targetSize) {
+  uint16 numSubIfds = 0;
+  toff_t* subIfds = nullptr;
+  if (!TIFFGetField(tif.handle(), TIFFTAG_SUBIFD, &numSubIfds, &subIfds) || (numSubIfds == 0)) {
+    return true;
+  }
+  // The array belongs to the current directory, which we are about to leave.
+  const std::vector<toff_t> subIfdOffsets(subIfds, subIfds + numSubIfds);
+  const toff_t pageOffset = TIFFCurrentDirOffset(tif.handle());
+
+  const QSize fitSize(fullSize.scaled(targetSize, Qt::KeepAspectRatio));
+  toff_t bestOffset = pageOffset;
+  qint64 bestArea = qint64(fullSize.width()) * fullSize.height();
+  for (const toff_t offset : subIfdOffsets) {
+    if (!TIFFSetSubDirectory(tif.handle(), offset)) {
+      continue;
+    }
+
+    uint32 subfileType = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_SUBFILETYPE, &subfileType);
+    if (!(subfileType & FILETYPE_REDUCEDIMAGE)) {
+      continue;
+    }
+
+    uint32 width = 0, height = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGELENGTH, &height);
+    const qint64 area = qint64(width) * height;
+    if ((int(width) >= fitSize.width()) && (int(height) >= fitSize.height()) && (area < bestArea)) {
+      bestOffset = offset;
+      bestArea = area;
+    }
+  }
+  return TIFFSetSubDirectory(tif.handle(), bestOffset) != 0;
+}  // TiffReader::selectReducedImage
+
 TiffReader::TiffHeader TiffReader::readHeader(QIODevice& device) {
   unsigned char data[4];
   if (device.peek((char*) data, sizeof(data)) != sizeof(data)) {
@@ -436,11 +501,65 @@ QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const Tif
 
 void TiffReader::readLines(const TiffHandle& tif, QImage& image) {
   const int height = image.height();
+  const tsize_t scanlineSize = TIFFScanlineSize(tif.handle());
+
+  uint32 rowsPerStrip = 0;
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+  if (!TIFFIsTiled(tif.handle()) && (scanlineSize == image.bytesPerLine()) && (rowsPerStrip > 0)) {
+    // The lines of the image are laid out exactly like in a strip,
+    // so whole strips can be decoded directly into the image.
+    // For uncompressed strips of a mapped file, that's a single copy.
+    const int stripHeight = (int) std::min<uint32>(rowsPerStrip, (uint32) height);
+    for (int y = 0; y < height; y += stripHeight) {
+      const int numRows = std::min(stripHeight, height - y);
+      const tstrip_t strip = TIFFComputeStrip(tif.handle(), (uint32) y, 0);
+      TIFFReadEncodedStrip(tif.handle(), strip, image.scanLine(y), numRows * scanlineSize);
+    }
+    return;
+  }
+
+  if (TIFFIsTiled(tif.handle())) {
+    // libtiff can't read tiled images by scanlines.
+    readTiles(tif, image);
+    return;
+  }
+
   for (int y = 0; y < height; ++y) {
     TIFFReadScanline(tif.handle(), image.scanLine(y), y);
   }
 }
 
+void TiffReader::readTiles(const TiffHandle& tif, QImage& image) {
+  uint32 tileWidth = 0, tileHeight = 0;
+  TIFFGetField(tif.handle(), TIFFTAG_TILEWIDTH, &tileWidth);
+  TIFFGetField(tif.handle(), TIFFTAG_TILELENGTH, &tileHeight);
+  if ((tileWidth == 0) || (tileHeight == 0)) {
+    return;
+  }
+
+  const auto width = (uint32) image.width();
+  const auto height = (uint32) image.height();
+  const tsize_t scanlineSize = TIFFScanlineSize(tif.handle());
+  const tsize_t tileRowSize = TIFFTileRowSize(tif.handle());
+  TiffBuffer<uint8> buf(TIFFTileSize(tif.handle()));
+
+  for (uint32 ty = 0; ty < height; ty += tileHeight) {
+    const uint32 numRows = std::min(tileHeight, height - ty);
+    for (uint32 tx = 0; tx < width; tx += tileWidth) {
+      if (TIFFReadTile(tif.handle(), buf.data(), tx, ty, 0, 0) < 0) {
+        continue;
+      }
+      // Tile widths are multiples of 16, so even with 1 bit per pixel
+      // every tile starts at a byte boundary.
+      const tsize_t dstOffset = (tsize_t) tx * image.depth() / 8;
+      const tsize_t numBytes = std::min(tileRowSize, scanlineSize - dstOffset);
+      for (uint32 row = 0; row < numRows; ++row) {
+        memcpy(image.scanLine(ty + row) + dstOffset, buf.data() + row * tileRowSize, numBytes);
+      }
+    }
+  }
+}
+
 void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image) {
   TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
 
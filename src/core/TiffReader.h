@@ -4,6 +4,8 @@
 #ifndef SCANTAILOR_CORE_TIFFREADER_H_
 #define SCANTAILOR_CORE_TIFFREADER_H_
 
+#include <QSize>
+
 #include "ImageMetadataLoader.h"
 #include "VirtualFunction.h"
 
@@ -26,9 +28,13 @@ class TiffReader {
    *        opened for reading and must be seekable.
    * \param pageNum A zero-based page number within a multi-page
    *        TIFF file.
+   * \param targetSize If not empty, the image is going to be scaled
+   *        down to fit into that size.  If the page comes with reduced
+   *        resolution versions of itself (SubIFDs), the smallest one that
+   *        still doesn't need upscaling is read instead of the full image.
    * \return The resulting image, or a null image in case of failure.
    */
-  static QImage readImage(QIODevice& device, int pageNum = 0);
+  static QImage readImage(QIODevice& device, int pageNum = 0, const QSize& targetSize = QSize());
 
  private:
   class TiffHeader;
@@ -47,10 +53,14 @@ class TiffReader {
 
   static Dpi getDpi(float xres, float yres, unsigned resUnit);
 
+  static bool selectReducedImage(const TiffHandle& tif, const QSize& fullSize, const QSize& targetSize);
+
   static QImage extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info);
 
   static void readLines(const TiffHandle& tif, QImage& image);
 
+  static void readTiles(const TiffHandle& tif, QImage& image);
+
   static void readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image);
 };
 
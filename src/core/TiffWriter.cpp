@@ -5,14 +5,19 @@
 
 #include <Constants.h>
 #include <Grayscale.h>
+#include <Tracer.h>
 #include <tiffio.h>
 
 #include <QDebug>
+#include <QRect>
+#include <QSize>
 #include <QtCore/QFile>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
 #include "ApplicationSettings.h"
+#include "DecodedImageCache.h"
 #include "Dpm.h"
 
 /**
@@ -101,11 +106,39 @@ static void deviceUnmap(thandle_t, tdata_t, toff_t) {
   // Not implemented.
 }
 
+namespace {
+// Lines of images in formats TIFF can't represent directly
+// are converted in bands of this height.
+const int CONVERSION_BAND_HEIGHT = 64;
+
+// The height of bands requested when writing images band by band.
+const int WRITING_BAND_HEIGHT = 256;
+
+/**
+ * \return true if the palette maps each index to the gray level equal to it,
+ *         so the indices can be stored as grayscale samples.  Other gray palettes,
+ *         like the ones of posterized images, have to be stored as palettes.
+ */
+bool isGrayscaleRamp(const QVector<QRgb>& colorTable) {
+  if (colorTable.size() != 256) {
+    return false;
+  }
+  for (int i = 0; i < 256; ++i) {
+    if (colorTable[i] != qRgb(i, i, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
 bool TiffWriter::writeImage(const QString& filePath, const QImage& image) {
   if (image.isNull()) {
     return false;
   }
 
+  DecodedImageCache::instance().invalidate(filePath);
+
   QFile file(filePath);
   if (!file.open(QFile::WriteOnly)) {
     return false;
@@ -122,41 +155,47 @@ bool TiffWriter::writeImage(QIODevice& device, const QImage& image) {
   if (image.isNull()) {
     return false;
   }
-  if (!device.isWritable()) {
-    return false;
-  }
-  if (device.isSequential()) {
-    // libtiff needs to be able to seek.
+
+  const foundation::Tracer::Span span("TiffWriter::writeImage");
+
+  StripWriter writer;
+  return writer.begin(device, image.size(), image.format(), image.colorTable(), Dpm(image))
+         && writer.writeRows(image) && writer.finish();
+}
+
+bool TiffWriter::writeImage(const QString& filePath,
+                            const QSize& size,
+                            const std::function<QImage(const QRect& area)>& bandAt) {
+  if (size.isEmpty()) {
     return false;
   }
 
-  TiffHandle tif(TIFFClientOpen(
-      // Libtiff seems to be buggy with L or H flags,
-      // so we use B.
-      "file", "wBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose, &deviceSize, &deviceMap,
-      &deviceUnmap));
-  if (!tif.handle()) {
+  // Includes producing the bands, so it's named apart from writing a ready image.
+  const foundation::Tracer::Span span("TiffWriter::writeImage(bands)");
+
+  DecodedImageCache::instance().invalidate(filePath);
+
+  QFile file(filePath);
+  if (!file.open(QFile::WriteOnly)) {
     return false;
   }
 
-  TIFFSetField(tif.handle(), TIFFTAG_IMAGEWIDTH, uint32(image.width()));
-  TIFFSetField(tif.handle(), TIFFTAG_IMAGELENGTH, uint32(image.height()));
-  TIFFSetField(tif.handle(), TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-  TIFFSetField(tif.handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  setDpm(tif, Dpm(image));
-
-  switch (image.format()) {
-    case QImage::Format_Mono:
-    case QImage::Format_MonoLSB:
-    case QImage::Format_Indexed8:
-      return writeBitonalOrIndexed8Image(tif, image);
-    default:;
+  StripWriter writer;
+  bool success = true;
+  for (int y = 0; success && (y < size.height()); y += WRITING_BAND_HEIGHT) {
+    const QRect area(0, y, size.width(), std::min(WRITING_BAND_HEIGHT, size.height() - y));
+    const QImage band(bandAt(area));
+    if ((y == 0) && !writer.begin(file, size, band.format(), band.colorTable(), Dpm(band))) {
+      success = false;
+    } else {
+      success = writer.writeRows(band);
+    }
   }
-  if (image.hasAlphaChannel()) {
-    return writeARGB32Image(tif, image.convertToFormat(QImage::Format_ARGB32));
-  } else {
-    return writeRGB32Image(tif, image.convertToFormat(QImage::Format_RGB32));
+  if (!success || !writer.finish()) {
+    file.remove();
+    return false;
   }
+  return true;
 }  // TiffWriter::writeImage
 
 /**
@@ -190,27 +229,29 @@ void TiffWriter::setDpm(const TiffHandle& tif, const Dpm& dpm) {
   TIFFSetField(tif.handle(), TIFFTAG_RESOLUTIONUNIT, unit);
 }
 
-bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image) {
+void TiffWriter::setupBitonalOrIndexed8Image(const TiffHandle& tif,
+                                             const QImage::Format format,
+                                             const QVector<QRgb>& colorTable) {
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(1));
 
   uint16 bitsPerSample = 8;
   uint16 photometric = PHOTOMETRIC_PALETTE;
-  if (image.isGrayscale()) {
+  if ((format == QImage::Format_Indexed8) && isGrayscaleRamp(colorTable)) {
     photometric = PHOTOMETRIC_MINISBLACK;
   }
 
-  switch (image.format()) {
+  switch (format) {
     case QImage::Format_Mono:
     case QImage::Format_MonoLSB:
       bitsPerSample = 1;
-      if (image.colorCount() < 2) {
+      if (colorTable.size() < 2) {
         photometric = PHOTOMETRIC_MINISWHITE;
       } else {
         // Some programs don't understand
         // palettized binary images, so don't
         // use a palette for black and white images.
-        const uint32_t c0 = image.color(0);
-        const uint32_t c1 = image.color(1);
+        const uint32_t c0 = colorTable[0];
+        const uint32_t c1 = colorTable[1];
         if ((c0 == 0xffffffff) && (c1 == 0xff000000)) {
           photometric = PHOTOMETRIC_MINISWHITE;
         } else if ((c0 == 0xff000000) && (c1 == 0xffffffff)) {
@@ -221,7 +262,7 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
     default:;
   }
 
-  if (image.format() == QImage::Format_Indexed8) {
+  if (format == QImage::Format_Indexed8) {
     TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
                  uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
   } else {
@@ -233,153 +274,213 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
 
   if (photometric == PHOTOMETRIC_PALETTE) {
     const int numColors = 1 << bitsPerSample;
-    QVector<QRgb> colorTable(image.colorTable());
-    if (colorTable.size() > numColors) {
-      colorTable.resize(numColors);
+    QVector<QRgb> palette(colorTable);
+    if (palette.size() > numColors) {
+      palette.resize(numColors);
     }
     std::vector<uint16> pr(numColors, 0);
     std::vector<uint16> pg(numColors, 0);
     std::vector<uint16> pb(numColors, 0);
-    for (int i = 0; i < colorTable.size(); ++i) {
-      const QRgb rgb = colorTable[i];
+    for (int i = 0; i < palette.size(); ++i) {
+      const QRgb rgb = palette[i];
       pr[i] = static_cast<unsigned short>((0xFFFF * qRed(rgb) + 128) / 255);
       pg[i] = static_cast<unsigned short>((0xFFFF * qGreen(rgb) + 128) / 255);
       pb[i] = static_cast<unsigned short>((0xFFFF * qBlue(rgb) + 128) / 255);
     }
     TIFFSetField(tif.handle(), TIFFTAG_COLORMAP, &pr[0], &pg[0], &pb[0]);
   }
+}  // TiffWriter::setupBitonalOrIndexed8Image
 
-  if (image.format() == QImage::Format_Indexed8) {
-    return write8bitLines(tif, image);
-  } else {
-    if (image.format() == QImage::Format_MonoLSB) {
-      return writeBinaryLinesReversed(tif, image);
-    } else {
-      return writeBinaryLinesAsIs(tif, image);
-    }
-  }
-}  // TiffWriter::writeBitonalOrIndexed8Image
-
-bool TiffWriter::writeRGB32Image(const TiffHandle& tif, const QImage& image) {
-  assert(image.format() == QImage::Format_RGB32);
-
-  TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(3));
+void TiffWriter::setupRGBImage(const TiffHandle& tif, const int samplesPerPixel) {
+  TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(samplesPerPixel));
   TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
   TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
   TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+}
 
-  const int width = image.width();
-  const int height = image.height();
-
-  std::vector<uint8_t> tmpLine(width * 3);
+/*============================ TiffWriter::StripWriter ============================*/
 
-  // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
+TiffWriter::StripWriter::StripWriter()
+    : m_lineFormat(BINARY_AS_IS),
+      m_format(QImage::Format_Invalid),
+      m_width(0),
+      m_height(0),
+      m_nextRow(0),
+      m_failed(false) {}
 
-  for (int y = 0; y < height; ++y) {
-    const auto* pSrc = (const uint32_t*) image.scanLine(y);
-    uint8_t* pDst = &tmpLine[0];
-    for (int x = 0; x < width; ++x) {
-      const uint32_t ARGB = *pSrc;
-      pDst[0] = static_cast<uint8_t>(ARGB >> 16);
-      pDst[1] = static_cast<uint8_t>(ARGB >> 8);
-      pDst[2] = static_cast<uint8_t>(ARGB);
-      ++pSrc;
-      pDst += 3;
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
-  }
-  return true;
-}  // TiffWriter::writeRGB32Image
+TiffWriter::StripWriter::~StripWriter() = default;
 
-bool TiffWriter::writeARGB32Image(const TiffHandle& tif, const QImage& image) {
-  assert(image.format() == QImage::Format_ARGB32);
+bool TiffWriter::StripWriter::begin(QIODevice& device,
+                                    const QSize& size,
+                                    const QImage::Format format,
+                                    const QVector<QRgb>& colorTable,
+                                    const Dpm& dpm) {
+  m_tif.reset();
+  m_failed = true;
 
-  TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(4));
-  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
-  TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
-  TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  if (size.isEmpty() || (format == QImage::Format_Invalid)) {
+    return false;
+  }
+  if (!device.isWritable()) {
+    return false;
+  }
+  if (device.isSequential()) {
+    // libtiff needs to be able to seek.
+    return false;
+  }
 
-  const int width = image.width();
-  const int height = image.height();
+  auto tif = std::make_unique<TiffHandle>(TIFFClientOpen(
+      // Libtiff seems to be buggy with L or H flags,
+      // so we use B.
+      "file", "wBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose, &deviceSize, &deviceMap,
+      &deviceUnmap));
+  if (!tif->handle()) {
+    return false;
+  }
 
-  std::vector<uint8_t> tmpLine(width * 4);
+  TIFFSetField(tif->handle(), TIFFTAG_IMAGEWIDTH, uint32(size.width()));
+  TIFFSetField(tif->handle(), TIFFTAG_IMAGELENGTH, uint32(size.height()));
+  TIFFSetField(tif->handle(), TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+  TIFFSetField(tif->handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  setDpm(*tif, dpm);
 
-  // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
+  switch (format) {
+    case QImage::Format_Mono:
+      m_lineFormat = BINARY_AS_IS;
+      setupBitonalOrIndexed8Image(*tif, format, colorTable);
+      break;
+    case QImage::Format_MonoLSB:
+      m_lineFormat = BINARY_REVERSED;
+      setupBitonalOrIndexed8Image(*tif, format, colorTable);
+      break;
+    case QImage::Format_Indexed8:
+      m_lineFormat = GRAY_OR_INDEXED8;
+      setupBitonalOrIndexed8Image(*tif, format, colorTable);
+      break;
+    default:
+      if (QImage::toPixelFormat(format).alphaUsage() == QPixelFormat::UsesAlpha) {
+        m_lineFormat = RGBA;
+        setupRGBImage(*tif, 4);
+      } else {
+        m_lineFormat = RGB;
+        setupRGBImage(*tif, 3);
+      }
+  }
 
-  for (int y = 0; y < height; ++y) {
-    const auto* pSrc = (const uint32_t*) image.scanLine(y);
-    uint8_t* pDst = &tmpLine[0];
-    for (int x = 0; x < width; ++x) {
-      const uint32_t ARGB = *pSrc;
-      pDst[0] = static_cast<uint8_t>(ARGB >> 16);
-      pDst[1] = static_cast<uint8_t>(ARGB >> 8);
-      pDst[2] = static_cast<uint8_t>(ARGB);
-      pDst[3] = static_cast<uint8_t>(ARGB >> 24);
-      ++pSrc;
-      pDst += 4;
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
+  switch (m_lineFormat) {
+    case BINARY_AS_IS:
+    case BINARY_REVERSED:
+      m_tmpLine.resize((size.width() + 7) / 8);
+      break;
+    case GRAY_OR_INDEXED8:
+      m_tmpLine.resize(size.width());
+      break;
+    case RGB:
+      m_tmpLine.resize(size.width() * 3);
+      break;
+    case RGBA:
+      m_tmpLine.resize(size.width() * 4);
+      break;
   }
+
+  m_tif = std::move(tif);
+  m_format = format;
+  m_width = size.width();
+  m_height = size.height();
+  m_nextRow = 0;
+  m_failed = false;
   return true;
-}  // TiffWriter::writeARGB32Image
+}  // TiffWriter::StripWriter::begin
 
-bool TiffWriter::write8bitLines(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
+bool TiffWriter::StripWriter::writeRows(const QImage& rows) {
+  if (m_failed || !m_tif) {
+    return false;
+  }
+  if ((rows.format() != m_format) || (rows.width() != m_width) || (rows.height() > m_height - m_nextRow)) {
+    m_failed = true;
+    return false;
+  }
 
-  // TIFFWriteScanline() can actually modify the data you pass it,
-  // so we have to use a temporary buffer even when no coversion
-  // is required.
-  std::vector<uint8_t> tmpLine(width, 0);
+  if (((m_lineFormat == RGB) && (m_format != QImage::Format_RGB32))
+      || ((m_lineFormat == RGBA) && (m_format != QImage::Format_ARGB32))) {
+    // Convert a few lines at a time rather than the whole image.
+    const QImage::Format targetFormat = (m_lineFormat == RGB) ? QImage::Format_RGB32 : QImage::Format_ARGB32;
+    for (int y = 0; y < rows.height(); y += CONVERSION_BAND_HEIGHT) {
+      const int bandHeight = std::min(CONVERSION_BAND_HEIGHT, rows.height() - y);
+      const QImage band(rows.copy(0, y, m_width, bandHeight).convertToFormat(targetFormat));
+      for (int i = 0; i < bandHeight; ++i) {
+        if (!writeLine(band.scanLine(i))) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
 
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    memcpy(&tmpLine[0], srcLine, tmpLine.size());
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
+  for (int y = 0; y < rows.height(); ++y) {
+    if (!writeLine(rows.scanLine(y))) {
       return false;
     }
   }
   return true;
-}
+}  // TiffWriter::StripWriter::writeRows
 
-bool TiffWriter::writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
+bool TiffWriter::StripWriter::writeLine(const uint8_t* line) {
   // TIFFWriteScanline() can actually modify the data you pass it,
   // so we have to use a temporary buffer even when no coversion
   // is required.
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmpLine(bpl, 0);
-
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    memcpy(&tmpLine[0], srcLine, bpl);
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
+  uint8_t* dst = &m_tmpLine[0];
+  switch (m_lineFormat) {
+    case BINARY_AS_IS:
+    case GRAY_OR_INDEXED8:
+      memcpy(dst, line, m_tmpLine.size());
+      break;
+    case BINARY_REVERSED:
+      for (size_t i = 0; i < m_tmpLine.size(); ++i) {
+        dst[i] = m_reverseBitsLUT[line[i]];
+      }
+      break;
+    case RGB: {
+      // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
+      const auto* src = (const uint32_t*) line;
+      for (int x = 0; x < m_width; ++x) {
+        const uint32_t ARGB = src[x];
+        dst[0] = static_cast<uint8_t>(ARGB >> 16);
+        dst[1] = static_cast<uint8_t>(ARGB >> 8);
+        dst[2] = static_cast<uint8_t>(ARGB);
+        dst += 3;
+      }
+      break;
+    }
+    case RGBA: {
+      // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
+      const auto* src = (const uint32_t*) line;
+      for (int x = 0; x < m_width; ++x) {
+        const uint32_t ARGB = src[x];
+        dst[0] = static_cast<uint8_t>(ARGB >> 16);
+        dst[1] = static_cast<uint8_t>(ARGB >> 8);
+        dst[2] = static_cast<uint8_t>(ARGB);
+        dst[3] = static_cast<uint8_t>(ARGB >> 24);
+        dst += 4;
+      }
+      break;
     }
   }
-  return true;
-}
-
-bool TiffWriter::writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
 
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmpLine(bpl, 0);
-
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    for (int i = 0; i < bpl; ++i) {
-      tmpLine[i] = m_reverseBitsLUT[srcLine[i]];
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
+  if (TIFFWriteScanline(m_tif->handle(), &m_tmpLine[0], m_nextRow) == -1) {
+    m_failed = true;
+    return false;
   }
+  ++m_nextRow;
   return true;
+}  // TiffWriter::StripWriter::writeLine
+
+bool TiffWriter::StripWriter::finish() {
+  if (!m_tif) {
+    return false;
+  }
+
+  const bool success = !m_failed && (m_nextRow == m_height) && TIFFFlush(m_tif->handle());
+  m_tif.reset();
+  return success;
 }
@@ -6,16 +6,101 @@
 
 #include <tiff.h>
 
+#include <QImage>
+#include <QVector>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "NonCopyable.h"
 
 class QIODevice;
+class QRect;
+class QSize;
 class QString;
-class QImage;
 class Dpm;
 
 class TiffWriter {
+ private:
+  class TiffHandle;
+
  public:
+  /**
+   * \brief Writes a TIFF image supplied in bands of lines.
+   *
+   * Lines are compressed as soon as a strip of them is complete,
+   * so the whole image never has to be in memory.  Usage:
+   * \code
+   * TiffWriter::StripWriter writer;
+   * if (writer.begin(device, size, format, colorTable, dpm)) {
+   *   // writeRows() for every band, from top to bottom.
+   *   ok = writer.finish();
+   * }
+   * \endcode
+   */
+  class StripWriter {
+    DECLARE_NON_COPYABLE(StripWriter)
+
+   public:
+    StripWriter();
+
+    /**
+     * \brief Abandons writing, if it wasn't finished.
+     */
+    ~StripWriter();
+
+    /**
+     * \brief Writes the TIFF header and prepares for writing lines.
+     *
+     * \param device The device to write to.  This device must be
+     *        opened for writing and seekable.
+     * \param size The size of the whole image.
+     * \param format The format of bands to be passed to writeRows().
+     * \param colorTable The color table for the indexed and bitonal formats.
+     * \param dpm The physical resolution of the image.  May be null.
+     * \return True on success, false on failure.
+     */
+    bool begin(QIODevice& device,
+               const QSize& size,
+               QImage::Format format,
+               const QVector<QRgb>& colorTable,
+               const Dpm& dpm);
+
+    /**
+     * \brief Writes the next band of lines.
+     *
+     * \param rows The lines to write.  Must be as wide as the image and
+     *        have the format passed to begin().  RGB images in formats other
+     *        than RGB32 and ARGB32 are converted a few lines at a time.
+     * \return True on success, false on failure.
+     */
+    bool writeRows(const QImage& rows);
+
+    /**
+     * \brief Completes the file.
+     *
+     * \return True if all the lines have been written successfully.
+     */
+    bool finish();
+
+   private:
+    enum LineFormat { BINARY_AS_IS, BINARY_REVERSED, GRAY_OR_INDEXED8, RGB, RGBA };
+
+    bool writeLine(const uint8_t* line);
+
+    std::unique_ptr<TiffHandle> m_tif;
+    LineFormat m_lineFormat;
+    QImage::Format m_format;
+    int m_width;
+    int m_height;
+    int m_nextRow;
+    bool m_failed;
+    std::vector<uint8_t> m_tmpLine;
+  };
+
+
   /**
    * \brief Writes a QImage in TIFF format to a file.
    *
@@ -35,22 +120,28 @@ class TiffWriter {
    */
   static bool writeImage(QIODevice& device, const QImage& image);
 
- private:
-  class TiffHandle;
+  /**
+   * \brief Writes an image in TIFF format to a file, requesting it
+   *        band by band, so that it's never in memory as a whole.
+   *
+   * \param filePath The full path to the file.
+   * \param size The size of the image.  Writing an empty image will fail.
+   * \param bandAt Returns the given area of the image.  All the bands
+   *        must have the same format, color table and DPI.
+   * \return True on success, false on failure.
+   */
+  static bool writeImage(const QString& filePath,
+                         const QSize& size,
+                         const std::function<QImage(const QRect& area)>& bandAt);
 
+ private:
   static void setDpm(const TiffHandle& tif, const Dpm& dpm);
 
-  static bool writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image);
-
-  static bool writeRGB32Image(const TiffHandle& tif, const QImage& image);
-
-  static bool writeARGB32Image(const TiffHandle& tif, const QImage& image);
-
-  static bool write8bitLines(const TiffHandle& tif, const QImage& image);
-
-  static bool writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image);
+  static void setupBitonalOrIndexed8Image(const TiffHandle& tif,
+                                          QImage::Format format,
+                                          const QVector<QRgb>& colorTable);
 
-  static bool writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image);
+  static void setupRGBImage(const TiffHandle& tif, int samplesPerPixel);
 
   static const uint8_t m_reverseBitsLUT[256];
 };
@@ -50,7 +50,7 @@ QString Utils::outputDirToThumbDir(const QString& outputDir) {
 std::shared_ptr<ThumbnailPixmapCache> Utils::createThumbnailCache(const QString& outputDir) {
   const QSize maxPixmapSize = ApplicationSettings::getInstance().getThumbnailQuality();
   const QString thumbsCachePath(outputDirToThumbDir(outputDir));
-  return std::make_shared<ThumbnailPixmapCache>(thumbsCachePath, maxPixmapSize, 40, 5);
+  return std::make_shared<ThumbnailPixmapCache>(thumbsCachePath, maxPixmapSize, 100);
 }
 
 QString Utils::qssConvertPxToEm(const QString& stylesheet, const double base, const int precision) {
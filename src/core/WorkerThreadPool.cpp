@@ -5,9 +5,12 @@
 
 #include <QCoreApplication>
 #include <QThreadPool>
+#include <algorithm>
+#include <functional>
 #include <utility>
 
 #include "OutOfMemoryHandler.h"
+#include "ParallelFor.h"
 
 class WorkerThreadPool::TaskResultEvent : public QEvent {
  public:
@@ -24,55 +27,140 @@ class WorkerThreadPool::TaskResultEvent : public QEvent {
 };
 
 
-WorkerThreadPool::WorkerThreadPool(QObject* parent) : QObject(parent), m_pool(new QThreadPool(this)) {
+namespace {
+class FunctionRunnable : public QRunnable {
+ public:
+  explicit FunctionRunnable(std::function<void()> func) : m_func(std::move(func)) { setAutoDelete(true); }
+
+  void run() override { m_func(); }
+
+ private:
+  std::function<void()> m_func;
+};
+
+// The input and output stages mostly wait for the disk or libtiff,
+// so a couple of threads is enough to keep up with processing.
+const int NUM_INPUT_THREADS = 2;
+const int NUM_OUTPUT_THREADS = 2;
+const int MAX_PENDING_OUTPUTS = 2 * NUM_OUTPUT_THREADS;
+}  // namespace
+
+WorkerThreadPool::WorkerThreadPool(QObject* parent)
+    : QObject(parent),
+      m_inputPool(new QThreadPool(this)),
+      m_pool(new QThreadPool(this)),
+      m_outputPool(new QThreadPool(this)),
+      m_outputSlots(MAX_PENDING_OUTPUTS),
+      m_numThreadsOverride(0) {
+  m_inputPool->setMaxThreadCount(NUM_INPUT_THREADS);
+  m_outputPool->setMaxThreadCount(NUM_OUTPUT_THREADS);
   updateNumberOfThreads();
 }
 
-WorkerThreadPool::~WorkerThreadPool() = default;
+WorkerThreadPool::~WorkerThreadPool() {
+  shutdown();
+}
 
 void WorkerThreadPool::shutdown() {
+  // Each stage feeds the next one, so they have to be drained in order.
+  m_inputPool->waitForDone();
   m_pool->waitForDone();
+  m_outputPool->waitForDone();
 }
 
 bool WorkerThreadPool::hasSpareCapacity() const {
-  return m_pool->activeThreadCount() < m_pool->maxThreadCount();
+  // Keep enough batch tasks in flight for the processing threads not to wait
+  // while other pages are being decoded or written, but no more than that,
+  // as every one of them holds a whole page in memory.
+  const int maxBatchTasks = m_pool->maxThreadCount() + NUM_INPUT_THREADS + MAX_PENDING_OUTPUTS;
+  return m_numBatchTasks.load() < maxBatchTasks;
+}
+
+void WorkerThreadPool::setNumberOfThreads(const int numThreads) {
+  m_numThreadsOverride = std::max(numThreads, 0);
+  updateNumberOfThreads();
 }
 
 void WorkerThreadPool::submitTask(const BackgroundTaskPtr& task) {
-  class Runnable : public QRunnable {
-   public:
-    Runnable(WorkerThreadPool& owner, BackgroundTaskPtr task) : m_owner(owner), m_task(std::move(task)) {
-      setAutoDelete(true);
-    }
+  updateNumberOfThreads();
 
-    void run() override {
-      if (m_task->isCancelled()) {
-        return;
-      }
-
-      try {
-        const FilterResultPtr result((*m_task)());
-        if (result) {
-          QCoreApplication::postEvent(&m_owner, new TaskResultEvent(m_task, result));
-        }
-      } catch (const std::bad_alloc&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
-      }
-    }
+  if (task->type() == BackgroundTask::BATCH) {
+    m_numBatchTasks.ref();
+    m_inputPool->start(new FunctionRunnable([this, task]() { runInputStage(task); }));
+  } else {
+    // Interactive tasks skip the staging, as there is nothing to overlap them with.
+    m_pool->start(new FunctionRunnable([this, task]() { runProcessingStage(task); }));
+  }
+}
 
-   private:
-    WorkerThreadPool& m_owner;
-    BackgroundTaskPtr m_task;
-  };
+void WorkerThreadPool::runInputStage(const BackgroundTaskPtr& task) {
+  if (task->isCancelled()) {
+    taskFinished(task, nullptr);
+    return;
+  }
 
+  try {
+    task->prepare();
+  } catch (const std::bad_alloc&) {
+    OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+    taskFinished(task, nullptr);
+    return;
+  }
 
-  updateNumberOfThreads();
-  m_pool->start(new Runnable(*this, task));
-}  // WorkerThreadPool::submitTask
+  m_pool->start(new FunctionRunnable([this, task]() { runProcessingStage(task); }));
+}
+
+void WorkerThreadPool::runProcessingStage(const BackgroundTaskPtr& task) {
+  FilterResultPtr result;
+  if (!task->isCancelled()) {
+    // Keeps image processing routines from spreading over cores other tasks are using.
+    const foundation::ParallelFor::ComputeScope computeScope;
+    try {
+      result = (*task)();
+    } catch (const std::bad_alloc&) {
+      OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+    }
+  }
+
+  std::function<void()> deferredWork;
+  if (result) {
+    deferredWork = result->takeDeferredWork();
+  }
+  if (!deferredWork) {
+    taskFinished(task, result);
+    return;
+  }
+
+  // This blocks if the output stage falls behind, which prevents
+  // finished pages from piling up in memory.
+  m_outputSlots.acquire();
+  m_outputPool->start(new FunctionRunnable([this, task, result, deferredWork]() {
+    bool succeeded = true;
+    try {
+      deferredWork();
+    } catch (const std::bad_alloc&) {
+      OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+      succeeded = false;
+    }
+    m_outputSlots.release();
+    taskFinished(task, succeeded ? result : nullptr);
+  }));
+}  // WorkerThreadPool::runProcessingStage
+
+void WorkerThreadPool::taskFinished(const BackgroundTaskPtr& task, const FilterResultPtr& result) {
+  if (task->type() == BackgroundTask::BATCH) {
+    m_numBatchTasks.deref();
+  }
+  QCoreApplication::postEvent(this, new TaskResultEvent(task, result));
+}
 
 void WorkerThreadPool::customEvent(QEvent* event) {
   if (auto* evt = dynamic_cast<TaskResultEvent*>(event)) {
-    emit taskResult(evt->task(), evt->result());
+    if (evt->result()) {
+      emit taskResult(evt->task(), evt->result());
+    } else {
+      emit taskDiscarded(evt->task());
+    }
   }
 }
 
@@ -84,7 +172,10 @@ void WorkerThreadPool::updateNumberOfThreads() {
     maxThreads = std::min(maxThreads, 2);
   }
 
-  int numThreads = m_settings.value("settings/batch_processing_threads", maxThreads).toInt();
-  numThreads = std::min(numThreads, maxThreads);
+  int numThreads = m_numThreadsOverride;
+  if (numThreads <= 0) {
+    numThreads = m_settings.value("settings/batch_processing_threads", maxThreads).toInt();
+    numThreads = std::min(numThreads, maxThreads);
+  }
   m_pool->setMaxThreadCount(numThreads);
 }
@@ -4,7 +4,9 @@
 #ifndef SCANTAILOR_CORE_WORKERTHREADPOOL_H_
 #define SCANTAILOR_CORE_WORKERTHREADPOOL_H_
 
+#include <QAtomicInt>
 #include <QObject>
+#include <QSemaphore>
 #include <QSettings>
 #include <memory>
 
@@ -13,6 +15,16 @@
 
 class QThreadPool;
 
+/**
+ * \brief Runs background tasks on a pool of threads.
+ *
+ * Batch tasks go through three stages, each with its own threads:
+ * the input stage calls BackgroundTask::prepare() to decode the source image,
+ * the processing stage runs the task itself, and the output stage runs
+ * FilterResult::takeDeferredWork(), which encodes and writes the output files.
+ * The number of batch tasks in flight is limited, see hasSpareCapacity(),
+ * and the processing stage blocks when too many results wait for output.
+ */
 class WorkerThreadPool : public QObject {
   Q_OBJECT
  public:
@@ -30,12 +42,25 @@ class WorkerThreadPool : public QObject {
 
   bool hasSpareCapacity() const;
 
+  /**
+   * \brief Overrides the number of threads taken from the application settings.
+   *
+   * \param numThreads The number of worker threads, or 0 to use the settings value.
+   */
+  void setNumberOfThreads(int numThreads);
+
   void submitTask(const BackgroundTaskPtr& task);
 
  signals:
 
   void taskResult(const BackgroundTaskPtr& task, const FilterResultPtr& result);
 
+  /**
+   * \brief Emitted instead of taskResult() for a task that finished without a result,
+   *        for instance because it was cancelled.
+   */
+  void taskDiscarded(const BackgroundTaskPtr& task);
+
  private:
   class TaskResultEvent;
 
@@ -43,8 +68,19 @@ class WorkerThreadPool : public QObject {
 
   void updateNumberOfThreads();
 
+  void runInputStage(const BackgroundTaskPtr& task);
+
+  void runProcessingStage(const BackgroundTaskPtr& task);
+
+  void taskFinished(const BackgroundTaskPtr& task, const FilterResultPtr& result);
+
+  QThreadPool* m_inputPool;
   QThreadPool* m_pool;
+  QThreadPool* m_outputPool;
+  QSemaphore m_outputSlots;
+  QAtomicInt m_numBatchTasks;
   QSettings m_settings;
+  int m_numThreadsOverride;
 };
 
 
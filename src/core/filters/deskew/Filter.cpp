@@ -7,6 +7,8 @@
 #include <filters/select_content/CacheDrivenTask.h>
 #include <filters/select_content/Task.h>
 
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "AbstractRelinker.h"
@@ -37,6 +39,10 @@ QString Filter::getName() const {
   return QCoreApplication::translate("deskew::Filter", "Deskew");
 }
 
+QString Filter::settingsTagName() const {
+  return "deskew";
+}
+
 PageView Filter::getView() const {
   return PAGE_VIEW;
 }
@@ -51,20 +57,20 @@ void Filter::preUpdateUI(FilterUiInterface* const ui, const PageInfo& pageInfo)
   ui->setOptionsWidget(m_optionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("deskew"));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
 
   writer.enumPages(
-      [&](const PageId& pageId, const int numericId) { this->writeParams(doc, filterEl, pageId, numericId); });
+      [&](const PageId& pageId, const int numericId) { this->writeParams(writer, xml, pageId, numericId); });
 
-  saveImageSettings(writer, doc, filterEl);
-  return filterEl;
+  saveImageSettings(writer, xml);
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  const QDomElement filterEl(filtersEl.namedItem("deskew").toElement());
+  const QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
 
   const QString pageTagName("page");
   QDomNode node(filterEl.firstChild());
@@ -100,17 +106,21 @@ void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filter
   loadImageSettings(reader, filterEl.namedItem("image-settings").toElement());
 }  // Filter::loadSettings
 
-void Filter::writeParams(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writeParams(const ProjectWriter& writer,
+                         QXmlStreamWriter& xml,
+                         const PageId& pageId,
+                         int numericId) const {
   const std::unique_ptr<Params> params(m_settings->getPageParams(pageId));
   if (!params) {
+    writer.writeRemovedEntry(xml, "page", numericId);
     return;
   }
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
-  pageEl.appendChild(params->toXml(doc, "params"));
-
-  filterEl.appendChild(pageEl);
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "params"));
+  xml.writeEndElement();
 }
 
 std::shared_ptr<Task> Filter::createTask(const PageId& pageId,
@@ -150,26 +160,28 @@ OptionsWidget* Filter::optionsWidget() {
   return m_optionsWidget.get();
 }
 
-void Filter::saveImageSettings(const ProjectWriter& writer, QDomDocument& doc, QDomElement& filterEl) const {
-  QDomElement imageSettingsEl(doc.createElement("image-settings"));
-  writer.enumPages([&](const PageId& pageId, const int numericId) {
-    this->writeImageParams(doc, imageSettingsEl, pageId, numericId);
-  });
-
-  filterEl.appendChild(imageSettingsEl);
+void Filter::saveImageSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement("image-settings");
+  writer.enumPages(
+      [&](const PageId& pageId, const int numericId) { this->writeImageParams(writer, xml, pageId, numericId); });
+  xml.writeEndElement();
 }
 
-void Filter::writeImageParams(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writeImageParams(const ProjectWriter& writer,
+                              QXmlStreamWriter& xml,
+                              const PageId& pageId,
+                              int numericId) const {
   const std::unique_ptr<ImageSettings::PageParams> params(m_imageSettings->getPageParams(pageId));
   if (!params) {
+    writer.writeRemovedEntry(xml, "page", numericId);
     return;
   }
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
-  pageEl.appendChild(params->toXml(doc, "image-params"));
-
-  filterEl.appendChild(pageEl);
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "image-params"));
+  xml.writeEndElement();
 }
 
 void Filter::loadImageSettings(const ProjectReader& reader, const QDomElement& imageSettingsEl) {
@@ -11,6 +11,7 @@
 #include <ReduceThreshold.h>
 #include <SeedFill.h>
 #include <SkewFinder.h>
+#include <Tracer.h>
 #include <UnitsProvider.h>
 #include <UpscaleIntegerTimes.h>
 #include <core/ApplicationSettings.h>
@@ -80,6 +81,8 @@ Task::Task(std::shared_ptr<Filter> filter,
 Task::~Task() = default;
 
 FilterResultPtr Task::process(const TaskStatus& status, FilterData data) {
+  const foundation::Tracer::Span span("deskew::Task::process");
+
   status.throwIfCancelled();
 
   const Dependencies deps(data.xform().preCropArea(), data.xform().preRotation());
@@ -7,6 +7,8 @@
 #include <filters/page_split/Task.h>
 
 #include <QCoreApplication>
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "CacheDrivenTask.h"
@@ -18,7 +20,6 @@
 #include "Settings.h"
 #include "Task.h"
 #include "Utils.h"
-#include "XmlMarshaller.h"
 
 namespace fix_orientation {
 Filter::Filter(const PageSelectionAccessor& pageSelectionAccessor)
@@ -32,6 +33,10 @@ QString Filter::getName() const {
   return QCoreApplication::translate("fix_orientation::Filter", "Fix Orientation");
 }
 
+QString Filter::settingsTagName() const {
+  return "fix-orientation";
+}
+
 PageView Filter::getView() const {
   return IMAGE_VIEW;
 }
@@ -49,19 +54,19 @@ void Filter::preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) {
   }
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("fix-orientation"));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
   writer.enumImages(
-      [&](const ImageId& imageId, const int numericId) { this->writeParams(doc, filterEl, imageId, numericId); });
+      [&](const ImageId& imageId, const int numericId) { this->writeParams(writer, xml, imageId, numericId); });
 
-  saveImageSettings(writer, doc, filterEl);
-  return filterEl;
+  saveImageSettings(writer, xml);
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  QDomElement filterEl(filtersEl.namedItem("fix-orientation").toElement());
+  QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
 
   const QString imageTagName("image");
   QDomNode node(filterEl.firstChild());
@@ -104,18 +109,21 @@ std::shared_ptr<CacheDrivenTask> Filter::createCacheDrivenTask(std::shared_ptr<p
   return std::make_shared<CacheDrivenTask>(m_settings, std::move(nextTask));
 }
 
-void Filter::writeParams(QDomDocument& doc, QDomElement& filterEl, const ImageId& imageId, int numericId) const {
+void Filter::writeParams(const ProjectWriter& writer,
+                         QXmlStreamWriter& xml,
+                         const ImageId& imageId,
+                         int numericId) const {
   const OrthogonalRotation rotation(m_settings->getRotationFor(imageId));
   if (rotation.toDegrees() == 0) {
+    writer.writeRemovedEntry(xml, "image", numericId);
     return;
   }
 
-  XmlMarshaller marshaller(doc);
-
-  QDomElement imageEl(doc.createElement("image"));
-  imageEl.setAttribute("id", numericId);
-  imageEl.appendChild(rotation.toXml(doc, "rotation"));
-  filterEl.appendChild(imageEl);
+  QDomDocument doc;
+  xml.writeStartElement("image");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, rotation.toXml(doc, "rotation"));
+  xml.writeEndElement();
 }
 
 void Filter::loadDefaultSettings(const PageInfo& pageInfo) {
@@ -129,26 +137,28 @@ OptionsWidget* Filter::optionsWidget() {
   return m_optionsWidget.get();
 }
 
-void Filter::saveImageSettings(const ProjectWriter& writer, QDomDocument& doc, QDomElement& filterEl) const {
-  QDomElement imageSettingsEl(doc.createElement("image-settings"));
-  writer.enumPages([&](const PageId& pageId, const int numericId) {
-    this->writeImageParams(doc, imageSettingsEl, pageId, numericId);
-  });
-
-  filterEl.appendChild(imageSettingsEl);
+void Filter::saveImageSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement("image-settings");
+  writer.enumPages(
+      [&](const PageId& pageId, const int numericId) { this->writeImageParams(writer, xml, pageId, numericId); });
+  xml.writeEndElement();
 }
 
-void Filter::writeImageParams(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writeImageParams(const ProjectWriter& writer,
+                              QXmlStreamWriter& xml,
+                              const PageId& pageId,
+                              int numericId) const {
   const std::unique_ptr<ImageSettings::PageParams> params(m_imageSettings->getPageParams(pageId));
   if (!params) {
+    writer.writeRemovedEntry(xml, "page", numericId);
     return;
   }
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
-  pageEl.appendChild(params->toXml(doc, "image-params"));
-
-  filterEl.appendChild(pageEl);
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "image-params"));
+  xml.writeEndElement();
 }
 
 void Filter::loadImageSettings(const ProjectReader& reader, const QDomElement& imageSettingsEl) {
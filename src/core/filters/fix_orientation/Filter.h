@@ -15,8 +15,8 @@
 class ImageId;
 class PageSelectionAccessor;
 class QString;
-class QDomDocument;
 class QDomElement;
+class QXmlStreamWriter;
 class ImageSettings;
 
 namespace page_split {
@@ -44,13 +44,15 @@ class Filter : public AbstractFilter {
 
   QString getName() const override;
 
+  QString settingsTagName() const override;
+
   PageView getView() const override;
 
   void performRelinking(const AbstractRelinker& relinker) override;
 
   void preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) override;
 
-  QDomElement saveSettings(const ProjectWriter& writer, QDomDocument& doc) const override;
+  void saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const override;
 
   void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) override;
 
@@ -65,11 +67,11 @@ class Filter : public AbstractFilter {
   OptionsWidget* optionsWidget();
 
  private:
-  void writeParams(QDomDocument& doc, QDomElement& filterEl, const ImageId& imageId, int numericId) const;
+  void writeParams(const ProjectWriter& writer, QXmlStreamWriter& xml, const ImageId& imageId, int numericId) const;
 
-  void saveImageSettings(const ProjectWriter& writer, QDomDocument& doc, QDomElement& filterEl) const;
+  void saveImageSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const;
 
-  void writeImageParams(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const;
+  void writeImageParams(const ProjectWriter& writer, QXmlStreamWriter& xml, const PageId& pageId, int numericId) const;
 
   void loadImageSettings(const ProjectReader& reader, const QDomElement& imageSettingsEl);
 
@@ -3,6 +3,7 @@
 
 #include "Task.h"
 
+#include <Tracer.h>
 #include <UnitsProvider.h>
 
 #include <utility>
@@ -59,6 +60,7 @@ Task::~Task() = default;
 
 FilterResultPtr Task::process(const TaskStatus& status, FilterData data) {
   // This function is executed from the worker thread.
+  const foundation::Tracer::Span span("fix_orientation::Task::process");
   status.throwIfCancelled();
 
   updateFilterData(data);
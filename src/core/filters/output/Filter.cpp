@@ -5,19 +5,34 @@
 
 #include <OrderByCompletenessProvider.h>
 
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "CacheDrivenTask.h"
 #include "FilterUiInterface.h"
+#include "MemoryBudget.h"
 #include "OptionsWidget.h"
 #include "ProjectReader.h"
 #include "ProjectWriter.h"
 #include "Settings.h"
 #include "Task.h"
 #include "ThumbnailPixmapCache.h"
+#include "RenderParams.h"
 #include "Utils.h"
 
 namespace output {
+namespace {
+// Rough numbers of bytes per output pixel taken by the images
+// OutputGenerator keeps around at the same time.
+const int BINARY_BYTES_PER_PIXEL = 4 + 1 + 1 + 1;
+const int COLOR_BYTES_PER_PIXEL = 4 + 4 + 4;
+const int MIXED_BYTES_PER_PIXEL = COLOR_BYTES_PER_PIXEL + 1 + 1 + 1;
+const int SPLIT_OUTPUT_BYTES_PER_PIXEL = 4 + 4;
+const int COLOR_SEGMENTATION_BYTES_PER_PIXEL = 4;
+const int DEWARPING_BYTES_PER_PIXEL = 4;
+}  // namespace
+
 Filter::Filter(const PageSelectionAccessor& pageSelectionAccessor)
     : m_settings(std::make_shared<Settings>()), m_selectedPageOrder(0) {
   m_optionsWidget.reset(new OptionsWidget(m_settings, pageSelectionAccessor));
@@ -34,6 +49,10 @@ QString Filter::getName() const {
   return QCoreApplication::translate("output::Filter", "Output");
 }
 
+QString Filter::settingsTagName() const {
+  return "output";
+}
+
 PageView Filter::getView() const {
   return PAGE_VIEW;
 }
@@ -47,37 +66,39 @@ void Filter::preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) {
   ui->setOptionsWidget(m_optionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("output"));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
 
-  writer.enumPages(
-      [&](const PageId& pageId, int numericId) { this->writePageSettings(doc, filterEl, pageId, numericId); });
-  return filterEl;
+  writer.enumPages([&](const PageId& pageId, int numericId) { this->writePageSettings(xml, pageId, numericId); });
+  xml.writeEndElement();
 }
 
-void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writePageSettings(QXmlStreamWriter& xml, const PageId& pageId, int numericId) const {
   const Params params(m_settings->getParams(pageId));
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
+  // Zones and dewarping models are the bulk of a project, so only
+  // the current page's ones are held as DOM at a time.
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
 
-  pageEl.appendChild(m_settings->pictureZonesForPage(pageId).toXml(doc, "zones"));
-  pageEl.appendChild(m_settings->fillZonesForPage(pageId).toXml(doc, "fill-zones"));
-  pageEl.appendChild(params.toXml(doc, "params"));
-  pageEl.appendChild(m_settings->getOutputProcessingParams(pageId).toXml(doc, "processing-params"));
+  ProjectWriter::writeDomElement(xml, m_settings->pictureZonesForPage(pageId).toXml(doc, "zones"));
+  ProjectWriter::writeDomElement(xml, m_settings->fillZonesForPage(pageId).toXml(doc, "fill-zones"));
+  ProjectWriter::writeDomElement(xml, params.toXml(doc, "params"));
+  ProjectWriter::writeDomElement(xml, m_settings->getOutputProcessingParams(pageId).toXml(doc, "processing-params"));
 
   std::unique_ptr<OutputParams> outputParams(m_settings->getOutputParams(pageId));
   if (outputParams) {
-    pageEl.appendChild(outputParams->toXml(doc, "output-params"));
+    ProjectWriter::writeDomElement(xml, outputParams->toXml(doc, "output-params"));
   }
 
-  filterEl.appendChild(pageEl);
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  const QDomElement filterEl(filtersEl.namedItem("output").toElement());
+  const QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
 
   const QString pageTagName("page");
   QDomNode node(filterEl.firstChild());
@@ -155,6 +176,38 @@ void Filter::loadDefaultSettings(const PageInfo& pageInfo) {
   m_settings->setParams(pageInfo.id(), Utils::buildDefaultParams());
 }
 
+qint64 Filter::estimateMemoryUsage(const PageInfo& pageInfo) const {
+  const Params params(m_settings->getParams(pageInfo.id()));
+  const RenderParams renderParams(params.colorParams(), params.splittingOptions());
+  const ImageMetadata& metadata = pageInfo.metadata();
+
+  // The output can't be larger than the whole source image scaled to the output resolution.
+  double scale = 1.0;
+  const Dpi& srcDpi = metadata.dpi();
+  const Dpi& outDpi = params.outputDpi();
+  if (!srcDpi.isNull() && !outDpi.isNull()) {
+    scale = (double(outDpi.horizontal()) / srcDpi.horizontal()) * (double(outDpi.vertical()) / srcDpi.vertical());
+  }
+  const double outPixels = double(metadata.size().width()) * metadata.size().height() * scale;
+
+  int bytesPerPixel = COLOR_BYTES_PER_PIXEL;
+  if (renderParams.binaryOutput()) {
+    bytesPerPixel = BINARY_BYTES_PER_PIXEL;
+  } else if (renderParams.mixedOutput()) {
+    bytesPerPixel = MIXED_BYTES_PER_PIXEL;
+  }
+  if (renderParams.splitOutput()) {
+    bytesPerPixel += SPLIT_OUTPUT_BYTES_PER_PIXEL;
+  }
+  if (renderParams.needColorSegmentation()) {
+    bytesPerPixel += COLOR_SEGMENTATION_BYTES_PER_PIXEL;
+  }
+  if (params.dewarpingOptions().dewarpingMode() != OFF) {
+    bytesPerPixel += DEWARPING_BYTES_PER_PIXEL;
+  }
+  return MemoryBudget::estimateForImage(metadata) + static_cast<qint64>(outPixels * bytesPerPixel);
+}
+
 OptionsWidget* Filter::optionsWidget() {
   return m_optionsWidget.get();
 }
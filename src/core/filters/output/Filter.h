@@ -38,13 +38,15 @@ class Filter : public AbstractFilter {
 
   QString getName() const override;
 
+  QString settingsTagName() const override;
+
   PageView getView() const override;
 
   void performRelinking(const AbstractRelinker& relinker) override;
 
   void preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) override;
 
-  QDomElement saveSettings(const ProjectWriter& writer, QDomDocument& doc) const override;
+  void saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const override;
 
   void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) override;
 
@@ -58,6 +60,12 @@ class Filter : public AbstractFilter {
 
   std::shared_ptr<CacheDrivenTask> createCacheDrivenTask(const OutputFileNameGenerator& outFileNameGen);
 
+  /**
+   * \brief Estimates the peak memory usage of processing a page
+   *        up to and including this stage, in bytes.
+   */
+  qint64 estimateMemoryUsage(const PageInfo& pageInfo) const;
+
   OptionsWidget* optionsWidget();
 
   std::vector<PageOrderOption> pageOrderOptions() const override;
@@ -67,7 +75,7 @@ class Filter : public AbstractFilter {
   void selectPageOrder(int option) override;
 
  private:
-  void writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const;
+  void writePageSettings(QXmlStreamWriter& xml, const PageId& pageId, int numericId) const;
 
   std::shared_ptr<Settings> m_settings;
   SafeDeletingQObjectPtr<OptionsWidget> m_optionsWidget;
@@ -28,6 +28,7 @@
 #include <SeedFill.h>
 #include <TextLineTracer.h>
 #include <TopBottomEdgeTracer.h>
+#include <Tracer.h>
 #include <Transform.h>
 #include <core/ApplicationSettings.h>
 #include <imageproc/BackgroundColorCalculator.h>
@@ -64,6 +65,7 @@
 #include "PictureShapeOptions.h"
 #include "RenderParams.h"
 #include "Settings.h"
+#include "StageCache.h"
 #include "TaskStatus.h"
 #include "Utils.h"
 #include "ZoneCategoryProperty.h"
@@ -96,6 +98,7 @@ class OutputGenerator::Processor {
   Processor(const OutputGenerator& generator,
             const PageId& pageId,
             const std::shared_ptr<Settings>& settings,
+            const StageCache* stageCache,
             const FilterData& input,
             const TaskStatus& status,
             DebugImages* dbg);
@@ -158,6 +161,15 @@ class OutputGenerator::Processor {
                                       const QRect& targetRect,
                                       GrayImage* background = nullptr) const;
 
+  /**
+   * \brief Normalizes illumination of the input image transformed
+   *        to the working coordinate system.
+   *
+   * As the result only depends on the previous stages, it's taken
+   * from the stage cache when possible.
+   */
+  GrayImage normalizeIlluminationInWorkingCs() const;
+
   GrayImage detectPictures(const GrayImage& input300dpi) const;
 
   BinaryImage estimateBinarizationMask(const GrayImage& graySource,
@@ -209,6 +221,7 @@ class OutputGenerator::Processor {
 
   const PageId m_pageId;
   const std::shared_ptr<Settings> m_settings;
+  const StageCache* const m_stageCache;
 
   Dpi m_dpi;
   ColorParams m_colorParams;
@@ -255,14 +268,16 @@ std::unique_ptr<OutputImage> OutputGenerator::process(const TaskStatus& status,
                                                       BinaryImage* specklesImage,
                                                       DebugImages* dbg,
                                                       const PageId& pageId,
-                                                      const std::shared_ptr<Settings>& settings) const {
-  return Processor(*this, pageId, settings, input, status, dbg)
+                                                      const std::shared_ptr<Settings>& settings,
+                                                      const StageCache* stageCache) const {
+  return Processor(*this, pageId, settings, stageCache, input, status, dbg)
       .process(pictureZones, fillZones, distortionModel, depthPerception, autoPictureMask, specklesImage);
 }
 
 OutputGenerator::Processor::Processor(const OutputGenerator& generator,
                                       const PageId& pageId,
                                       const std::shared_ptr<Settings>& settings,
+                                      const StageCache* stageCache,
                                       const FilterData& input,
                                       const TaskStatus& status,
                                       DebugImages* dbg)
@@ -271,6 +286,7 @@ OutputGenerator::Processor::Processor(const OutputGenerator& generator,
       m_contentRect(generator.m_contentRect),
       m_pageId(pageId),
       m_settings(settings),
+      m_stageCache(stageCache),
       m_despeckleLevel(0),
       m_blank(false),
       m_blackOnWhite(true),
@@ -290,6 +306,8 @@ std::unique_ptr<OutputImage> OutputGenerator::Processor::process(ZoneSet& pictur
                                                                  const DepthPerception& depthPerception,
                                                                  BinaryImage* autoPictureMask,
                                                                  BinaryImage* specklesImage) {
+  const foundation::Tracer::Span span("OutputGenerator::process");
+
   std::unique_ptr<OutputImage> image
       = processImpl(pictureZones, fillZones, distortionModel, depthPerception, autoPictureMask, specklesImage);
   image->setDpm(m_dpi);
@@ -1487,8 +1505,7 @@ std::unique_ptr<OutputImage> OutputGenerator::Processor::processWithDewarping(Zo
     warpedGrayOutput = transformToGray(m_inputGrayImage, m_xform.transform(), m_workingBoundingRect,
                                        OutsidePixels::assumeWeakColor(m_outsideBackgroundColor));
   } else {
-    warpedGrayOutput = normalizeIlluminationGray(m_inputGrayImage, m_preCropAreaInOriginalCs, m_xform.transform(),
-                                                 m_workingBoundingRect);
+    warpedGrayOutput = normalizeIlluminationInWorkingCs();
   }
 
   // Original image, but:
@@ -1835,9 +1852,34 @@ GrayImage OutputGenerator::Processor::normalizeIlluminationGray(const QImage& in
   return bgImg;
 }
 
+GrayImage OutputGenerator::Processor::normalizeIlluminationInWorkingCs() const {
+  // Debugging images are only produced when actually processing.
+  if (!m_stageCache || m_dbg) {
+    return normalizeIlluminationGray(m_inputGrayImage, m_preCropAreaInOriginalCs, m_xform.transform(),
+                                     m_workingBoundingRect);
+  }
+
+  StageCache::Key key(QStringLiteral("output/normalized_illumination/1"));
+  key.addSource(m_pageId.imageId());
+  key << m_blackOnWhite << m_preCropAreaInOriginalCs << m_xform.transform() << m_workingBoundingRect;
+
+  QImage cached;
+  if (m_stageCache->load(key, cached) && (cached.format() == QImage::Format_Indexed8)
+      && (cached.size() == m_workingBoundingRect.size())) {
+    return GrayImage(cached);
+  }
+
+  GrayImage normalized = normalizeIlluminationGray(m_inputGrayImage, m_preCropAreaInOriginalCs, m_xform.transform(),
+                                                   m_workingBoundingRect);
+  m_stageCache->store(key, normalized.toQImage());
+  return normalized;
+}
+
 BinaryImage OutputGenerator::Processor::estimateBinarizationMask(const GrayImage& graySource,
                                                                  const QRect& sourceRect,
                                                                  const QRect& sourceSubRect) const {
+  const foundation::Tracer::Span span("OutputGenerator::estimateBinarizationMask");
+
   assert(sourceRect.contains(sourceSubRect));
 
   // If we need to strip some of the margins from a grayscale
@@ -1977,6 +2019,8 @@ QImage OutputGenerator::Processor::dewarp(const QTransform& origToSrc,
                                           const DistortionModel& distortionModel,
                                           const DepthPerception& depthPerception,
                                           const QColor& bgColor) const {
+  const foundation::Tracer::Span span("OutputGenerator::dewarp");
+
   const CylindricalSurfaceDewarper dewarper(createDewarper(distortionModel, origToSrc, depthPerception.value()));
 
   // Model domain is a rectangle in output image coordinates that
@@ -1991,6 +2035,8 @@ QImage OutputGenerator::Processor::dewarp(const QTransform& origToSrc,
 }
 
 GrayImage OutputGenerator::Processor::detectPictures(const GrayImage& input300dpi) const {
+  const foundation::Tracer::Span span("OutputGenerator::detectPictures");
+
   // We stretch the range of gray levels to cover the whole
   // range of [0, 255].  We do it because we want text
   // and background to be equally far from the center
@@ -2103,6 +2149,8 @@ BinaryThreshold OutputGenerator::Processor::calcBinarizationThreshold(const QIma
 }
 
 void OutputGenerator::Processor::morphologicalSmoothInPlace(BinaryImage& binImg) const {
+  const foundation::Tracer::Span span("OutputGenerator::morphologicalSmooth");
+
   // When removing black noise, remove small ones first.
 
   {
@@ -2187,6 +2235,8 @@ void OutputGenerator::Processor::morphologicalSmoothInPlace(BinaryImage& binImg)
 }
 
 BinaryImage OutputGenerator::Processor::binarize(const QImage& image) const {
+  const foundation::Tracer::Span span("OutputGenerator::binarize");
+
   if ((image.format() == QImage::Format_Mono) || (image.format() == QImage::Format_MonoLSB)) {
     return BinaryImage(image);
   }
@@ -2281,6 +2331,8 @@ void OutputGenerator::Processor::maybeDespeckleInPlace(BinaryImage& image,
                                                        double level,
                                                        BinaryImage* specklesImg,
                                                        const Dpi& dpi) const {
+  const foundation::Tracer::Span span("OutputGenerator::despeckle");
+
   const QRect srcRect(maskRect.translated(-imageRect.topLeft()));
   const QRect dstRect(maskRect);
 
@@ -2309,6 +2361,8 @@ void OutputGenerator::Processor::maybeDespeckleInPlace(BinaryImage& image,
 }
 
 double OutputGenerator::Processor::findSkew(const QImage& image) const {
+  const foundation::Tracer::Span span("OutputGenerator::findSkew");
+
   if (m_dewarpingOptions.needPostDeskew()
       && ((m_dewarpingOptions.dewarpingMode() == MARGINAL) || (m_dewarpingOptions.dewarpingMode() == MANUAL))) {
     const BinaryImage bwImage(image, BinaryThreshold::otsuThreshold(GrayscaleHistogram(image)));
@@ -2321,6 +2375,8 @@ double OutputGenerator::Processor::findSkew(const QImage& image) const {
 }
 
 QImage OutputGenerator::Processor::segmentImage(const BinaryImage& image, const QImage& colorImage) const {
+  const foundation::Tracer::Span span("OutputGenerator::segmentImage");
+
   const BlackWhiteOptions::ColorSegmenterOptions& segmenterOptions
       = m_colorParams.blackWhiteOptions().getColorSegmenterOptions();
   ColorSegmenter segmenter(m_dpi, segmenterOptions.getNoiseReduction(), segmenterOptions.getRedThresholdAdjustment(),
@@ -2344,6 +2400,8 @@ QImage OutputGenerator::Processor::segmentImage(const BinaryImage& image, const
 }
 
 QImage OutputGenerator::Processor::posterizeImage(const QImage& image, const QColor& backgroundColor) const {
+  const foundation::Tracer::Span span("OutputGenerator::posterizeImage");
+
   const ColorCommonOptions::PosterizationOptions& posterizationOptions
       = m_colorParams.colorCommonOptions().getPosterizationOptions();
   Posterizer posterizer(posterizationOptions.getLevel(), posterizationOptions.isNormalizationEnabled(),
@@ -2402,10 +2460,11 @@ ForegroundType OutputGenerator::Processor::getForegroundType() const {
 }
 
 QImage OutputGenerator::Processor::transformToWorkingCs(bool normalize) const {
+  const foundation::Tracer::Span span("OutputGenerator::transformToWorkingCs");
+
   QImage dst;
   if (normalize) {
-    dst = normalizeIlluminationGray(m_inputGrayImage, m_preCropAreaInOriginalCs, m_xform.transform(),
-                                    m_workingBoundingRect);
+    dst = normalizeIlluminationInWorkingCs();
     if (m_colorOriginal) {
       assert(dst.format() == QImage::Format_Indexed8);
       QImage colorImg = transform(m_inputOrigImage, m_xform.transform(), m_workingBoundingRect,
@@ -2428,6 +2487,8 @@ QImage OutputGenerator::Processor::transformToWorkingCs(bool normalize) const {
 
 DistortionModel OutputGenerator::Processor::buildAutoDistortionModel(const GrayImage& warpedGrayOutput,
                                                                      const QTransform& toOriginal) const {
+  const foundation::Tracer::Span span("OutputGenerator::buildAutoDistortionModel");
+
   DistortionModelBuilder modelBuilder(Vec2d(0, 1));
 
   TextLineTracer::trace(warpedGrayOutput, m_dpi, m_contentRectInWorkingCs, modelBuilder, m_status, m_dbg);
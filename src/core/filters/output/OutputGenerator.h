@@ -17,6 +17,7 @@ class ZoneSet;
 class QSize;
 class QImage;
 class PageId;
+class StageCache;
 
 namespace imageproc {
 class BinaryImage;
@@ -60,6 +61,8 @@ class OutputGenerator {
    *        to be performed again with different settings, without going
    *        through the whole output generation process again.
    * \param dbg An optional sink for debugging images.
+   * \param stageCache An optional on-disk cache for the intermediate images
+   *        that only depend on the previous stages.
    */
   std::unique_ptr<OutputImage> process(const TaskStatus& status,
                                        const FilterData& input,
@@ -71,7 +74,8 @@ class OutputGenerator {
                                        imageproc::BinaryImage* specklesImage,
                                        DebugImages* dbg,
                                        const PageId& pageId,
-                                       const std::shared_ptr<Settings>& settings) const;
+                                       const std::shared_ptr<Settings>& settings,
+                                       const StageCache* stageCache = nullptr) const;
 
   QSize outputImageSize() const;
 
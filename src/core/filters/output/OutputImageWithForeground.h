@@ -12,6 +12,14 @@ class OutputImageWithForeground : public virtual OutputImage {
   virtual QImage getForegroundImage() const = 0;
 
   virtual QImage getBackgroundImage() const = 0;
+
+  /**
+   * \brief Returns the given area of the background image.
+   *
+   * Lets the background image be written in bands without
+   * ever having it in memory as a whole.
+   */
+  virtual QImage getBackgroundImage(const QRect& area) const = 0;
 };
 }  // namespace output
 
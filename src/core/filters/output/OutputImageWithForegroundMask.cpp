@@ -5,6 +5,7 @@
 
 #include <imageproc/ImageCombination.h>
 #include <imageproc/Posterizer.h>
+#include <imageproc/RasterOp.h>
 
 using namespace imageproc;
 
@@ -41,6 +42,21 @@ QImage OutputImageWithForegroundMask::getBackgroundImage() const {
   return background;
 }
 
+QImage OutputImageWithForegroundMask::getBackgroundImage(const QRect& area) const {
+  QImage background = OutputImagePlain::toImage().copy(area);
+  applyMask(background, maskArea(m_foregroundMask, area).inverted());
+  return background;
+}
+
+BinaryImage OutputImageWithForegroundMask::maskArea(const BinaryImage& mask, const QRect& area) {
+  if (area == mask.rect()) {
+    return mask;
+  }
+  BinaryImage part(area.size());
+  rasterOp<RopSrc>(part, part.rect(), mask, area.topLeft());
+  return part;
+}
+
 std::unique_ptr<OutputImageWithForegroundMask> OutputImageWithForegroundMask::fromPlainData(
     const QImage& foregroundImage,
     const QImage& backgroundImage) {
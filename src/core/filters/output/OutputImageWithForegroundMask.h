@@ -28,9 +28,16 @@ class OutputImageWithForegroundMask : public OutputImagePlain, public virtual Ou
 
   QImage getBackgroundImage() const override;
 
+  QImage getBackgroundImage(const QRect& area) const override;
+
  protected:
   static ForegroundType getForegroundType(const QImage& foregroundImage);
 
+  /**
+   * \brief Returns the part of \p mask corresponding to \p area.
+   */
+  static imageproc::BinaryImage maskArea(const imageproc::BinaryImage& mask, const QRect& area);
+
  private:
   imageproc::BinaryImage m_foregroundMask;
   ForegroundType m_foregroundType = ForegroundType::COLOR;
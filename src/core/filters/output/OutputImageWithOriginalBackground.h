@@ -10,6 +10,11 @@ namespace output {
 class OutputImageWithOriginalBackground : public virtual OutputImageWithForeground {
  public:
   virtual QImage getOriginalBackgroundImage() const = 0;
+
+  /**
+   * \brief Returns the given area of the original background image.
+   */
+  virtual QImage getOriginalBackgroundImage(const QRect& area) const = 0;
 };
 }  // namespace output
 
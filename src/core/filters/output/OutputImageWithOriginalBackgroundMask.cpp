@@ -31,6 +31,18 @@ QImage OutputImageWithOriginalBackgroundMask::getOriginalBackgroundImage() const
   return originalBackground;
 }
 
+QImage OutputImageWithOriginalBackgroundMask::getBackgroundImage(const QRect& area) const {
+  QImage background = OutputImageWithForegroundMask::getBackgroundImage(area);
+  applyMask(background, maskArea(m_backgroundMask, area));
+  return background;
+}
+
+QImage OutputImageWithOriginalBackgroundMask::getOriginalBackgroundImage(const QRect& area) const {
+  QImage originalBackground = OutputImageWithForegroundMask::getBackgroundImage(area);
+  applyMask(originalBackground, maskArea(m_backgroundMask, area).inverted(), BLACK);
+  return originalBackground;
+}
+
 std::unique_ptr<OutputImageWithOriginalBackgroundMask> OutputImageWithOriginalBackgroundMask::fromPlainData(
     const QImage& foregroundImage,
     const QImage& backgroundImage,
@@ -28,8 +28,12 @@ class OutputImageWithOriginalBackgroundMask : public OutputImageWithForegroundMa
 
   QImage getBackgroundImage() const override;
 
+  QImage getBackgroundImage(const QRect& area) const override;
+
   QImage getOriginalBackgroundImage() const override;
 
+  QImage getOriginalBackgroundImage(const QRect& area) const override;
+
  private:
   imageproc::BinaryImage m_backgroundMask;
 };
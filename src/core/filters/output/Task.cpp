@@ -5,14 +5,18 @@
 
 #include <DewarpingPointMapper.h>
 #include <PolygonUtils.h>
+#include <Tracer.h>
 #include <UnitsProvider.h>
+#include <core/ApplicationSettings.h>
 #include <core/TiffWriter.h>
 
 #include <QDir>
 #include <boost/bind.hpp>
+#include <functional>
 #include <utility>
 
 #include "DebugImagesImpl.h"
+#include "DecodedImageCache.h"
 #include "DespeckleState.h"
 #include "DespeckleView.h"
 #include "DespeckleVisualization.h"
@@ -24,7 +28,6 @@
 #include "Filter.h"
 #include "FilterData.h"
 #include "FilterUiInterface.h"
-#include "ImageLoader.h"
 #include "ImageView.h"
 #include "OptionsWidget.h"
 #include "OutputGenerator.h"
@@ -35,6 +38,7 @@
 #include "PictureZoneEditor.h"
 #include "RenderParams.h"
 #include "Settings.h"
+#include "StageCache.h"
 #include "TabbedImageView.h"
 #include "TaskStatus.h"
 #include "ThumbnailPixmapCache.h"
@@ -66,6 +70,10 @@ class Task::UiUpdater : public FilterResult {
 
   std::shared_ptr<AbstractFilter> filter() override { return m_filter; }
 
+  std::function<void()> takeDeferredWork() override { return std::move(m_deferredWork); }
+
+  void setDeferredWork(std::function<void()> work) { m_deferredWork = std::move(work); }
+
  private:
   std::shared_ptr<Filter> m_filter;
   std::shared_ptr<Settings> m_settings;
@@ -83,6 +91,7 @@ class Task::UiUpdater : public FilterResult {
   DespeckleVisualization m_despeckleVisualization;
   bool m_batchProcessing;
   bool m_debug;
+  std::function<void()> m_deferredWork;
 };
 
 
@@ -110,6 +119,8 @@ Task::Task(std::shared_ptr<Filter> filter,
 Task::~Task() = default;
 
 FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data, const QPolygonF& contentRectPhys) {
+  const foundation::Tracer::Span span("output::Task::process");
+
   status.throwIfCancelled();
 
   Params params = m_settings->getParams(m_pageId);
@@ -254,26 +265,26 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
   QImage outImg;
   BinaryImage automaskImg;
   BinaryImage specklesImg;
+  std::function<void()> writeOutput;
 
   if (!needReprocess) {
-    QFile outFile(outFilePath);
-    if (outFile.open(QIODevice::ReadOnly)) {
-      outImg = ImageLoader::load(outFile, 0);
-    }
+    // Output images are kept in memory to make switching back to this page fast.
+    DecodedImageCache& imageCache = DecodedImageCache::instance();
+    outImg = imageCache.load(ImageId(outFilePath));
     if (outImg.isNull() && renderParams.splitOutput()) {
       OutputImageBuilder imageBuilder;
-      QFile foregroundFile(foregroundFilePath);
-      if (foregroundFile.open(QIODevice::ReadOnly)) {
-        imageBuilder.setForegroundImage(ImageLoader::load(foregroundFile, 0));
+      const QImage foregroundImage(imageCache.load(ImageId(foregroundFilePath)));
+      if (!foregroundImage.isNull()) {
+        imageBuilder.setForegroundImage(foregroundImage);
       }
-      QFile backgroundFile(backgroundFilePath);
-      if (backgroundFile.open(QIODevice::ReadOnly)) {
-        imageBuilder.setBackgroundImage(ImageLoader::load(backgroundFile, 0));
+      const QImage backgroundImage(imageCache.load(ImageId(backgroundFilePath)));
+      if (!backgroundImage.isNull()) {
+        imageBuilder.setBackgroundImage(backgroundImage);
       }
       if (renderParams.originalBackground()) {
-        QFile originalBackgroundFile(originalBackgroundFilePath);
-        if (originalBackgroundFile.open(QIODevice::ReadOnly)) {
-          imageBuilder.setOriginalBackgroundImage(ImageLoader::load(originalBackgroundFile, 0));
+        const QImage originalBackgroundImage(imageCache.load(ImageId(originalBackgroundFilePath)));
+        if (!originalBackgroundImage.isNull()) {
+          imageBuilder.setOriginalBackgroundImage(originalBackgroundImage);
         }
       }
       outImg = *imageBuilder.build();
@@ -281,18 +292,12 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
     needReprocess = outImg.isNull();
 
     if (needPictureEditor && !needReprocess) {
-      QFile automaskFile(automaskFilePath);
-      if (automaskFile.open(QIODevice::ReadOnly)) {
-        automaskImg = BinaryImage(ImageLoader::load(automaskFile, 0));
-      }
+      automaskImg = BinaryImage(imageCache.load(ImageId(automaskFilePath)));
       needReprocess = automaskImg.isNull() || automaskImg.size() != outImg.size();
     }
 
     if (needSpecklesImage && !needReprocess) {
-      QFile specklesFile(specklesFilePath);
-      if (specklesFile.open(QIODevice::ReadOnly)) {
-        specklesImg = BinaryImage(ImageLoader::load(specklesFile, 0));
-      }
+      specklesImg = BinaryImage(imageCache.load(ImageId(specklesFilePath)));
       needReprocess = specklesImg.isNull();
     }
   }
@@ -316,36 +321,56 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
       distortionModel = params.distortionModel();
     }
 
-    bool invalidateParams = false;
-    {
-      std::unique_ptr<OutputImage> outputImage
-          = generator.process(status, data, newPictureZones, newFillZones, distortionModel, params.depthPerception(),
-                              writeAutomask ? &automaskImg : nullptr, writeSpecklesFile ? &specklesImg : nullptr,
-                              m_dbg.get(), m_pageId, m_settings);
-
-      params = m_settings->getParams(m_pageId);
-
-      if (((params.dewarpingOptions().dewarpingMode() == AUTO)
-           || (params.dewarpingOptions().dewarpingMode() == MARGINAL))
-          && distortionModel.isValid()) {
-        // A new distortion model was generated.
-        // We need to save it to be able to modify it manually.
-        params.setDistortionModel(distortionModel);
-        m_settings->setParams(m_pageId, params);
-        newOutputImageParams.setDistortionModel(distortionModel);
-      }
+    const StageCache stageCache(Utils::stageCacheDir(m_outFileNameGen.outDir()),
+                                qint64(ApplicationSettings::getInstance().getStageCacheSize()) * 1024 * 1024);
+    std::shared_ptr<OutputImage> outputImage
+        = generator.process(status, data, newPictureZones, newFillZones, distortionModel, params.depthPerception(),
+                            writeAutomask ? &automaskImg : nullptr, writeSpecklesFile ? &specklesImg : nullptr,
+                            m_dbg.get(), m_pageId, m_settings, &stageCache);
+
+    params = m_settings->getParams(m_pageId);
+
+    if (((params.dewarpingOptions().dewarpingMode() == AUTO) || (params.dewarpingOptions().dewarpingMode() == MARGINAL))
+        && distortionModel.isValid()) {
+      // A new distortion model was generated.
+      // We need to save it to be able to modify it manually.
+      params.setDistortionModel(distortionModel);
+      m_settings->setParams(m_pageId, params);
+      newOutputImageParams.setDistortionModel(distortionModel);
+    }
+
+    // Saving refreshed params and output processing params.
+    newOutputImageParams.setBlackOnWhite(m_settings->getParams(m_pageId).isBlackOnWhite());
+    newOutputImageParams.setOutputProcessingParams(m_settings->getOutputProcessingParams(m_pageId));
 
-      // Saving refreshed params and output processing params.
-      newOutputImageParams.setBlackOnWhite(m_settings->getParams(m_pageId).isBlackOnWhite());
-      newOutputImageParams.setOutputProcessingParams(m_settings->getOutputProcessingParams(m_pageId));
+    outImg = *outputImage;
+
+    if (writeSpecklesFile && specklesImg.isNull()) {
+      // Even if despeckling didn't actually take place, we still need
+      // to write an empty speckles file.  Making it a special case
+      // is simply not worth it.
+      BinaryImage(outImg.size(), WHITE).swap(specklesImg);
+    }
+
+    const std::shared_ptr<Settings> settings(m_settings);
+    const std::shared_ptr<ThumbnailPixmapCache> thumbnailCache(m_thumbnailCache);
+    const OutputFileNameGenerator outFileNameGen(m_outFileNameGen);
+    const PageId pageId(m_pageId);
+    writeOutput = [=]() {
+      bool invalidateParams = false;
 
       if (renderParams.splitOutput()) {
         auto* outputImageWithForeground = dynamic_cast<OutputImageWithForeground*>(outputImage.get());
 
         QDir().mkdir(foregroundDir);
         QDir().mkdir(backgroundDir);
+        // The background layers are written band by band, so that
+        // they don't take as much memory as the output image itself.
+        const auto backgroundAt = [outputImageWithForeground](const QRect& area) {
+          return outputImageWithForeground->getBackgroundImage(area);
+        };
         if (!TiffWriter::writeImage(foregroundFilePath, outputImageWithForeground->getForegroundImage())
-            || !TiffWriter::writeImage(backgroundFilePath, outputImageWithForeground->getBackgroundImage())) {
+            || !TiffWriter::writeImage(backgroundFilePath, outImg.size(), backgroundAt)) {
           invalidateParams = true;
         }
 
@@ -353,76 +378,75 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
           auto* outputImageWithOrigBg = dynamic_cast<OutputImageWithOriginalBackground*>(outputImage.get());
 
           QDir().mkdir(originalBackgroundDir);
-          if (!TiffWriter::writeImage(originalBackgroundFilePath,
-                                      outputImageWithOrigBg->getOriginalBackgroundImage())) {
+          const auto originalBackgroundAt = [outputImageWithOrigBg](const QRect& area) {
+            return outputImageWithOrigBg->getOriginalBackgroundImage(area);
+          };
+          if (!TiffWriter::writeImage(originalBackgroundFilePath, outImg.size(), originalBackgroundAt)) {
             invalidateParams = true;
           }
         }
       }
 
-      outImg = *outputImage;
-    }
-
-    if (!renderParams.originalBackground()) {
-      QFile::remove(originalBackgroundFilePath);
-    }
-    if (!renderParams.splitOutput()) {
-      QFile::remove(foregroundFilePath);
-      QFile::remove(backgroundFilePath);
-    }
-
-    if (!TiffWriter::writeImage(outFilePath, outImg)) {
-      invalidateParams = true;
-    } else {
-      deleteMutuallyExclusiveOutputFiles();
-    }
-
-    if (writeSpecklesFile && specklesImg.isNull()) {
-      // Even if despeckling didn't actually take place, we still need
-      // to write an empty speckles file.  Making it a special case
-      // is simply not worth it.
-      BinaryImage(outImg.size(), WHITE).swap(specklesImg);
-    }
+      if (!renderParams.originalBackground()) {
+        QFile::remove(originalBackgroundFilePath);
+      }
+      if (!renderParams.splitOutput()) {
+        QFile::remove(foregroundFilePath);
+        QFile::remove(backgroundFilePath);
+      }
 
-    if (writeAutomask) {
-      // Note that QDir::mkdir() will fail if the parent directory,
-      // that is $OUT/cache doesn't exist. We want that behaviour,
-      // as otherwise when loading a project from a different machine,
-      // a whole bunch of bogus directories would be created.
-      QDir().mkdir(automaskDir);
-      // Also note that QDir::mkdir() will fail if the directory already exists,
-      // so we ignore its return value here.
-      if (!TiffWriter::writeImage(automaskFilePath, automaskImg.toQImage())) {
+      if (!TiffWriter::writeImage(outFilePath, outImg)) {
         invalidateParams = true;
+      } else {
+        deleteMutuallyExclusiveOutputFiles(outFileNameGen, pageId);
       }
-    }
-    if (writeSpecklesFile) {
-      if (!QDir().mkpath(specklesDir)) {
-        invalidateParams = true;
-      } else if (!TiffWriter::writeImage(specklesFilePath, specklesImg.toQImage())) {
-        invalidateParams = true;
+
+      if (writeAutomask) {
+        // Note that QDir::mkdir() will fail if the parent directory,
+        // that is $OUT/cache doesn't exist. We want that behaviour,
+        // as otherwise when loading a project from a different machine,
+        // a whole bunch of bogus directories would be created.
+        QDir().mkdir(automaskDir);
+        // Also note that QDir::mkdir() will fail if the directory already exists,
+        // so we ignore its return value here.
+        if (!TiffWriter::writeImage(automaskFilePath, automaskImg.toQImage())) {
+          invalidateParams = true;
+        }
+      }
+      if (writeSpecklesFile) {
+        if (!QDir().mkpath(specklesDir)) {
+          invalidateParams = true;
+        } else if (!TiffWriter::writeImage(specklesFilePath, specklesImg.toQImage())) {
+          invalidateParams = true;
+        }
       }
-    }
 
-    if (invalidateParams) {
-      m_settings->removeOutputParams(m_pageId);
-    } else {
-      // Note that we can't reuse *_file_info objects
-      // as we've just overwritten those files.
-      const OutputParams outParams(
-          newOutputImageParams, OutputFileParams(sourceFileInfo), OutputFileParams(QFileInfo(outFilePath)),
-          renderParams.splitOutput() ? OutputFileParams(QFileInfo(foregroundFilePath)) : OutputFileParams(),
-          renderParams.splitOutput() ? OutputFileParams(QFileInfo(backgroundFilePath)) : OutputFileParams(),
-          renderParams.originalBackground() ? OutputFileParams(QFileInfo(originalBackgroundFilePath))
-                                            : OutputFileParams(),
-          writeAutomask ? OutputFileParams(QFileInfo(automaskFilePath)) : OutputFileParams(),
-          writeSpecklesFile ? OutputFileParams(QFileInfo(specklesFilePath)) : OutputFileParams(), newPictureZones,
-          newFillZones);
-
-      m_settings->setOutputParams(m_pageId, outParams);
-    }
+      if (invalidateParams) {
+        settings->removeOutputParams(pageId);
+      } else {
+        // Note that we can't reuse *_file_info objects
+        // as we've just overwritten those files.
+        const OutputParams outParams(
+            newOutputImageParams, OutputFileParams(sourceFileInfo), OutputFileParams(QFileInfo(outFilePath)),
+            renderParams.splitOutput() ? OutputFileParams(QFileInfo(foregroundFilePath)) : OutputFileParams(),
+            renderParams.splitOutput() ? OutputFileParams(QFileInfo(backgroundFilePath)) : OutputFileParams(),
+            renderParams.originalBackground() ? OutputFileParams(QFileInfo(originalBackgroundFilePath))
+                                              : OutputFileParams(),
+            writeAutomask ? OutputFileParams(QFileInfo(automaskFilePath)) : OutputFileParams(),
+            writeSpecklesFile ? OutputFileParams(QFileInfo(specklesFilePath)) : OutputFileParams(), newPictureZones,
+            newFillZones);
+
+        settings->setOutputParams(pageId, outParams);
+      }
+
+      thumbnailCache->recreateThumbnail(ImageId(outFilePath), outImg);
+    };
 
-    m_thumbnailCache->recreateThumbnail(ImageId(outFilePath), outImg);
+    if (!m_batchProcessing) {
+      // In batch mode, WorkerThreadPool writes the files from its output stage.
+      writeOutput();
+      writeOutput = nullptr;
+    }
   }
 
   const DespeckleState despeckleState(outImg, specklesImg, params.despeckleLevel(), params.outputDpi());
@@ -434,23 +458,26 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
     // Otherwise it will get constructed on demand.
     despeckleVisualization = despeckleState.visualize();
   }
-  return std::make_shared<UiUpdater>(m_filter, m_settings, std::move(m_dbg), params, newXform,
-                                     generator.outputContentRect(), m_pageId, data.origImage(), outImg, automaskImg,
-                                     despeckleState, despeckleVisualization, m_batchProcessing, m_debug);
+  auto uiUpdater = std::make_shared<UiUpdater>(m_filter, m_settings, std::move(m_dbg), params, newXform,
+                                               generator.outputContentRect(), m_pageId, data.origImage(), outImg,
+                                               automaskImg, despeckleState, despeckleVisualization, m_batchProcessing,
+                                               m_debug);
+  uiUpdater->setDeferredWork(std::move(writeOutput));
+  return uiUpdater;
 }  // Task::process
 
 /**
- * Delete output files mutually exclusive to m_pageId.
+ * Delete output files mutually exclusive to \p pageId.
  */
-void Task::deleteMutuallyExclusiveOutputFiles() {
-  switch (m_pageId.subPage()) {
+void Task::deleteMutuallyExclusiveOutputFiles(const OutputFileNameGenerator& outFileNameGen, const PageId& pageId) {
+  switch (pageId.subPage()) {
     case PageId::SINGLE_PAGE:
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::LEFT_PAGE)));
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::RIGHT_PAGE)));
+      QFile::remove(outFileNameGen.filePathFor(PageId(pageId.imageId(), PageId::LEFT_PAGE)));
+      QFile::remove(outFileNameGen.filePathFor(PageId(pageId.imageId(), PageId::RIGHT_PAGE)));
       break;
     case PageId::LEFT_PAGE:
     case PageId::RIGHT_PAGE:
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::SINGLE_PAGE)));
+      QFile::remove(outFileNameGen.filePathFor(PageId(pageId.imageId(), PageId::SINGLE_PAGE)));
       break;
   }
 }
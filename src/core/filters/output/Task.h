@@ -52,7 +52,7 @@ class Task {
  private:
   class UiUpdater;
 
-  void deleteMutuallyExclusiveOutputFiles();
+  static void deleteMutuallyExclusiveOutputFiles(const OutputFileNameGenerator& outFileNameGen, const PageId& pageId);
 
   std::shared_ptr<Filter> m_filter;
   std::shared_ptr<Settings> m_settings;
@@ -26,6 +26,10 @@ QString Utils::specklesDir(const QString& outDir) {
   return QDir(outDir).absoluteFilePath("cache/speckles");
 }
 
+QString Utils::stageCacheDir(const QString& outDir) {
+  return QDir(outDir).absoluteFilePath("cache/stages");
+}
+
 QTransform Utils::scaleFromToDpi(const Dpi& from, const Dpi& to) {
   QTransform xform;
   xform.scale((double) to.horizontal() / from.horizontal(), (double) to.vertical() / from.vertical());
@@ -22,6 +22,8 @@ class Utils {
 
   static QString specklesDir(const QString& outDir);
 
+  static QString stageCacheDir(const QString& outDir);
+
   static QString foregroundDir(const QString& outDir);
 
   static QString backgroundDir(const QString& outDir);
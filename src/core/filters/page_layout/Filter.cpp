@@ -7,6 +7,8 @@
 #include <filters/output/CacheDrivenTask.h>
 #include <filters/output/Task.h>
 
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "CacheDrivenTask.h"
@@ -44,6 +46,10 @@ QString Filter::getName() const {
   return tr("Margins");
 }
 
+QString Filter::settingsTagName() const {
+  return "page-layout";
+}
+
 PageView Filter::getView() const {
   return PAGE_VIEW;
 }
@@ -76,41 +82,46 @@ void Filter::preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) {
   ui->setOptionsWidget(m_optionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("page-layout"));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
 
-  filterEl.setAttribute("showMiddleRect", m_settings->isShowingMiddleRectEnabled() ? "1" : "0");
+  xml.writeAttribute("showMiddleRect", m_settings->isShowingMiddleRectEnabled() ? "1" : "0");
 
   if (!m_settings->guides().empty()) {
-    QDomElement guidesEl(doc.createElement("guides"));
+    QDomDocument doc;
+    xml.writeStartElement("guides");
     for (const Guide& guide : m_settings->guides()) {
-      guidesEl.appendChild(guide.toXml(doc, "guide"));
+      ProjectWriter::writeDomElement(xml, guide.toXml(doc, "guide"));
     }
-    filterEl.appendChild(guidesEl);
+    xml.writeEndElement();
   }
 
   writer.enumPages(
-      [&](const PageId& pageId, int numericId) { this->writePageSettings(doc, filterEl, pageId, numericId); });
-  return filterEl;
+      [&](const PageId& pageId, int numericId) { this->writePageSettings(writer, xml, pageId, numericId); });
+  xml.writeEndElement();
 }
 
-void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writePageSettings(const ProjectWriter& writer,
+                               QXmlStreamWriter& xml,
+                               const PageId& pageId,
+                               int numericId) const {
   const std::unique_ptr<Params> params(m_settings->getPageParams(pageId));
   if (!params) {
+    writer.writeRemovedEntry(xml, "page", numericId);
     return;
   }
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
-  pageEl.appendChild(params->toXml(doc, "params"));
-
-  filterEl.appendChild(pageEl);
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "params"));
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  const QDomElement filterEl(filtersEl.namedItem("page-layout").toElement());
+  const QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
 
   m_settings->enableShowingMiddleRect(filterEl.attribute("showMiddleRect") == "1");
 
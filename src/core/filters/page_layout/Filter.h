@@ -43,6 +43,8 @@ class Filter : public AbstractFilter {
 
   QString getName() const override;
 
+  QString settingsTagName() const override;
+
   PageView getView() const override;
 
   void selected() override;
@@ -57,7 +59,7 @@ class Filter : public AbstractFilter {
 
   void preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) override;
 
-  QDomElement saveSettings(const ProjectWriter& writer, QDomDocument& doc) const override;
+  void saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const override;
 
   void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) override;
 
@@ -79,7 +81,7 @@ class Filter : public AbstractFilter {
   OptionsWidget* optionsWidget();
 
  private:
-  void writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const;
+  void writePageSettings(const ProjectWriter& writer, QXmlStreamWriter& xml, const PageId& pageId, int numericId) const;
 
   std::shared_ptr<ProjectPages> m_pages;
   std::shared_ptr<Settings> m_settings;
@@ -6,6 +6,8 @@
 #include <filters/deskew/CacheDrivenTask.h>
 #include <filters/deskew/Task.h>
 
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "CacheDrivenTask.h"
@@ -36,6 +38,10 @@ QString Filter::getName() const {
   return QCoreApplication::translate("page_split::Filter", "Split Pages");
 }
 
+QString Filter::settingsTagName() const {
+  return "page-split";
+}
+
 PageView Filter::getView() const {
   return IMAGE_VIEW;
 }
@@ -49,20 +55,19 @@ void Filter::preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) {
   ui->setOptionsWidget(m_optionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("page-split"));
-  filterEl.setAttribute("defaultLayoutType", layoutTypeToString(m_settings->defaultLayoutType()));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
+  xml.writeAttribute("defaultLayoutType", layoutTypeToString(m_settings->defaultLayoutType()));
 
-  writer.enumImages([&](const ImageId& imageId, const int numericId) {
-    this->writeImageSettings(doc, filterEl, imageId, numericId);
-  });
-  return filterEl;
+  writer.enumImages(
+      [&](const ImageId& imageId, const int numericId) { this->writeImageSettings(writer, xml, imageId, numericId); });
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  const QDomElement filterEl(filtersEl.namedItem("page-split").toElement());
+  const QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
   const QString defaultLayoutType(filterEl.attribute("defaultLayoutType"));
   m_settings->setLayoutTypeForAllPages(layoutTypeFromString(defaultLayoutType));
 
@@ -121,22 +126,27 @@ void Filter::pageOrientationUpdate(const ImageId& imageId, const OrthogonalRotat
   m_pages->autoSetLayoutTypeFor(imageId, orientation);
 }
 
-void Filter::writeImageSettings(QDomDocument& doc,
-                                QDomElement& filterEl,
+void Filter::writeImageSettings(const ProjectWriter& writer,
+                                QXmlStreamWriter& xml,
                                 const ImageId& imageId,
                                 const int numericId) const {
   const Settings::Record record(m_settings->getPageRecord(imageId));
 
-  QDomElement imageEl(doc.createElement("image"));
-  imageEl.setAttribute("id", numericId);
-  if (const LayoutType* layoutType = record.layoutType()) {
-    imageEl.setAttribute("layoutType", layoutTypeToString(*layoutType));
+  // Images without params are not written at all, even if they have a layout type.
+  const Params* params = record.params();
+  if (!params) {
+    writer.writeRemovedEntry(xml, "image", numericId);
+    return;
   }
 
-  if (const Params* params = record.params()) {
-    imageEl.appendChild(params->toXml(doc, "params"));
-    filterEl.appendChild(imageEl);
+  QDomDocument doc;
+  xml.writeStartElement("image");
+  xml.writeAttribute("id", QString::number(numericId));
+  if (const LayoutType* layoutType = record.layoutType()) {
+    xml.writeAttribute("layoutType", layoutTypeToString(*layoutType));
   }
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "params"));
+  xml.writeEndElement();
 }
 
 std::shared_ptr<Task> Filter::createTask(const PageInfo& pageInfo,
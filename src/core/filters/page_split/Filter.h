@@ -45,13 +45,15 @@ class Filter : public AbstractFilter {
 
   QString getName() const override;
 
+  QString settingsTagName() const override;
+
   PageView getView() const override;
 
   void performRelinking(const AbstractRelinker& relinker) override;
 
   void preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) override;
 
-  QDomElement saveSettings(const ProjectWriter& wirter, QDomDocument& doc) const override;
+  void saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const override;
 
   void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) override;
 
@@ -75,7 +77,10 @@ class Filter : public AbstractFilter {
   void selectPageOrder(int option) override;
 
  private:
-  void writeImageSettings(QDomDocument& doc, QDomElement& filterEl, const ImageId& imageId, int numericId) const;
+  void writeImageSettings(const ProjectWriter& writer,
+                          QXmlStreamWriter& xml,
+                          const ImageId& imageId,
+                          int numericId) const;
 
   std::shared_ptr<ProjectPages> m_pages;
   std::shared_ptr<Settings> m_settings;
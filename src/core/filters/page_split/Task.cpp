@@ -3,6 +3,7 @@
 
 #include "Task.h"
 
+#include <Tracer.h>
 #include <UnitsProvider.h>
 
 #include <utility>
@@ -86,6 +87,8 @@ Task::Task(std::shared_ptr<Filter> filter,
 Task::~Task() = default;
 
 FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data) {
+  const foundation::Tracer::Span span("page_split::Task::process");
+
   status.throwIfCancelled();
 
   Settings::Record record(m_settings->getPageRecord(m_pageInfo.imageId()));
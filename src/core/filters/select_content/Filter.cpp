@@ -10,6 +10,8 @@
 #include <filters/page_layout/Task.h>
 #include <foundation/Utils.h>
 
+#include <QDomDocument>
+#include <QXmlStreamWriter>
 #include <utility>
 
 #include "CacheDrivenTask.h"
@@ -45,6 +47,10 @@ QString Filter::getName() const {
   return tr("Select Content");
 }
 
+QString Filter::settingsTagName() const {
+  return "select-content";
+}
+
 PageView Filter::getView() const {
   return PAGE_VIEW;
 }
@@ -71,35 +77,41 @@ void Filter::preUpdateUI(FilterUiInterface* ui, const PageInfo& pageInfo) {
   ui->setOptionsWidget(m_optionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
 
-QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc) const {
-  QDomElement filterEl(doc.createElement("select-content"));
+void Filter::saveSettings(const ProjectWriter& writer, QXmlStreamWriter& xml) const {
+  xml.writeStartElement(settingsTagName());
 
-  filterEl.appendChild(XmlMarshaller(doc).sizeF(m_settings->pageDetectionBox(), "page-detection-box"));
-  filterEl.setAttribute("pageDetectionTolerance",
-                        foundation::Utils::doubleToString(m_settings->pageDetectionTolerance()));
+  xml.writeAttribute("pageDetectionTolerance", foundation::Utils::doubleToString(m_settings->pageDetectionTolerance()));
+  {
+    QDomDocument doc;
+    ProjectWriter::writeDomElement(xml, XmlMarshaller(doc).sizeF(m_settings->pageDetectionBox(), "page-detection-box"));
+  }
 
   writer.enumPages(
-      [&](const PageId& pageId, int numericId) { this->writePageSettings(doc, filterEl, pageId, numericId); });
-  return filterEl;
+      [&](const PageId& pageId, int numericId) { this->writePageSettings(writer, xml, pageId, numericId); });
+  xml.writeEndElement();
 }
 
-void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
+void Filter::writePageSettings(const ProjectWriter& writer,
+                               QXmlStreamWriter& xml,
+                               const PageId& pageId,
+                               int numericId) const {
   const std::unique_ptr<Params> params(m_settings->getPageParams(pageId));
   if (!params) {
+    writer.writeRemovedEntry(xml, "page", numericId);
     return;
   }
 
-  QDomElement pageEl(doc.createElement("page"));
-  pageEl.setAttribute("id", numericId);
-  pageEl.appendChild(params->toXml(doc, "params"));
-
-  filterEl.appendChild(pageEl);
+  QDomDocument doc;
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(numericId));
+  ProjectWriter::writeDomElement(xml, params->toXml(doc, "params"));
+  xml.writeEndElement();
 }
 
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
-  const QDomElement filterEl(filtersEl.namedItem("select-content").toElement());
+  const QDomElement filterEl(filtersEl.namedItem(settingsTagName()).toElement());
 
   m_settings->setPageDetectionBox(XmlUnmarshaller::sizeF(filterEl.namedItem("page-detection-box").toElement()));
   m_settings->setPageDetectionTolerance(filterEl.attribute("pageDetectionTolerance", "0.1").toDouble());
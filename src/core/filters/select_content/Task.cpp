@@ -3,6 +3,7 @@
 
 #include "Task.h"
 
+#include <Tracer.h>
 #include <UnitsProvider.h>
 
 #include <iostream>
@@ -70,6 +71,8 @@ Task::Task(std::shared_ptr<Filter> filter,
 Task::~Task() = default;
 
 FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data) {
+  const foundation::Tracer::Span span("select_content::Task::process");
+
   status.throwIfCancelled();
 
   std::unique_ptr<Params> params(m_settings->getPageParams(m_pageId));
@@ -0,0 +1,103 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <DecodedImageCache.h>
+
+#include <QImage>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests {
+namespace {
+QImage makeImage(const int width, const int height, const QRgb color) {
+  QImage image(width, height, QImage::Format_RGB32);
+  image.fill(color);
+  return image;
+}
+
+ImageId saveImage(const QTemporaryDir& dir, const QString& name, const QImage& image) {
+  const QString filePath(dir.path() + '/' + name);
+  BOOST_REQUIRE(image.save(filePath, "PNG"));
+  return ImageId(filePath);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(DecodedImageCacheTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_load_and_find) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const ImageId imageId(saveImage(dir, "1.png", makeImage(10, 10, qRgb(10, 20, 30))));
+
+  DecodedImageCache cache(1024 * 1024);
+  BOOST_CHECK(cache.find(imageId).isNull());
+
+  const QImage loaded(cache.load(imageId));
+  BOOST_REQUIRE(!loaded.isNull());
+  BOOST_CHECK(cache.find(imageId).cacheKey() == loaded.cacheKey());
+  BOOST_CHECK(cache.load(imageId).cacheKey() == loaded.cacheKey());
+}
+
+BOOST_AUTO_TEST_CASE(test_replaced_file_is_reloaded) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const ImageId imageId(saveImage(dir, "1.png", makeImage(10, 10, qRgb(10, 20, 30))));
+
+  DecodedImageCache cache(1024 * 1024);
+  BOOST_REQUIRE(!cache.load(imageId).isNull());
+
+  saveImage(dir, "1.png", makeImage(20, 10, qRgb(10, 20, 30)));
+  BOOST_CHECK(cache.find(imageId).isNull());
+  BOOST_CHECK(cache.load(imageId).size() == QSize(20, 10));
+}
+
+BOOST_AUTO_TEST_CASE(test_invalidated_file_is_reloaded) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const ImageId imageId(saveImage(dir, "1.png", makeImage(10, 10, qRgb(10, 20, 30))));
+  const ImageId otherImageId(saveImage(dir, "2.png", makeImage(10, 10, qRgb(10, 20, 30))));
+
+  DecodedImageCache cache(1024 * 1024);
+  BOOST_REQUIRE(!cache.load(imageId).isNull());
+  BOOST_REQUIRE(!cache.load(otherImageId).isNull());
+
+  // The size and the modification time may stay the same when a file is rewritten.
+  cache.invalidate(imageId.filePath());
+  BOOST_CHECK(cache.find(imageId).isNull());
+  BOOST_CHECK(!cache.find(otherImageId).isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_least_recently_used_are_dropped) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  // Each image takes 40000 bytes.
+  const ImageId imageId1(saveImage(dir, "1.png", makeImage(100, 100, qRgb(1, 1, 1))));
+  const ImageId imageId2(saveImage(dir, "2.png", makeImage(100, 100, qRgb(2, 2, 2))));
+  const ImageId imageId3(saveImage(dir, "3.png", makeImage(100, 100, qRgb(3, 3, 3))));
+
+  DecodedImageCache cache(100000);
+  cache.load(imageId1);
+  cache.load(imageId2);
+  cache.load(imageId1);
+  cache.load(imageId3);
+
+  BOOST_CHECK(!cache.find(imageId1).isNull());
+  BOOST_CHECK(cache.find(imageId2).isNull());
+  BOOST_CHECK(!cache.find(imageId3).isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_grayscale_is_reused) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const ImageId imageId(saveImage(dir, "1.png", makeImage(10, 10, qRgb(50, 100, 150))));
+
+  DecodedImageCache cache(1024 * 1024);
+  const QImage image(cache.load(imageId));
+  const imageproc::GrayImage gray1(cache.grayscale(imageId, image));
+  const imageproc::GrayImage gray2(cache.grayscale(imageId, image));
+  BOOST_CHECK(gray1.toQImage().cacheKey() == gray2.toQImage().cacheKey());
+  BOOST_CHECK(gray1 == imageproc::GrayImage(image));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
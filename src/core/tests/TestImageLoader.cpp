@@ -0,0 +1,65 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageLoader.h>
+
+#include <QBuffer>
+#include <QImage>
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+
+namespace Tests {
+namespace {
+QByteArray encodeJpeg(const QImage& image) {
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  image.save(&buffer, "JPEG", 90);
+  return data;
+}
+
+QImage loadDownscaled(QByteArray data, const QSize& targetSize) {
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+  return ImageLoader::loadDownscaled(buffer, 0, targetSize);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ImageLoaderTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_jpeg_scale_selection) {
+  QImage image(800, 600, QImage::Format_RGB32);
+  image.fill(qRgb(40, 120, 200));
+  image.setDotsPerMeterX(11811);
+  image.setDotsPerMeterY(11811);
+  const QByteArray data(encodeJpeg(image));
+  BOOST_REQUIRE(!data.isEmpty());
+
+  // 800x600 fits into 200x200 as 200x150, which is exactly 1/4 scale.
+  QImage decoded(loadDownscaled(data, QSize(200, 200)));
+  BOOST_CHECK(decoded.size() == QSize(200, 150));
+  BOOST_CHECK(std::abs(decoded.dotsPerMeterX() - 11811 / 4) <= 1);
+
+  // 1/4 scale would be too small for 250x250, and 1/8 is too small for both.
+  decoded = loadDownscaled(data, QSize(250, 250));
+  BOOST_CHECK(decoded.size() == QSize(400, 300));
+
+  decoded = loadDownscaled(data, QSize(50, 50));
+  BOOST_CHECK(decoded.size() == QSize(100, 75));
+
+  // No target size or a larger one means full resolution.
+  BOOST_CHECK(loadDownscaled(data, QSize()).size() == image.size());
+  BOOST_CHECK(loadDownscaled(data, QSize(2000, 2000)).size() == image.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_jpeg_grayscale) {
+  QImage image(64, 64, QImage::Format_Grayscale8);
+  image.fill(100);
+  const QImage decoded(loadDownscaled(encodeJpeg(image), QSize(16, 16)));
+  BOOST_REQUIRE(decoded.size() == QSize(16, 16));
+  BOOST_CHECK(decoded.isGrayscale());
+  BOOST_CHECK(std::abs(qGray(decoded.pixel(8, 8)) - 100) <= 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,110 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ProcessingTaskQueue.h>
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+
+namespace Tests {
+namespace {
+class DummyTask : public BackgroundTask {
+ public:
+  DummyTask() : BackgroundTask(BATCH) {}
+
+  FilterResultPtr operator()() override { return nullptr; }
+};
+
+PageInfo makePage(const int idx) {
+  const PageId pageId(ImageId(QString("%1.png").arg(idx)));
+  return PageInfo(pageId, ImageMetadata(QSize(100, 100), Dpi(300, 300)), 1, false, false);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ProcessingTaskQueueTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_no_budget) {
+  ProcessingTaskQueue queue;
+  queue.addProcessingTask(makePage(1), std::make_shared<DummyTask>(), 1000);
+  queue.addProcessingTask(makePage(2), std::make_shared<DummyTask>(), 1000);
+
+  BOOST_CHECK(queue.takeForProcessing());
+  BOOST_CHECK(queue.takeForProcessing());
+  BOOST_CHECK(!queue.takeForProcessing());
+}
+
+BOOST_AUTO_TEST_CASE(test_budget_limits_tasks_in_flight) {
+  ProcessingTaskQueue queue;
+  queue.setMemoryBudget(2500);
+  for (int i = 0; i < 4; ++i) {
+    queue.addProcessingTask(makePage(i), std::make_shared<DummyTask>(), 1000);
+  }
+
+  const BackgroundTaskPtr task1(queue.takeForProcessing());
+  const BackgroundTaskPtr task2(queue.takeForProcessing());
+  BOOST_REQUIRE(task1 && task2);
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  queue.processingFinished(task1);
+  const BackgroundTaskPtr task3(queue.takeForProcessing());
+  BOOST_REQUIRE(task3);
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  queue.processingFinished(task2);
+  queue.processingFinished(task3);
+  BOOST_CHECK(queue.takeForProcessing());
+  BOOST_CHECK(!queue.takeForProcessing());
+}
+
+BOOST_AUTO_TEST_CASE(test_oversized_task_runs_alone) {
+  ProcessingTaskQueue queue;
+  queue.setMemoryBudget(1000);
+  queue.addProcessingTask(makePage(1), std::make_shared<DummyTask>(), 5000);
+  queue.addProcessingTask(makePage(2), std::make_shared<DummyTask>(), 10);
+
+  const BackgroundTaskPtr task(queue.takeForProcessing());
+  BOOST_REQUIRE(task);
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  queue.processingFinished(task);
+  BOOST_CHECK(queue.takeForProcessing());
+}
+
+BOOST_AUTO_TEST_CASE(test_cancelled_task_releases_budget_when_finished) {
+  ProcessingTaskQueue queue;
+  queue.setMemoryBudget(1000);
+  queue.addProcessingTask(makePage(1), std::make_shared<DummyTask>(), 1000);
+  queue.addProcessingTask(makePage(2), std::make_shared<DummyTask>(), 1000);
+
+  const BackgroundTaskPtr task(queue.takeForProcessing());
+  BOOST_REQUIRE(task);
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  // The cancelled task may still be running.
+  queue.cancelAndRemove({makePage(1).id()});
+  BOOST_CHECK(task->isCancelled());
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  queue.processingFinished(task);
+  BOOST_CHECK(queue.takeForProcessing());
+}
+
+BOOST_AUTO_TEST_CASE(test_clear_keeps_budget_of_running_tasks) {
+  ProcessingTaskQueue queue;
+  queue.setMemoryBudget(1000);
+  queue.addProcessingTask(makePage(1), std::make_shared<DummyTask>(), 1000);
+
+  const BackgroundTaskPtr task(queue.takeForProcessing());
+  BOOST_REQUIRE(task);
+  queue.cancelAndClear();
+  BOOST_CHECK(queue.allProcessed());
+
+  queue.addProcessingTask(makePage(2), std::make_shared<DummyTask>(), 1000);
+  BOOST_CHECK(!queue.takeForProcessing());
+
+  queue.processingFinished(task);
+  BOOST_CHECK(queue.takeForProcessing());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,326 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ProjectJournal.h>
+
+#include <QBuffer>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(ProjectJournalTestSuite)
+
+namespace {
+QDomElement parse(QDomDocument& doc, const char* xml) {
+  const QByteArray data(xml);
+  QXmlStreamReader reader(data);
+  reader.readNextStartElement();
+  return ProjectJournal::readDomElement(reader, doc);
+}
+
+QDomElement childWithId(const QDomElement& parent, const QString& tagName, int id) {
+  for (QDomElement el(parent.firstChildElement(tagName)); !el.isNull(); el = el.nextSiblingElement(tagName)) {
+    if (el.attribute("id").toInt() == id) {
+      return el;
+    }
+  }
+  return QDomElement();
+}
+
+QString toString(const QDomElement& el) {
+  QString str;
+  QTextStream strm(&str);
+  el.save(strm, 0);
+  return str;
+}
+
+// Filter settings laid out the way filters write them: project-wide ones
+// around per-page entries, which are written in the order of pages.
+struct Settings {
+  std::map<int, int> deskewAngles;
+  std::map<int, int> deskewImageSettings;
+  bool showMiddleRect = false;
+  std::vector<int> guides;
+  std::map<int, int> layoutWidths;
+};
+
+const std::set<int> ALL_PAGES{2, 4, 6};
+
+// Records mark the pages without settings as removed entries.
+void writeEntry(QXmlStreamWriter& xml,
+                const char* tagName,
+                const int id,
+                const char* attribute,
+                const std::map<int, int>& values,
+                const bool record) {
+  const auto it = values.find(id);
+  if (it == values.end()) {
+    if (record) {
+      xml.writeEmptyElement("page");
+      xml.writeAttribute("id", QString::number(id));
+    }
+    return;
+  }
+  xml.writeStartElement("page");
+  xml.writeAttribute("id", QString::number(id));
+  xml.writeEmptyElement(tagName);
+  xml.writeAttribute(attribute, QString::number(it->second));
+  xml.writeEndElement();
+}
+
+void writeFilters(QXmlStreamWriter& xml, const Settings& settings, const std::set<int>& pages, const bool record) {
+  xml.writeStartElement("filters");
+
+  xml.writeStartElement("deskew");
+  for (const int id : pages) {
+    writeEntry(xml, "params", id, "angle", settings.deskewAngles, record);
+  }
+  xml.writeStartElement("image-settings");
+  for (const int id : pages) {
+    writeEntry(xml, "image-params", id, "index", settings.deskewImageSettings, record);
+  }
+  xml.writeEndElement();
+  xml.writeEndElement();
+
+  xml.writeStartElement("page-layout");
+  xml.writeAttribute("showMiddleRect", settings.showMiddleRect ? "1" : "0");
+  if (!settings.guides.empty()) {
+    xml.writeStartElement("guides");
+    for (const int x : settings.guides) {
+      xml.writeEmptyElement("guide");
+      xml.writeAttribute("x", QString::number(x));
+    }
+    xml.writeEndElement();
+  }
+  for (const int id : pages) {
+    writeEntry(xml, "params", id, "width", settings.layoutWidths, record);
+  }
+  xml.writeEndElement();
+
+  xml.writeEndElement();
+}
+
+QByteArray writeRecord(const Settings& settings, const std::set<int>& pages) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  QXmlStreamWriter xml(&buffer);
+  xml.setAutoFormatting(true);
+  xml.setAutoFormattingIndent(2);
+  writeFilters(xml, settings, pages, /* record= */ true);
+  xml.writeEndDocument();
+  return buffer.data();
+}
+
+QByteArray writeProject(const Settings& settings) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  QXmlStreamWriter xml(&buffer);
+  xml.setAutoFormatting(true);
+  xml.setAutoFormattingIndent(2);
+  xml.writeStartElement("project");
+  xml.writeStartElement("pages");
+  for (const int id : ALL_PAGES) {
+    xml.writeEmptyElement("page");
+    xml.writeAttribute("id", QString::number(id));
+  }
+  xml.writeEndElement();
+  writeFilters(xml, settings, ALL_PAGES, /* record= */ false);
+  xml.writeEndDocument();
+  return buffer.data();
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_read_dom_element) {
+  QDomDocument doc;
+  const QDomElement el(parse(doc, "<a x=\"1\">\n  <b>text</b>\n  <c/>\n</a>"));
+
+  BOOST_CHECK_EQUAL(el.tagName().toStdString(), "a");
+  BOOST_CHECK_EQUAL(el.attribute("x").toStdString(), "1");
+  BOOST_CHECK_EQUAL(el.childNodes().count(), 2);
+  BOOST_CHECK_EQUAL(el.firstChildElement("b").text().toStdString(), "text");
+  BOOST_CHECK(!el.firstChildElement("c").isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_replaces_pages_and_filter_settings) {
+  QDomDocument doc;
+  QDomElement target(parse(doc,
+                           "<filters>"
+                           "<deskew>"
+                           "<page id=\"1\"><params angle=\"1\"/></page>"
+                           "<page id=\"2\"><params angle=\"2\"/></page>"
+                           "<image-settings><page id=\"1\"><image-params/></page></image-settings>"
+                           "</deskew>"
+                           "<page-layout showMiddleRect=\"1\">"
+                           "<guides><guide x=\"1\"/><guide x=\"2\"/></guides>"
+                           "<page id=\"1\"><params/></page>"
+                           "</page-layout>"
+                           "</filters>"));
+  const QDomElement delta(parse(doc,
+                                "<filters>"
+                                "<deskew>"
+                                "<page id=\"2\"><params angle=\"5\"/></page>"
+                                "<page id=\"3\"><params angle=\"3\"/></page>"
+                                "<image-settings><page id=\"3\"><image-params/></page></image-settings>"
+                                "</deskew>"
+                                "<page-layout showMiddleRect=\"0\"/>"
+                                "</filters>"));
+
+  ProjectJournal::merge(target, delta);
+
+  const QDomElement deskewEl(target.firstChildElement("deskew"));
+  BOOST_CHECK_EQUAL(deskewEl.elementsByTagName("params").count(), 3);
+  BOOST_CHECK_EQUAL(childWithId(deskewEl, "page", 1).firstChildElement("params").attribute("angle").toInt(), 1);
+  BOOST_CHECK_EQUAL(childWithId(deskewEl, "page", 2).firstChildElement("params").attribute("angle").toInt(), 5);
+  BOOST_CHECK_EQUAL(childWithId(deskewEl, "page", 3).firstChildElement("params").attribute("angle").toInt(), 3);
+
+  const QDomElement imageSettingsEl(deskewEl.firstChildElement("image-settings"));
+  BOOST_CHECK(!childWithId(imageSettingsEl, "page", 1).isNull());
+  BOOST_CHECK(!childWithId(imageSettingsEl, "page", 3).isNull());
+
+  // Project-wide settings missing from the delta are gone.
+  const QDomElement pageLayoutEl(target.firstChildElement("page-layout"));
+  BOOST_CHECK_EQUAL(pageLayoutEl.attribute("showMiddleRect").toStdString(), "0");
+  BOOST_CHECK(pageLayoutEl.firstChildElement("guides").isNull());
+  BOOST_CHECK(!childWithId(pageLayoutEl, "page", 1).isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_compacted_project_matches_full_write) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString projectFile(QDir(dir.path()).filePath("project.ScanTailor"));
+
+  Settings settings;
+  settings.deskewAngles = {{4, 1}};
+  settings.deskewImageSettings = {{4, 1}};
+  settings.layoutWidths = {{4, 10}};
+  {
+    QFile file(projectFile);
+    BOOST_REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(writeProject(settings));
+  }
+
+  // New entries on both sides of the existing ones, and new project-wide settings before them.
+  settings.deskewAngles = {{2, 3}, {4, 2}, {6, 5}};
+  settings.deskewImageSettings = {{2, 1}, {4, 1}, {6, 2}};
+  settings.showMiddleRect = true;
+  settings.guides = {7, 8};
+  settings.layoutWidths = {{2, 20}, {4, 10}, {6, 30}};
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {6})));
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {2, 4})));
+
+  BOOST_REQUIRE(ProjectJournal::compact(projectFile));
+  BOOST_CHECK(!QFile::exists(ProjectJournal::filePath(projectFile)));
+
+  QFile file(projectFile);
+  BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+  BOOST_CHECK_EQUAL(file.readAll().toStdString(), writeProject(settings).toStdString());
+}
+
+BOOST_AUTO_TEST_CASE(test_cleared_page_settings_stay_cleared) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString projectFile(QDir(dir.path()).filePath("project.ScanTailor"));
+
+  Settings settings;
+  settings.deskewAngles = {{2, 1}, {4, 2}};
+  settings.deskewImageSettings = {{2, 1}, {4, 1}};
+  settings.layoutWidths = {{2, 10}, {4, 20}};
+  {
+    QFile file(projectFile);
+    BOOST_REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(writeProject(settings));
+  }
+
+  // The params of page 4 are cleared, and then another page changes.
+  settings.deskewAngles.erase(4);
+  settings.deskewImageSettings.erase(4);
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {4})));
+  settings.layoutWidths[2] = 30;
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {2})));
+
+  // Recovery, as after a crash.
+  QDomDocument doc;
+  {
+    QFile file(projectFile);
+    BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+    BOOST_REQUIRE(doc.setContent(&file));
+  }
+  ProjectJournal::applyTo(doc, projectFile);
+
+  const QDomElement filtersEl(doc.documentElement().firstChildElement("filters"));
+  const QDomElement deskewEl(filtersEl.firstChildElement("deskew"));
+  BOOST_CHECK(!childWithId(deskewEl, "page", 2).isNull());
+  BOOST_CHECK(childWithId(deskewEl, "page", 4).isNull());
+  BOOST_CHECK(childWithId(deskewEl.firstChildElement("image-settings"), "page", 4).isNull());
+  const QDomElement pageLayoutEl(filtersEl.firstChildElement("page-layout"));
+  BOOST_CHECK_EQUAL(childWithId(pageLayoutEl, "page", 2).firstChildElement("params").attribute("width").toInt(), 30);
+  BOOST_CHECK_EQUAL(childWithId(pageLayoutEl, "page", 4).firstChildElement("params").attribute("width").toInt(), 20);
+
+  // Compaction.
+  BOOST_REQUIRE(ProjectJournal::compact(projectFile));
+  QFile file(projectFile);
+  BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+  BOOST_CHECK_EQUAL(file.readAll().toStdString(), writeProject(settings).toStdString());
+}
+
+BOOST_AUTO_TEST_CASE(test_apply_to_one_filter_at_a_time) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString projectFile(QDir(dir.path()).filePath("project.ScanTailor"));
+
+  Settings settings;
+  settings.deskewAngles = {{2, 1}, {4, 2}};
+  settings.layoutWidths = {{4, 10}};
+  {
+    QFile file(projectFile);
+    BOOST_REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(writeProject(settings));
+  }
+
+  settings.deskewAngles = {{2, 1}, {6, 3}};
+  settings.deskewImageSettings = {{6, 1}};
+  settings.guides = {5};
+  settings.layoutWidths = {{2, 20}, {4, 10}};
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {4, 6})));
+  BOOST_REQUIRE(ProjectJournal::append(projectFile, writeRecord(settings, {2})));
+
+  QDomDocument doc;
+  {
+    QFile file(projectFile);
+    BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+    BOOST_REQUIRE(doc.setContent(&file));
+  }
+  const QDomElement projectFiltersEl(doc.documentElement().firstChildElement("filters"));
+
+  QDomDocument deltaDoc;
+  const QDomElement delta(ProjectJournal::readDelta(projectFile, deltaDoc));
+  BOOST_REQUIRE(!delta.isNull());
+
+  // As ProjectReader does it.
+  std::map<QString, QString> filterSettings;
+  for (const QString& tagName : {QString("deskew"), QString("page-layout")}) {
+    QDomDocument filterDoc;
+    QDomElement filtersEl(filterDoc.createElement("filters"));
+    filtersEl.appendChild(filterDoc.importNode(projectFiltersEl.firstChildElement(tagName), true));
+    ProjectJournal::applyTo(filtersEl, delta, tagName);
+    filterSettings[tagName] = toString(filtersEl.firstChildElement(tagName));
+  }
+
+  ProjectJournal::applyTo(doc, projectFile);
+  for (const auto& tagAndSettings : filterSettings) {
+    BOOST_CHECK_EQUAL(tagAndSettings.second.toStdString(),
+                      toString(projectFiltersEl.firstChildElement(tagAndSettings.first)).toStdString());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
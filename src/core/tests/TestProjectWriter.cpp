@@ -0,0 +1,78 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ProjectWriter.h>
+
+#include <QBuffer>
+#include <QDomDocument>
+#include <QTextStream>
+#include <QXmlStreamWriter>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(ProjectWriterTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_dom_element_matches_dom_output) {
+  // One attribute per element, as QDom doesn't keep their order.
+  QDomDocument doc;
+  QDomElement rootEl(doc.createElement("filters"));
+  doc.appendChild(rootEl);
+  QDomElement pageEl(doc.createElement("page"));
+  pageEl.setAttribute("id", 12);
+  rootEl.appendChild(pageEl);
+  QDomElement zonesEl(doc.createElement("zones"));
+  zonesEl.setAttribute("path", "a<b & \"c\"");
+  pageEl.appendChild(zonesEl);
+  pageEl.appendChild(doc.createElement("params"));
+  QDomElement textEl(doc.createElement("text"));
+  textEl.appendChild(doc.createTextNode("x & y"));
+  pageEl.appendChild(textEl);
+
+  QByteArray expected;
+  {
+    QTextStream strm(&expected);
+    strm.setCodec("UTF-8");
+    doc.save(strm, 2);
+  }
+
+  QByteArray actual;
+  {
+    QBuffer buffer(&actual);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
+    ProjectWriter::writeDomElement(xml, rootEl);
+    xml.writeEndDocument();
+  }
+
+  BOOST_CHECK_EQUAL(actual.toStdString(), expected.toStdString());
+}
+
+BOOST_AUTO_TEST_CASE(test_dom_element_attribute_order) {
+  const auto write = [](const QDomElement& el) {
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    ProjectWriter::writeDomElement(xml, el);
+    xml.writeEndDocument();
+    return data;
+  };
+
+  QDomDocument doc;
+  QDomElement el1(doc.createElement("params"));
+  el1.setAttribute("width", 1);
+  el1.setAttribute("angle", 2);
+  el1.setAttribute("mode", "auto");
+  QDomElement el2(doc.createElement("params"));
+  el2.setAttribute("mode", "auto");
+  el2.setAttribute("angle", 2);
+  el2.setAttribute("width", 1);
+
+  BOOST_CHECK_EQUAL(write(el1).toStdString(), "<params angle=\"2\" mode=\"auto\" width=\"1\"/>");
+  BOOST_CHECK_EQUAL(write(el2).toStdString(), write(el1).toStdString());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,123 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageId.h>
+#include <StageCache.h>
+
+#include <QImage>
+#include <QRect>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests {
+namespace {
+const qint64 MAX_CACHE_SIZE = qint64(1024) * 1024 * 1024;
+
+QImage makeGrayImage(const int width, const int height) {
+  QImage image(width, height, QImage::Format_Indexed8);
+  QVector<QRgb> palette(256);
+  for (int i = 0; i < 256; ++i) {
+    palette[i] = qRgb(i, i, i);
+  }
+  image.setColorTable(palette);
+  for (int y = 0; y < height; ++y) {
+    uint8_t* line = image.scanLine(y);
+    for (int x = 0; x < width; ++x) {
+      line[x] = static_cast<uint8_t>(x * 7 + y * 13);
+    }
+  }
+  image.setDotsPerMeterX(11811);
+  image.setDotsPerMeterY(11811);
+  return image;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(StageCacheTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const StageCache cache(dir.path(), MAX_CACHE_SIZE);
+
+  StageCache::Key key("test");
+  key << QRect(1, 2, 3, 4) << true;
+
+  const QImage image(makeGrayImage(13, 7));
+  cache.store(key, image);
+
+  QImage loaded;
+  BOOST_REQUIRE(cache.load(key, loaded));
+  BOOST_CHECK(loaded == image);
+  BOOST_CHECK(loaded.dotsPerMeterX() == image.dotsPerMeterX());
+}
+
+BOOST_AUTO_TEST_CASE(test_mono_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const StageCache cache(dir.path(), MAX_CACHE_SIZE);
+
+  QImage image(37, 5, QImage::Format_Mono);
+  image.setColorTable({qRgb(255, 255, 255), qRgb(0, 0, 0)});
+  image.fill(0);
+  for (int i = 0; i < 5; ++i) {
+    image.setPixel(i * 7, i, 1);
+  }
+
+  const StageCache::Key key("test");
+  cache.store(key, image);
+
+  QImage loaded;
+  BOOST_REQUIRE(cache.load(key, loaded));
+  BOOST_CHECK(loaded == image);
+}
+
+BOOST_AUTO_TEST_CASE(test_different_keys) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const StageCache cache(dir.path(), MAX_CACHE_SIZE);
+
+  StageCache::Key key1("test");
+  key1.addSource(ImageId("image.png")) << QRect(0, 0, 10, 10);
+  StageCache::Key key2("test");
+  key2.addSource(ImageId("image.png")) << QRect(0, 0, 10, 11);
+  BOOST_CHECK(key1.toFileName() != key2.toFileName());
+
+  cache.store(key1, makeGrayImage(10, 10));
+
+  QImage loaded;
+  BOOST_CHECK(!cache.load(key2, loaded));
+  BOOST_CHECK(loaded.isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_least_recently_used_are_removed) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+
+  const QImage image(makeGrayImage(100, 100));
+  const StageCache::Key key1("test1");
+  const StageCache::Key key2("test2");
+  const StageCache::Key key3("test3");
+
+  // Enough for two images, but not for three.
+  const StageCache cache(dir.path(), 25000);
+  cache.store(key1, image);
+  cache.store(key2, image);
+
+  QImage loaded;
+  BOOST_REQUIRE(cache.load(key1, loaded));
+
+  cache.store(key3, image);
+  BOOST_CHECK(cache.load(key1, loaded));
+  BOOST_CHECK(!cache.load(key2, loaded));
+  BOOST_CHECK(cache.load(key3, loaded));
+
+  // Another cache for the same directory sees the same entries.
+  const StageCache otherCache(dir.path(), 25000);
+  otherCache.store(key2, image);
+  BOOST_CHECK(!cache.load(key1, loaded));
+  BOOST_CHECK(cache.load(key2, loaded));
+  BOOST_CHECK(cache.load(key3, loaded));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
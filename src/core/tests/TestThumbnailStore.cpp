@@ -0,0 +1,142 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ThumbnailStore.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+#include <memory>
+
+namespace Tests {
+namespace {
+QImage makeImage(const int width, const int height, const int seed) {
+  QImage image(width, height, QImage::Format_RGB32);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      image.setPixel(x, y, qRgb((x + seed) & 0xff, (y * 3) & 0xff, (x * y + seed) & 0xff));
+    }
+  }
+  return image;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ThumbnailStoreTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  ThumbnailStore store(dir.path());
+
+  QImage gray(21, 9, QImage::Format_Indexed8);
+  QVector<QRgb> palette(256);
+  for (int i = 0; i < 256; ++i) {
+    palette[i] = qRgb(i, i, i);
+  }
+  gray.setColorTable(palette);
+  gray.fill(77);
+
+  const QImage color(makeImage(17, 11, 1));
+  BOOST_REQUIRE(store.store("gray", gray));
+  BOOST_REQUIRE(store.store("color", color));
+
+  BOOST_CHECK(store.contains("gray"));
+  BOOST_CHECK(!store.contains("missing"));
+  BOOST_CHECK(store.load("gray") == gray);
+  BOOST_CHECK(store.load("color") == color);
+  BOOST_CHECK(store.load("missing").isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_reopen) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QImage first(makeImage(10, 10, 1));
+  const QImage second(makeImage(12, 8, 2));
+  {
+    ThumbnailStore store(dir.path());
+    BOOST_REQUIRE(store.store("a", first));
+    BOOST_REQUIRE(store.store("b", first));
+    BOOST_REQUIRE(store.store("a", second));
+  }
+  {
+    ThumbnailStore store(dir.path());
+    BOOST_CHECK(store.load("a") == second);
+    BOOST_CHECK(store.load("b") == first);
+  }
+
+  // Without the index, the pack gets scanned.
+  BOOST_REQUIRE(QFile::remove(QDir(dir.path()).absoluteFilePath("thumbnails.index")));
+  {
+    ThumbnailStore store(dir.path());
+    BOOST_CHECK(store.load("a") == second);
+    BOOST_CHECK(store.load("b") == first);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_compaction) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString packPath(QDir(dir.path()).absoluteFilePath("thumbnails.pack"));
+  const QImage image(makeImage(64, 64, 3));
+
+  ThumbnailStore store(dir.path());
+  for (int i = 0; i < 10; ++i) {
+    BOOST_REQUIRE(store.store("a", makeImage(64, 64, i)));
+  }
+  BOOST_REQUIRE(store.store("a", image));
+  BOOST_REQUIRE(store.store("b", image));
+  const qint64 sizeBefore = QFileInfo(packPath).size();
+
+  store.compact();
+  BOOST_CHECK(QFileInfo(packPath).size() < sizeBefore);
+  BOOST_CHECK(store.load("a") == image);
+  BOOST_CHECK(store.load("b") == image);
+
+  BOOST_REQUIRE(store.store("c", image));
+  BOOST_CHECK(store.load("c") == image);
+}
+
+BOOST_AUTO_TEST_CASE(test_legacy_thumbnails) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString legacyPath(QDir(dir.path()).absoluteFilePath("page_0_hash_q200.png"));
+  const QImage image(makeImage(15, 20, 4));
+  BOOST_REQUIRE(image.save(legacyPath, "PNG"));
+
+  ThumbnailStore store(dir.path());
+  BOOST_CHECK(store.contains("page_0_hash_q200"));
+  BOOST_CHECK(store.load("page_0_hash_q200") == image);
+  // The thumbnail has been moved into the pack.
+  BOOST_CHECK(!QFile::exists(legacyPath));
+  BOOST_CHECK(store.load("page_0_hash_q200") == image);
+}
+
+BOOST_AUTO_TEST_CASE(test_single_writer) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QImage first(makeImage(10, 10, 5));
+  const QImage second(makeImage(10, 10, 6));
+
+  const std::shared_ptr<ThumbnailStore> store(ThumbnailStore::forDirectory(dir.path()));
+  BOOST_CHECK(ThumbnailStore::forDirectory(dir.path()) == store);
+  BOOST_CHECK(!store->isReadOnly());
+  BOOST_REQUIRE(store->store("a", first));
+
+  {
+    // Another store for the same pack may only read it.
+    ThumbnailStore other(dir.path());
+    BOOST_CHECK(other.isReadOnly());
+    BOOST_CHECK(other.load("a") == first);
+    BOOST_CHECK(!other.store("b", second));
+  }
+
+  BOOST_REQUIRE(store->store("b", second));
+  BOOST_CHECK(store->load("a") == first);
+  BOOST_CHECK(store->load("b") == second);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
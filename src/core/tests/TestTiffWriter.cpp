@@ -0,0 +1,80 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageLoader.h>
+#include <TiffWriter.h>
+
+#include <QBuffer>
+#include <QImage>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests {
+namespace {
+QImage writeAndLoad(const QImage& image) {
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadWrite);
+  if (!TiffWriter::writeImage(buffer, image)) {
+    return QImage();
+  }
+  buffer.seek(0);
+  return ImageLoader::load(buffer, 0);
+}
+
+QImage makeIndexed8(const QVector<QRgb>& colorTable) {
+  QImage image(colorTable.size(), 10, QImage::Format_Indexed8);
+  image.setColorTable(colorTable);
+  for (int y = 0; y < image.height(); ++y) {
+    uchar* line = image.scanLine(y);
+    for (int x = 0; x < image.width(); ++x) {
+      line[x] = static_cast<uchar>(x);
+    }
+  }
+  return image;
+}
+
+bool samePixels(const QImage& lhs, const QImage& rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (int y = 0; y < lhs.height(); ++y) {
+    for (int x = 0; x < lhs.width(); ++x) {
+      if (lhs.pixel(x, y) != rhs.pixel(x, y)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(TiffWriterTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_grayscale_ramp_round_trip) {
+  QVector<QRgb> colorTable(256);
+  for (int i = 0; i < 256; ++i) {
+    colorTable[i] = qRgb(i, i, i);
+  }
+  const QImage image(makeIndexed8(colorTable));
+  const QImage loaded(writeAndLoad(image));
+  BOOST_REQUIRE(!loaded.isNull());
+  BOOST_CHECK(loaded.isGrayscale());
+  BOOST_CHECK(samePixels(image, loaded));
+}
+
+BOOST_AUTO_TEST_CASE(test_posterized_gray_palette_round_trip) {
+  // A posterized image has a few gray levels that don't match their indices.
+  // Storing its indices as grayscale samples would make it almost black.
+  QVector<QRgb> colorTable;
+  for (int i = 0; i < 8; ++i) {
+    const int level = i * 255 / 7;
+    colorTable.push_back(qRgb(level, level, level));
+  }
+  const QImage image(makeIndexed8(colorTable));
+  const QImage loaded(writeAndLoad(image));
+  BOOST_REQUIRE(!loaded.isNull());
+  BOOST_CHECK(samePixels(image, loaded));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
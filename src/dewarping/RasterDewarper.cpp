@@ -5,9 +5,11 @@
 
 #include <ColorMixer.h>
 #include <GrayImage.h>
+#include <ParallelFor.h>
 
 #include <QDebug>
 #include <cmath>
+#include <vector>
 
 #include "CylindricalSurfaceDewarper.h"
 
@@ -140,260 +142,261 @@ void dewarpGeneric(const PixelType* const srcData,
 
 #elif INTERPOLATION_METHOD == INTERP_AREA_MAPPING
 
+const int MIN_LINES_PER_CHUNK = 8;
+
+/**
+ * Computes the color of a destination pixel by mixing the source pixels
+ * covered by the quadrilateral its corners map to.
+ */
 template <typename ColorMixer, typename PixelType>
-void areaMapGeneratrix(const PixelType* const srcData,
+PixelType areaMapPixel(const PixelType* const srcData,
                        const QSize srcSize,
                        const int srcStride,
-                       PixelType* pDst,
-                       const QSize dstSize,
-                       const int dstStride,
                        const PixelType bgColor,
-                       const std::vector<Vec2f>& prevGridColumn,
-                       const std::vector<Vec2f>& nextGridColumn) {
+                       const Vec2f& topLeft,
+                       const Vec2f& topRight,
+                       const Vec2f& bottomLeft,
+                       const Vec2f& bottomRight) {
   const int sw = srcSize.width();
   const int sh = srcSize.height();
-  const int dstHeight = dstSize.height();
 
-  const Vec2f* srcLeftPoints = &prevGridColumn[0];
-  const Vec2f* srcRightPoints = &nextGridColumn[0];
-
-  Vec2f f_src32_quad[4];
-
-  for (int dstY = 0; dstY < dstHeight; ++dstY) {
-    // Take a mid-point of each edge, pre-multiply by 32,
-    // write the result to f_src32_quad. 16 comes from 32*0.5
-    f_src32_quad[0] = 16.0f * (srcLeftPoints[0] + srcRightPoints[0]);
-    f_src32_quad[1] = 16.0f * (srcRightPoints[0] + srcRightPoints[1]);
-    f_src32_quad[2] = 16.0f * (srcRightPoints[1] + srcLeftPoints[1]);
-    f_src32_quad[3] = 16.0f * (srcLeftPoints[0] + srcLeftPoints[1]);
-    ++srcLeftPoints;
-    ++srcRightPoints;
-
-    // Calculate the bounding box of src_quad.
-
-    float fSrc32Left = f_src32_quad[0][0];
-    float fSrc32Top = f_src32_quad[0][1];
-    float fSrc32Right = fSrc32Left;
-    float fSrc32Bottom = fSrc32Top;
-
-    for (int i = 1; i < 4; ++i) {
-      const Vec2f pt(f_src32_quad[i]);
-      if (pt[0] < fSrc32Left) {
-        fSrc32Left = pt[0];
-      } else if (pt[0] > fSrc32Right) {
-        fSrc32Right = pt[0];
-      }
-      if (pt[1] < fSrc32Top) {
-        fSrc32Top = pt[1];
-      } else if (pt[1] > fSrc32Bottom) {
-        fSrc32Bottom = pt[1];
-      }
-    }
+  // Take a mid-point of each edge, pre-multiply by 32,
+  // write the result to f_src32_quad. 16 comes from 32*0.5
+  const Vec2f f_src32_quad[4] = {16.0f * (topLeft + topRight), 16.0f * (topRight + bottomRight),
+                                 16.0f * (bottomRight + bottomLeft), 16.0f * (topLeft + bottomLeft)};
 
-    if ((fSrc32Top < -32.0f * 10000.0f) || (fSrc32Left < -32.0f * 10000.0f)
-        || (fSrc32Bottom > 32.0f * (float(sh) + 10000.f)) || (fSrc32Right > 32.0f * (float(sw) + 10000.f))) {
-      // This helps to prevent integer overflows.
-      *pDst = bgColor;
-      pDst += dstStride;
-      continue;
-    }
+  // Calculate the bounding box of src_quad.
 
-    // Note: the code below is more or less the same as in transformGeneric()
-    // in imageproc/Transform.cpp
-
-    // Note that without using std::floor() and std::ceil()
-    // we can't guarantee that srcBottom >= srcTop
-    // and srcRight >= srcLeft.
-    auto src32Left = (int) std::floor(fSrc32Left);
-    auto src32Right = (int) std::ceil(fSrc32Right);
-    auto src32Top = (int) std::floor(fSrc32Top);
-    auto src32Bottom = (int) std::ceil(fSrc32Bottom);
-    int srcLeft = src32Left >> 5;
-    int srcRight = (src32Right - 1) >> 5;  // inclusive
-    int srcTop = src32Top >> 5;
-    int srcBottom = (src32Bottom - 1) >> 5;  // inclusive
-    assert(srcBottom >= srcTop);
-    assert(srcRight >= srcLeft);
-
-    if ((srcBottom < 0) || (srcRight < 0) || (srcLeft >= sw) || (srcTop >= sh)) {
-      // Completely outside of src image.
-      *pDst = bgColor;
-      pDst += dstStride;
-      continue;
-    }
+  float fSrc32Left = f_src32_quad[0][0];
+  float fSrc32Top = f_src32_quad[0][1];
+  float fSrc32Right = fSrc32Left;
+  float fSrc32Bottom = fSrc32Top;
 
-    /*
-     * Note that (intval / 32) is not the same as (intval >> 5).
-     * The former rounds towards zero, while the latter rounds towards
-     * negative infinity.
-     * Likewise, (intval % 32) is not the same as (intval & 31).
-     * The following expression:
-     * topFraction = 32 - (src32Top & 31);
-     * works correctly with both positive and negative src32Top.
-     */
-
-    unsigned backgroundArea = 0;
-
-    if (srcTop < 0) {
-      const unsigned topFraction = 32 - (src32Top & 31);
-      const unsigned horFraction = src32Right - src32Left;
-      backgroundArea += topFraction * horFraction;
-      const unsigned fullPixelsVer = -1 - srcTop;
-      backgroundArea += horFraction * (fullPixelsVer << 5);
-      srcTop = 0;
-      src32Top = 0;
+  for (int i = 1; i < 4; ++i) {
+    const Vec2f pt(f_src32_quad[i]);
+    if (pt[0] < fSrc32Left) {
+      fSrc32Left = pt[0];
+    } else if (pt[0] > fSrc32Right) {
+      fSrc32Right = pt[0];
     }
-    if (srcBottom >= sh) {
-      const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
-      const unsigned horFraction = src32Right - src32Left;
-      backgroundArea += bottomFraction * horFraction;
-      const unsigned fullPixelsVer = srcBottom - sh;
-      backgroundArea += horFraction * (fullPixelsVer << 5);
-      srcBottom = sh - 1;     // inclusive
-      src32Bottom = sh << 5;  // exclusive
-    }
-    if (srcLeft < 0) {
-      const unsigned leftFraction = 32 - (src32Left & 31);
-      const unsigned vertFraction = src32Bottom - src32Top;
-      backgroundArea += leftFraction * vertFraction;
-      const unsigned fullPixelsHor = -1 - srcLeft;
-      backgroundArea += vertFraction * (fullPixelsHor << 5);
-      srcLeft = 0;
-      src32Left = 0;
+    if (pt[1] < fSrc32Top) {
+      fSrc32Top = pt[1];
+    } else if (pt[1] > fSrc32Bottom) {
+      fSrc32Bottom = pt[1];
     }
-    if (srcRight >= sw) {
-      const unsigned rightFraction = src32Right - (srcRight << 5);
-      const unsigned vertFraction = src32Bottom - src32Top;
-      backgroundArea += rightFraction * vertFraction;
-      const unsigned fullPixelsHor = srcRight - sw;
-      backgroundArea += vertFraction * (fullPixelsHor << 5);
-      srcRight = sw - 1;     // inclusive
-      src32Right = sw << 5;  // exclusive
-    }
-    assert(srcBottom >= srcTop);
-    assert(srcRight >= srcLeft);
+  }
+
+  if ((fSrc32Top < -32.0f * 10000.0f) || (fSrc32Left < -32.0f * 10000.0f)
+      || (fSrc32Bottom > 32.0f * (float(sh) + 10000.f)) || (fSrc32Right > 32.0f * (float(sw) + 10000.f))) {
+    // This helps to prevent integer overflows.
+    return bgColor;
+  }
+
+  // Note: the code below is more or less the same as in transformGeneric()
+  // in imageproc/Transform.cpp
+
+  // Note that without using std::floor() and std::ceil()
+  // we can't guarantee that srcBottom >= srcTop
+  // and srcRight >= srcLeft.
+  auto src32Left = (int) std::floor(fSrc32Left);
+  auto src32Right = (int) std::ceil(fSrc32Right);
+  auto src32Top = (int) std::floor(fSrc32Top);
+  auto src32Bottom = (int) std::ceil(fSrc32Bottom);
+  int srcLeft = src32Left >> 5;
+  int srcRight = (src32Right - 1) >> 5;  // inclusive
+  int srcTop = src32Top >> 5;
+  int srcBottom = (src32Bottom - 1) >> 5;  // inclusive
+  assert(srcBottom >= srcTop);
+  assert(srcRight >= srcLeft);
+
+  if ((srcBottom < 0) || (srcRight < 0) || (srcLeft >= sw) || (srcTop >= sh)) {
+    // Completely outside of src image.
+    return bgColor;
+  }
 
-    ColorMixer mixer;
-    // if (weak_background) {
-    // backgroundArea = 0;
-    // } else {
-    mixer.add(bgColor, backgroundArea);
-    // }
+  /*
+   * Note that (intval / 32) is not the same as (intval >> 5).
+   * The former rounds towards zero, while the latter rounds towards
+   * negative infinity.
+   * Likewise, (intval % 32) is not the same as (intval & 31).
+   * The following expression:
+   * topFraction = 32 - (src32Top & 31);
+   * works correctly with both positive and negative src32Top.
+   */
 
-    const unsigned leftFraction = 32 - (src32Left & 31);
+  unsigned backgroundArea = 0;
+
+  if (srcTop < 0) {
     const unsigned topFraction = 32 - (src32Top & 31);
-    const unsigned rightFraction = src32Right - (srcRight << 5);
+    const unsigned horFraction = src32Right - src32Left;
+    backgroundArea += topFraction * horFraction;
+    const unsigned fullPixelsVer = -1 - srcTop;
+    backgroundArea += horFraction * (fullPixelsVer << 5);
+    srcTop = 0;
+    src32Top = 0;
+  }
+  if (srcBottom >= sh) {
     const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
+    const unsigned horFraction = src32Right - src32Left;
+    backgroundArea += bottomFraction * horFraction;
+    const unsigned fullPixelsVer = srcBottom - sh;
+    backgroundArea += horFraction * (fullPixelsVer << 5);
+    srcBottom = sh - 1;     // inclusive
+    src32Bottom = sh << 5;  // exclusive
+  }
+  if (srcLeft < 0) {
+    const unsigned leftFraction = 32 - (src32Left & 31);
+    const unsigned vertFraction = src32Bottom - src32Top;
+    backgroundArea += leftFraction * vertFraction;
+    const unsigned fullPixelsHor = -1 - srcLeft;
+    backgroundArea += vertFraction * (fullPixelsHor << 5);
+    srcLeft = 0;
+    src32Left = 0;
+  }
+  if (srcRight >= sw) {
+    const unsigned rightFraction = src32Right - (srcRight << 5);
+    const unsigned vertFraction = src32Bottom - src32Top;
+    backgroundArea += rightFraction * vertFraction;
+    const unsigned fullPixelsHor = srcRight - sw;
+    backgroundArea += vertFraction * (fullPixelsHor << 5);
+    srcRight = sw - 1;     // inclusive
+    src32Right = sw << 5;  // exclusive
+  }
+  assert(srcBottom >= srcTop);
+  assert(srcRight >= srcLeft);
+
+  ColorMixer mixer;
+  // if (weak_background) {
+  // backgroundArea = 0;
+  // } else {
+  mixer.add(bgColor, backgroundArea);
+  // }
+
+  const unsigned leftFraction = 32 - (src32Left & 31);
+  const unsigned topFraction = 32 - (src32Top & 31);
+  const unsigned rightFraction = src32Right - (srcRight << 5);
+  const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
+
+  assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32
+         == static_cast<unsigned>(src32Right - src32Left));
+  assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32
+         == static_cast<unsigned>(src32Bottom - src32Top));
+
+  const unsigned srcArea = (src32Bottom - src32Top) * (src32Right - src32Left);
+  if (srcArea == 0) {
+    return bgColor;
+  }
 
-    assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32
-           == static_cast<unsigned>(src32Right - src32Left));
-    assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32
-           == static_cast<unsigned>(src32Bottom - src32Top));
+  const PixelType* srcLine = &srcData[srcTop * srcStride];
 
-    const unsigned srcArea = (src32Bottom - src32Top) * (src32Right - src32Left);
-    if (srcArea == 0) {
-      *pDst = bgColor;
-      pDst += dstStride;
-      continue;
-    }
+  if (srcTop == srcBottom) {
+    if (srcLeft == srcRight) {
+      // dst pixel maps to a single src pixel
+      const PixelType c = srcLine[srcLeft];
+      if (backgroundArea == 0) {
+        // common case optimization
+        return c;
+      }
+      mixer.add(c, srcArea);
+    } else {
+      // dst pixel maps to a horizontal line of src pixels
+      const unsigned vertFraction = src32Bottom - src32Top;
+      const unsigned leftArea = vertFraction * leftFraction;
+      const unsigned middleArea = vertFraction << 5;
+      const unsigned rightArea = vertFraction * rightFraction;
 
-    const PixelType* srcLine = &srcData[srcTop * srcStride];
-
-    if (srcTop == srcBottom) {
-      if (srcLeft == srcRight) {
-        // dst pixel maps to a single src pixel
-        const PixelType c = srcLine[srcLeft];
-        if (backgroundArea == 0) {
-          // common case optimization
-          *pDst = c;
-          pDst += dstStride;
-          continue;
-        }
-        mixer.add(c, srcArea);
-      } else {
-        // dst pixel maps to a horizontal line of src pixels
-        const unsigned vertFraction = src32Bottom - src32Top;
-        const unsigned leftArea = vertFraction * leftFraction;
-        const unsigned middleArea = vertFraction << 5;
-        const unsigned rightArea = vertFraction * rightFraction;
-
-        mixer.add(srcLine[srcLeft], leftArea);
-
-        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], middleArea);
-        }
-
-        mixer.add(srcLine[srcRight], rightArea);
+      mixer.add(srcLine[srcLeft], leftArea);
+
+      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+        mixer.add(srcLine[sx], middleArea);
       }
-    } else if (srcLeft == srcRight) {
-      // dst pixel maps to a vertical line of src pixels
-      const unsigned horFraction = src32Right - src32Left;
-      const unsigned topArea = horFraction * topFraction;
-      const unsigned middleArea = horFraction << 5;
-      const unsigned bottomArea = horFraction * bottomFraction;
 
-      srcLine += srcLeft;
-      mixer.add(*srcLine, topArea);
+      mixer.add(srcLine[srcRight], rightArea);
+    }
+  } else if (srcLeft == srcRight) {
+    // dst pixel maps to a vertical line of src pixels
+    const unsigned horFraction = src32Right - src32Left;
+    const unsigned topArea = horFraction * topFraction;
+    const unsigned middleArea = horFraction << 5;
+    const unsigned bottomArea = horFraction * bottomFraction;
+
+    srcLine += srcLeft;
+    mixer.add(*srcLine, topArea);
 
+    srcLine += srcStride;
+
+    for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+      mixer.add(*srcLine, middleArea);
       srcLine += srcStride;
+    }
 
-      for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-        mixer.add(*srcLine, middleArea);
-        srcLine += srcStride;
-      }
+    mixer.add(*srcLine, bottomArea);
+  } else {
+    // dst pixel maps to a block of src pixels
+    const unsigned topArea = topFraction << 5;
+    const unsigned bottomArea = bottomFraction << 5;
+    const unsigned leftArea = leftFraction << 5;
+    const unsigned rightArea = rightFraction << 5;
+    const unsigned topleftArea = topFraction * leftFraction;
+    const unsigned toprightArea = topFraction * rightFraction;
+    const unsigned bottomleftArea = bottomFraction * leftFraction;
+    const unsigned bottomrightArea = bottomFraction * rightFraction;
+
+    // process the top-left corner
+    mixer.add(srcLine[srcLeft], topleftArea);
+
+    // process the top line (without corners)
+    for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+      mixer.add(srcLine[sx], topArea);
+    }
+
+    // process the top-right corner
+    mixer.add(srcLine[srcRight], toprightArea);
+
+    srcLine += srcStride;
+    // process middle lines
+    for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+      mixer.add(srcLine[srcLeft], leftArea);
 
-      mixer.add(*srcLine, bottomArea);
-    } else {
-      // dst pixel maps to a block of src pixels
-      const unsigned topArea = topFraction << 5;
-      const unsigned bottomArea = bottomFraction << 5;
-      const unsigned leftArea = leftFraction << 5;
-      const unsigned rightArea = rightFraction << 5;
-      const unsigned topleftArea = topFraction * leftFraction;
-      const unsigned toprightArea = topFraction * rightFraction;
-      const unsigned bottomleftArea = bottomFraction * leftFraction;
-      const unsigned bottomrightArea = bottomFraction * rightFraction;
-
-      // process the top-left corner
-      mixer.add(srcLine[srcLeft], topleftArea);
-
-      // process the top line (without corners)
       for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-        mixer.add(srcLine[sx], topArea);
+        mixer.add(srcLine[sx], 32 * 32);
       }
 
-      // process the top-right corner
-      mixer.add(srcLine[srcRight], toprightArea);
+      mixer.add(srcLine[srcRight], rightArea);
 
       srcLine += srcStride;
-      // process middle lines
-      for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-        mixer.add(srcLine[srcLeft], leftArea);
+    }
 
-        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], 32 * 32);
-        }
+    // process bottom-left corner
+    mixer.add(srcLine[srcLeft], bottomleftArea);
 
-        mixer.add(srcLine[srcRight], rightArea);
+    // process the bottom line (without corners)
+    for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+      mixer.add(srcLine[sx], bottomArea);
+    }
+    // process the bottom-right corner
+    mixer.add(srcLine[srcRight], bottomrightArea);
+  }
 
-        srcLine += srcStride;
-      }
+  return mixer.mix(srcArea + backgroundArea);
+}  // areaMapPixel
 
-      // process bottom-left corner
-      mixer.add(srcLine[srcLeft], bottomleftArea);
+/**
+ * The mapping of a vertical line of the destination image
+ * to a curve in the source image.
+ */
+struct GeneratrixMapping {
+  HomographicTransform<1, float> homog;
+  Vec2f origin;
+  Vec2f vec;
 
-      // process the bottom line (without corners)
-      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-        mixer.add(srcLine[sx], bottomArea);
-      }
-      // process the bottom-right corner
-      mixer.add(srcLine[srcRight], bottomrightArea);
-    }
+  explicit GeneratrixMapping(const CylindricalSurfaceDewarper::Generatrix& generatrix)
+      : homog(generatrix.pln2img.mat()),
+        origin(generatrix.imgLine.p1()),
+        vec(generatrix.imgLine.p2() - generatrix.imgLine.p1()) {}
 
-    *pDst = mixer.mix(srcArea + backgroundArea);
-    pDst += dstStride;
-  }
-}  // areaMapGeneratrix
+  Vec2f operator()(const float modelY) const { return origin + vec * homog(modelY); }
+};
 
 template <typename ColorMixer, typename PixelType>
 void dewarpGeneric(const PixelType* const srcData,
@@ -405,41 +408,52 @@ void dewarpGeneric(const PixelType* const srcData,
                    const CylindricalSurfaceDewarper& distortionModel,
                    const QRectF& modelDomain,
                    const PixelType bgColor) {
-  const int srcWidth = srcSize.width();
-  const int srcHeight = srcSize.height();
   const int dstWidth = dstSize.width();
   const int dstHeight = dstSize.height();
 
-  CylindricalSurfaceDewarper::State state;
-
   const double modelDomainLeft = modelDomain.left();
   const double modelXScale = 1.0 / (modelDomain.right() - modelDomain.left());
 
   const auto modelDomainTop = static_cast<float>(modelDomain.top());
   const auto modelYScale = static_cast<float>(1.0 / (modelDomain.bottom() - modelDomain.top()));
 
-  std::vector<Vec2f> prevGridColumn(dstHeight + 1);
-  std::vector<Vec2f> nextGridColumn(dstHeight + 1);
-
-  for (int dstX = 0; dstX <= dstWidth; ++dstX) {
-    const double modelX = (dstX - modelDomainLeft) * modelXScale;
-    const CylindricalSurfaceDewarper::Generatrix generatrix(distortionModel.mapGeneratrix(modelX, state));
-
-    const HomographicTransform<1, float> homog(generatrix.pln2img.mat());
-    const Vec2f origin(generatrix.imgLine.p1());
-    const Vec2f vec(generatrix.imgLine.p2() - generatrix.imgLine.p1());
-    for (int dstY = 0; dstY <= dstHeight; ++dstY) {
-      const float modelY = (float(dstY) - modelDomainTop) * modelYScale;
-      nextGridColumn[dstY] = origin + vec * homog(modelY);
+  // Mapping a generatrix is the expensive part, so it's done once per
+  // grid column, while the grid itself is built a row at a time.
+  std::vector<GeneratrixMapping> generatrices;
+  generatrices.reserve(dstWidth + 1);
+  {
+    CylindricalSurfaceDewarper::State state;
+    for (int dstX = 0; dstX <= dstWidth; ++dstX) {
+      const double modelX = (dstX - modelDomainLeft) * modelXScale;
+      generatrices.emplace_back(distortionModel.mapGeneratrix(modelX, state));
     }
+  }
 
-    if (dstX != 0) {
-      areaMapGeneratrix<ColorMixer, PixelType>(srcData, srcSize, srcStride, dstData + dstX - 1, dstSize, dstStride,
-                                               bgColor, prevGridColumn, nextGridColumn);
+  const auto mapGridRow = [&](const int dstY, std::vector<Vec2f>& gridRow) {
+    const float modelY = (float(dstY) - modelDomainTop) * modelYScale;
+    for (int dstX = 0; dstX <= dstWidth; ++dstX) {
+      gridRow[dstX] = generatrices[dstX](modelY);
     }
-
-    prevGridColumn.swap(nextGridColumn);
-  }
+  };
+
+  // Destination pixels are produced row by row, so that both writing them
+  // and reading the source pixels they map to go along image lines.
+  foundation::ParallelFor::run(dstHeight, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    std::vector<Vec2f> topGridRow(dstWidth + 1);
+    std::vector<Vec2f> bottomGridRow(dstWidth + 1);
+    mapGridRow(yBegin, topGridRow);
+
+    PixelType* dstLine = dstData + yBegin * dstStride;
+    for (int dstY = yBegin; dstY < yEnd; ++dstY, dstLine += dstStride) {
+      mapGridRow(dstY + 1, bottomGridRow);
+      for (int dstX = 0; dstX < dstWidth; ++dstX) {
+        dstLine[dstX] = areaMapPixel<ColorMixer, PixelType>(srcData, srcSize, srcStride, bgColor, topGridRow[dstX],
+                                                            topGridRow[dstX + 1], bottomGridRow[dstX],
+                                                            bottomGridRow[dstX + 1]);
+      }
+      topGridRow.swap(bottomGridRow);
+    }
+  });
 }  // dewarpGeneric
 #endif  // INTERPOLATION_METHOD
 #if INTERPOLATION_METHOD == INTERP_BILLINEAR
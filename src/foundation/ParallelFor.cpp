@@ -0,0 +1,174 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ParallelFor.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace foundation {
+namespace {
+// Splitting the work into a few chunks per core evens out
+// the differences in complexity between parts of an image.
+const int CHUNKS_PER_THREAD = 4;
+
+// The number of threads currently busy with processing, including the helpers.
+QAtomicInt numBusyThreads;
+
+thread_local bool isBusyThread = false;
+
+int maxBusyThreads() {
+  static const int maxThreads = std::max(1, QThread::idealThreadCount());
+  return maxThreads;
+}
+
+class HelperPool : public QThreadPool {
+ public:
+  HelperPool() { setMaxThreadCount(maxBusyThreads()); }
+};
+
+QThreadPool& helperPool() {
+  static HelperPool pool;
+  return pool;
+}
+
+/**
+ * \return The number of helpers that may be started, at most \p wanted.
+ */
+int reserveHelpers(const int wanted) {
+  while (true) {
+    const int numBusy = numBusyThreads.loadAcquire();
+    const int numAvailable = std::min(wanted, maxBusyThreads() - numBusy);
+    if (numAvailable <= 0) {
+      return 0;
+    }
+    if (numBusyThreads.testAndSetOrdered(numBusy, numBusy + numAvailable)) {
+      return numAvailable;
+    }
+  }
+}
+
+struct Job {
+  Job(const std::function<void(int, int)>& body, int count, int chunkSize)
+      : body(body), count(count), chunkSize(chunkSize), numChunks((count + chunkSize - 1) / chunkSize) {}
+
+  // Only dereferenced while there are chunks left, which means
+  // the thread that called ParallelFor::run() is still waiting.
+  const std::function<void(int, int)>& body;
+  const int count;
+  const int chunkSize;
+  const int numChunks;
+  QAtomicInt nextChunk;
+  QAtomicInt failed;
+  QMutex mutex;
+  QWaitCondition allDone;
+  int numDone = 0;
+  std::exception_ptr error;
+};
+
+void processChunks(Job& job) {
+  while (true) {
+    const int chunk = job.nextChunk.fetchAndAddRelaxed(1);
+    if (chunk >= job.numChunks) {
+      return;
+    }
+
+    if (!job.failed.loadAcquire()) {
+      const int begin = chunk * job.chunkSize;
+      const int end = std::min(job.count, begin + job.chunkSize);
+      try {
+        job.body(begin, end);
+      } catch (...) {
+        QMutexLocker locker(&job.mutex);
+        if (!job.error) {
+          job.error = std::current_exception();
+        }
+        job.failed.storeRelease(1);
+      }
+    }
+
+    QMutexLocker locker(&job.mutex);
+    if (++job.numDone == job.numChunks) {
+      job.allDone.wakeAll();
+    }
+  }
+}
+
+class HelperRunnable : public QRunnable {
+ public:
+  explicit HelperRunnable(std::shared_ptr<Job> job) : m_job(std::move(job)) { setAutoDelete(true); }
+
+  void run() override {
+    // The slot in numBusyThreads has been reserved by reserveHelpers().
+    isBusyThread = true;
+    processChunks(*m_job);
+    isBusyThread = false;
+    numBusyThreads.deref();
+  }
+
+ private:
+  std::shared_ptr<Job> m_job;
+};
+}  // namespace
+
+ParallelFor::ComputeScope::ComputeScope() : m_counted(!isBusyThread) {
+  if (m_counted) {
+    isBusyThread = true;
+    numBusyThreads.ref();
+  }
+}
+
+ParallelFor::ComputeScope::~ComputeScope() {
+  if (m_counted) {
+    numBusyThreads.deref();
+    isBusyThread = false;
+  }
+}
+
+void ParallelFor::run(const int count, const int minChunkSize, const std::function<void(int, int)>& body) {
+  if (count <= 0) {
+    return;
+  }
+
+  const int maxChunks = maxBusyThreads() * CHUNKS_PER_THREAD;
+  const int chunkSize = std::max(std::max(minChunkSize, 1), (count + maxChunks - 1) / maxChunks);
+  if (chunkSize >= count) {
+    body(0, count);
+    return;
+  }
+
+  // The calling thread takes part in processing.
+  const ComputeScope computeScope;
+
+  auto job = std::make_shared<Job>(body, count, chunkSize);
+  const int numHelpers = reserveHelpers(job->numChunks - 1);
+  if (numHelpers == 0) {
+    body(0, count);
+    return;
+  }
+
+  for (int i = 0; i < numHelpers; ++i) {
+    helperPool().start(new HelperRunnable(job));
+  }
+  processChunks(*job);
+
+  // Helpers that haven't started by now will find nothing to do,
+  // so we only need to wait for the chunks being processed.
+  QMutexLocker locker(&job->mutex);
+  while (job->numDone < job->numChunks) {
+    job->allDone.wait(&job->mutex);
+  }
+  if (job->error) {
+    std::rethrow_exception(job->error);
+  }
+}  // ParallelFor::run
+}  // namespace foundation
@@ -0,0 +1,60 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_FOUNDATION_PARALLELFOR_H_
+#define SCANTAILOR_FOUNDATION_PARALLELFOR_H_
+
+#include <functional>
+
+#include "NonCopyable.h"
+
+namespace foundation {
+/**
+ * \brief Splits a loop over independent items, typically image rows,
+ *        between the calling thread and a process-wide pool of helpers.
+ *
+ * The number of helpers is limited by the number of CPU cores not already
+ * busy with other work.  Threads doing heavy processing, like the ones
+ * WorkerThreadPool runs tasks on, declare themselves with a ComputeScope.
+ * When every core is already busy, as it normally is in batch processing,
+ * the loop simply runs on the calling thread.
+ */
+class ParallelFor {
+ public:
+  /**
+   * \brief Marks the current thread as busy with processing for
+   *        the lifetime of the object.
+   */
+  class ComputeScope {
+    DECLARE_NON_COPYABLE(ComputeScope)
+
+   public:
+    ComputeScope();
+
+    ~ComputeScope();
+
+   private:
+    bool m_counted;
+  };
+
+  /**
+   * \brief Calls \p body for consecutive ranges covering [0, count).
+   *
+   * \param count The number of items.
+   * \param minChunkSize The minimum number of items to process at once.
+   *        Makes sure the per-chunk overhead is negligible.
+   * \param body The function to call with [begin, end) ranges of items.
+   *        It may be called concurrently from different threads,
+   *        each time with a different range.
+   *
+   * Returns once all the items have been processed.  If \p body throws,
+   * the remaining chunks are skipped and the exception is rethrown here.
+   */
+  static void run(int count, int minChunkSize, const std::function<void(int begin, int end)>& body);
+
+  ParallelFor() = delete;
+};
+}  // namespace foundation
+
+
+#endif  // ifndef SCANTAILOR_FOUNDATION_PARALLELFOR_H_
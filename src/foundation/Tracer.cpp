@@ -0,0 +1,143 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "Tracer.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+namespace foundation {
+namespace {
+struct Event {
+  const char* name;
+  int threadId;
+  qint64 startTime;
+  qint64 duration;
+  qint64 cpuTime;
+};
+
+QMutex mutex;
+std::vector<Event> events;
+
+// All the times are in microseconds since tracing was first enabled.
+QElapsedTimer timer;
+
+QAtomicInt lastThreadId;
+
+thread_local int threadId = 0;
+
+/**
+ * \return A small number identifying the current thread, which reads better
+ *         in trace viewers than the IDs given by the OS.
+ */
+int currentThreadId() {
+  if (threadId == 0) {
+    threadId = lastThreadId.fetchAndAddRelaxed(1) + 1;
+  }
+  return threadId;
+}
+
+/**
+ * \return The CPU time spent by the current thread, in microseconds.
+ */
+qint64 threadCpuTime() {
+#ifdef Q_OS_WIN
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+    return 0;
+  }
+  // FILETIME is measured in 100 nanosecond intervals.
+  const auto toMicroseconds = [](const FILETIME& time) {
+    return static_cast<qint64>((quint64(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+  };
+  return toMicroseconds(kernelTime) + toMicroseconds(userTime);
+#else
+  timespec time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+    return 0;
+  }
+  return qint64(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+}
+}  // namespace
+
+QAtomicInt Tracer::m_sEnabled;
+
+void Tracer::Span::start(const char* name) {
+  m_name = name;
+  m_startTime = timer.nsecsElapsed() / 1000;
+  m_startCpuTime = threadCpuTime();
+}
+
+void Tracer::Span::finish() {
+  const Event event{m_name, currentThreadId(), m_startTime, timer.nsecsElapsed() / 1000 - m_startTime,
+                    threadCpuTime() - m_startCpuTime};
+
+  QMutexLocker locker(&mutex);
+  events.push_back(event);
+}
+
+void Tracer::setEnabled(const bool enabled) {
+  if (enabled) {
+    QMutexLocker locker(&mutex);
+    if (!timer.isValid()) {
+      timer.start();
+    }
+  }
+  // Makes the started timer visible to the threads that see tracing enabled.
+  m_sEnabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool Tracer::saveChromeTrace(const QString& filePath) {
+  const qint64 pid = QCoreApplication::applicationPid();
+
+  QJsonArray traceEvents;
+  {
+    QMutexLocker locker(&mutex);
+    for (const Event& event : events) {
+      QJsonObject args;
+      args.insert("cpu_us", double(event.cpuTime));
+
+      // A "complete" event, which has both the start time and the duration.
+      QJsonObject object;
+      object.insert("name", QString::fromLatin1(event.name));
+      object.insert("ph", QString("X"));
+      object.insert("pid", double(pid));
+      object.insert("tid", event.threadId);
+      object.insert("ts", double(event.startTime));
+      object.insert("dur", double(event.duration));
+      object.insert("args", args);
+      traceEvents.append(object);
+    }
+  }
+
+  QJsonObject root;
+  root.insert("traceEvents", traceEvents);
+  root.insert("displayTimeUnit", QString("ms"));
+
+  QFile file(filePath);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  const QByteArray data(QJsonDocument(root).toJson(QJsonDocument::Compact));
+  return file.write(data) == data.size();
+}
+
+void Tracer::clear() {
+  QMutexLocker locker(&mutex);
+  events.clear();
+}
+}  // namespace foundation
@@ -0,0 +1,80 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_FOUNDATION_TRACER_H_
+#define SCANTAILOR_FOUNDATION_TRACER_H_
+
+#include <QAtomicInt>
+#include <QString>
+#include <QtGlobal>
+
+#include "NonCopyable.h"
+
+namespace foundation {
+/**
+ * \brief Records how long processing stages take, for finding bottlenecks.
+ *
+ * Stages are marked with Span objects.  Each span records the thread it ran on,
+ * the wall time, and the CPU time of that thread.  Spans are only recorded
+ * while tracing is enabled; otherwise they cost a single atomic load.
+ * The recorded spans can be saved in the Chrome trace format and
+ * viewed in chrome://tracing or ui.perfetto.dev.
+ */
+class Tracer {
+ public:
+  /**
+   * \brief Records the lifetime of the object as a span, if tracing is enabled.
+   */
+  class Span {
+    DECLARE_NON_COPYABLE(Span)
+
+   public:
+    /**
+     * \param name The name of the stage.  Has to be a string literal,
+     *        as it's not copied.
+     */
+    explicit Span(const char* name) : m_name(nullptr), m_startTime(0), m_startCpuTime(0) {
+      if (Tracer::isEnabled()) {
+        start(name);
+      }
+    }
+
+    ~Span() {
+      if (m_name) {
+        finish();
+      }
+    }
+
+   private:
+    void start(const char* name);
+
+    void finish();
+
+    const char* m_name;
+    qint64 m_startTime;
+    qint64 m_startCpuTime;
+  };
+
+  static bool isEnabled() { return m_sEnabled.loadAcquire() != 0; }
+
+  static void setEnabled(bool enabled);
+
+  /**
+   * \brief Writes the spans recorded so far as Chrome trace JSON.
+   */
+  static bool saveChromeTrace(const QString& filePath);
+
+  /**
+   * \brief Discards the spans recorded so far.
+   */
+  static void clear();
+
+  Tracer() = delete;
+
+ private:
+  static QAtomicInt m_sEnabled;
+};
+}  // namespace foundation
+
+
+#endif  // ifndef SCANTAILOR_FOUNDATION_TRACER_H_
@@ -4,14 +4,187 @@
 #include "Binarize.h"
 
 #include <QDebug>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <vector>
 
 #include "BinaryImage.h"
 #include "Grayscale.h"
-#include "IntegralImage.h"
+#include "NonCopyable.h"
+#include "ParallelFor.h"
 
 namespace imageproc {
+namespace {
+const int MIN_LINES_PER_CHUNK = 16;
+
+// Each chunk starts by summing up a full window of rows, so chunks
+// have to be several windows high for that to be amortized.
+const int MIN_WINDOWS_PER_CHUNK = 4;
+
+int minLinesPerChunk(const QSize windowSize) {
+  return std::max(MIN_LINES_PER_CHUNK, MIN_WINDOWS_PER_CHUNK * windowSize.height());
+}
+
+/**
+ * \brief The mean and the standard deviation of gray levels in a window
+ *        around each pixel of a row.
+ *
+ * Rather than building integral images of the whole image, keeps the sums
+ * over the window rows for every column and updates them as the window
+ * slides down, so only a few rows worth of memory is needed.  Both loops
+ * over a row are simple enough for the compiler to vectorize.
+ */
+class WindowStats {
+  DECLARE_NON_COPYABLE(WindowStats)
+
+ public:
+  WindowStats(const QImage& gray, QSize windowSize);
+
+  /**
+   * \brief Computes the statistics for row \p y.
+   *
+   * Going to the next row is the cheapest, but any row may be requested.
+   */
+  void moveToRow(int y);
+
+  const double* means() const { return m_means.data(); }
+
+  const double* deviations() const { return m_deviations.data(); }
+
+ private:
+  void addRows(int begin, int end);
+
+  void subtractRows(int begin, int end);
+
+  const uint8_t* m_grayData;
+  int m_grayBpl;
+  int m_width;
+  int m_height;
+  int m_windowLowerHalf;
+  int m_windowUpperHalf;
+  int m_top;
+  int m_bottom;  // exclusive
+  std::vector<uint32_t> m_colSums;
+  std::vector<uint64_t> m_colSqsums;
+  // Prefix sums of the above, with an extra leading zero.  The sums of
+  // gray levels may wrap around, which doesn't affect the differences.
+  std::vector<uint32_t> m_prefixSums;
+  std::vector<uint64_t> m_prefixSqsums;
+  std::vector<int> m_lefts;
+  std::vector<int> m_rights;  // exclusive
+  std::vector<double> m_means;
+  std::vector<double> m_deviations;
+};
+
+
+WindowStats::WindowStats(const QImage& gray, const QSize windowSize)
+    : m_grayData(gray.bits()),
+      m_grayBpl(gray.bytesPerLine()),
+      m_width(gray.width()),
+      m_height(gray.height()),
+      m_windowLowerHalf(windowSize.height() >> 1),
+      m_windowUpperHalf(windowSize.height() - m_windowLowerHalf),
+      m_top(0),
+      m_bottom(0),
+      m_colSums(m_width, 0),
+      m_colSqsums(m_width, 0),
+      m_prefixSums(m_width + 1, 0),
+      m_prefixSqsums(m_width + 1, 0),
+      m_lefts(m_width),
+      m_rights(m_width),
+      m_means(m_width),
+      m_deviations(m_width) {
+  const int windowLeftHalf = windowSize.width() >> 1;
+  const int windowRightHalf = windowSize.width() - windowLeftHalf;
+  for (int x = 0; x < m_width; ++x) {
+    m_lefts[x] = std::max(0, x - windowLeftHalf);
+    m_rights[x] = std::min(m_width, x + windowRightHalf);
+  }
+}
+
+void WindowStats::moveToRow(const int y) {
+  const int top = std::max(0, y - m_windowLowerHalf);
+  const int bottom = std::min(m_height, y + m_windowUpperHalf);
+
+  if ((top >= m_bottom) || (top < m_top) || (bottom < m_bottom)) {
+    // Not a move down, or no overlap with the previous window.
+    subtractRows(m_top, m_bottom);
+    addRows(top, bottom);
+  } else {
+    subtractRows(m_top, top);
+    addRows(m_bottom, bottom);
+  }
+  m_top = top;
+  m_bottom = bottom;
+
+  for (int x = 0; x < m_width; ++x) {
+    m_prefixSums[x + 1] = m_prefixSums[x] + m_colSums[x];
+    m_prefixSqsums[x + 1] = m_prefixSqsums[x] + m_colSqsums[x];
+  }
+
+  const int height = bottom - top;
+  for (int x = 0; x < m_width; ++x) {
+    const int left = m_lefts[x];
+    const int right = m_rights[x];
+    const int area = height * (right - left);
+    assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
+    const double windowSum = m_prefixSums[right] - m_prefixSums[left];
+    const double windowSqsum = m_prefixSqsums[right] - m_prefixSqsums[left];
+
+    const double rArea = 1.0 / area;
+    const double mean = windowSum * rArea;
+    const double sqmean = windowSqsum * rArea;
+
+    const double variance = sqmean - mean * mean;
+    m_means[x] = mean;
+    m_deviations[x] = std::sqrt(std::fabs(variance));
+  }
+}  // WindowStats::moveToRow
+
+void WindowStats::addRows(const int begin, const int end) {
+  const uint8_t* grayLine = m_grayData + begin * m_grayBpl;
+  for (int y = begin; y < end; ++y, grayLine += m_grayBpl) {
+    for (int x = 0; x < m_width; ++x) {
+      const uint32_t pixel = grayLine[x];
+      m_colSums[x] += pixel;
+      m_colSqsums[x] += pixel * pixel;
+    }
+  }
+}
+
+void WindowStats::subtractRows(const int begin, const int end) {
+  const uint8_t* grayLine = m_grayData + begin * m_grayBpl;
+  for (int y = begin; y < end; ++y, grayLine += m_grayBpl) {
+    for (int x = 0; x < m_width; ++x) {
+      const uint32_t pixel = grayLine[x];
+      m_colSums[x] -= pixel;
+      m_colSqsums[x] -= pixel * pixel;
+    }
+  }
+}
+
+/**
+ * Sets the bits of a binary image line to isBlack(x), a word at a time.
+ */
+template <typename IsBlack>
+void packLine(uint32_t* const bwLine, const int width, const IsBlack& isBlack) {
+  const int lastWord = (width - 1) >> 5;
+  for (int i = 0; i <= lastWord; ++i) {
+    const int xBegin = i << 5;
+    const int xEnd = std::min(width, xBegin + 32);
+    uint32_t word = 0;
+    for (int x = xBegin; x < xEnd; ++x) {
+      word |= uint32_t(isBlack(x)) << (31 - (x & 31));
+    }
+    bwLine[i] = word;
+  }
+}
+}  // namespace
+
 BinaryImage binarizeOtsu(const QImage& src) {
   return BinaryImage(src, BinaryThreshold::otsuThreshold(src));
 }
@@ -34,67 +207,29 @@ BinaryImage binarizeSauvola(const QImage& src, const QSize windowSize, const dou
   const int w = gray.width();
   const int h = gray.height();
 
-  IntegralImage<uint32_t> integralImage(w, h);
-  IntegralImage<uint64_t> integralSqimage(w, h);
-
-  const uint8_t* grayLine = gray.bits();
-  const int grayBpl = gray.bytesPerLine();
-
-  for (int y = 0; y < h; ++y, grayLine += grayBpl) {
-    integralImage.beginRow();
-    integralSqimage.beginRow();
-    for (int x = 0; x < w; ++x) {
-      const uint32_t pixel = grayLine[x];
-      integralImage.push(pixel);
-      integralSqimage.push(pixel * pixel);
-    }
-  }
-
-  const int windowLowerHalf = windowSize.height() >> 1;
-  const int windowUpperHalf = windowSize.height() - windowLowerHalf;
-  const int windowLeftHalf = windowSize.width() >> 1;
-  const int windowRightHalf = windowSize.width() - windowLeftHalf;
-
   BinaryImage bwImg(w, h);
-  uint32_t* bwLine = bwImg.data();
+  uint32_t* const bwData = bwImg.data();
   const int bwWpl = bwImg.wordsPerLine();
+  const uint8_t* const grayData = gray.bits();
+  const int grayBpl = gray.bytesPerLine();
 
-  grayLine = gray.bits();
-  for (int y = 0; y < h; ++y) {
-    const int top = std::max(0, y - windowLowerHalf);
-    const int bottom = std::min(h, y + windowUpperHalf);  // exclusive
-    for (int x = 0; x < w; ++x) {
-      const int left = std::max(0, x - windowLeftHalf);
-      const int right = std::min(w, x + windowRightHalf);  // exclusive
-      const int area = (bottom - top) * (right - left);
-      assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
-      const QRect rect(left, top, right - left, bottom - top);
-      const double windowSum = integralImage.sum(rect);
-      const double windowSqsum = integralSqimage.sum(rect);
-
-      const double rArea = 1.0 / area;
-      const double mean = windowSum * rArea;
-      const double sqmean = windowSqsum * rArea;
-
-      const double variance = sqmean - mean * mean;
-      const double deviation = std::sqrt(std::fabs(variance));
-
-      const double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
-
-      const uint32_t msb = uint32_t(1) << 31;
-      const uint32_t mask = msb >> (x & 31);
-      if (int(grayLine[x]) < threshold) {
-        // black
-        bwLine[x >> 5] |= mask;
-      } else {
-        // white
-        bwLine[x >> 5] &= ~mask;
+  foundation::ParallelFor::run(h, minLinesPerChunk(windowSize), [&](const int yBegin, const int yEnd) {
+    WindowStats stats(gray, windowSize);
+    std::vector<double> thresholds(w);
+
+    const uint8_t* grayLine = grayData + yBegin * grayBpl;
+    uint32_t* bwLine = bwData + yBegin * bwWpl;
+    for (int y = yBegin; y < yEnd; ++y, grayLine += grayBpl, bwLine += bwWpl) {
+      stats.moveToRow(y);
+      const double* const means = stats.means();
+      const double* const deviations = stats.deviations();
+      for (int x = 0; x < w; ++x) {
+        thresholds[x] = means[x] * (1.0 + k * (deviations[x] / 128.0 - 1.0));
       }
-    }
 
-    grayLine += grayBpl;
-    bwLine += bwWpl;
-  }
+      packLine(bwLine, w, [&](const int x) { return int(grayLine[x]) < thresholds[x]; });
+    }
+  });
   return bwImg;
 }  // binarizeSauvola
 
@@ -114,85 +249,64 @@ BinaryImage binarizeWolf(const QImage& src,
   const QImage gray(toGrayscale(src));
   const int w = gray.width();
   const int h = gray.height();
-
-  IntegralImage<uint32_t> integralImage(w, h);
-  IntegralImage<uint64_t> integralSqimage(w, h);
-
-  const uint8_t* grayLine = gray.bits();
+  const uint8_t* const grayData = gray.bits();
   const int grayBpl = gray.bytesPerLine();
 
+  // The thresholds depend on the maximum deviation over the whole image,
+  // so we make two passes.  Computing the window statistics twice is
+  // cheaper than keeping them for every pixel in between.
   uint32_t minGrayLevel = 255;
-
-  for (int y = 0; y < h; ++y, grayLine += grayBpl) {
-    integralImage.beginRow();
-    integralSqimage.beginRow();
-    for (int x = 0; x < w; ++x) {
-      const uint32_t pixel = grayLine[x];
-      integralImage.push(pixel);
-      integralSqimage.push(pixel * pixel);
-      minGrayLevel = std::min(minGrayLevel, pixel);
-    }
-  }
-
-  const int windowLowerHalf = windowSize.height() >> 1;
-  const int windowUpperHalf = windowSize.height() - windowLowerHalf;
-  const int windowLeftHalf = windowSize.width() >> 1;
-  const int windowRightHalf = windowSize.width() - windowLeftHalf;
-
-  std::vector<float> means(w * h, 0);
-  std::vector<float> deviations(w * h, 0);
-
   double maxDeviation = 0;
-
-  for (int y = 0; y < h; ++y) {
-    const int top = std::max(0, y - windowLowerHalf);
-    const int bottom = std::min(h, y + windowUpperHalf);  // exclusive
-    for (int x = 0; x < w; ++x) {
-      const int left = std::max(0, x - windowLeftHalf);
-      const int right = std::min(w, x + windowRightHalf);  // exclusive
-      const int area = (bottom - top) * (right - left);
-      assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
-      const QRect rect(left, top, right - left, bottom - top);
-      const double windowSum = integralImage.sum(rect);
-      const double windowSqsum = integralSqimage.sum(rect);
-
-      const double rArea = 1.0 / area;
-      const double mean = windowSum * rArea;
-      const double sqmean = windowSqsum * rArea;
-
-      const double variance = sqmean - mean * mean;
-      const double deviation = std::sqrt(std::fabs(variance));
-      maxDeviation = std::max(maxDeviation, deviation);
-      means[w * y + x] = (float) mean;
-      deviations[w * y + x] = (float) deviation;
+  QMutex mutex;
+
+  foundation::ParallelFor::run(h, minLinesPerChunk(windowSize), [&](const int yBegin, const int yEnd) {
+    WindowStats stats(gray, windowSize);
+    uint32_t localMinGrayLevel = 255;
+    double localMaxDeviation = 0;
+
+    const uint8_t* grayLine = grayData + yBegin * grayBpl;
+    for (int y = yBegin; y < yEnd; ++y, grayLine += grayBpl) {
+      stats.moveToRow(y);
+      const double* const deviations = stats.deviations();
+      for (int x = 0; x < w; ++x) {
+        localMinGrayLevel = std::min<uint32_t>(localMinGrayLevel, grayLine[x]);
+        localMaxDeviation = std::max(localMaxDeviation, deviations[x]);
+      }
     }
-  }
 
-  // TODO: integral images can be disposed at this point.
+    const QMutexLocker locker(&mutex);
+    minGrayLevel = std::min(minGrayLevel, localMinGrayLevel);
+    maxDeviation = std::max(maxDeviation, localMaxDeviation);
+  });
 
   BinaryImage bwImg(w, h);
-  uint32_t* bwLine = bwImg.data();
+  uint32_t* const bwData = bwImg.data();
   const int bwWpl = bwImg.wordsPerLine();
 
-  grayLine = gray.bits();
-  for (int y = 0; y < h; ++y, grayLine += grayBpl, bwLine += bwWpl) {
-    for (int x = 0; x < w; ++x) {
-      const float mean = means[y * w + x];
-      const float deviation = deviations[y * w + x];
-      const double a = 1.0 - deviation / maxDeviation;
-      const double threshold = mean - k * a * (mean - minGrayLevel);
-
-      const uint32_t msb = uint32_t(1) << 31;
-      const uint32_t mask = msb >> (x & 31);
-      if ((grayLine[x] < lowerBound) || ((grayLine[x] <= upperBound) && (int(grayLine[x]) < threshold))) {
-        // black
-        bwLine[x >> 5] |= mask;
-      } else {
-        // white
-        bwLine[x >> 5] &= ~mask;
+  foundation::ParallelFor::run(h, minLinesPerChunk(windowSize), [&](const int yBegin, const int yEnd) {
+    WindowStats stats(gray, windowSize);
+    std::vector<double> thresholds(w);
+
+    const uint8_t* grayLine = grayData + yBegin * grayBpl;
+    uint32_t* bwLine = bwData + yBegin * bwWpl;
+    for (int y = yBegin; y < yEnd; ++y, grayLine += grayBpl, bwLine += bwWpl) {
+      stats.moveToRow(y);
+      const double* const means = stats.means();
+      const double* const deviations = stats.deviations();
+      for (int x = 0; x < w; ++x) {
+        // The statistics used to be stored as floats.  Rounding them
+        // the same way keeps the results unchanged.
+        const float mean = static_cast<float>(means[x]);
+        const float deviation = static_cast<float>(deviations[x]);
+        const double a = 1.0 - deviation / maxDeviation;
+        thresholds[x] = mean - k * a * (mean - minGrayLevel);
       }
+
+      packLine(bwLine, w, [&](const int x) {
+        return (grayLine[x] < lowerBound) || ((grayLine[x] <= upperBound) && (int(grayLine[x]) < thresholds[x]));
+      });
     }
-  }
+  });
   return bwImg;
 }  // binarizeWolf
 
@@ -5,12 +5,121 @@
 
 #include <QDebug>
 #include <QImage>
+#include <algorithm>
+#include <numeric>
 
 #include "BinaryImage.h"
 #include "BitOps.h"
 #include "InfluenceMap.h"
+#include "ParallelFor.h"
 
 namespace imageproc {
+namespace {
+const int LINES_PER_STRIPE = 64;
+
+/**
+ * A horizontal run of black pixels [begin, end).
+ */
+struct Run {
+  int begin;
+  int end;
+};
+
+/**
+ * Runs of a horizontal stripe of an image.  The runs of line y
+ * of the stripe are runs[lineOffsets[y]] to runs[lineOffsets[y + 1] - 1].
+ */
+struct RunStripe {
+  std::vector<Run> runs;
+  std::vector<int> lineOffsets;
+  uint32_t firstRunIdx = 0;
+};
+
+void extractRuns(const uint32_t* line, const int width, std::vector<Run>& runs) {
+  const int lastWordIdx = (width - 1) >> 5;
+  const uint32_t lastWordMask = ~uint32_t(0) << (31 - ((width - 1) & 31));
+
+  bool inRun = false;
+  int runBegin = 0;
+  for (int i = 0; i <= lastWordIdx; ++i) {
+    const uint32_t word = (i == lastWordIdx) ? (line[i] & lastWordMask) : line[i];
+    const int wordOffset = i << 5;
+    // The position of the first bit in this word that hasn't been looked at yet.
+    int bit = 0;
+    while (bit < 32) {
+      // The bits we are looking for are ones outside of a run and zeroes inside.
+      const uint32_t rest = (inRun ? ~word : word) & (~uint32_t(0) >> bit);
+      if (!rest) {
+        break;
+      }
+      bit = countMostSignificantZeroes(rest);
+      if (inRun) {
+        runs.push_back({runBegin, wordOffset + bit});
+      } else {
+        runBegin = wordOffset + bit;
+      }
+      inRun = !inRun;
+    }
+  }
+
+  if (inRun) {
+    runs.push_back({runBegin, width});
+  }
+}
+
+/**
+ * Returns the root of the tree \p idx belongs to, halving the path to it.
+ */
+uint32_t findRoot(std::vector<uint32_t>& parent, uint32_t idx) {
+  while (parent[idx] != idx) {
+    parent[idx] = parent[parent[idx]];
+    idx = parent[idx];
+  }
+  return idx;
+}
+
+/**
+ * Merges the trees of the two runs.  The root with a lower index always becomes
+ * the root of the merged tree, so that a run's parent never has a higher index.
+ */
+void unite(std::vector<uint32_t>& parent, const uint32_t idx1, const uint32_t idx2) {
+  const uint32_t root1 = findRoot(parent, idx1);
+  const uint32_t root2 = findRoot(parent, idx2);
+  if (root1 < root2) {
+    parent[root2] = root1;
+  } else {
+    parent[root1] = root2;
+  }
+}
+
+/**
+ * Unites every run of a line with the runs of the previous line it touches.
+ *
+ * \param reach 0 for 4-connectivity, 1 for 8-connectivity, where runs touching
+ *        diagonally are connected as well.
+ */
+void linkLines(std::vector<uint32_t>& parent,
+               const Run* prevRuns,
+               const uint32_t prevFirstIdx,
+               const int numPrevRuns,
+               const Run* runs,
+               const uint32_t firstIdx,
+               const int numRuns,
+               const int reach) {
+  int prev = 0;
+  for (int i = 0; i < numRuns; ++i) {
+    const Run& run = runs[i];
+    while ((prev < numPrevRuns) && (prevRuns[prev].end + reach <= run.begin)) {
+      ++prev;
+    }
+    // The last of the runs touched may touch the next run as well, so we don't skip it.
+    for (int j = prev; (j < numPrevRuns) && (prevRuns[j].begin < run.end + reach); ++j) {
+      unite(parent, prevFirstIdx + j, firstIdx + i);
+    }
+  }
+}
+}  // namespace
+
 const uint32_t ConnectivityMap::BACKGROUND = ~uint32_t(0);
 const uint32_t ConnectivityMap::UNTAGGED_FG = BACKGROUND - 1;
 
@@ -38,28 +147,11 @@ ConnectivityMap::ConnectivityMap(const BinaryImage& image, const Connectivity co
   const int width = m_size.width();
   const int height = m_size.height();
 
-  m_data.resize((width + 2) * (height + 2), BACKGROUND);
+  m_data.resize((width + 2) * (height + 2), 0);
   m_stride = width + 2;
   m_plainData = &m_data[0] + 1 + m_stride;
 
-  uint32_t* dst = m_plainData;
-  const int dstStride = m_stride;
-
-  const uint32_t* src = image.data();
-  const int srcStride = image.wordsPerLine();
-
-  const uint32_t msb = uint32_t(1) << 31;
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      if (src[x >> 5] & (msb >> (x & 31))) {
-        dst[x] = UNTAGGED_FG;
-      }
-    }
-    src += srcStride;
-    dst += dstStride;
-  }
-
-  assignIds(conn);
+  labelRuns(image, conn);
 }
 
 ConnectivityMap::ConnectivityMap(const ConnectivityMap& other)
@@ -301,6 +393,97 @@ void ConnectivityMap::copyFromInfluenceMap(const InfluenceMap& imap) {
   }
 }
 
+/**
+ * Black pixels are grouped into horizontal runs, which are then united
+ * into components with a union-find structure.  As the runs are indexed
+ * in raster order, and the lowest index in a component becomes its root,
+ * components get their labels in the order they are encountered in,
+ * just like with assignIds().  The image is split into stripes, which
+ * are processed in parallel, and then the stripes are joined together.
+ */
+void ConnectivityMap::labelRuns(const BinaryImage& image, const Connectivity conn) {
+  const int width = m_size.width();
+  const int height = m_size.height();
+  const int reach = (conn == CONN8) ? 1 : 0;
+
+  const uint32_t* const srcData = image.data();
+  const int srcStride = image.wordsPerLine();
+
+  const int numStripes = (height + LINES_PER_STRIPE - 1) / LINES_PER_STRIPE;
+  std::vector<RunStripe> stripes(numStripes);
+
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = stripeBegin; s < stripeEnd; ++s) {
+      RunStripe& stripe = stripes[s];
+      const int yBegin = s * LINES_PER_STRIPE;
+      const int yEnd = std::min(yBegin + LINES_PER_STRIPE, height);
+      stripe.lineOffsets.reserve(yEnd - yBegin + 1);
+
+      const uint32_t* srcLine = srcData + yBegin * srcStride;
+      for (int y = yBegin; y < yEnd; ++y, srcLine += srcStride) {
+        stripe.lineOffsets.push_back(static_cast<int>(stripe.runs.size()));
+        extractRuns(srcLine, width, stripe.runs);
+      }
+      stripe.lineOffsets.push_back(static_cast<int>(stripe.runs.size()));
+    }
+  });
+
+  uint32_t numRuns = 0;
+  for (RunStripe& stripe : stripes) {
+    stripe.firstRunIdx = numRuns;
+    numRuns += static_cast<uint32_t>(stripe.runs.size());
+  }
+
+  std::vector<uint32_t> parent(numRuns);
+  std::iota(parent.begin(), parent.end(), uint32_t(0));
+
+  // Stripes only touch their own part of the parent array.
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = stripeBegin; s < stripeEnd; ++s) {
+      const RunStripe& stripe = stripes[s];
+      const int numLines = static_cast<int>(stripe.lineOffsets.size()) - 1;
+      for (int y = 1; y < numLines; ++y) {
+        const int prevOffset = stripe.lineOffsets[y - 1];
+        const int offset = stripe.lineOffsets[y];
+        linkLines(parent, stripe.runs.data() + prevOffset, stripe.firstRunIdx + prevOffset, offset - prevOffset,
+                  stripe.runs.data() + offset, stripe.firstRunIdx + offset, stripe.lineOffsets[y + 1] - offset, reach);
+      }
+    }
+  });
+
+  for (int s = 1; s < numStripes; ++s) {
+    const RunStripe& prevStripe = stripes[s - 1];
+    const RunStripe& stripe = stripes[s];
+    const int prevOffset = prevStripe.lineOffsets[prevStripe.lineOffsets.size() - 2];
+    const int numPrevRuns = static_cast<int>(prevStripe.runs.size()) - prevOffset;
+    linkLines(parent, prevStripe.runs.data() + prevOffset, prevStripe.firstRunIdx + prevOffset, numPrevRuns,
+              stripe.runs.data(), stripe.firstRunIdx, stripe.lineOffsets[1], reach);
+  }
+
+  // As a parent never has a higher index than its child, the parent's entry
+  // is already replaced with the component's label by the time we get to the child.
+  uint32_t nextLabel = 1;
+  for (uint32_t i = 0; i < numRuns; ++i) {
+    parent[i] = (parent[i] == i) ? nextLabel++ : parent[parent[i]];
+  }
+  m_maxLabel = nextLabel - 1;
+
+  const std::vector<uint32_t>& labels = parent;
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = stripeBegin; s < stripeEnd; ++s) {
+      const RunStripe& stripe = stripes[s];
+      const int numLines = static_cast<int>(stripe.lineOffsets.size()) - 1;
+      uint32_t* line = m_plainData + s * LINES_PER_STRIPE * m_stride;
+      for (int y = 0; y < numLines; ++y, line += m_stride) {
+        for (int i = stripe.lineOffsets[y]; i < stripe.lineOffsets[y + 1]; ++i) {
+          const Run& run = stripe.runs[i];
+          std::fill(line + run.begin, line + run.end, labels[stripe.firstRunIdx + i]);
+        }
+      }
+    }
+  });
+}  // ConnectivityMap::labelRuns
+
 void ConnectivityMap::assignIds(const Connectivity conn) {
   const uint32_t numInitialTags = initialTagging();
   std::vector<uint32_t> table(numInitialTags, 0);
@@ -204,6 +204,8 @@ class ConnectivityMap {
  private:
   void copyFromInfluenceMap(const InfluenceMap& imap);
 
+  void labelRuns(const BinaryImage& image, Connectivity conn);
+
   void assignIds(Connectivity conn);
 
   uint32_t initialTagging();
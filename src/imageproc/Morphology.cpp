@@ -5,11 +5,11 @@
 
 #include <QDebug>
 #include <cassert>
-#include <cmath>
 
 #include "BinaryImage.h"
 #include "GrayImage.h"
 #include "Grayscale.h"
+#include "ParallelFor.h"
 #include "RasterOp.h"
 
 namespace imageproc {
@@ -49,6 +49,8 @@ Brick Brick::flipped() const {
 }
 
 namespace {
+const int MIN_LINES_PER_CHUNK = 64;
+
 class ReusableImages {
  public:
   void store(BinaryImage& img);
@@ -144,6 +146,13 @@ inline QRect shrinkByBrick(const QRect& rect, const Brick& brick) {
 
 const int COMPOSITE_THRESHOLD = 8;
 
+// Up to this length, taking the extremum of every pixel under
+// the structuring element is cheaper than the van Herk / Gil-Werman scheme.
+const int DIRECT_GRAY_SPREAD_THRESHOLD = 4;
+
+// The width of the vertical strips spreadGrayVertical() processes at a time.
+const int GRAY_STRIP_WIDTH = 256;
+
 void doInitialCopy(BinaryImage& dst,
                    const CoordinateSystem& dstCs,
                    const QRect& dstRelevantRect,
@@ -242,6 +251,23 @@ void spreadInDirectionLow(BinaryImage& dst,
   }
 }  // spreadInDirectionLow
 
+/**
+ * \brief Combines an image with itself shifted by (dx, dy), in place.
+ */
+void spreadInPlace(BinaryImage& img,
+                   const QRect& relevantRect,
+                   const int dx,
+                   const int dy,
+                   const AbstractRasterOp& rop) {
+  QRect dstRect(img.rect());
+  QRect srcRect(dstRect);
+  dstRect.translate(dx, dy);
+
+  adjustToFit(relevantRect, dstRect, srcRect);
+
+  rop(img, dstRect, img, srcRect.topLeft());
+}
+
 void spreadInDirection(BinaryImage& dst,
                        const CoordinateSystem& dstCs,
                        const QRect& dstRelevantRect,
@@ -266,35 +292,38 @@ void spreadInDirection(BinaryImage& dst,
     return;
   }
 
-  const auto firstPhaseSteps = (int) std::sqrt((double) numSteps);
-
-  BinaryImage tmp(tmpImages.retrieveOrCreate(tmpImageSize));
-
-  spreadInDirection(tmp, tmpCs, tmp.rect(), src, srcCs, tmpImages, tmpCs, tmpImageSize, dxMin, dxStep, dyMin, dyStep,
-                    firstPhaseSteps, rop, initialColor, true);
-
-  const int secondPhaseSteps = numSteps / firstPhaseSteps;
-
-  spreadInDirection(dst, dstCs, dstRelevantRect, tmp, tmpCs, tmpImages, tmpCs, tmpImageSize, 0,
-                    dxStep * firstPhaseSteps, 0, dyStep * firstPhaseSteps, secondPhaseSteps, rop, initialColor,
-                    dstCompositionAllowed);
-
-  const int stepsDone = firstPhaseSteps * secondPhaseSteps;
-  const int stepsRemaining = numSteps - stepsDone;
+  // Logarithmic decomposition.  Once an image is spread over span steps,
+  // combining it with itself shifted by span steps spreads it over twice as many.
+  // The remaining steps are covered by a single shift that overlaps the previous ones.
+  // That makes the cost grow with the logarithm of the brick size rather than
+  // the brick size itself, while every operation still handles whole words.
+  // When composing in dst isn't allowed, it's done in a temporary image,
+  // which covers everything the relevant part of dst depends on.
+  BinaryImage tmp;
+  BinaryImage* work = &dst;
+  const CoordinateSystem* workCs = &dstCs;
+  QRect workRelevantRect(dstRelevantRect);
+  if (!dstCompositionAllowed) {
+    tmp = tmpImages.retrieveOrCreate(tmpImageSize);
+    work = &tmp;
+    workCs = &tmpCs;
+    workRelevantRect = tmp.rect();
+  }
 
-  if (stepsRemaining <= 0) {
-    assert(stepsRemaining == 0);
-  } else if (stepsRemaining < COMPOSITE_THRESHOLD) {
-    spreadInto(dst, dstCs, dstRelevantRect, src, srcCs, dxMin + dxStep * stepsDone, dxStep, dyMin + dyStep * stepsDone,
-               dyStep, stepsRemaining, rop);
-  } else {
-    spreadInDirection(tmp, tmpCs, tmp.rect(), src, srcCs, tmpImages, tmpCs, tmpImageSize, dxMin + dxStep * stepsDone,
-                      dxStep, dyMin + dyStep * stepsDone, dyStep, stepsRemaining, rop, initialColor, true);
+  doInitialCopy(*work, *workCs, workRelevantRect, src, srcCs, initialColor, dxMin, dyMin);
 
-    spreadInto(dst, dstCs, dstRelevantRect, tmp, tmpCs, 0, 0, 0, 0, 1, rop);
+  int span = 1;
+  for (; (span << 1) <= numSteps; span <<= 1) {
+    spreadInPlace(*work, workRelevantRect, dxStep * span, dyStep * span, rop);
+  }
+  if (span < numSteps) {
+    spreadInPlace(*work, workRelevantRect, dxStep * (numSteps - span), dyStep * (numSteps - span), rop);
   }
 
-  tmpImages.store(tmp);
+  if (!dstCompositionAllowed) {
+    doInitialCopy(dst, dstCs, dstRelevantRect, tmp, tmpCs, initialColor, 0, 0);
+    tmpImages.store(tmp);
+  }
 }  // spreadInDirection
 
 void dilateOrErodeBrick(BinaryImage& dst,
@@ -379,6 +408,14 @@ class Lighter {
 };
 
 
+template <typename MinOrMax>
+void selectLine(uint8_t* dst, const uint8_t* src1, const uint8_t* src2, const int width) {
+  // A loop the compiler turns into packed min / max instructions.
+  for (int x = 0; x < width; ++x) {
+    dst[x] = MinOrMax::select(src1[x], src2[x]);
+  }
+}
+
 template <typename MinOrMax>
 void fillExtremumArrayLeftHalf(uint8_t* dst,
                                const uint8_t* const srcCenter,
@@ -419,44 +456,58 @@ template <typename MinOrMax>
 void spreadGrayHorizontal(GrayImage& dst, const GrayImage& src, const int dy, const int dx1, const int dx2) {
   const int srcStride = src.stride();
   const int dstStride = dst.stride();
-  const uint8_t* srcLine = src.data() + dy * srcStride;
-  uint8_t* dstLine = dst.data();
+  const uint8_t* const srcData = src.data() + dy * srcStride;
+  uint8_t* const dstData = dst.data();
 
   const int dstWidth = dst.width();
   const int dstHeight = dst.height();
 
   const int seLen = dx2 - dx1 + 1;
 
-  std::vector<uint8_t> minMaxArray(seLen * 2 - 1, 0);
-  uint8_t* const arrayCenter = &minMaxArray[seLen - 1];
-
-  for (int y = 0; y < dstHeight; ++y) {
-    for (int dstSegmentFirst = 0; dstSegmentFirst < dstWidth; dstSegmentFirst += seLen) {
-      const int dstSegmentLast = std::min(dstSegmentFirst + seLen, dstWidth) - 1;  // inclusive
-      const int srcSegmentFirst = dstSegmentFirst + dx1;
-      const int srcSegmentLast = dstSegmentLast + dx2;
-      const int srcSegmentCenter = (srcSegmentFirst + srcSegmentLast) >> 1;
-
-      fillExtremumArrayLeftHalf<MinOrMax>(arrayCenter, srcLine + srcSegmentCenter, 1, srcSegmentFirst,
-                                          srcSegmentCenter);
-
-      fillExtremumArrayRightHalf<MinOrMax>(arrayCenter, srcLine + srcSegmentCenter, 1, srcSegmentCenter,
-                                           srcSegmentLast);
-
-      for (int x = dstSegmentFirst; x <= dstSegmentLast; ++x) {
-        const int srcFirst = x + dx1;
-        const int srcLast = x + dx2;  // inclusive
-        assert(srcSegmentCenter >= srcFirst);
-        assert(srcSegmentCenter <= srcLast);
-        uint8_t v1 = arrayCenter[srcFirst - srcSegmentCenter];
-        uint8_t v2 = arrayCenter[srcLast - srcSegmentCenter];
-        dstLine[x] = MinOrMax::select(v1, v2);
+  foundation::ParallelFor::run(dstHeight, MIN_LINES_PER_CHUNK, [&](const int top, const int bottom) {
+    const uint8_t* srcLine = srcData + top * srcStride;
+    uint8_t* dstLine = dstData + top * dstStride;
+
+    if (seLen <= DIRECT_GRAY_SPREAD_THRESHOLD) {
+      for (int y = top; y < bottom; ++y, srcLine += srcStride, dstLine += dstStride) {
+        for (int x = 0; x < dstWidth; ++x) {
+          const uint8_t* src = srcLine + x + dx1;
+          uint8_t extremum = *src;
+          for (int i = 1; i < seLen; ++i) {
+            extremum = MinOrMax::select(extremum, *++src);
+          }
+          dstLine[x] = extremum;
+        }
       }
+      return;
     }
 
-    srcLine += srcStride;
-    dstLine += dstStride;
-  }
+    std::vector<uint8_t> minMaxArray(seLen * 2 - 1, 0);
+    uint8_t* const arrayCenter = &minMaxArray[seLen - 1];
+
+    for (int y = top; y < bottom; ++y, srcLine += srcStride, dstLine += dstStride) {
+      for (int dstSegmentFirst = 0; dstSegmentFirst < dstWidth; dstSegmentFirst += seLen) {
+        const int dstSegmentLast = std::min(dstSegmentFirst + seLen, dstWidth) - 1;  // inclusive
+        const int srcSegmentFirst = dstSegmentFirst + dx1;
+        const int srcSegmentLast = dstSegmentLast + dx2;
+        const int srcSegmentCenter = (srcSegmentFirst + srcSegmentLast) >> 1;
+
+        fillExtremumArrayLeftHalf<MinOrMax>(arrayCenter, srcLine + srcSegmentCenter, 1, srcSegmentFirst,
+                                            srcSegmentCenter);
+
+        fillExtremumArrayRightHalf<MinOrMax>(arrayCenter, srcLine + srcSegmentCenter, 1, srcSegmentCenter,
+                                             srcSegmentLast);
+
+        // Building the arrays above is inherently sequential, but combining them
+        // is the same packed min / max over two lines as in the vertical pass.
+        assert(srcSegmentCenter >= dstSegmentLast + dx1);
+        assert(srcSegmentCenter <= dstSegmentFirst + dx2);
+        selectLine<MinOrMax>(dstLine + dstSegmentFirst, arrayCenter + (dstSegmentFirst + dx1 - srcSegmentCenter),
+                             arrayCenter + (dstSegmentFirst + dx2 - srcSegmentCenter),
+                             dstSegmentLast - dstSegmentFirst + 1);
+      }
+    }
+  });
 }  // spreadGrayHorizontal
 
 template <typename MinOrMax>
@@ -485,35 +536,64 @@ void spreadGrayVertical(GrayImage& dst, const GrayImage& src, const int dx, cons
 
   const int seLen = dy2 - dy1 + 1;
 
-  std::vector<uint8_t> minMaxArray(seLen * 2 - 1, 0);
-  uint8_t* const arrayCenter = &minMaxArray[seLen - 1];
-
-  for (int x = 0; x < dstWidth; ++x) {
-    for (int dstSegmentFirst = 0; dstSegmentFirst < dstHeight; dstSegmentFirst += seLen) {
-      const int dstSegmentLast = std::min(dstSegmentFirst + seLen, dstHeight) - 1;  // inclusive
-      const int srcSegmentFirst = dstSegmentFirst + dy1;
-      const int srcSegmentLast = dstSegmentLast + dy2;
-      const int srcSegmentCenter = (srcSegmentFirst + srcSegmentLast) >> 1;
-
-      fillExtremumArrayLeftHalf<MinOrMax>(arrayCenter, srcData + x + srcSegmentCenter * srcStride, srcStride,
-                                          srcSegmentFirst, srcSegmentCenter);
-
-      fillExtremumArrayRightHalf<MinOrMax>(arrayCenter, srcData + x + srcSegmentCenter * srcStride, srcStride,
-                                           srcSegmentCenter, srcSegmentLast);
-
-      uint8_t* dst = dstData + x + dstSegmentFirst * dstStride;
-      for (int y = dstSegmentFirst; y <= dstSegmentLast; ++y) {
-        const int srcFirst = y + dy1;
-        const int srcLast = y + dy2;  // inclusive
-        assert(srcSegmentCenter >= srcFirst);
-        assert(srcSegmentCenter <= srcLast);
-        uint8_t v1 = arrayCenter[srcFirst - srcSegmentCenter];
-        uint8_t v2 = arrayCenter[srcLast - srcSegmentCenter];
-        *dst = MinOrMax::select(v1, v2);
-        dst += dstStride;
+  if (seLen <= DIRECT_GRAY_SPREAD_THRESHOLD) {
+    foundation::ParallelFor::run(dstHeight, MIN_LINES_PER_CHUNK, [&](const int top, const int bottom) {
+      for (int y = top; y < bottom; ++y) {
+        uint8_t* const dstLine = dstData + y * dstStride;
+        const uint8_t* srcLine = srcData + (y + dy1) * srcStride;
+        memcpy(dstLine, srcLine, dstWidth);
+        for (int i = 1; i < seLen; ++i) {
+          srcLine += srcStride;
+          selectLine<MinOrMax>(dstLine, dstLine, srcLine, dstWidth);
+        }
       }
-    }
+    });
+    return;
   }
+
+  // The same van Herk / Gil-Werman scheme as in spreadGrayHorizontal(), but
+  // with the extremum arrays made of line fragments rather than single pixels.
+  // That keeps memory accesses sequential and lets all the pixels of a fragment
+  // be processed at once.  Fragments are narrow enough for the arrays to stay
+  // in cache, and are independent of each other.
+  const int numStrips = (dstWidth + GRAY_STRIP_WIDTH - 1) / GRAY_STRIP_WIDTH;
+  foundation::ParallelFor::run(numStrips, 1, [&](const int firstStrip, const int lastStrip) {
+    std::vector<uint8_t> minMaxArray((seLen * 2 - 1) * GRAY_STRIP_WIDTH, 0);
+    uint8_t* const arrayCenter = &minMaxArray[(seLen - 1) * GRAY_STRIP_WIDTH];
+
+    for (int strip = firstStrip; strip < lastStrip; ++strip) {
+      const int x0 = strip * GRAY_STRIP_WIDTH;
+      const int width = std::min(GRAY_STRIP_WIDTH, dstWidth - x0);
+
+      for (int dstSegmentFirst = 0; dstSegmentFirst < dstHeight; dstSegmentFirst += seLen) {
+        const int dstSegmentLast = std::min(dstSegmentFirst + seLen, dstHeight) - 1;  // inclusive
+        const int srcSegmentFirst = dstSegmentFirst + dy1;
+        const int srcSegmentLast = dstSegmentLast + dy2;
+        const int srcSegmentCenter = (srcSegmentFirst + srcSegmentLast) >> 1;
+        const uint8_t* const srcCenter = srcData + x0 + srcSegmentCenter * srcStride;
+
+        memcpy(arrayCenter, srcCenter, width);
+        for (int i = srcSegmentCenter - 1; i >= srcSegmentFirst; --i) {
+          uint8_t* const line = arrayCenter + (i - srcSegmentCenter) * GRAY_STRIP_WIDTH;
+          selectLine<MinOrMax>(line, line + GRAY_STRIP_WIDTH, srcCenter + (i - srcSegmentCenter) * srcStride, width);
+        }
+        for (int i = srcSegmentCenter + 1; i <= srcSegmentLast; ++i) {
+          uint8_t* const line = arrayCenter + (i - srcSegmentCenter) * GRAY_STRIP_WIDTH;
+          selectLine<MinOrMax>(line, line - GRAY_STRIP_WIDTH, srcCenter + (i - srcSegmentCenter) * srcStride, width);
+        }
+
+        uint8_t* dstLine = dstData + x0 + dstSegmentFirst * dstStride;
+        for (int y = dstSegmentFirst; y <= dstSegmentLast; ++y, dstLine += dstStride) {
+          const int srcFirst = y + dy1;
+          const int srcLast = y + dy2;  // inclusive
+          assert(srcSegmentCenter >= srcFirst);
+          assert(srcSegmentCenter <= srcLast);
+          selectLine<MinOrMax>(dstLine, arrayCenter + (srcFirst - srcSegmentCenter) * GRAY_STRIP_WIDTH,
+                               arrayCenter + (srcLast - srcSegmentCenter) * GRAY_STRIP_WIDTH, width);
+        }
+      }
+    }
+  });
 }  // spreadGrayVertical
 
 template <typename MinOrMax>
@@ -888,53 +968,63 @@ BinaryImage hitMissMatch(const BinaryImage& src,
   const QRect rect(src.rect());  // same as dst.rect()
   BinaryImage dst(src.size());
 
-  bool first = true;
-
-  for (const QPoint& hit : hits) {
-    QRect srcRect(rect);
-    QRect dstRect(rect.translated(-hit));
-    adjustToFit(rect, dstRect, srcRect);
-
-    if (first) {
-      first = false;
-      rasterOp<RopSrc>(dst, dstRect, src, srcRect.topLeft());
-      if (srcSurroundings == BLACK) {
-        dst.fillExcept(dstRect, BLACK);
-      }
-    } else {
-      rasterOp<RopAnd<RopSrc, RopDst>>(dst, dstRect, src, srcRect.topLeft());
-    }
-
-    if (srcSurroundings == WHITE) {
-      // No hits on white surroundings.
-      dst.fillExcept(dstRect, WHITE);
-    }
+  if (hits.empty() && misses.empty()) {
+    dst.fill(WHITE);  // No matches.
+    return dst;
   }
 
-  for (const QPoint& miss : misses) {
-    QRect srcRect(rect);
-    QRect dstRect(rect.translated(-miss));
-    adjustToFit(rect, dstRect, srcRect);
+  // A line of dst only depends on the nearby lines of src,
+  // so we can process bands of lines independently.
+  foundation::ParallelFor::run(rect.height(), MIN_LINES_PER_CHUNK, [&](const int top, const int bottom) {
+    const QRect band(rect.left(), top, rect.width(), bottom - top);
+    bool first = true;
+
+    for (const QPoint& hit : hits) {
+      QRect srcRect(rect);
+      QRect dstRect(rect.translated(-hit));
+      adjustToFit(rect, dstRect, srcRect);
+      const QRect bandDstRect(dstRect.intersected(band));
+      const QPoint bandSrcPos(srcRect.topLeft() + (bandDstRect.topLeft() - dstRect.topLeft()));
+
+      if (first) {
+        first = false;
+        rasterOp<RopSrc>(dst, bandDstRect, src, bandSrcPos);
+        if (srcSurroundings == BLACK) {
+          dst.fillFrame(band, bandDstRect, BLACK);
+        }
+      } else {
+        rasterOp<RopAnd<RopSrc, RopDst>>(dst, bandDstRect, src, bandSrcPos);
+      }
 
-    if (first) {
-      first = false;
-      rasterOp<RopNot<RopSrc>>(dst, dstRect, src, srcRect.topLeft());
       if (srcSurroundings == WHITE) {
-        dst.fillExcept(dstRect, BLACK);
+        // No hits on white surroundings.
+        dst.fillFrame(band, bandDstRect, WHITE);
       }
-    } else {
-      rasterOp<RopAnd<RopNot<RopSrc>, RopDst>>(dst, dstRect, src, srcRect.topLeft());
     }
 
-    if (srcSurroundings == BLACK) {
-      // No misses on black surroundings.
-      dst.fillExcept(dstRect, WHITE);
-    }
-  }
+    for (const QPoint& miss : misses) {
+      QRect srcRect(rect);
+      QRect dstRect(rect.translated(-miss));
+      adjustToFit(rect, dstRect, srcRect);
+      const QRect bandDstRect(dstRect.intersected(band));
+      const QPoint bandSrcPos(srcRect.topLeft() + (bandDstRect.topLeft() - dstRect.topLeft()));
+
+      if (first) {
+        first = false;
+        rasterOp<RopNot<RopSrc>>(dst, bandDstRect, src, bandSrcPos);
+        if (srcSurroundings == WHITE) {
+          dst.fillFrame(band, bandDstRect, BLACK);
+        }
+      } else {
+        rasterOp<RopAnd<RopNot<RopSrc>, RopDst>>(dst, bandDstRect, src, bandSrcPos);
+      }
 
-  if (first) {
-    dst.fill(WHITE);  // No matches.
-  }
+      if (srcSurroundings == BLACK) {
+        // No misses on black surroundings.
+        dst.fillFrame(band, bandDstRect, WHITE);
+      }
+    }
+  });
   return dst;
 }  // hitMissMatch
 
@@ -1036,21 +1126,32 @@ void hitMissReplaceInPlace(BinaryImage& img,
   const BinaryImage matches(hitMissMatch(img, srcSurroundings, hits, misses));
   const QRect rect(img.rect());
 
-  for (const QPoint& offset : whiteToBlack) {
-    QRect srcRect(rect);
-    QRect dstRect(rect.translated(offset));
-    adjustToFit(rect, dstRect, srcRect);
+  // Make img own its data before it's modified from several threads.
+  img.data();
 
-    rasterOp<RopOr<RopSrc, RopDst>>(img, dstRect, matches, srcRect.topLeft());
-  }
+  foundation::ParallelFor::run(rect.height(), MIN_LINES_PER_CHUNK, [&](const int top, const int bottom) {
+    const QRect band(rect.left(), top, rect.width(), bottom - top);
 
-  for (const QPoint& offset : blackToWhite) {
-    QRect srcRect(rect);
-    QRect dstRect(rect.translated(offset));
-    adjustToFit(rect, dstRect, srcRect);
+    for (const QPoint& offset : whiteToBlack) {
+      QRect srcRect(rect);
+      QRect dstRect(rect.translated(offset));
+      adjustToFit(rect, dstRect, srcRect);
+      const QRect bandDstRect(dstRect.intersected(band));
+      const QPoint bandSrcPos(srcRect.topLeft() + (bandDstRect.topLeft() - dstRect.topLeft()));
 
-    rasterOp<RopSubtract<RopDst, RopSrc>>(img, dstRect, matches, srcRect.topLeft());
-  }
+      rasterOp<RopOr<RopSrc, RopDst>>(img, bandDstRect, matches, bandSrcPos);
+    }
+
+    for (const QPoint& offset : blackToWhite) {
+      QRect srcRect(rect);
+      QRect dstRect(rect.translated(offset));
+      adjustToFit(rect, dstRect, srcRect);
+      const QRect bandDstRect(dstRect.intersected(band));
+      const QPoint bandSrcPos(srcRect.topLeft() + (bandDstRect.topLeft() - dstRect.topLeft()));
+
+      rasterOp<RopSubtract<RopDst, RopSrc>>(img, bandDstRect, matches, bandSrcPos);
+    }
+  });
 }
 
 BinaryImage whiteTopHatTransform(const BinaryImage& src,
@@ -3,14 +3,13 @@
 
 #include "OrthogonalRotation.h"
 
+#include <algorithm>
+
 #include "BinaryImage.h"
+#include "BitOps.h"
 #include "RasterOp.h"
 
 namespace imageproc {
-static inline uint32_t mask(int x) {
-  return (uint32_t(1) << 31) >> (x % 32);
-}
-
 static BinaryImage rotate0(const BinaryImage& src, const QRect& srcRect) {
   if (srcRect == src.rect()) {
     return src;
@@ -21,15 +20,55 @@ static BinaryImage rotate0(const BinaryImage& src, const QRect& srcRect) {
   return dst;
 }
 
+/**
+ * \brief Loads 32 pixels of a line, starting at \p x, as a single word.
+ *
+ * Pixels outside of [xMin, xMax] come out as white.  Only the words
+ * covering [xMin, xMax] are accessed.
+ */
+static inline uint32_t loadWord(const uint32_t* line, const int x, const int xMin, const int xMax) {
+  const int from = std::max(x, xMin);
+  const int to = std::min(x + 31, xMax);
+  if (from > to) {
+    return 0;
+  }
+
+  const int wordIdx = from / 32;
+  const int offset = from % 32;
+  uint32_t word = line[wordIdx] << offset;
+  if ((offset != 0) && (to / 32 != wordIdx)) {
+    word |= line[wordIdx + 1] >> (32 - offset);
+  }
+  word &= ~uint32_t(0) << (31 - (to - from));
+  return word >> (from - x);
+}
+
+/**
+ * \brief Transposes a 32x32 bit matrix in place.
+ *
+ * Row i is words[i], with column 0 being its most significant bit.
+ * That's the recursive block swapping from Hacker's Delight, which takes
+ * 5 passes of 16 word operations instead of 1024 single bit ones.
+ */
+static void transpose32(uint32_t* words) {
+  uint32_t mask = 0x0000ffff;
+  for (int j = 16; j != 0; j >>= 1, mask ^= mask << j) {
+    for (int k = 0; k < 32; k = (k + j + 1) & ~j) {
+      const uint32_t t = (words[k] ^ (words[k + j] >> j)) & mask;
+      words[k] ^= t;
+      words[k + j] ^= t << j;
+    }
+  }
+}
+
 static BinaryImage rotate90(const BinaryImage& src, const QRect& srcRect) {
   const int dstW = srcRect.height();
   const int dstH = srcRect.width();
   BinaryImage dst(dstW, dstH);
-  dst.fill(WHITE);
   const int srcWpl = src.wordsPerLine();
   const int dstWpl = dst.wordsPerLine();
-  const uint32_t* const srcData = src.data() + srcRect.bottom() * srcWpl;
-  uint32_t* dstLine = dst.data();
+  const uint32_t* const srcData = src.data();
+  uint32_t* const dstData = dst.data();
 
   /*
    *   dst
@@ -39,19 +78,30 @@ static BinaryImage rotate90(const BinaryImage& src, const QRect& srcRect) {
    * |
    */
 
-  for (int dstY = 0; dstY < dstH; ++dstY) {
+  // The destination is processed in blocks of 32x32 pixels, that is 32 lines of
+  // a single word each.  Line i of such a block is the source column left + dstY + i,
+  // which is gathered by transposing 32 source words, one from each of the source lines
+  // bottom - dstX - j.
+  uint32_t block[32];
+  for (int dstY = 0; dstY < dstH; dstY += 32) {
     const int srcX = srcRect.left() + dstY;
-    const uint32_t* srcPword = srcData + srcX / 32;
-    const uint32_t srcMask = mask(srcX);
+    const int blockHeight = std::min(32, dstH - dstY);
+
+    for (int dstWordIdx = 0; dstWordIdx < dstWpl; ++dstWordIdx) {
+      const int dstX = dstWordIdx * 32;
+      for (int j = 0; j < 32; ++j) {
+        const int srcY = srcRect.bottom() - dstX - j;
+        block[j]
+            = (srcY < srcRect.top()) ? 0 : loadWord(srcData + srcY * srcWpl, srcX, srcRect.left(), srcRect.right());
+      }
+      transpose32(block);
 
-    for (int dstX = 0; dstX < dstW; ++dstX) {
-      if (*srcPword & srcMask) {
-        dstLine[dstX / 32] |= mask(dstX);
+      uint32_t* dstWord = dstData + dstY * dstWpl + dstWordIdx;
+      for (int i = 0; i < blockHeight; ++i) {
+        *dstWord = block[i];
+        dstWord += dstWpl;
       }
-      srcPword -= srcWpl;
     }
-
-    dstLine += dstWpl;
   }
   return dst;
 }
@@ -60,7 +110,6 @@ static BinaryImage rotate180(const BinaryImage& src, const QRect& srcRect) {
   const int dstW = srcRect.width();
   const int dstH = srcRect.height();
   BinaryImage dst(dstW, dstH);
-  dst.fill(WHITE);
   const int srcWpl = src.wordsPerLine();
   const int dstWpl = dst.wordsPerLine();
   const uint32_t* srcLine = src.data() + srcRect.bottom() * srcWpl;
@@ -73,12 +122,11 @@ static BinaryImage rotate180(const BinaryImage& src, const QRect& srcRect) {
    *  src
    */
 
+  // Each destination word is a source word read right to left.
   for (int dstY = 0; dstY < dstH; ++dstY) {
-    int srcX = srcRect.right();
-    for (int dstX = 0; dstX < dstW; --srcX, ++dstX) {
-      if (srcLine[srcX / 32] & mask(srcX)) {
-        dstLine[dstX / 32] |= mask(dstX);
-      }
+    for (int dstWordIdx = 0; dstWordIdx < dstWpl; ++dstWordIdx) {
+      const int srcX = srcRect.right() - dstWordIdx * 32 - 31;
+      dstLine[dstWordIdx] = reverseBits(loadWord(srcLine, srcX, srcRect.left(), srcRect.right()));
     }
 
     srcLine -= srcWpl;
@@ -91,11 +139,10 @@ static BinaryImage rotate270(const BinaryImage& src, const QRect& srcRect) {
   const int dstW = srcRect.height();
   const int dstH = srcRect.width();
   BinaryImage dst(dstW, dstH);
-  dst.fill(WHITE);
   const int srcWpl = src.wordsPerLine();
   const int dstWpl = dst.wordsPerLine();
-  const uint32_t* const srcData = src.data() + srcRect.top() * srcWpl;
-  uint32_t* dstLine = dst.data();
+  const uint32_t* const srcData = src.data();
+  uint32_t* const dstData = dst.data();
 
   /*
    *  dst
@@ -105,19 +152,29 @@ static BinaryImage rotate270(const BinaryImage& src, const QRect& srcRect) {
    *       v
    */
 
-  for (int dstY = 0; dstY < dstH; ++dstY) {
-    const int srcX = srcRect.right() - dstY;
-    const uint32_t* srcPword = srcData + srcX / 32;
-    const uint32_t srcMask = mask(srcX);
+  // Same as rotate90(), except that source lines go top to bottom
+  // and source words are read right to left.
+  uint32_t block[32];
+  for (int dstY = 0; dstY < dstH; dstY += 32) {
+    const int srcX = srcRect.right() - dstY - 31;
+    const int blockHeight = std::min(32, dstH - dstY);
+
+    for (int dstWordIdx = 0; dstWordIdx < dstWpl; ++dstWordIdx) {
+      const int dstX = dstWordIdx * 32;
+      for (int j = 0; j < 32; ++j) {
+        const int srcY = srcRect.top() + dstX + j;
+        block[j] = (srcY > srcRect.bottom())
+                       ? 0
+                       : reverseBits(loadWord(srcData + srcY * srcWpl, srcX, srcRect.left(), srcRect.right()));
+      }
+      transpose32(block);
 
-    for (int dstX = 0; dstX < dstW; ++dstX) {
-      if (*srcPword & srcMask) {
-        dstLine[dstX / 32] |= mask(dstX);
+      uint32_t* dstWord = dstData + dstY * dstWpl + dstWordIdx;
+      for (int i = 0; i < blockHeight; ++i) {
+        *dstWord = block[i];
+        dstWord += dstWpl;
       }
-      srcPword += srcWpl;
     }
-
-    dstLine += dstWpl;
   }
   return dst;
 }
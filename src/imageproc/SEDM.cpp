@@ -4,13 +4,22 @@
 
 #include "SEDM.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "BinaryImage.h"
 #include "ConnectivityMap.h"
 #include "Morphology.h"
+#include "ParallelFor.h"
 #include "RasterOp.h"
 #include "SeedFill.h"
 
 namespace imageproc {
+namespace {
+const int MIN_LINES_PER_CHUNK = 32;
+const int MIN_COLUMNS_PER_CHUNK = 256;
+}  // namespace
+
 // Note that -1 is an implementation detail.
 // It exists to make sure INF_DIST + 1 doesn't overflow.
 const uint32_t SEDM::INF_DIST = ~uint32_t(0) - 1;
@@ -173,173 +182,187 @@ inline uint32_t SEDM::distSq(const int x1, const int x2, const uint32_t dySq) {
 void SEDM::processColumns() {
   const int width = m_size.width() + 2;
   const int height = m_size.height() + 2;
+  uint32_t* const data = &m_data[0];
 
-  uint32_t* pSqd = &m_data[0];
-  for (int x = 0; x < width; ++x, ++pSqd) {
+  // Columns are independent, but walking them one by one would stride over
+  // whole lines at every step.  Instead, bands of columns are swept line by line,
+  // keeping the state of each column in an array.
+  foundation::ParallelFor::run(width, MIN_COLUMNS_PER_CHUNK, [&](const int xBegin, const int xEnd) {
+    const int bandWidth = xEnd - xBegin;
     // (d + 1)^2 = d^2 + 2d + 1
-    uint32_t b = 1;  // 2d + 1 in the above formula.
+    std::vector<uint32_t> b(bandWidth, 1);  // 2d + 1 in the above formula.
+
+    uint32_t* line = data + xBegin;
     for (int todo = height - 1; todo > 0; --todo) {
-      const uint32_t sqd = *pSqd + b;
-      pSqd += width;
-      if (*pSqd > sqd) {
-        *pSqd = sqd;
-        b += 2;
-      } else {
-        b = 1;
+      const uint32_t* const prevLine = line;
+      line += width;
+      for (int x = 0; x < bandWidth; ++x) {
+        const uint32_t sqd = prevLine[x] + b[x];
+        if (line[x] > sqd) {
+          line[x] = sqd;
+          b[x] += 2;
+        } else {
+          b[x] = 1;
+        }
       }
     }
 
-    b = 1;
+    std::fill(b.begin(), b.end(), 1);
     for (int todo = height - 1; todo > 0; --todo) {
-      const uint32_t sqd = *pSqd + b;
-      pSqd -= width;
-      if (*pSqd > sqd) {
-        *pSqd = sqd;
-        b += 2;
-      } else {
-        b = 1;
+      const uint32_t* const nextLine = line;
+      line -= width;
+      for (int x = 0; x < bandWidth; ++x) {
+        const uint32_t sqd = nextLine[x] + b[x];
+        if (line[x] > sqd) {
+          line[x] = sqd;
+          b[x] += 2;
+        } else {
+          b[x] = 1;
+        }
       }
     }
-  }
+  });
 }  // SEDM::processColumns
 
 void SEDM::processColumns(ConnectivityMap& cmap) {
   const int width = m_size.width() + 2;
   const int height = m_size.height() + 2;
+  uint32_t* const data = &m_data[0];
+  uint32_t* const labels = cmap.paddedData();
 
-  uint32_t* pSqd = &m_data[0];
-  uint32_t* pLabel = cmap.paddedData();
-  for (int x = 0; x < width; ++x, ++pSqd, ++pLabel) {
+  // See processColumns() above.
+  foundation::ParallelFor::run(width, MIN_COLUMNS_PER_CHUNK, [&](const int xBegin, const int xEnd) {
+    const int bandWidth = xEnd - xBegin;
     // (d + 1)^2 = d^2 + 2d + 1
-    uint32_t b = 1;  // 2d + 1 in the above formula.
+    std::vector<uint32_t> b(bandWidth, 1);  // 2d + 1 in the above formula.
+
+    uint32_t* line = data + xBegin;
+    uint32_t* labelLine = labels + xBegin;
     for (int todo = height - 1; todo > 0; --todo) {
-      const uint32_t sqd = *pSqd + b;
-      pSqd += width;
-      pLabel += width;
-      if (sqd < *pSqd) {
-        *pSqd = sqd;
-        *pLabel = pLabel[-width];
-        b += 2;
-      } else {
-        b = 1;
+      const uint32_t* const prevLine = line;
+      const uint32_t* const prevLabelLine = labelLine;
+      line += width;
+      labelLine += width;
+      for (int x = 0; x < bandWidth; ++x) {
+        const uint32_t sqd = prevLine[x] + b[x];
+        if (sqd < line[x]) {
+          line[x] = sqd;
+          labelLine[x] = prevLabelLine[x];
+          b[x] += 2;
+        } else {
+          b[x] = 1;
+        }
       }
     }
 
-    b = 1;
+    std::fill(b.begin(), b.end(), 1);
     for (int todo = height - 1; todo > 0; --todo) {
-      const uint32_t sqd = *pSqd + b;
-      pSqd -= width;
-      pLabel -= width;
-      if (sqd < *pSqd) {
-        *pSqd = sqd;
-        *pLabel = pLabel[width];
-        b += 2;
-      } else {
-        b = 1;
+      const uint32_t* const nextLine = line;
+      const uint32_t* const nextLabelLine = labelLine;
+      line -= width;
+      labelLine -= width;
+      for (int x = 0; x < bandWidth; ++x) {
+        const uint32_t sqd = nextLine[x] + b[x];
+        if (sqd < line[x]) {
+          line[x] = sqd;
+          labelLine[x] = nextLabelLine[x];
+          b[x] += 2;
+        } else {
+          b[x] = 1;
+        }
       }
     }
-  }
+  });
 }  // SEDM::processColumns
 
 void SEDM::processRows() {
   const int width = m_size.width() + 2;
   const int height = m_size.height() + 2;
+  uint32_t* const data = &m_data[0];
 
-  std::vector<int> s(width, 0);
-  std::vector<int> t(width, 0);
-  std::vector<uint32_t> rowCopy(width, 0);
-
-  uint32_t* line = &m_data[0];
-  for (int y = 0; y < height; ++y, line += width) {
-    int q = 0;
-    s[0] = 0;
-    t[0] = 0;
-    for (int x = 1; x < width; ++x) {
-      while (q >= 0 && distSq(t[q], s[q], line[s[q]]) > distSq(t[q], x, line[x])) {
-        --q;
-      }
+  // Rows are independent of each other.
+  foundation::ParallelFor::run(height, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    std::vector<int> s(width, 0);
+    std::vector<int> t(width, 0);
+    std::vector<uint32_t> rowCopy(width, 0);
 
-      if (q < 0) {
-        q = 0;
-        s[0] = x;
-      } else {
-        const int x2 = s[q];
-        if ((line[x] != INF_DIST) && (line[x2] != INF_DIST)) {
-          int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
-          w /= (x - x2) << 1;
-          ++w;
-          if ((unsigned) w < (unsigned) width) {
-            ++q;
-            s[q] = x;
-            t[q] = w;
-          }
-        }
-      }
-    }
+    for (int y = yBegin; y < yEnd; ++y) {
+      uint32_t* const line = data + y * width;
+      const int q = findLowerEnvelope(line, width, s.data(), t.data());
 
-    memcpy(&rowCopy[0], line, width * sizeof(*line));
+      memcpy(&rowCopy[0], line, width * sizeof(*line));
 
-    for (int x = width - 1; x >= 0; --x) {
-      const int x2 = s[q];
-      line[x] = distSq(x, x2, rowCopy[x2]);
-      if (x == t[q]) {
-        --q;
+      for (int x = width - 1, i = q; x >= 0; --x) {
+        const int x2 = s[i];
+        line[x] = distSq(x, x2, rowCopy[x2]);
+        if (x == t[i]) {
+          --i;
+        }
       }
     }
-  }
+  });
 }  // SEDM::processRows
 
 void SEDM::processRows(ConnectivityMap& cmap) {
   const int width = m_size.width() + 2;
   const int height = m_size.height() + 2;
-
-  std::vector<int> s(width, 0);
-  std::vector<int> t(width, 0);
-  std::vector<uint32_t> rowCopy(width, 0);
-  std::vector<uint32_t> cmapRowCopy(width, 0);
-
-  uint32_t* line = &m_data[0];
-  uint32_t* cmapLine = cmap.paddedData();
-  for (int y = 0; y < height; ++y, line += width, cmapLine += width) {
-    int q = 0;
-    s[0] = 0;
-    t[0] = 0;
-    for (int x = 1; x < width; ++x) {
-      while (q >= 0 && distSq(t[q], s[q], line[s[q]]) > distSq(t[q], x, line[x])) {
-        --q;
-      }
-
-      if (q < 0) {
-        q = 0;
-        s[0] = x;
-      } else {
-        const int x2 = s[q];
-        if ((line[x] != INF_DIST) && (line[x2] != INF_DIST)) {
-          int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
-          w /= (x - x2) << 1;
-          ++w;
-          if ((unsigned) w < (unsigned) width) {
-            ++q;
-            s[q] = x;
-            t[q] = w;
-          }
+  uint32_t* const data = &m_data[0];
+  uint32_t* const labels = cmap.paddedData();
+
+  foundation::ParallelFor::run(height, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    std::vector<int> s(width, 0);
+    std::vector<int> t(width, 0);
+    std::vector<uint32_t> rowCopy(width, 0);
+    std::vector<uint32_t> cmapRowCopy(width, 0);
+
+    for (int y = yBegin; y < yEnd; ++y) {
+      uint32_t* const line = data + y * width;
+      uint32_t* const cmapLine = labels + y * width;
+      const int q = findLowerEnvelope(line, width, s.data(), t.data());
+
+      memcpy(&rowCopy[0], line, width * sizeof(*line));
+      memcpy(&cmapRowCopy[0], cmapLine, width * sizeof(*cmapLine));
+
+      for (int x = width - 1, i = q; x >= 0; --x) {
+        const int x2 = s[i];
+        line[x] = distSq(x, x2, rowCopy[x2]);
+        cmapLine[x] = cmapRowCopy[x2];
+        if (x == t[i]) {
+          --i;
         }
       }
     }
+  });
+}  // SEDM::processRows
 
-    memcpy(&rowCopy[0], line, width * sizeof(*line));
-    memcpy(&cmapRowCopy[0], cmapLine, width * sizeof(*cmapLine));
+int SEDM::findLowerEnvelope(const uint32_t* line, const int width, int* s, int* t) {
+  int q = 0;
+  s[0] = 0;
+  t[0] = 0;
+  for (int x = 1; x < width; ++x) {
+    while (q >= 0 && distSq(t[q], s[q], line[s[q]]) > distSq(t[q], x, line[x])) {
+      --q;
+    }
 
-    for (int x = width - 1; x >= 0; --x) {
+    if (q < 0) {
+      q = 0;
+      s[0] = x;
+    } else {
       const int x2 = s[q];
-      line[x] = distSq(x, x2, rowCopy[x2]);
-      cmapLine[x] = cmapRowCopy[x2];
-      if (x == t[q]) {
-        --q;
+      if ((line[x] != INF_DIST) && (line[x2] != INF_DIST)) {
+        int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
+        w /= (x - x2) << 1;
+        ++w;
+        if ((unsigned) w < (unsigned) width) {
+          ++q;
+          s[q] = x;
+          t[q] = w;
+        }
       }
     }
   }
-}  // SEDM::processRows
+  return q;
+}  // SEDM::findLowerEnvelope
 
 /*====================== Peak finding stuff goes below ====================*/
 
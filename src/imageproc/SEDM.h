@@ -164,6 +164,13 @@ class SEDM {
 
   void processRows(ConnectivityMap& cmap);
 
+  /**
+   * \brief Finds the parabolas forming the lower envelope of a row.
+   *
+   * \return The index of the last parabola in \p s and \p t.
+   */
+  static int findLowerEnvelope(const uint32_t* line, int width, int* s, int* t);
+
   BinaryImage findPeakCandidatesNonPadded() const;
 
   BinaryImage buildEqualMapNonPadded(const uint32_t* src1, const uint32_t* src2) const;
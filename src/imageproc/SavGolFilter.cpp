@@ -3,40 +3,37 @@
 
 #include "SavGolFilter.h"
 
+#include <QPoint>
+#include <QSize>
+#include <algorithm>
+#include <vector>
+
 #include "Grayscale.h"
+#include "ParallelFor.h"
 #include "SavGolKernel.h"
 
 namespace imageproc {
 namespace {
+const int MIN_LINES_PER_CHUNK = 16;
+
 int calcNumTerms(const int horDegree, const int vertDegree) {
   return (horDegree + 1) * (vertDegree + 1);
 }
 
-class Kernel : public SavGolKernel {
- public:
-  Kernel(const QSize& size, const QPoint& origin, int horDegree, int vertDegree)
-      : SavGolKernel(size, origin, horDegree, vertDegree) {}
-
-  void convolve(uint8_t* dst, const uint8_t* srcTopLeft, int srcBpl) const;
-};
+/**
+ * Returns the kernels for every possible origin within a window
+ * of the given size, laid out one after another.
+ */
+std::vector<float> kernelsForAllOrigins(const QSize& size, const int horDegree, const int vertDegree) {
+  const int numDataPoints = size.width() * size.height();
+  std::vector<float> kernels(numDataPoints * numDataPoints);
 
-
-inline void Kernel::convolve(uint8_t* dst, const uint8_t* srcTopLeft, int srcBpl) const {
-  const uint8_t* pSrc = srcTopLeft;
-  const float* pKernel = data();
-  float sum = 0.5;  // For rounding purposes.
-  const int w = width();
-  const int h = height();
-
-  for (int y = 0; y < h; ++y, pSrc += srcBpl) {
-    for (int x = 0; x < w; ++x) {
-      sum += pSrc[x] * *pKernel;
-      ++pKernel;
-    }
+  SavGolKernel kernel(size, QPoint(0, 0), horDegree, vertDegree);
+  for (int i = 0; i < numDataPoints; ++i) {
+    kernel.recalcForOrigin(QPoint(i % size.width(), i / size.width()));
+    std::copy(kernel.data(), kernel.data() + numDataPoints, kernels.begin() + i * numDataPoints);
   }
-
-  const auto val = static_cast<int>(sum);
-  *dst = static_cast<uint8_t>(qBound(0, val, 255));
+  return kernels;
 }
 
 QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const int horDegree, const int vertDegree) {
@@ -58,28 +55,37 @@ QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const
    * |L|L|C|R|R|
    * |x|x|B|x|x|
    * |x|x|B|x|x|
+   *
+   * Near the edges of the image, the window is moved inside the image area
+   * and the hot spot of the kernel is moved off the center (C) to keep
+   * pointing to the same pixel.
+   *
+   * The polynomial is a tensor product of a horizontal and a vertical one,
+   * and the window is rectangular, so the kernel for any hot spot is
+   * the outer product of two 1D kernels.  Therefore the whole image,
+   * edges included, is filtered by a horizontal pass followed by
+   * a vertical one.
    */
 
-  // Co-ordinates of the central point (C) of the kernel.
-  const QPoint kCenter(kw / 2, kh / 2);
-
-  // Origin is the current hot spot of the kernel.
-  // Normally it's at kCenter, but sometimes we move
-  // it to other locations to avoid parts of the kernel
-  // from going outside of the image area.
-  QPoint kOrigin;
-
   // Length of the top segment (T) of the kernel.
-  const int kTop = kCenter.y();
-
+  const int kTop = kh / 2;
   // Length of the bottom segment (B) of the kernel.
   const int kBottom = kh - kTop - 1;
-
   // Length of the left segment (L) of the kernel.
-  const int kLeft = kCenter.x();
+  const int kLeft = kw / 2;
   // Length of the right segment (R) of the kernel.
   const int kRight = kw - kLeft - 1;
 
+  // 1D kernels for every possible position of the hot spot, one after another.
+  const std::vector<float> horKernels(kernelsForAllOrigins(QSize(kw, 1), horDegree, 0));
+  const std::vector<float> vertKernels(kernelsForAllOrigins(QSize(1, kh), 0, vertDegree));
+
+  // Pixels away from the edges have always been truncated rather than
+  // rounded.  Keep it that way, so the results don't change.
+  std::vector<float> centralRowBias(width, 0.5f);
+  std::fill(centralRowBias.begin() + kLeft, centralRowBias.end() - kRight, 0.0f);
+  const std::vector<float> edgeRowBias(width, 0.5f);
+
   const uint8_t* const srcData = src.bits();
   const int srcBpl = src.bytesPerLine();
 
@@ -91,172 +97,55 @@ QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const
 
   uint8_t* const dstData = dst.bits();
   const int dstBpl = dst.bytesPerLine();
-  // Top-left corner.
-  const uint8_t* srcLine = srcData;
-  uint8_t* dstLine = dstData;
-  Kernel kernel(windowSize, QPoint(0, 0), horDegree, vertDegree);
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setY(y);
-    for (int x = 0; x < kLeft; ++x) {
-      kOrigin.setX(x);
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-    }
-  }
-
-  // Top area between two corners.
-  kOrigin.setX(kCenter.x());
-  srcLine = srcData - kLeft;
-  dstLine = dstData;
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setY(y);
-    kernel.recalcForOrigin(kOrigin);
-    for (int x = kLeft; x < width - kRight; ++x) {
-      kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-    }
-  }
-  // Top-right corner.
-  kOrigin.setY(0);
-  srcLine = srcData + width - kw;
-  dstLine = dstData;
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setX(kCenter.x() + 1);
-    for (int x = width - kRight; x < width; ++x) {
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      kOrigin.rx() += 1;
-    }
-    kOrigin.ry() += 1;
-  }
-  // Central area.
-#if 0
-            // Simple but slow implementation.
-                    kernel.recalcForOrigin(kCenter);
-                    srcLine = srcData - kLeft;
-                    dstLine = dstData + dstBpl * kTop;
-                    for (int y = kTop; y < height - kBottom; ++y) {
-                        for (int x = kLeft; x < width - kRight; ++x) {
-                            kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-                        }
-                        srcLine += srcBpl;
-                        dstLine += dstBpl;
-                    }
-#else
-  // Take advantage of Savitzky-Golay filter being separable.
-  const SavGolKernel horKernel(QSize(windowSize.width(), 1), QPoint(kCenter.x(), 0), horDegree, 0);
-  const SavGolKernel vertKernel(QSize(1, windowSize.height()), QPoint(0, kCenter.y()), 0, vertDegree);
-
-  const int shift = kw - 1;
 
   // Allocate a 16-byte aligned temporary storage.
   // That may help the compiler to emit efficient SSE code.
-  const int tempStride = (width - shift + 3) & ~3;
+  const int tempStride = (width + 3) & ~3;
   AlignedArray<float, 4> tempArray(tempStride * height);
+  // Both passes process lines independently, so we split them into bands of lines.
   // Horizontal pass.
-  srcLine = srcData - shift;
-  float* tempLine = tempArray.data() - shift;
-  for (int y = 0; y < height; ++y) {
-    for (int i = shift; i < width; ++i) {
-      float sum = 0.0f;
-
-      const uint8_t* src = srcLine + i;
-      for (int j = 0; j < kw; ++j) {
-        sum += src[j] * horKernel[j];
+  foundation::ParallelFor::run(height, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    const uint8_t* srcLine = srcData + yBegin * srcBpl;
+    float* tempLine = tempArray.data() + yBegin * tempStride;
+    for (int y = yBegin; y < yEnd; ++y, srcLine += srcBpl, tempLine += tempStride) {
+      for (int x = 0; x < width; ++x) {
+        const int windowLeft = qBound(0, x - kLeft, width - kw);
+        const float* const kernel = &horKernels[(x - windowLeft) * kw];
+
+        float sum = 0.0f;
+        const uint8_t* src = srcLine + windowLeft;
+        for (int j = 0; j < kw; ++j) {
+          sum += src[j] * kernel[j];
+        }
+        tempLine[x] = sum;
       }
-      tempLine[i] = sum;
     }
-    tempLine += tempStride;
-    srcLine += srcBpl;
-  }
-  // Vertical pass.
-  dstLine = dstData + kTop * dstBpl + kLeft - shift;
-  tempLine = tempArray.data() - shift;
-  for (int y = kTop; y < height - kBottom; ++y) {
-    for (int i = shift; i < width; ++i) {
-      float sum = 0.0f;
-
-      float* tmp = tempLine + i;
-      for (int j = 0; j < kh; ++j, tmp += tempStride) {
-        sum += *tmp * vertKernel[j];
+  });
+  // Vertical pass.  Whole lines are accumulated at once, which
+  // keeps the memory access sequential and vectorizes well.
+  foundation::ParallelFor::run(height, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    std::vector<float> sums(width);
+    uint8_t* dstLine = dstData + yBegin * dstBpl;
+    for (int y = yBegin; y < yEnd; ++y, dstLine += dstBpl) {
+      const int windowTop = qBound(0, y - kTop, height - kh);
+      const float* const kernel = &vertKernels[(y - windowTop) * kh];
+      const bool centralRow = (y >= kTop) && (y < height - kBottom);
+      sums = centralRow ? centralRowBias : edgeRowBias;
+
+      const float* tempLine = tempArray.data() + windowTop * tempStride;
+      for (int j = 0; j < kh; ++j, tempLine += tempStride) {
+        const float k = kernel[j];
+        for (int x = 0; x < width; ++x) {
+          sums[x] += tempLine[x] * k;
+        }
       }
-      const auto val = static_cast<int>(sum);
-      dstLine[i] = static_cast<uint8_t>(qBound(0, val, 255));
-    }
-
-    tempLine += tempStride;
-    dstLine += dstBpl;
-  }
-#endif  // if 0
-
-  // Left area between two corners.
-  kOrigin.setX(0);
-  kOrigin.setY(kCenter.y() + 1);
-  for (int x = 0; x < kLeft; ++x) {
-    srcLine = srcData;
-    dstLine = dstData + dstBpl * kTop;
-
-    kernel.recalcForOrigin(kOrigin);
-    for (int y = kTop; y < height - kBottom; ++y) {
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      srcLine += srcBpl;
-      dstLine += dstBpl;
-    }
-    kOrigin.rx() += 1;
-  }
-  // Right area between two corners.
-  kOrigin.setX(kCenter.x() + 1);
-  kOrigin.setY(kCenter.y());
-  for (int x = width - kRight; x < width; ++x) {
-    srcLine = srcData + width - kw;
-    dstLine = dstData + dstBpl * kTop;
 
-    kernel.recalcForOrigin(kOrigin);
-    for (int y = kTop; y < height - kBottom; ++y) {
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      srcLine += srcBpl;
-      dstLine += dstBpl;
-    }
-    kOrigin.rx() += 1;
-  }
-
-  // Bottom-left corner.
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh);
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    for (int x = 0; x < kLeft; ++x) {
-      kOrigin.setX(x);
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-    }
-    kOrigin.ry() += 1;
-  }
-
-  // Bottom area between two corners.
-  kOrigin.setX(kCenter.x());
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh) - kLeft;
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    kernel.recalcForOrigin(kOrigin);
-    for (int x = kLeft; x < width - kRight; ++x) {
-      kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-    }
-    kOrigin.ry() += 1;
-  }
-  // Bottom-right corner.
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh) + (width - kw);
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    kOrigin.setX(kCenter.x() + 1);
-    for (int x = width - kRight; x < width; ++x) {
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      kOrigin.rx() += 1;
+      for (int x = 0; x < width; ++x) {
+        const auto val = static_cast<int>(sums[x]);
+        dstLine[x] = static_cast<uint8_t>(qBound(0, val, 255));
+      }
     }
-    kOrigin.ry() += 1;
-  }
+  });
   return dst;
 }  // savGolFilterGrayToGray
 }  // namespace
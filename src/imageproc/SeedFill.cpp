@@ -4,12 +4,22 @@
 #include "SeedFill.h"
 
 #include <QDebug>
+#include <algorithm>
+#include <vector>
 
 #include "GrayImage.h"
+#include "ParallelFor.h"
 #include "SeedFillGeneric.h"
 
 namespace imageproc {
 namespace {
+const int MIN_LINES_PER_CHUNK = 64;
+
+const int MAX_ROUNDS = 3;
+
+const uint8_t FIRST_LINE_CHANGED = 1;
+const uint8_t LAST_LINE_CHANGED = 2;
+
 inline uint32_t fillWordHorizontally(uint32_t word, const uint32_t mask) {
   uint32_t prevWord;
 
@@ -21,183 +31,236 @@ inline uint32_t fillWordHorizontally(uint32_t word, const uint32_t mask) {
   return word;
 }
 
-void seedFill4Iteration(BinaryImage& seed, const BinaryImage& mask) {
-  const int w = seed.width();
-  const int h = seed.height();
+/**
+ * A horizontal stripe of a binary seed image and of its mask.
+ */
+struct BinaryStripe {
+  uint32_t* seed;
+  int seedWpl;
+  const uint32_t* mask;
+  int maskWpl;
+  int numLines;
+  int lastWordIdx;
+  uint32_t lastWordMask;
+  // The lines just outside of the stripe.
+  const uint32_t* lineAbove;
+  const uint32_t* lineBelow;
+};
 
-  const int seedWpl = seed.wordsPerLine();
-  const int maskWpl = mask.wordsPerLine();
-  const int lastWordIdx = (w - 1) >> 5;
-  const uint32_t lastWordMask = ~uint32_t(0) << (((lastWordIdx + 1) << 5) - w);
+/**
+ * Does a raster and an anti-raster pass over a stripe.
+ *
+ * Off-screen bits of the seed are expected to be 0, and they stay that way.
+ *
+ * \return true if the seed was modified.
+ */
+bool seedFill4Iteration(const BinaryStripe& stripe) {
+  const int lastWordIdx = stripe.lastWordIdx;
 
-  uint32_t* seedLine = seed.data();
-  const uint32_t* maskLine = mask.data();
-  const uint32_t* prevLine = seedLine;
+  uint32_t* seedLine = stripe.seed;
+  const uint32_t* maskLine = stripe.mask;
+  const uint32_t* prevLine = stripe.lineAbove;
+  uint32_t modified = 0;
 
   // Top to bottom.
-  for (int y = 0; y < h; ++y) {
+  for (int y = 0; y < stripe.numLines; ++y) {
     uint32_t prevWord = 0;
-
-    // Make sure offscreen bits are 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Left to right (except the last word).
+    // Left to right.
     for (int i = 0; i <= lastWordIdx; ++i) {
-      const uint32_t mask = maskLine[i];
+      const uint32_t mask = (i == lastWordIdx) ? maskLine[i] & stripe.lastWordMask : maskLine[i];
       uint32_t word = prevWord << 31;
       word |= seedLine[i] | prevLine[i];
       word &= mask;
       word = fillWordHorizontally(word, mask);
+      modified |= seedLine[i] ^ word;
       seedLine[i] = word;
       prevWord = word;
     }
 
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    seedLine[lastWordIdx] &= lastWordMask;
-
     prevLine = seedLine;
-    seedLine += seedWpl;
-    maskLine += maskWpl;
+    seedLine += stripe.seedWpl;
+    maskLine += stripe.maskWpl;
   }
 
-  seedLine -= seedWpl;
-  maskLine -= maskWpl;
-  prevLine = seedLine;
+  seedLine -= stripe.seedWpl;
+  maskLine -= stripe.maskWpl;
+  prevLine = stripe.lineBelow;
 
   // Bottom to top.
-  for (int y = h - 1; y >= 0; --y) {
+  for (int y = stripe.numLines - 1; y >= 0; --y) {
     uint32_t prevWord = 0;
-
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
     // Right to left.
     for (int i = lastWordIdx; i >= 0; --i) {
-      const uint32_t mask = maskLine[i];
+      const uint32_t mask = (i == lastWordIdx) ? maskLine[i] & stripe.lastWordMask : maskLine[i];
       uint32_t word = prevWord >> 31;
       word |= seedLine[i] | prevLine[i];
       word &= mask;
       word = fillWordHorizontally(word, mask);
+      modified |= seedLine[i] ^ word;
       seedLine[i] = word;
       prevWord = word;
     }
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    // Fortunately, garbage can't spread through prevWord,
-    // as only 1 bit is used from it, which can't be garbage.
-    seedLine[lastWordIdx] &= lastWordMask;
 
     prevLine = seedLine;
-    seedLine -= seedWpl;
-    maskLine -= maskWpl;
+    seedLine -= stripe.seedWpl;
+    maskLine -= stripe.maskWpl;
   }
+  return modified != 0;
 }  // seedFill4Iteration
 
-void seedFill8Iteration(BinaryImage& seed, const BinaryImage& mask) {
-  const int w = seed.width();
-  const int h = seed.height();
+/**
+ * \return The bits of a line that are 8-connected to the given word.
+ */
+inline uint32_t spread8FromLine(const uint32_t* line, const int i, const int lastWordIdx) {
+  uint32_t word = line[i];
+  word |= (word << 1) | (word >> 1);
+  if (i > 0) {
+    word |= line[i - 1] << 31;
+  }
+  if (i < lastWordIdx) {
+    word |= line[i + 1] >> 31;
+  }
+  return word;
+}
 
-  const int seedWpl = seed.wordsPerLine();
-  const int maskWpl = mask.wordsPerLine();
-  const int lastWordIdx = (w - 1) >> 5;
-  const uint32_t lastWordMask = ~uint32_t(0) << (((lastWordIdx + 1) << 5) - w);
+/**
+ * The same as seedFill4Iteration(), but for 8-connectivity.
+ */
+bool seedFill8Iteration(const BinaryStripe& stripe) {
+  const int lastWordIdx = stripe.lastWordIdx;
 
-  uint32_t* seedLine = seed.data();
-  const uint32_t* maskLine = mask.data();
-  const uint32_t* prevLine = seedLine;
-
-  // Note: we start with prevLine == seedLine, but in this case
-  // prevLine[i + 1] won't be clipped by its mask when we use it to
-  // update seedLine[i].  The wrong value may propagate further from
-  // there, so clipping we do on the anti-raster pass won't help.
-  // That's why we clip the first line here.
-  for (int i = 0; i <= lastWordIdx; ++i) {
-    seedLine[i] &= maskLine[i];
-  }
+  uint32_t* seedLine = stripe.seed;
+  const uint32_t* maskLine = stripe.mask;
+  const uint32_t* prevLine = stripe.lineAbove;
+  uint32_t modified = 0;
 
   // Top to bottom.
-  for (int y = 0; y < h; ++y) {
+  for (int y = 0; y < stripe.numLines; ++y) {
     uint32_t prevWord = 0;
-
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Left to right (except the last word).
-    int i = 0;
-    for (; i < lastWordIdx; ++i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevLine[i];
-      word |= (word << 1) | (word >> 1);
+    // Left to right.
+    for (int i = 0; i <= lastWordIdx; ++i) {
+      const uint32_t mask = (i == lastWordIdx) ? maskLine[i] & stripe.lastWordMask : maskLine[i];
+      uint32_t word = spread8FromLine(prevLine, i, lastWordIdx);
       word |= seedLine[i];
-      word |= prevLine[i + 1] >> 31;
       word |= prevWord << 31;
       word &= mask;
       word = fillWordHorizontally(word, mask);
+      modified |= seedLine[i] ^ word;
       seedLine[i] = word;
       prevWord = word;
     }
-    // Last word.
-    const uint32_t mask = maskLine[i] & lastWordMask;
-    uint32_t word = prevLine[i];
-    word |= (word << 1) | (word >> 1);
-    word |= seedLine[i];
-    word |= prevWord << 31;
-    word &= mask;
-    word = fillWordHorizontally(word, mask);
-    seedLine[i] = word;
 
     prevLine = seedLine;
-    seedLine += seedWpl;
-    maskLine += maskWpl;
+    seedLine += stripe.seedWpl;
+    maskLine += stripe.maskWpl;
   }
 
-  seedLine -= seedWpl;
-  maskLine -= maskWpl;
-  prevLine = seedLine;
+  seedLine -= stripe.seedWpl;
+  maskLine -= stripe.maskWpl;
+  prevLine = stripe.lineBelow;
 
   // Bottom to top.
-  for (int y = h - 1; y >= 0; --y) {
+  for (int y = stripe.numLines - 1; y >= 0; --y) {
     uint32_t prevWord = 0;
-
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Right to left (except the last word).
-    int i = lastWordIdx;
-    for (; i > 0; --i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevLine[i];
-      word |= (word << 1) | (word >> 1);
+    // Right to left.
+    for (int i = lastWordIdx; i >= 0; --i) {
+      const uint32_t mask = (i == lastWordIdx) ? maskLine[i] & stripe.lastWordMask : maskLine[i];
+      uint32_t word = spread8FromLine(prevLine, i, lastWordIdx);
       word |= seedLine[i];
-      word |= prevLine[i - 1] << 31;
       word |= prevWord >> 31;
       word &= mask;
       word = fillWordHorizontally(word, mask);
+      modified |= seedLine[i] ^ word;
       seedLine[i] = word;
       prevWord = word;
     }
 
-    // Last word.
-    const uint32_t mask = maskLine[i];
-    uint32_t word = prevLine[i];
-    word |= (word << 1) | (word >> 1);
-    word |= seedLine[i];
-    word |= prevWord >> 31;
-    word &= mask;
-    word = fillWordHorizontally(word, mask);
-    seedLine[i] = word;
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    // Fortunately, garbage can't spread through prevWord,
-    // as only 1 bit is used from it, which can't be garbage.
-    seedLine[lastWordIdx] &= lastWordMask;
-
     prevLine = seedLine;
-    seedLine -= seedWpl;
-    maskLine -= maskWpl;
+    seedLine -= stripe.seedWpl;
+    maskLine -= stripe.maskWpl;
   }
+  return modified != 0;
 }  // seedFill8Iteration
 
+void fillStripe(const BinaryStripe& stripe, const Connectivity connectivity) {
+  if (connectivity == CONN4) {
+    while (seedFill4Iteration(stripe)) {
+      // Continue until done.
+    }
+  } else {
+    while (seedFill8Iteration(stripe)) {
+      // Continue until done.
+    }
+  }
+}
+
+/**
+ * \brief Tells which stripes of a binary image have to be filled on each round.
+ *
+ * Each stripe is filled on its own, with the lines just outside of it taken
+ * from a copy made before the current round.  Once the first or the last line
+ * of a stripe changes, the neighbor on that side has to be filled again on
+ * the next round.  That goes on until no changes cross stripe boundaries.
+ * Values travelling through many stripes would take as many rounds, with only
+ * a few stripes filled on each, so after a few rounds the rest of the work
+ * is left to a fill of the whole image.
+ */
+class StripeRounds {
+ public:
+  explicit StripeRounds(const int numStripes)
+      : m_numStripes(numStripes),
+        m_numRounds(1),
+        m_isComplete(false),
+        m_needsFilling(numStripes, 1),
+        m_changedEdges(numStripes, 0) {}
+
+  bool needsFilling(const int stripe) const { return m_needsFilling[stripe] != 0; }
+
+  /**
+   * \brief Records the edge lines of the stripe having changed on the current round.
+   *
+   * May be called concurrently for different stripes.
+   */
+  void setChangedEdges(const int stripe, const bool firstLineChanged, const bool lastLineChanged) {
+    m_changedEdges[stripe] = (firstLineChanged ? FIRST_LINE_CHANGED : 0) | (lastLineChanged ? LAST_LINE_CHANGED : 0);
+  }
+
+  /**
+   * \brief Marks the stripes next to the changed edges as needing to be filled.
+   *
+   * \return false if there are no more rounds to do, either because the fill
+   *         is complete or because there were too many rounds already.
+   */
+  bool startNextRound() {
+    bool haveWork = false;
+    for (int s = 0; s < m_numStripes; ++s) {
+      const bool aboveChanged = (s > 0) && (m_changedEdges[s - 1] & LAST_LINE_CHANGED);
+      const bool belowChanged = (s < m_numStripes - 1) && (m_changedEdges[s + 1] & FIRST_LINE_CHANGED);
+      m_needsFilling[s] = (aboveChanged || belowChanged) ? 1 : 0;
+      haveWork |= aboveChanged || belowChanged;
+    }
+    std::fill(m_changedEdges.begin(), m_changedEdges.end(), 0);
+
+    if (!haveWork) {
+      m_isComplete = true;
+      return false;
+    }
+    return ++m_numRounds <= MAX_ROUNDS;
+  }
+
+  /**
+   * \brief Tells whether the fill is complete or the whole image still has to be filled.
+   */
+  bool isComplete() const { return m_isComplete; }
+
+ private:
+  int m_numStripes;
+  int m_numRounds;
+  bool m_isComplete;
+  std::vector<uint8_t> m_needsFilling;
+  std::vector<uint8_t> m_changedEdges;
+};
+
 inline uint8_t lightest(uint8_t lhs, uint8_t rhs) {
   return lhs > rhs ? lhs : rhs;
 }
@@ -401,19 +464,96 @@ BinaryImage seedFill(const BinaryImage& seed, const BinaryImage& mask, const Con
     throw std::invalid_argument("seedFill: seed and mask have different sizes");
   }
 
-  BinaryImage prev;
   BinaryImage img(seed);
+  if (img.isNull()) {
+    return img;
+  }
 
-  do {
-    prev = img;
-    if (connectivity == CONN4) {
-      seedFill4Iteration(img, mask);
-    } else {
-      seedFill8Iteration(img, mask);
+  const int w = img.width();
+  const int h = img.height();
+
+  uint32_t* const seedData = img.data();
+  const int seedWpl = img.wordsPerLine();
+  const uint32_t* const maskData = mask.data();
+  const int maskWpl = mask.wordsPerLine();
+  const int lastWordIdx = (w - 1) >> 5;
+  const uint32_t lastWordMask = ~uint32_t(0) << (((lastWordIdx + 1) << 5) - w);
+  const int numWords = lastWordIdx + 1;
+
+  // Black pixels outside of the mask must not be seen by the neighboring stripes.
+  // This also makes sure off-screen bits are 0.
+  foundation::ParallelFor::run(h, MIN_LINES_PER_CHUNK, [&](const int yBegin, const int yEnd) {
+    for (int y = yBegin; y < yEnd; ++y) {
+      uint32_t* const seedLine = seedData + y * seedWpl;
+      const uint32_t* const maskLine = maskData + y * maskWpl;
+      for (int i = 0; i < lastWordIdx; ++i) {
+        seedLine[i] &= maskLine[i];
+      }
+      seedLine[lastWordIdx] &= maskLine[lastWordIdx] & lastWordMask;
+    }
+  });
+
+  const detail::seed_fill_generic::Stripes stripes(h);
+  const int numStripes = stripes.numStripes();
+  StripeRounds rounds(numStripes);
+
+  // The first and the last lines of each stripe, as of the beginning of a round.
+  std::vector<uint32_t> edges(numStripes * 2 * numWords);
+  const std::vector<uint32_t> emptyLine(numWords, 0);
+  const auto saveEdges = [&]() {
+    for (int s = 0; s < numStripes; ++s) {
+      const uint32_t* const firstLine = seedData + stripes.firstLine(s) * seedWpl;
+      const uint32_t* const lastLine = firstLine + (stripes.numLines(s) - 1) * seedWpl;
+      std::copy(firstLine, firstLine + numWords, &edges[(s * 2) * numWords]);
+      std::copy(lastLine, lastLine + numWords, &edges[(s * 2 + 1) * numWords]);
     }
-  } while (img != prev);
+  };
+
+  saveEdges();
+  do {
+    foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+      for (int s = stripeBegin; s < stripeEnd; ++s) {
+        if (!rounds.needsFilling(s)) {
+          continue;
+        }
+
+        BinaryStripe stripe;
+        stripe.seed = seedData + stripes.firstLine(s) * seedWpl;
+        stripe.seedWpl = seedWpl;
+        stripe.mask = maskData + stripes.firstLine(s) * maskWpl;
+        stripe.maskWpl = maskWpl;
+        stripe.numLines = stripes.numLines(s);
+        stripe.lastWordIdx = lastWordIdx;
+        stripe.lastWordMask = lastWordMask;
+        stripe.lineAbove = (s > 0) ? &edges[(s * 2 - 1) * numWords] : &emptyLine[0];
+        stripe.lineBelow = (s < numStripes - 1) ? &edges[(s * 2 + 2) * numWords] : &emptyLine[0];
+
+        fillStripe(stripe, connectivity);
+
+        const uint32_t* const firstLine = stripe.seed;
+        const uint32_t* const lastLine = firstLine + (stripe.numLines - 1) * seedWpl;
+        rounds.setChangedEdges(s, !std::equal(firstLine, firstLine + numWords, &edges[(s * 2) * numWords]),
+                               !std::equal(lastLine, lastLine + numWords, &edges[(s * 2 + 1) * numWords]));
+      }
+    });
+    saveEdges();
+  } while (rounds.startNextRound());
+
+  if (!rounds.isComplete()) {
+    BinaryStripe stripe;
+    stripe.seed = seedData;
+    stripe.seedWpl = seedWpl;
+    stripe.mask = maskData;
+    stripe.maskWpl = maskWpl;
+    stripe.numLines = h;
+    stripe.lastWordIdx = lastWordIdx;
+    stripe.lastWordMask = lastWordMask;
+    stripe.lineAbove = &emptyLine[0];
+    stripe.lineBelow = &emptyLine[0];
+    fillStripe(stripe, connectivity);
+  }
   return img;
-}
+}  // seedFill
 
 GrayImage seedFillGray(const GrayImage& seed, const GrayImage& mask, const Connectivity connectivity) {
   GrayImage result(seed);
@@ -3,9 +3,19 @@
 
 #include "SeedFillGeneric.h"
 
+#include <QThread>
+
 namespace imageproc {
 namespace detail {
 namespace seed_fill_generic {
+namespace {
+const int MIN_LINES_PER_STRIPE = 64;
+const int MAX_STRIPES = 16;
+
+const int MIN_COLUMN_BLOCK_WIDTH = 64;
+const int MAX_COLUMN_BLOCKS = 16;
+}  // namespace
+
 void initHorTransitions(std::vector<HTransition>& transitions, const int width) {
   transitions.reserve(width);
 
@@ -47,6 +57,34 @@ void initVertTransitions(std::vector<VTransition>& transitions, const int height
   // Only north transition is allowed.
   transitions.emplace_back(~0, 0);
 }
+
+Stripes::Stripes(const int height)
+    : m_height(height),
+      m_linesPerStripe(std::max(MIN_LINES_PER_STRIPE, (height + MAX_STRIPES - 1) / MAX_STRIPES)),
+      m_numStripes((height + m_linesPerStripe - 1) / m_linesPerStripe) {}
+
+int columnBlockWidth(const int imageWidth) {
+  const int width = std::max(MIN_COLUMN_BLOCK_WIDTH, (imageWidth + MAX_COLUMN_BLOCKS - 1) / MAX_COLUMN_BLOCKS);
+  return (width + 31) & ~31;
+}
+
+StripeProgress::StripeProgress(const int numStripes) : m_numBlocksDone(numStripes) {}
+
+void StripeProgress::reset() {
+  for (QAtomicInt& numBlocksDone : m_numBlocksDone) {
+    numBlocksDone.storeRelease(0);
+  }
+}
+
+void StripeProgress::waitUntil(const int stripe, const int numBlocks) const {
+  while (m_numBlocksDone[stripe].loadAcquire() < numBlocks) {
+    QThread::yieldCurrentThread();
+  }
+}
+
+void StripeProgress::advance(const int stripe) {
+  m_numBlocksDone[stripe].fetchAndAddRelease(1);
+}
 }  // namespace seed_fill_generic
 }  // namespace detail
 }  // namespace imageproc
\ No newline at end of file
@@ -4,13 +4,17 @@
 #ifndef SCANTAILOR_IMAGEPROC_SEEDFILLGENERIC_H_
 #define SCANTAILOR_IMAGEPROC_SEEDFILLGENERIC_H_
 
+#include <QAtomicInt>
+#include <QRect>
 #include <QSize>
+#include <algorithm>
 #include <cassert>
 #include <vector>
 
 #include "BinaryImage.h"
 #include "Connectivity.h"
 #include "FastQueue.h"
+#include "ParallelFor.h"
 
 namespace imageproc {
 namespace detail {
@@ -43,6 +47,53 @@ void initHorTransitions(std::vector<HTransition>& transitions, int width);
 
 void initVertTransitions(std::vector<VTransition>& transitions, int height);
 
+/**
+ * \brief Splits an image into horizontal stripes to be filled in parallel.
+ */
+class Stripes {
+ public:
+  explicit Stripes(int height);
+
+  int numStripes() const { return m_numStripes; }
+
+  int firstLine(int stripe) const { return stripe * m_linesPerStripe; }
+
+  int numLines(int stripe) const { return std::min(m_linesPerStripe, m_height - firstLine(stripe)); }
+
+ private:
+  int m_height;
+  int m_linesPerStripe;
+  int m_numStripes;
+};
+
+/**
+ * \return The width of column blocks stripes of an image are processed by,
+ *         which is a multiple of 32, so that no two blocks share a word of a BinaryImage.
+ */
+int columnBlockWidth(int imageWidth);
+
+/**
+ * \brief Tracks how many column blocks of each stripe were processed in the current pass.
+ */
+class StripeProgress {
+ public:
+  explicit StripeProgress(int numStripes);
+
+  void reset();
+
+  /**
+   * \brief Waits for the given stripe to process \p numBlocks blocks.
+   *
+   * The stripe has to be processed by a thread not waiting for the current one.
+   */
+  void waitUntil(int stripe, int numBlocks) const;
+
+  void advance(int stripe);
+
+ private:
+  std::vector<QAtomicInt> m_numBlocksDone;
+};
+
 template <typename T, typename SpreadOp, typename MaskOp>
 void seedFillSingleLine(SpreadOp spreadOp,
                         MaskOp maskOp,
@@ -113,6 +164,8 @@ void spread4(SpreadOp spreadOp,
     const HTransition ht(hTransitions[pos.x]);
     const VTransition vt(vTransitions[pos.y]);
     uint32_t* const inQueueLine = inQueueData + inQueueStride * pos.y;
+    // Should the value change again, the pixel has to be queued again.
+    inQueueLine[pos.x >> 5] &= ~((uint32_t(1) << 31) >> (pos.x & 31));
     T* seed;
     const T* mask;
 
@@ -158,6 +211,8 @@ void spread8(SpreadOp spreadOp,
     const HTransition ht(hTransitions[pos.x]);
     const VTransition vt(vTransitions[pos.y]);
     uint32_t* const inQueueLine = inQueueData + inQueueStride * pos.y;
+    // Should the value change again, the pixel has to be queued again.
+    inQueueLine[pos.x >> 5] &= ~((uint32_t(1) << 31) >> (pos.x & 31));
     T* seed;
     const T* mask;
 
@@ -203,7 +258,7 @@ void spread8(SpreadOp spreadOp,
 
     // South-Western neighbor.
     seed = pos.seed + (seedStride & vt.southMask) + ht.westDelta;
-    mask = pos.mask + (seedStride & vt.southMask) + ht.westDelta;
+    mask = pos.mask + (maskStride & vt.southMask) + ht.westDelta;
     processNeighbor(spreadOp, maskOp, queue, inQueueLine + (inQueueStride & vt.southMask), thisVal, seed, mask, pos,
                     ht.westDelta, 1 & vt.southMask);
   }
@@ -422,6 +477,317 @@ void seedFill8(SpreadOp spreadOp,
   spread8(spreadOp, maskOp, queue, inQueueData, inQueueStride, &hTransitions[0], &vTransitions[0], seedStride,
           maskStride);
 }  // seedFill8
+
+/**
+ * The raster pass of seedFill4() over a block of an image already clipped by the mask.
+ */
+template <typename T, typename SpreadOp, typename MaskOp>
+void rasterBlock4(SpreadOp spreadOp,
+                  MaskOp maskOp,
+                  const HTransition* hTransitions,
+                  const VTransition* vTransitions,
+                  T* const seed,
+                  const int seedStride,
+                  const T* const mask,
+                  const int maskStride,
+                  const QRect& block) {
+  for (int y = block.top(); y <= block.bottom(); ++y) {
+    T* const seedLine = seed + seedStride * y;
+    const T* const maskLine = mask + maskStride * y;
+    const T* const prevLine = seedLine - (seedStride & vTransitions[y].northMask);
+
+    for (int x = block.left(); x <= block.right(); ++x) {
+      const HTransition ht(hTransitions[x]);
+      seedLine[x] = maskOp(maskLine[x], spreadOp(seedLine[x], spreadOp(seedLine[x + ht.westDelta], prevLine[x])));
+    }
+  }
+}
+
+/**
+ * The raster pass of seedFill8() over a block of an image already clipped by the mask.
+ *
+ * Pixels in the first column of the block are processed after their south-western
+ * neighbors from the previous block, so these get updated and queued, if necessary.
+ */
+template <typename T, typename SpreadOp, typename MaskOp>
+void rasterBlock8(SpreadOp spreadOp,
+                  MaskOp maskOp,
+                  FastQueue<Position<T>>& queue,
+                  uint32_t* const inQueueData,
+                  const int inQueueStride,
+                  const HTransition* hTransitions,
+                  const VTransition* vTransitions,
+                  T* const seed,
+                  const int seedStride,
+                  const T* const mask,
+                  const int maskStride,
+                  const QRect& block) {
+  for (int y = block.top(); y <= block.bottom(); ++y) {
+    T* const seedLine = seed + seedStride * y;
+    const T* const maskLine = mask + maskStride * y;
+    const T* const prevLine = seedLine - (seedStride & vTransitions[y].northMask);
+
+    for (int x = block.left(); x <= block.right(); ++x) {
+      const HTransition ht(hTransitions[x]);
+      seedLine[x] = maskOp(maskLine[x], spreadOp(spreadOp(spreadOp(seedLine[x], seedLine[x + ht.westDelta]),
+                                                          spreadOp(prevLine[x], prevLine[x + ht.westDelta])),
+                                                 prevLine[x + ht.eastDelta]));
+    }
+
+    if ((block.left() > 0) && (y < block.bottom())) {
+      const int x = block.left();
+      processNeighbor(spreadOp, maskOp, queue, inQueueData + inQueueStride * (y + 1), seedLine[x],
+                      seedLine + seedStride + x - 1, maskLine + maskStride + x - 1,
+                      Position<T>(seedLine + x, maskLine + x, x, y), -1, 1);
+    }
+  }
+}  // rasterBlock8
+
+/**
+ * The anti-raster pass of seedFill4() over a block of an image.
+ */
+template <typename T, typename SpreadOp, typename MaskOp>
+void antiRasterBlock4(SpreadOp spreadOp,
+                      MaskOp maskOp,
+                      FastQueue<Position<T>>& queue,
+                      uint32_t* const inQueueData,
+                      const int inQueueStride,
+                      const HTransition* hTransitions,
+                      const VTransition* vTransitions,
+                      T* const seed,
+                      const int seedStride,
+                      const T* const mask,
+                      const int maskStride,
+                      const QRect& block) {
+  for (int y = block.bottom(); y >= block.top(); --y) {
+    const VTransition vt(vTransitions[y]);
+    T* const seedLine = seed + seedStride * y;
+    const T* const maskLine = mask + maskStride * y;
+    uint32_t* const inQueueLine = inQueueData + inQueueStride * y;
+
+    for (int x = block.right(); x >= block.left(); --x) {
+      const HTransition ht(hTransitions[x]);
+
+      T* const pBaseSeed = seedLine + x;
+      const T* const pBaseMask = maskLine + x;
+
+      T* const pEastSeed = pBaseSeed + ht.eastDelta;
+      T* const pSouthSeed = pBaseSeed + (seedStride & vt.southMask);
+
+      const T newVal(maskOp(*pBaseMask, spreadOp(*pBaseSeed, spreadOp(*pEastSeed, *pSouthSeed))));
+      if (newVal == *pBaseSeed) {
+        continue;
+      }
+
+      *pBaseSeed = newVal;
+
+      const Position<T> pos(pBaseSeed, pBaseMask, x, y);
+      const T* pEastMask = pBaseMask + ht.eastDelta;
+      const T* pSouthMask = pBaseMask + (maskStride & vt.southMask);
+
+      // Eastern neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine, newVal, pEastSeed, pEastMask, pos, ht.eastDelta, 0);
+
+      // Southern neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine + (inQueueStride & vt.southMask), newVal, pSouthSeed,
+                      pSouthMask, pos, 0, 1 & vt.southMask);
+    }
+  }
+}  // antiRasterBlock4
+
+/**
+ * The anti-raster pass of seedFill8() over a block of an image.
+ *
+ * Pixels in the last column of the block are processed after their north-eastern
+ * neighbors from the next block, so these get updated and queued, if necessary.
+ */
+template <typename T, typename SpreadOp, typename MaskOp>
+void antiRasterBlock8(SpreadOp spreadOp,
+                      MaskOp maskOp,
+                      FastQueue<Position<T>>& queue,
+                      uint32_t* const inQueueData,
+                      const int inQueueStride,
+                      const HTransition* hTransitions,
+                      const VTransition* vTransitions,
+                      T* const seed,
+                      const int seedStride,
+                      const T* const mask,
+                      const int maskStride,
+                      const QRect& block) {
+  const int lastColumn = hTransitions[block.right()].eastDelta != 0 ? block.right() : -1;
+
+  for (int y = block.bottom(); y >= block.top(); --y) {
+    const VTransition vt(vTransitions[y]);
+    T* const seedLine = seed + seedStride * y;
+    const T* const maskLine = mask + maskStride * y;
+    uint32_t* const inQueueLine = inQueueData + inQueueStride * y;
+
+    for (int x = block.right(); x >= block.left(); --x) {
+      const HTransition ht(hTransitions[x]);
+
+      T* const pBaseSeed = seedLine + x;
+      const T* const pBaseMask = maskLine + x;
+
+      T* const pEastSeed = pBaseSeed + ht.eastDelta;
+      T* const pSouthSeed = pBaseSeed + (seedStride & vt.southMask);
+      T* const pSouthWestSeed = pSouthSeed + ht.westDelta;
+      T* const pSouthEastSeed = pSouthSeed + ht.eastDelta;
+
+      const T newVal = maskOp(*pBaseMask, spreadOp(*pBaseSeed, spreadOp(spreadOp(*pEastSeed, *pSouthEastSeed),
+                                                                        spreadOp(*pSouthSeed, *pSouthWestSeed))));
+      const Position<T> pos(pBaseSeed, pBaseMask, x, y);
+
+      if ((x == lastColumn) && (y > block.top())) {
+        processNeighbor(spreadOp, maskOp, queue, inQueueLine - inQueueStride, newVal, pBaseSeed - seedStride + 1,
+                        pBaseMask - maskStride + 1, pos, 1, -1);
+      }
+
+      if (newVal == *pBaseSeed) {
+        continue;
+      }
+
+      *pBaseSeed = newVal;
+
+      const T* pEastMask = pBaseMask + ht.eastDelta;
+      const T* pSouthMask = pBaseMask + (maskStride & vt.southMask);
+      const T* pSouthWestMask = pSouthMask + ht.westDelta;
+      const T* pSouthEastMask = pSouthMask + ht.eastDelta;
+
+      // Eastern neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine, newVal, pEastSeed, pEastMask, pos, ht.eastDelta, 0);
+
+      // South-eastern neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine + (inQueueStride & vt.southMask), newVal, pSouthEastSeed,
+                      pSouthEastMask, pos, ht.eastDelta, 1 & vt.southMask);
+
+      // Southern neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine + (inQueueStride & vt.southMask), newVal, pSouthSeed,
+                      pSouthMask, pos, 0, 1 & vt.southMask);
+
+      // South-western neighbor.
+      processNeighbor(spreadOp, maskOp, queue, inQueueLine + (inQueueStride & vt.southMask), newVal, pSouthWestSeed,
+                      pSouthWestMask, pos, ht.westDelta, 1 & vt.southMask);
+    }
+  }
+}  // antiRasterBlock8
+
+/**
+ * The same as seedFill4() and seedFill8(), except the raster and the anti-raster
+ * passes are done in parallel, stripe by stripe.  Stripes are split into column blocks.
+ * A stripe proceeds to the next block once the stripe it depends on, the one above
+ * it for the raster pass or the one below it for the anti-raster pass, is done
+ * with the block after that.  Pixels are thus processed in the same order relative
+ * to their neighbors as in a sequential pass, except for the diagonal neighbors
+ * across block boundaries, which are taken care of by the functions above.
+ * Just like for a sequential pass, values travel through the whole image
+ * in a single pass, while only the queue phase is left sequential.
+ */
+template <typename T, typename SpreadOp, typename MaskOp>
+void seedFillWavefront(SpreadOp spreadOp,
+                       MaskOp maskOp,
+                       const Connectivity conn,
+                       T* const seed,
+                       const int seedStride,
+                       const QSize size,
+                       const T* const mask,
+                       const int maskStride) {
+  const int w = size.width();
+  const int h = size.height();
+
+  const Stripes stripes(h);
+  const int numStripes = stripes.numStripes();
+  const int blockWidth = columnBlockWidth(w);
+  const int numBlocks = (w + blockWidth - 1) / blockWidth;
+
+  if (numStripes == 1) {
+    if (conn == CONN4) {
+      seedFill4(spreadOp, maskOp, seed, seedStride, size, mask, maskStride);
+    } else {
+      seedFill8(spreadOp, maskOp, seed, seedStride, size, mask, maskStride);
+    }
+    return;
+  }
+
+  // Pixels across block boundaries may be read before their blocks are processed,
+  // so they must be already clipped by the mask.
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = stripeBegin; s < stripeEnd; ++s) {
+      for (int y = stripes.firstLine(s); y < stripes.firstLine(s) + stripes.numLines(s); ++y) {
+        T* const seedLine = seed + seedStride * y;
+        const T* const maskLine = mask + maskStride * y;
+        for (int x = 0; x < w; ++x) {
+          seedLine[x] = maskOp(seedLine[x], maskLine[x]);
+        }
+      }
+    }
+  });
+
+  BinaryImage inQueue(size, WHITE);
+  uint32_t* const inQueueData = inQueue.data();
+  const int inQueueStride = inQueue.wordsPerLine();
+  std::vector<HTransition> hTransitions;
+  std::vector<VTransition> vTransitions;
+  initHorTransitions(hTransitions, w);
+  initVertTransitions(vTransitions, h);
+  std::vector<FastQueue<Position<T>>> queues(numStripes);
+
+  const auto blockRect = [&](const int stripe, const int block) {
+    const int x = block * blockWidth;
+    return QRect(x, stripes.firstLine(stripe), std::min(blockWidth, w - x), stripes.numLines(stripe));
+  };
+
+  StripeProgress progress(numStripes);
+
+  // Top to bottom.
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = stripeBegin; s < stripeEnd; ++s) {
+      for (int block = 0; block < numBlocks; ++block) {
+        if (s > 0) {
+          progress.waitUntil(s - 1, std::min(block + 2, numBlocks));
+        }
+        if (conn == CONN4) {
+          rasterBlock4(spreadOp, maskOp, &hTransitions[0], &vTransitions[0], seed, seedStride, mask, maskStride,
+                       blockRect(s, block));
+        } else {
+          rasterBlock8(spreadOp, maskOp, queues[s], inQueueData, inQueueStride, &hTransitions[0], &vTransitions[0],
+                       seed, seedStride, mask, maskStride, blockRect(s, block));
+        }
+        progress.advance(s);
+      }
+    }
+  });
+
+  progress.reset();
+
+  // Bottom to top.
+  foundation::ParallelFor::run(numStripes, 1, [&](const int stripeBegin, const int stripeEnd) {
+    for (int s = numStripes - 1 - stripeBegin; s > numStripes - 1 - stripeEnd; --s) {
+      for (int block = 0; block < numBlocks; ++block) {
+        if (s < numStripes - 1) {
+          progress.waitUntil(s + 1, std::min(block + 2, numBlocks));
+        }
+        if (conn == CONN4) {
+          antiRasterBlock4(spreadOp, maskOp, queues[s], inQueueData, inQueueStride, &hTransitions[0],
+                           &vTransitions[0], seed, seedStride, mask, maskStride, blockRect(s, numBlocks - 1 - block));
+        } else {
+          antiRasterBlock8(spreadOp, maskOp, queues[s], inQueueData, inQueueStride, &hTransitions[0],
+                           &vTransitions[0], seed, seedStride, mask, maskStride, blockRect(s, numBlocks - 1 - block));
+        }
+        progress.advance(s);
+      }
+    }
+  });
+
+  for (FastQueue<Position<T>>& queue : queues) {
+    if (conn == CONN4) {
+      spread4(spreadOp, maskOp, queue, inQueueData, inQueueStride, &hTransitions[0], &vTransitions[0], seedStride,
+              maskStride);
+    } else {
+      spread8(spreadOp, maskOp, queue, inQueueData, inQueueStride, &hTransitions[0], &vTransitions[0], seedStride,
+              maskStride);
+    }
+  }
+}  // seedFillWavefront
 }  // namespace seed_fill_generic
 }  // namespace detail
 
@@ -453,6 +819,8 @@ void seedFill8(SpreadOp spreadOp,
  * Morphological Grayscale Reconstruction in Image Analysis:
  * Applications and Efficient Algorithms, technical report 91-16, Harvard Robotics Laboratory,
  * November 1991, IEEE Transactions on Image Processing, Vol. 2, No. 2, pp. 176-201, April 1993.\n
+ * The raster and the anti-raster passes are done on stripes of the image
+ * in parallel, as a wavefront.
  */
 template <typename T, typename SpreadOp, typename MaskOp>
 void seedFillGenericInPlace(SpreadOp spreadOp,
@@ -467,12 +835,8 @@ void seedFillGenericInPlace(SpreadOp spreadOp,
     return;
   }
 
-  if (conn == CONN4) {
-    detail::seed_fill_generic::seedFill4(spreadOp, maskOp, seed, seedStride, size, mask, maskStride);
-  } else {
-    assert(conn == CONN8);
-    detail::seed_fill_generic::seedFill8(spreadOp, maskOp, seed, seedStride, size, mask, maskStride);
-  }
+  assert(conn == CONN4 || conn == CONN8);
+  detail::seed_fill_generic::seedFillWavefront(spreadOp, maskOp, conn, seed, seedStride, size, mask, maskStride);
 }
 }  // namespace imageproc
 
@@ -5,13 +5,17 @@
 
 #include <QDebug>
 #include <cassert>
+#include <vector>
 
 #include "BadAllocIfNull.h"
 #include "ColorMixer.h"
 #include "Grayscale.h"
+#include "ParallelFor.h"
 
 namespace imageproc {
 namespace {
+const int MIN_LINES_PER_CHUNK = 16;
+
 struct XLess {
   bool operator()(const QPointF& lhs, const QPointF& rhs) const { return lhs.x() < rhs.x(); }
 };
@@ -39,6 +43,213 @@ QSizeF calcSrcUnitSize(const QTransform& xform, const QSizeF& min) {
   return QSizeF(std::max(min32.width(), width), std::max(min32.height(), height));
 }
 
+/**
+ * \brief The part of the source image a destination pixel maps to,
+ *        along one of the axes.
+ *
+ * Positions are in 1/32 of a source pixel.
+ */
+struct BoxSpan {
+  int src32Begin;  // Clipped to the image.
+  int src32End;    // Clipped to the image, exclusive.
+  int srcBegin;    // Clipped to the image.
+  int srcEnd;      // Clipped to the image, inclusive.
+  unsigned length;
+  unsigned clippedLength;
+  int center;  // The middle pixel of the unclipped span.
+  bool outside;
+
+  BoxSpan(int begin32, int length32, int srcSize);
+
+  unsigned beginFraction() const { return 32 - (src32Begin & 31); }
+
+  unsigned endFraction() const { return src32End - (srcEnd << 5); }
+};
+
+
+BoxSpan::BoxSpan(const int begin32, const int length32, const int srcSize)
+    : src32Begin(begin32),
+      src32End(begin32 + length32),
+      srcBegin(begin32 >> 5),
+      srcEnd((src32End - 1) >> 5),
+      length(length32),
+      clippedLength(length32),
+      center((srcBegin + srcEnd) >> 1),
+      outside((srcEnd < 0) || (srcBegin >= srcSize)) {
+  assert(srcEnd >= srcBegin);
+  /*
+   * Note that (intval / 32) is not the same as (intval >> 5).
+   * The former rounds towards zero, while the latter rounds towards
+   * negative infinity.
+   * Likewise, (intval % 32) is not the same as (intval & 31).
+   * The expression in beginFraction() works correctly
+   * with both positive and negative src32Begin.
+   */
+  if (outside) {
+    return;
+  }
+  if (srcBegin < 0) {
+    srcBegin = 0;
+    src32Begin = 0;
+  }
+  if (srcEnd >= srcSize) {
+    srcEnd = srcSize - 1;
+    src32End = srcSize << 5;
+  }
+  clippedLength = src32End - src32Begin;
+}
+
+/**
+ * Computes the color of a destination pixel from the source area
+ * it maps to by mixing source pixels proportionally to their coverage.
+ */
+template <typename StorageUnit, typename Mixer>
+inline StorageUnit mapBox(const StorageUnit* const srcData,
+                          const int srcStride,
+                          const QSize srcSize,
+                          const BoxSpan& hor,
+                          const BoxSpan& vert,
+                          const StorageUnit outsideColor,
+                          const int outsideFlags) {
+  if (hor.outside || vert.outside) {
+    // Completely outside of src image.
+    if (outsideFlags & OutsidePixels::COLOR) {
+      return outsideColor;
+    } else {
+      const int srcX = qBound<int>(0, hor.center, srcSize.width() - 1);
+      const int srcY = qBound<int>(0, vert.center, srcSize.height() - 1);
+      return srcData[srcY * srcStride + srcX];
+    }
+  }
+
+  const unsigned srcArea = vert.clippedLength * hor.clippedLength;
+  // The parts of the area outside of the image.
+  unsigned backgroundArea = vert.length * hor.length - srcArea;
+
+  Mixer mixer;
+  if (outsideFlags & OutsidePixels::WEAK) {
+    backgroundArea = 0;
+  } else {
+    assert(outsideFlags & OutsidePixels::COLOR);
+    mixer.add(outsideColor, backgroundArea);
+  }
+
+  if (srcArea == 0) {
+    if ((outsideFlags & OutsidePixels::COLOR)) {
+      return outsideColor;
+    } else {
+      const int srcX = qBound<int>(0, (hor.srcBegin + hor.srcEnd) >> 1, srcSize.width() - 1);
+      const int srcY = qBound<int>(0, (vert.srcBegin + vert.srcEnd) >> 1, srcSize.height() - 1);
+      return srcData[srcY * srcStride + srcX];
+    }
+  }
+
+  const int srcLeft = hor.srcBegin;
+  const int srcRight = hor.srcEnd;
+  const int srcTop = vert.srcBegin;
+  const int srcBottom = vert.srcEnd;
+  const unsigned leftFraction = hor.beginFraction();
+  const unsigned topFraction = vert.beginFraction();
+  const unsigned rightFraction = hor.endFraction();
+  const unsigned bottomFraction = vert.endFraction();
+
+  assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32 == hor.clippedLength);
+  assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32 == vert.clippedLength);
+
+  const StorageUnit* srcLine = &srcData[srcTop * srcStride];
+
+  if (srcTop == srcBottom) {
+    if (srcLeft == srcRight) {
+      // dst pixel maps to a single src pixel
+      const StorageUnit c = srcLine[srcLeft];
+      if (backgroundArea == 0) {
+        // common case optimization
+        return c;
+      }
+      mixer.add(c, srcArea);
+    } else {
+      // dst pixel maps to a horizontal line of src pixels
+      const unsigned vertFraction = vert.clippedLength;
+      const unsigned leftArea = vertFraction * leftFraction;
+      const unsigned middleArea = vertFraction << 5;
+      const unsigned rightArea = vertFraction * rightFraction;
+
+      mixer.add(srcLine[srcLeft], leftArea);
+
+      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+        mixer.add(srcLine[sx], middleArea);
+      }
+
+      mixer.add(srcLine[srcRight], rightArea);
+    }
+  } else if (srcLeft == srcRight) {
+    // dst pixel maps to a vertical line of src pixels
+    const unsigned horFraction = hor.clippedLength;
+    const unsigned topArea = horFraction * topFraction;
+    const unsigned middleArea = horFraction << 5;
+    const unsigned bottomArea = horFraction * bottomFraction;
+
+    srcLine += srcLeft;
+    mixer.add(*srcLine, topArea);
+
+    srcLine += srcStride;
+
+    for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+      mixer.add(*srcLine, middleArea);
+      srcLine += srcStride;
+    }
+
+    mixer.add(*srcLine, bottomArea);
+  } else {
+    // dst pixel maps to a block of src pixels
+    const unsigned topArea = topFraction << 5;
+    const unsigned bottomArea = bottomFraction << 5;
+    const unsigned leftArea = leftFraction << 5;
+    const unsigned rightArea = rightFraction << 5;
+    const unsigned topleftArea = topFraction * leftFraction;
+    const unsigned toprightArea = topFraction * rightFraction;
+    const unsigned bottomleftArea = bottomFraction * leftFraction;
+    const unsigned bottomrightArea = bottomFraction * rightFraction;
+
+    // process the top-left corner
+    mixer.add(srcLine[srcLeft], topleftArea);
+
+    // process the top line (without corners)
+    for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+      mixer.add(srcLine[sx], topArea);
+    }
+
+    // process the top-right corner
+    mixer.add(srcLine[srcRight], toprightArea);
+
+    srcLine += srcStride;
+    // process middle lines
+    for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+      mixer.add(srcLine[srcLeft], leftArea);
+
+      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+        mixer.add(srcLine[sx], 32 * 32);
+      }
+
+      mixer.add(srcLine[srcRight], rightArea);
+
+      srcLine += srcStride;
+    }
+
+    // process bottom-left corner
+    mixer.add(srcLine[srcLeft], bottomleftArea);
+
+    // process the bottom line (without corners)
+    for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+      mixer.add(srcLine[sx], bottomArea);
+    }
+
+    // process the bottom-right corner
+    mixer.add(srcLine[srcRight], bottomrightArea);
+  }
+  return mixer.mix(srcArea + backgroundArea);
+}  // mapBox
+
 template <typename StorageUnit, typename Mixer>
 static void transformGeneric(const StorageUnit* const srcData,
                              const int srcStride,
@@ -55,8 +266,6 @@ static void transformGeneric(const StorageUnit* const srcData,
   const int dw = dstRect.width();
   const int dh = dstRect.height();
 
-  StorageUnit* dstLine = dstData;
-
   QTransform invXform;
   invXform.translate(dstRect.x(), dstRect.y());
   invXform *= xform.inverted();
@@ -69,215 +278,51 @@ static void transformGeneric(const StorageUnit* const srcData,
   const int src32UnitW = std::max<int>(1, qRound(src32UnitSize.width()));
   const int src32UnitH = std::max<int>(1, qRound(src32UnitSize.height()));
 
-  for (int dy = 0; dy < dh; ++dy, dstLine += dstStride) {
-    const double fDyCenter = dy + 0.5;
-    const double fSx32Base = fDyCenter * invXform.m21() + invXform.dx();
-    const double fSy32Base = fDyCenter * invXform.m22() + invXform.dy();
-
+  if ((invXform.m12() == 0.0) && (invXform.m21() == 0.0)) {
+    // No rotation or shearing, which is the case for scaling and for
+    // pages that didn't need deskewing.  The horizontal extent of the
+    // mapped area then only depends on the column and the vertical one
+    // only on the line, so we compute them just once.  Apart from that,
+    // the computations are exactly the same as below.
+    std::vector<BoxSpan> columnSpans;
+    columnSpans.reserve(dw);
     for (int dx = 0; dx < dw; ++dx) {
-      const double fDxCenter = dx + 0.5;
-      const double fSx32Center = fSx32Base + fDxCenter * invXform.m11();
-      const double fSy32Center = fSy32Base + fDxCenter * invXform.m12();
-      int src32Left = (int) fSx32Center - (src32UnitW >> 1);
-      int src32Top = (int) fSy32Center - (src32UnitH >> 1);
-      int src32Right = src32Left + src32UnitW;
-      int src32Bottom = src32Top + src32UnitH;
-      int srcLeft = src32Left >> 5;
-      int srcRight = (src32Right - 1) >> 5;  // inclusive
-      int srcTop = src32Top >> 5;
-      int srcBottom = (src32Bottom - 1) >> 5;  // inclusive
-      assert(srcBottom >= srcTop);
-      assert(srcRight >= srcLeft);
-
-      if ((srcBottom < 0) || (srcRight < 0) || (srcLeft >= sw) || (srcTop >= sh)) {
-        // Completely outside of src image.
-        if (outsideFlags & OutsidePixels::COLOR) {
-          dstLine[dx] = outsideColor;
-        } else {
-          const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
-          const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
-          dstLine[dx] = srcData[srcY * srcStride + srcX];
-        }
-        continue;
-      }
-
-      /*
-       * Note that (intval / 32) is not the same as (intval >> 5).
-       * The former rounds towards zero, while the latter rounds towards
-       * negative infinity.
-       * Likewise, (intval % 32) is not the same as (intval & 31).
-       * The following expression:
-       * topFraction = 32 - (src32Top & 31);
-       * works correctly with both positive and negative src32Top.
-       */
-
-      unsigned backgroundArea = 0;
-
-      if (srcTop < 0) {
-        const unsigned topFraction = 32 - (src32Top & 31);
-        const unsigned horFraction = src32Right - src32Left;
-        backgroundArea += topFraction * horFraction;
-        const unsigned fullPixelsVer = -1 - srcTop;
-        backgroundArea += horFraction * (fullPixelsVer << 5);
-        srcTop = 0;
-        src32Top = 0;
-      }
-      if (srcBottom >= sh) {
-        const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
-        const unsigned horFraction = src32Right - src32Left;
-        backgroundArea += bottomFraction * horFraction;
-        const unsigned fullPixelsVer = srcBottom - sh;
-        backgroundArea += horFraction * (fullPixelsVer << 5);
-        srcBottom = sh - 1;     // inclusive
-        src32Bottom = sh << 5;  // exclusive
-      }
-      if (srcLeft < 0) {
-        const unsigned leftFraction = 32 - (src32Left & 31);
-        const unsigned vertFraction = src32Bottom - src32Top;
-        backgroundArea += leftFraction * vertFraction;
-        const unsigned fullPixelsHor = -1 - srcLeft;
-        backgroundArea += vertFraction * (fullPixelsHor << 5);
-        srcLeft = 0;
-        src32Left = 0;
-      }
-      if (srcRight >= sw) {
-        const unsigned rightFraction = src32Right - (srcRight << 5);
-        const unsigned vertFraction = src32Bottom - src32Top;
-        backgroundArea += rightFraction * vertFraction;
-        const unsigned fullPixelsHor = srcRight - sw;
-        backgroundArea += vertFraction * (fullPixelsHor << 5);
-        srcRight = sw - 1;     // inclusive
-        src32Right = sw << 5;  // exclusive
-      }
-      assert(srcBottom >= srcTop);
-      assert(srcRight >= srcLeft);
-
-      Mixer mixer;
-      if (outsideFlags & OutsidePixels::WEAK) {
-        backgroundArea = 0;
-      } else {
-        assert(outsideFlags & OutsidePixels::COLOR);
-        mixer.add(outsideColor, backgroundArea);
-      }
+      const double fSx32Center = invXform.dx() + (dx + 0.5) * invXform.m11();
+      columnSpans.emplace_back((int) fSx32Center - (src32UnitW >> 1), src32UnitW, sw);
+    }
 
-      const unsigned leftFraction = 32 - (src32Left & 31);
-      const unsigned topFraction = 32 - (src32Top & 31);
-      const unsigned rightFraction = src32Right - (srcRight << 5);
-      const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
-
-      assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32
-             == static_cast<unsigned>(src32Right - src32Left));
-      assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32
-             == static_cast<unsigned>(src32Bottom - src32Top));
-
-      const unsigned srcArea = (src32Bottom - src32Top) * (src32Right - src32Left);
-      if (srcArea == 0) {
-        if ((outsideFlags & OutsidePixels::COLOR)) {
-          dstLine[dx] = outsideColor;
-        } else {
-          const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
-          const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
-          dstLine[dx] = srcData[srcY * srcStride + srcX];
+    foundation::ParallelFor::run(dh, MIN_LINES_PER_CHUNK, [&](const int dyBegin, const int dyEnd) {
+      StorageUnit* dstLine = dstData + dyBegin * dstStride;
+      for (int dy = dyBegin; dy < dyEnd; ++dy, dstLine += dstStride) {
+        const double fSy32Center = (dy + 0.5) * invXform.m22() + invXform.dy();
+        const BoxSpan lineSpan((int) fSy32Center - (src32UnitH >> 1), src32UnitH, sh);
+        for (int dx = 0; dx < dw; ++dx) {
+          dstLine[dx] = mapBox<StorageUnit, Mixer>(srcData, srcStride, srcSize, columnSpans[dx], lineSpan,
+                                                   outsideColor, outsideFlags);
         }
-        continue;
       }
+    });
+    return;
+  }
 
-      const StorageUnit* srcLine = &srcData[srcTop * srcStride];
-
-      if (srcTop == srcBottom) {
-        if (srcLeft == srcRight) {
-          // dst pixel maps to a single src pixel
-          const StorageUnit c = srcLine[srcLeft];
-          if (backgroundArea == 0) {
-            // common case optimization
-            dstLine[dx] = c;
-            continue;
-          }
-          mixer.add(c, srcArea);
-        } else {
-          // dst pixel maps to a horizontal line of src pixels
-          const unsigned vertFraction = src32Bottom - src32Top;
-          const unsigned leftArea = vertFraction * leftFraction;
-          const unsigned middleArea = vertFraction << 5;
-          const unsigned rightArea = vertFraction * rightFraction;
-
-          mixer.add(srcLine[srcLeft], leftArea);
-
-          for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-            mixer.add(srcLine[sx], middleArea);
-          }
-
-          mixer.add(srcLine[srcRight], rightArea);
-        }
-      } else if (srcLeft == srcRight) {
-        // dst pixel maps to a vertical line of src pixels
-        const unsigned horFraction = src32Right - src32Left;
-        const unsigned topArea = horFraction * topFraction;
-        const unsigned middleArea = horFraction << 5;
-        const unsigned bottomArea = horFraction * bottomFraction;
-
-        srcLine += srcLeft;
-        mixer.add(*srcLine, topArea);
-
-        srcLine += srcStride;
-
-        for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-          mixer.add(*srcLine, middleArea);
-          srcLine += srcStride;
-        }
-
-        mixer.add(*srcLine, bottomArea);
-      } else {
-        // dst pixel maps to a block of src pixels
-        const unsigned topArea = topFraction << 5;
-        const unsigned bottomArea = bottomFraction << 5;
-        const unsigned leftArea = leftFraction << 5;
-        const unsigned rightArea = rightFraction << 5;
-        const unsigned topleftArea = topFraction * leftFraction;
-        const unsigned toprightArea = topFraction * rightFraction;
-        const unsigned bottomleftArea = bottomFraction * leftFraction;
-        const unsigned bottomrightArea = bottomFraction * rightFraction;
-
-        // process the top-left corner
-        mixer.add(srcLine[srcLeft], topleftArea);
-
-        // process the top line (without corners)
-        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], topArea);
-        }
-
-        // process the top-right corner
-        mixer.add(srcLine[srcRight], toprightArea);
-
-        srcLine += srcStride;
-        // process middle lines
-        for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-          mixer.add(srcLine[srcLeft], leftArea);
-
-          for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-            mixer.add(srcLine[sx], 32 * 32);
-          }
-
-          mixer.add(srcLine[srcRight], rightArea);
-
-          srcLine += srcStride;
-        }
-
-        // process bottom-left corner
-        mixer.add(srcLine[srcLeft], bottomleftArea);
-
-        // process the bottom line (without corners)
-        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], bottomArea);
-        }
-
-        // process the bottom-right corner
-        mixer.add(srcLine[srcRight], bottomrightArea);
+  // Every destination line is computed independently.
+  foundation::ParallelFor::run(dh, MIN_LINES_PER_CHUNK, [&](const int dyBegin, const int dyEnd) {
+    StorageUnit* dstLine = dstData + dyBegin * dstStride;
+    for (int dy = dyBegin; dy < dyEnd; ++dy, dstLine += dstStride) {
+      const double fDyCenter = dy + 0.5;
+      const double fSx32Base = fDyCenter * invXform.m21() + invXform.dx();
+      const double fSy32Base = fDyCenter * invXform.m22() + invXform.dy();
+
+      for (int dx = 0; dx < dw; ++dx) {
+        const double fDxCenter = dx + 0.5;
+        const double fSx32Center = fSx32Base + fDxCenter * invXform.m11();
+        const double fSy32Center = fSy32Base + fDxCenter * invXform.m12();
+        const BoxSpan hor((int) fSx32Center - (src32UnitW >> 1), src32UnitW, sw);
+        const BoxSpan vert((int) fSy32Center - (src32UnitH >> 1), src32UnitH, sh);
+        dstLine[dx] = mapBox<StorageUnit, Mixer>(srcData, srcStride, srcSize, hor, vert, outsideColor, outsideFlags);
       }
-
-      dstLine[dx] = mixer.mix(srcArea + backgroundArea);
     }
-  }
+  });
 }  // transformGeneric
 
 template <typename ImageT>
@@ -3,10 +3,14 @@
 
 #include <Binarize.h>
 #include <BinaryImage.h>
+#include <IntegralImage.h>
 
 #include <QImage>
 #include <QSize>
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <vector>
 
 #include "Utils.h"
 
@@ -14,7 +18,125 @@ namespace imageproc {
 namespace tests {
 using namespace utils;
 
+namespace {
+/**
+ * The window statistics computed straightforwardly from integral images.
+ */
+class ReferenceStats {
+ public:
+  ReferenceStats(const QImage& gray, const QSize& windowSize)
+      : m_sum(gray.width(), gray.height()),
+        m_sqsum(gray.width(), gray.height()),
+        m_width(gray.width()),
+        m_height(gray.height()),
+        m_windowSize(windowSize) {
+    for (int y = 0; y < m_height; ++y) {
+      const uint8_t* line = gray.constScanLine(y);
+      m_sum.beginRow();
+      m_sqsum.beginRow();
+      for (int x = 0; x < m_width; ++x) {
+        const uint32_t pixel = line[x];
+        m_sum.push(pixel);
+        m_sqsum.push(pixel * pixel);
+      }
+    }
+  }
+
+  void at(const int x, const int y, double& mean, double& deviation) const {
+    const int lowerHalf = m_windowSize.height() >> 1;
+    const int leftHalf = m_windowSize.width() >> 1;
+    const int top = std::max(0, y - lowerHalf);
+    const int bottom = std::min(m_height, y + m_windowSize.height() - lowerHalf);
+    const int left = std::max(0, x - leftHalf);
+    const int right = std::min(m_width, x + m_windowSize.width() - leftHalf);
+    const QRect rect(left, top, right - left, bottom - top);
+    const double rArea = 1.0 / ((bottom - top) * (right - left));
+    mean = m_sum.sum(rect) * rArea;
+    const double sqmean = m_sqsum.sum(rect) * rArea;
+    deviation = std::sqrt(std::fabs(sqmean - mean * mean));
+  }
+
+ private:
+  IntegralImage<uint32_t> m_sum;
+  IntegralImage<uint64_t> m_sqsum;
+  int m_width;
+  int m_height;
+  QSize m_windowSize;
+};
+
+BinaryImage referenceSauvola(const QImage& gray, const QSize& windowSize, const double k) {
+  const ReferenceStats stats(gray, windowSize);
+  BinaryImage bwImg(gray.width(), gray.height(), WHITE);
+  for (int y = 0; y < gray.height(); ++y) {
+    for (int x = 0; x < gray.width(); ++x) {
+      double mean;
+      double deviation;
+      stats.at(x, y, mean, deviation);
+      const double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+      if (gray.constScanLine(y)[x] < threshold) {
+        bwImg.data()[y * bwImg.wordsPerLine() + (x >> 5)] |= uint32_t(1) << (31 - (x & 31));
+      }
+    }
+  }
+  return bwImg;
+}
+
+BinaryImage referenceWolf(const QImage& gray,
+                          const QSize& windowSize,
+                          const unsigned char lowerBound,
+                          const unsigned char upperBound,
+                          const double k) {
+  const ReferenceStats stats(gray, windowSize);
+  const int w = gray.width();
+  const int h = gray.height();
+  std::vector<float> means(w * h);
+  std::vector<float> deviations(w * h);
+  uint32_t minGrayLevel = 255;
+  double maxDeviation = 0;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      double mean;
+      double deviation;
+      stats.at(x, y, mean, deviation);
+      means[y * w + x] = float(mean);
+      deviations[y * w + x] = float(deviation);
+      minGrayLevel = std::min<uint32_t>(minGrayLevel, gray.constScanLine(y)[x]);
+      maxDeviation = std::max(maxDeviation, deviation);
+    }
+  }
+
+  BinaryImage bwImg(w, h, WHITE);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const float mean = means[y * w + x];
+      const double a = 1.0 - deviations[y * w + x] / maxDeviation;
+      const double threshold = mean - k * a * (mean - minGrayLevel);
+      const int pixel = gray.constScanLine(y)[x];
+      if ((pixel < lowerBound) || ((pixel <= upperBound) && (pixel < threshold))) {
+        bwImg.data()[y * bwImg.wordsPerLine() + (x >> 5)] |= uint32_t(1) << (31 - (x & 31));
+      }
+    }
+  }
+  return bwImg;
+}
+}  // namespace
+
 BOOST_AUTO_TEST_SUITE(BinarizeTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_sauvola_matches_reference) {
+  const QImage gray(randomGrayImage(101, 67));
+  for (const QSize& windowSize : {QSize(1, 1), QSize(7, 5), QSize(30, 40), QSize(250, 250)}) {
+    BOOST_CHECK(binarizeSauvola(gray, windowSize) == referenceSauvola(gray, windowSize, 0.34));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_wolf_matches_reference) {
+  const QImage gray(randomGrayImage(101, 67));
+  for (const QSize& windowSize : {QSize(1, 1), QSize(7, 5), QSize(30, 40), QSize(250, 250)}) {
+    BOOST_CHECK(binarizeWolf(gray, windowSize, 1, 254, 0.3) == referenceWolf(gray, windowSize, 1, 254, 0.3));
+  }
+}
+
 #if 0
             BOOST_AUTO_TEST_CASE(test) {
                 QImage img("test.png");
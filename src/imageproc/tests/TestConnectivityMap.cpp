@@ -0,0 +1,131 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <BinaryImage.h>
+#include <ConnectivityMap.h>
+
+#include <QRect>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+#include "Utils.h"
+
+namespace imageproc {
+namespace tests {
+using namespace utils;
+
+namespace {
+/**
+ * A straightforward flood fill labeling.  Components are numbered
+ * in the order their first pixels are encountered in raster order.
+ */
+std::vector<uint32_t> floodFillLabels(const BinaryImage& img, const Connectivity conn) {
+  const int width = img.width();
+  const int height = img.height();
+  std::vector<uint32_t> labels(width * height, 0);
+
+  uint32_t nextLabel = 1;
+  std::vector<int> stack;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      if ((img.getPixel(x, y) != BLACK) || (labels[y * width + x] != 0)) {
+        continue;
+      }
+
+      labels[y * width + x] = nextLabel;
+      stack.push_back(y * width + x);
+      while (!stack.empty()) {
+        const int cx = stack.back() % width;
+        const int cy = stack.back() / width;
+        stack.pop_back();
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            if ((conn == CONN4) && (dx != 0) && (dy != 0)) {
+              continue;
+            }
+            const int nx = cx + dx;
+            const int ny = cy + dy;
+            if ((nx < 0) || (ny < 0) || (nx >= width) || (ny >= height)) {
+              continue;
+            }
+            if ((img.getPixel(nx, ny) == BLACK) && (labels[ny * width + nx] == 0)) {
+              labels[ny * width + nx] = nextLabel;
+              stack.push_back(ny * width + nx);
+            }
+          }
+        }
+      }
+      ++nextLabel;
+    }
+  }
+  return labels;
+}  // floodFillLabels
+
+bool matchesFloodFill(const BinaryImage& img, const Connectivity conn) {
+  const ConnectivityMap cmap(img, conn);
+  const std::vector<uint32_t> expected(floodFillLabels(img, conn));
+
+  uint32_t maxLabel = 0;
+  const uint32_t* line = cmap.data();
+  for (int y = 0; y < img.height(); ++y, line += cmap.stride()) {
+    for (int x = 0; x < img.width(); ++x) {
+      if (line[x] != expected[y * img.width() + x]) {
+        return false;
+      }
+      maxLabel = std::max(maxLabel, line[x]);
+    }
+  }
+  return cmap.maxLabel() == maxLabel;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ConnectivityMapTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_null_image) {
+  const ConnectivityMap cmap(BinaryImage(), CONN8);
+  BOOST_CHECK(cmap.data() == nullptr);
+  BOOST_CHECK_EQUAL(cmap.maxLabel(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_small_image) {
+  static const int inp[]
+      = {0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 0, 0,
+         0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0};
+
+  const BinaryImage img(makeBinaryImage(inp, 9, 8));
+  BOOST_CHECK_EQUAL(ConnectivityMap(img, CONN4).maxLabel(), 6u);
+  BOOST_CHECK_EQUAL(ConnectivityMap(img, CONN8).maxLabel(), 2u);
+  BOOST_CHECK(matchesFloodFill(img, CONN4));
+  BOOST_CHECK(matchesFloodFill(img, CONN8));
+}
+
+BOOST_AUTO_TEST_CASE(test_components_crossing_many_lines) {
+  // A long zigzag joined at alternating ends, going through all of the image.
+  BinaryImage img(40, 301, WHITE);
+  for (int y = 0; y < img.height(); y += 2) {
+    img.fill(QRect(0, y, 39, 1), BLACK);
+    if (y + 1 < img.height()) {
+      img.setPixel((y % 4 == 0) ? 38 : 0, y + 1, BLACK);
+    }
+  }
+  // Touches the zigzag only diagonally.
+  img.setPixel(39, 299, BLACK);
+
+  BOOST_CHECK_EQUAL(ConnectivityMap(img, CONN4).maxLabel(), 2u);
+  BOOST_CHECK_EQUAL(ConnectivityMap(img, CONN8).maxLabel(), 1u);
+  BOOST_CHECK(matchesFloodFill(img, CONN4));
+  BOOST_CHECK(matchesFloodFill(img, CONN8));
+}
+
+BOOST_AUTO_TEST_CASE(test_random_images) {
+  for (int i = 0; i < 50; ++i) {
+    const BinaryImage img(randomBinaryImage(1 + i * 7 % 97, 1 + i * 13 % 211));
+    BOOST_REQUIRE(matchesFloodFill(img, CONN4));
+    BOOST_REQUIRE(matchesFloodFill(img, CONN8));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
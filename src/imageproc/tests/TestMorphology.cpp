@@ -317,6 +317,38 @@ BOOST_AUTO_TEST_CASE(test_large_dilate) {
   BOOST_CHECK(dilateBrick(img, brick, img.rect(), WHITE) == control);
 }
 
+BOOST_AUTO_TEST_CASE(test_large_dilate_matches_repeated_small_ones) {
+  // Large bricks are decomposed differently from small ones,
+  // while dilating by a centered 3-pixel brick n times is the same
+  // as dilating by a centered (2n+1)-pixel one.
+  const BinaryImage img(randomBinaryImage(150, 120));
+
+  BinaryImage control(img);
+  for (int i = 0; i < 18; ++i) {
+    control = dilateBrick(control, QSize(3, 1), control.rect(), WHITE);
+  }
+  for (int i = 0; i < 12; ++i) {
+    control = dilateBrick(control, QSize(1, 3), control.rect(), WHITE);
+  }
+
+  BOOST_CHECK(dilateBrick(img, QSize(37, 25), img.rect(), WHITE) == control);
+}
+
+BOOST_AUTO_TEST_CASE(test_large_dilate_gray_matches_repeated_small_ones) {
+  // Wider than a single strip the vertical pass processes at once.
+  const GrayImage img(randomGrayImage(300, 90));
+
+  GrayImage control(img);
+  for (int i = 0; i < 14; ++i) {
+    control = dilateGray(control, QSize(3, 1), control.rect());
+  }
+  for (int i = 0; i < 11; ++i) {
+    control = dilateGray(control, QSize(1, 3), control.rect());
+  }
+
+  BOOST_CHECK(dilateGray(img, QSize(29, 23), img.rect()) == control);
+}
+
 BOOST_AUTO_TEST_CASE(test_erode_1x1) {
   static const int inp[] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1,
                             1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1,
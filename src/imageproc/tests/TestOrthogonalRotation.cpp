@@ -87,6 +87,35 @@ BOOST_AUTO_TEST_CASE(test_sub_image) {
   BOOST_REQUIRE(orthogonalRotation(img, rect, -90) == out4Img);
 }
 
+BOOST_AUTO_TEST_CASE(test_multi_word_sub_image) {
+  // Large enough to span several 32x32 blocks, with the sub-image not aligned to words.
+  const BinaryImage img(randomBinaryImage(100, 80));
+  const QRect rect(13, 5, 75, 70);
+  const QImage srcImg(img.toQImage());
+
+  for (const int degrees : {90, 180, 270}) {
+    const QImage dstImg(orthogonalRotation(img, rect, degrees).toQImage());
+    const QSize expectedSize(degrees == 180 ? rect.size() : rect.size().transposed());
+    BOOST_REQUIRE(dstImg.size() == expectedSize);
+
+    bool match = true;
+    for (int y = 0; y < dstImg.height(); ++y) {
+      for (int x = 0; x < dstImg.width(); ++x) {
+        QPoint srcPos;
+        if (degrees == 90) {
+          srcPos = QPoint(rect.left() + y, rect.bottom() - x);
+        } else if (degrees == 180) {
+          srcPos = QPoint(rect.right() - x, rect.bottom() - y);
+        } else {
+          srcPos = QPoint(rect.right() - y, rect.top() + x);
+        }
+        match = match && (dstImg.pixel(x, y) == srcImg.pixel(srcPos));
+      }
+    }
+    BOOST_CHECK(match);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
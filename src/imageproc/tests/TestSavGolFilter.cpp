@@ -0,0 +1,95 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Grayscale.h>
+#include <SavGolFilter.h>
+#include <SavGolKernel.h>
+
+#include <QImage>
+#include <QPoint>
+#include <QSize>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+
+namespace imageproc {
+namespace tests {
+namespace {
+QImage makeTestImage(const int width, const int height) {
+  QImage img(width, height, QImage::Format_Indexed8);
+  img.setColorTable(createGrayscalePalette());
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      img.setPixel(x, y, std::min(255, (x * 7 + y * 3) % 200 + rand() % 56));
+    }
+  }
+  return img;
+}
+
+/**
+ * Applies the full 2D kernel to every pixel, moving the window
+ * inside the image near the edges.
+ */
+QImage referenceSavGolFilter(const QImage& src, const QSize& windowSize, const int horDegree, const int vertDegree) {
+  const int width = src.width();
+  const int height = src.height();
+  const int kw = windowSize.width();
+  const int kh = windowSize.height();
+  const int kTop = kh / 2;
+  const int kLeft = kw / 2;
+
+  QImage dst(width, height, QImage::Format_Indexed8);
+  dst.setColorTable(createGrayscalePalette());
+
+  SavGolKernel kernel(windowSize, QPoint(kLeft, kTop), horDegree, vertDegree);
+  for (int y = 0; y < height; ++y) {
+    const int windowTop = std::min(std::max(0, y - kTop), height - kh);
+    for (int x = 0; x < width; ++x) {
+      const int windowLeft = std::min(std::max(0, x - kLeft), width - kw);
+      const bool central = (windowTop == y - kTop) && (windowLeft == x - kLeft);
+      kernel.recalcForOrigin(QPoint(x - windowLeft, y - windowTop));
+
+      float sum = central ? 0.0f : 0.5f;
+      for (int ky = 0; ky < kh; ++ky) {
+        const uint8_t* srcLine = src.constScanLine(windowTop + ky) + windowLeft;
+        for (int kx = 0; kx < kw; ++kx) {
+          sum += srcLine[kx] * kernel[ky * kw + kx];
+        }
+      }
+      dst.scanLine(y)[x] = static_cast<uint8_t>(qBound(0, static_cast<int>(sum), 255));
+    }
+  }
+  return dst;
+}
+
+int maxDifference(const QImage& img1, const QImage& img2) {
+  int maxDiff = 0;
+  for (int y = 0; y < img1.height(); ++y) {
+    for (int x = 0; x < img1.width(); ++x) {
+      maxDiff = std::max(maxDiff, std::abs(int(img1.constScanLine(y)[x]) - int(img2.constScanLine(y)[x])));
+    }
+  }
+  return maxDiff;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(SavGolFilterTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_matches_2d_kernel) {
+  const QImage src(makeTestImage(53, 41));
+  for (const QSize& windowSize : {QSize(7, 7), QSize(11, 11), QSize(9, 5)}) {
+    const QImage filtered(savGolFilter(src, windowSize, 4, 4));
+    BOOST_REQUIRE(filtered.size() == src.size());
+    // The separable version rounds differently in the last bit.
+    BOOST_CHECK(maxDifference(filtered, referenceSavGolFilter(src, windowSize, 4, 4)) <= 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_window_larger_than_image) {
+  const QImage src(makeTestImage(5, 5));
+  BOOST_CHECK(savGolFilter(src, QSize(7, 7), 2, 2) == src);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
@@ -81,6 +81,23 @@ BOOST_AUTO_TEST_CASE(test_regression_4) {
   BOOST_REQUIRE(seedFill(seed, mask, CONN4) == fill);
 }
 
+BOOST_AUTO_TEST_CASE(test_regression_5) {
+  int seed_data[70 * 2] = {0};
+  int mask_data[70 * 2] = {0};
+
+  seed_data[31] = 1;
+  seed_data[70 + 64] = 1;
+
+  mask_data[31] = 1;
+  mask_data[63] = 1;
+  mask_data[70 + 32] = 1;
+  mask_data[70 + 64] = 1;
+
+  const BinaryImage seed(makeBinaryImage(seed_data, 70, 2));
+  const BinaryImage mask(makeBinaryImage(mask_data, 70, 2));
+  BOOST_CHECK(seedFill(seed, mask, CONN8) == mask);
+}
+
 BOOST_AUTO_TEST_CASE(test_gray4_random) {
   for (int i = 0; i < 200; ++i) {
     const GrayImage seed(randomGrayImage(5, 5));
@@ -146,6 +163,39 @@ BOOST_AUTO_TEST_CASE(test_gray_vs_binary) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_gray_random_large) {
+  // Large enough to be split into stripes and column blocks.
+  for (int i = 0; i < 10; ++i) {
+    const GrayImage seed(randomGrayImage(150, 300));
+    const GrayImage mask(randomGrayImage(150, 300));
+    if (seedFillGray(seed, mask, CONN4) != seedFillGraySlow(seed, mask, CONN4)) {
+      BOOST_ERROR("fillNew != fillOld for 4-connectivity at iteration " << i);
+      break;
+    }
+    if (seedFillGray(seed, mask, CONN8) != seedFillGraySlow(seed, mask, CONN8)) {
+      BOOST_ERROR("fillNew != fillOld for 8-connectivity at iteration " << i);
+      break;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_gray_vs_binary_large) {
+  for (int i = 0; i < 10; ++i) {
+    const BinaryImage binSeed(randomBinaryImage(150, 300));
+    const BinaryImage binMask(randomBinaryImage(150, 300));
+    const GrayImage graySeed(toGrayscale(binSeed.toQImage()));
+    const GrayImage grayMask(toGrayscale(binMask.toQImage()));
+    if (seedFillGray(graySeed, grayMask, CONN4) != GrayImage(seedFill(binSeed, binMask, CONN4).toQImage())) {
+      BOOST_ERROR("grayscale 4-fill != binary 4-fill at index " << i);
+      break;
+    }
+    if (seedFillGray(graySeed, grayMask, CONN8) != GrayImage(seedFill(binSeed, binMask, CONN8).toQImage())) {
+      BOOST_ERROR("grayscale 8-fill != binary 8-fill at index " << i);
+      break;
+    }
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
@@ -45,6 +45,49 @@ BOOST_AUTO_TEST_CASE(test_random_image) {
   BOOST_CHECK(transformToGray(img, nullXform, img.rect(), outsidePixels) == img);
 }
 
+BOOST_AUTO_TEST_CASE(test_downscale) {
+  // 2x2 blocks of the same level.
+  GrayImage img(QSize(40, 30));
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      img.data()[y * img.stride() + x] = static_cast<uint8_t>((x / 2) * 7 + (y / 2) * 11);
+    }
+  }
+
+  GrayImage expected(QSize(20, 15));
+  for (int y = 0; y < expected.height(); ++y) {
+    for (int x = 0; x < expected.width(); ++x) {
+      expected.data()[y * expected.stride() + x] = static_cast<uint8_t>(x * 7 + y * 11);
+    }
+  }
+
+  const OutsidePixels outsidePixels(OutsidePixels::assumeColor(Qt::white));
+  const QTransform xform(QTransform().scale(0.5, 0.5));
+  BOOST_CHECK(transformToGray(img, xform, expected.rect(), outsidePixels) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_translation) {
+  GrayImage img(QSize(30, 20));
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      img.data()[y * img.stride() + x] = static_cast<uint8_t>(rand() % 255);
+    }
+  }
+
+  const OutsidePixels outsidePixels(OutsidePixels::assumeColor(Qt::white));
+  const QTransform xform(QTransform().translate(3, -2));
+  const GrayImage transformed(transformToGray(img, xform, img.rect(), outsidePixels));
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      const int srcX = x - 3;
+      const int srcY = y + 2;
+      const bool inside = (srcX >= 0) && (srcY < img.height());
+      const uint8_t expected = inside ? img.data()[srcY * img.stride() + srcX] : uint8_t(0xff);
+      BOOST_REQUIRE_EQUAL(int(transformed.data()[y * transformed.stride() + x]), int(expected));
+    }
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file